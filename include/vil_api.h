@@ -216,6 +216,41 @@ typedef bool (*PFN_vilOverlayTextEvent)(VilOverlay, const char* utf8);
 typedef void (*PFN_vilOverlayMouseMoveEvent)(VilOverlay, int x, int y);
 typedef void (*PFN_vilOverlayKeyboardModifier)(VilOverlay, enum VilKeyMod mod, bool active);
 
+// Lock contention profile of the layer itself, to find out how much
+// overhead the layer's synchronization adds to an application.
+// Only available when vil was built with debug checks or the lock-profile
+// meson option, the stats are all zero otherwise.
+#define VIL_LOCK_HISTOGRAM_BUCKETS 32
+
+typedef struct VilLockStats {
+	// Name of the lock site, e.g. "Device::mutex". Static string.
+	const char* name;
+	// Number of times the lock was acquired and how many of those
+	// had to wait for another thread.
+	uint64_t lockCount;
+	uint64_t contendedCount;
+	// Sums and maximums of the time spent waiting for the lock and
+	// holding it, in nanoseconds.
+	uint64_t waitNs;
+	uint64_t holdNs;
+	uint64_t maxWaitNs;
+	uint64_t maxHoldNs;
+	// log2 histograms: bucket i counts the durations in
+	// [2^(i-1), 2^i) nanoseconds, the last bucket all longer ones.
+	uint64_t waitHistogram[VIL_LOCK_HISTOGRAM_BUCKETS];
+	uint64_t holdHistogram[VIL_LOCK_HISTOGRAM_BUCKETS];
+} VilLockStats;
+
+// Enables or disables lock profiling. Disabled by default, can also be
+// enabled via the VIL_LOCK_PROFILE environment variable.
+// When reset is true, all stats collected so far are discarded.
+typedef void (*PFN_vilSetLockProfiling)(bool enable, bool reset);
+
+// Vulkan-style enumeration of the stats per lock site: when stats is NULL,
+// writes the number of lock sites to count. Otherwise writes up to
+// count entries to stats and the number of written entries to count.
+typedef void (*PFN_vilGetLockStats)(uint32_t* count, VilLockStats* stats);
+
 typedef struct VilApi {
 	PFN_vilCreateOverlayForLastCreatedSwapchain CreateOverlayForLastCreatedSwapchain;
 
@@ -227,6 +262,9 @@ typedef struct VilApi {
 	PFN_vilOverlayKeyEvent OverlayKeyEvent;
 	PFN_vilOverlayTextEvent OverlayTextEvent;
 	PFN_vilOverlayKeyboardModifier OverlayKeyboardModifier;
+
+	PFN_vilSetLockProfiling SetLockProfiling;
+	PFN_vilGetLockStats GetLockStats;
 } VilApi;
 
 // Must be called only *after* a vulkan device was created.
@@ -269,6 +307,8 @@ static inline int vilLoadApi(VilApi* api) {
 	vilLoadSym(OverlayKeyEvent);
 	vilLoadSym(OverlayTextEvent);
 	vilLoadSym(OverlayKeyboardModifier);
+	vilLoadSym(SetLockProfiling);
+	vilLoadSym(GetLockStats);
 
 	vilCloseLib();
 
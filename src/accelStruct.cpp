@@ -17,26 +17,23 @@ namespace vil {
 
 // util
 AccelStruct& accelStructAtLocked(Device& dev, VkDeviceAddress address) {
-	auto* accelStruct = tryAccelStructAtLocked(dev, address);
-	dlg_assertm(accelStruct,
-		"Couldn't find VkAccelerationStructure at address {}", address);
-	return *accelStruct;
+	assertOwnedOrShared(dev.mutex);
+	return accelStructAt(dev, address);
 }
 
 AccelStruct& accelStructAt(Device& dev, VkDeviceAddress address) {
-	std::shared_lock lock(dev.mutex);
-	return accelStructAtLocked(dev, address);
+	// See bufferAt, the address map itself needs no lock
+	auto* accelStruct = dev.accelStructAddresses.findExact(address);
+	dlg_assertm(accelStruct,
+		"Couldn't find VkAccelerationStructure at address {}", address);
+	return *accelStruct;
 }
 
 AccelStruct* tryAccelStructAtLocked(Device& dev, VkDeviceAddress address) {
 	ZoneScoped;
 
 	assertOwnedOrShared(dev.mutex);
-	auto it = dev.accelStructAddresses.find(address);
-	if(it == dev.accelStructAddresses.end()) {
-		return nullptr;
-	}
-	return it->second;
+	return dev.accelStructAddresses.findExact(address);
 }
 
 std::unordered_map<VkDeviceAddress, AccelStructStatePtr> captureBLASesLocked(Device& dev) {
@@ -46,11 +43,12 @@ std::unordered_map<VkDeviceAddress, AccelStructStatePtr> captureBLASesLocked(Dev
 	assertOwnedOrShared(dev.mutex);
 
 	std::unordered_map<VkDeviceAddress, AccelStructStatePtr> ret;
-	for(auto& as : dev.accelStructs.inner) {
+	std::shared_lock snapshotLock(dev.snapshotMutex);
+	dev.accelStructs.forEachLocked([&](auto& as) {
 		if(as->effectiveType == VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR && as->pendingState) {
 			ret.emplace(as->deviceAddress, as->pendingState);
 		}
-	}
+	});
 
 	return ret;
 }
@@ -369,9 +367,8 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateAccelerationStructureKHR(
 
 	{
 		std::lock_guard lock(dev.mutex);
-		auto [_, success] = dev.accelStructAddresses.insert({
-			accelStruct.deviceAddress, &accelStruct});
-		dlg_assert(success);
+		dev.accelStructAddresses.add(accelStruct.deviceAddress,
+			accelStruct.size, accelStruct);
 	}
 
 	return res;
@@ -379,8 +376,9 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateAccelerationStructureKHR(
 
 void AccelStruct::onApiDestroy() {
 	std::lock_guard lock(dev->mutex);
+	std::lock_guard snapshotLock(dev->snapshotMutex);
 	dlg_assert(deviceAddress);
-	dev->accelStructAddresses.erase(deviceAddress);
+	dev->accelStructAddresses.remove(*this);
 }
 
 VKAPI_ATTR void VKAPI_CALL DestroyAccelerationStructureKHR(
@@ -93,7 +93,7 @@ void copyBuildData(AccelStruct&,
 	bool instancesAreAddresses);
 
 // Returns the AccelStruct located at the given address. The address
-// must match exactly.
+// must match exactly. Like bufferAt, does not lock the device mutex.
 AccelStruct& accelStructAt(Device& dev, VkDeviceAddress address);
 AccelStruct& accelStructAtLocked(Device& dev, VkDeviceAddress address);
 AccelStruct* tryAccelStructAtLocked(Device& dev, VkDeviceAddress address);
@@ -6,6 +6,7 @@
 #include <window.hpp>
 #include <gui/gui.hpp>
 #include <util/export.hpp>
+#include <util/lockProfile.hpp>
 #include <swapchain.hpp>
 #include <overlay.hpp>
 #include <imgui/imgui.h>
@@ -164,3 +165,38 @@ extern "C" VIL_EXPORT void vilOverlayKeyboardModifier(VilOverlay overlay, enum V
 
 	ov.gui->addKeyEvent(key, active);
 }
+
+static_assert(VIL_LOCK_HISTOGRAM_BUCKETS == lockProfileBucketCount);
+
+extern "C" VIL_EXPORT void vilSetLockProfiling(bool enable, bool reset) {
+	if(reset) {
+		resetLockProfile();
+	}
+
+	setLockProfileEnabled(enable);
+}
+
+extern "C" VIL_EXPORT void vilGetLockStats(uint32_t* count, VilLockStats* stats) {
+	dlg_assert(count);
+
+	auto sites = collectLockProfile();
+	if(!stats) {
+		*count = u32(sites.size());
+		return;
+	}
+
+	*count = std::min(*count, u32(sites.size()));
+	for(auto i = 0u; i < *count; ++i) {
+		auto& src = sites[i];
+		auto& dst = stats[i];
+		dst.name = src.name;
+		dst.lockCount = src.count;
+		dst.contendedCount = src.contended;
+		dst.waitNs = src.waitNs;
+		dst.holdNs = src.holdNs;
+		dst.maxWaitNs = src.maxWaitNs;
+		dst.maxHoldNs = src.maxHoldNs;
+		std::copy(src.waitHist.begin(), src.waitHist.end(), dst.waitHistogram);
+		std::copy(src.holdHist.begin(), src.holdHist.end(), dst.holdHistogram);
+	}
+}
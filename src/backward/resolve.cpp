@@ -2699,7 +2699,7 @@ private:
 
 class TraceResolver : public TraceResolverImpl<system_tag::current_tag> {};
 
-std::vector<SourceLoc> resolve(vil::LinAllocScope& alloc, vil::span<void*> addresses) {
+std::vector<SourceLoc> resolve(vil::LinAllocScope& alloc, vil::span<void* const> addresses) {
 	// TODO PERF: lazy init kinda sucks here. Make it global?
 	static TraceResolver resolver;
 	static std::mutex mutex;
@@ -27,6 +27,6 @@ struct SourceLoc {
 
 // TODO: interface could be more efficient, avoiding allocations.
 // But not needed atm, only in gui code.
-std::vector<SourceLoc> resolve(vil::LinAllocScope&, vil::span<void*> address);
+std::vector<SourceLoc> resolve(vil::LinAllocScope&, vil::span<void* const> address);
 
 } // namespace backward
@@ -13,34 +13,20 @@ VkDeviceSize evalRange(VkDeviceSize fullSize, VkDeviceSize offset, VkDeviceSize
 	return range == VK_WHOLE_SIZE ? fullSize - offset : range;
 }
 
-Buffer* bufferAtInternal(const decltype(Device::bufferAddresses)& bufferAddresses,
-		VkDeviceAddress address) {
-	auto it = bufferAddresses.upper_bound(address);
-
-	// NOTE: for aliased buffers, this might degenerate into linear search,
-	// but we'll only ever have to iterate so many elements as elements
-	// overlap via aliasing so it should be fine.
-	// A better algorithmic solution would be to use an interval
-	// tree (e.g. augmented RB-Tree) but I couldn't find a good implementation
-	// to pull in easily and now it seems overkill anyways.
-	while(it != bufferAddresses.begin()) {
-		--it;
-		dlg_assert((*it)->deviceAddress <= address);
-		auto end = (*it)->deviceAddress + (*it)->ci.size;
-		if(end > address) {
-			return *it;
-		}
-	}
-
-	// When we didn't find anything we had to iterate *all* buffer addresses.
-	// This would be a major performance concern but we will most likely
-	// crash in this case anyways so we don't care.
-	return nullptr;
+Buffer& bufferAtLocked(Device& dev, VkDeviceAddress address) {
+	assertOwnedOrShared(dev.mutex);
+	return bufferAt(dev, address);
 }
 
-Buffer& bufferAtLocked(Device& dev, VkDeviceAddress address) {
+Buffer* findBufferAtLocked(Device& dev, VkDeviceAddress address) {
 	assertOwnedOrShared(dev.mutex);
-	auto* buf = bufferAtInternal(dev.bufferAddresses, address);
+	return dev.bufferAddresses.find(address);
+}
+
+Buffer& bufferAt(Device& dev, VkDeviceAddress address) {
+	// The address map itself needs no lock. The application guarantees
+	// that the buffer stays alive during the call using its address.
+	auto* buf = dev.bufferAddresses.find(address);
 	if(!buf) {
 		dlg_error("Unknown buffer device address {}", address);
 		throw std::invalid_argument("Invalid buffer device address");
@@ -49,19 +35,13 @@ Buffer& bufferAtLocked(Device& dev, VkDeviceAddress address) {
 	return *buf;
 }
 
-Buffer& bufferAt(Device& dev, VkDeviceAddress address) {
-	auto lock = std::shared_lock(dev.mutex);
-	return bufferAtLocked(dev, address);
-}
-
 // Classes
 void Buffer::onApiDestroy() {
 	MemoryResource::onApiDestroy();
 
 	std::lock_guard lock(dev->mutex);
 	if(ci.usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-		auto num = dev->bufferAddresses.erase(this);
-		dlg_assert(num == 1u);
+		dev->bufferAddresses.remove(*this);
 	}
 
 	for(auto* view : this->views) {
@@ -103,7 +83,7 @@ void retrieveDeviceAddress(Buffer& buf) {
 
 	std::lock_guard lock(dev.mutex);
 	buf.deviceAddress = address;
-	dev.bufferAddresses.insert(&buf);
+	dev.bufferAddresses.add(address, buf.ci.size, buf);
 }
 
 void checkDeviceAddress(Buffer& buf) {
@@ -216,6 +196,7 @@ void bindBufferMemory(Buffer& buf, DeviceMemory& mem, VkDeviceSize offset) {
 
 	// access to the given memory and buffer must be internally synced
 	std::lock_guard lock(dev.mutex);
+	std::lock_guard snapshotLock(dev.snapshotMutex);
 	dlg_assert(buf.memory.index() == 0u);
 	auto& memBind = std::get<0>(buf.memory);
 
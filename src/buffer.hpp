@@ -42,9 +42,15 @@ VkDeviceSize evalRange(VkDeviceSize fullSize, VkDeviceSize offset, VkDeviceSize
 // If there are multiple buffers with overlapping addresses (can happen
 // e.g. with memory aliasing I guess), will return the one that contains the
 // largest range from the given address.
-// Will lock the device mutex internally.
+// Does not lock the device mutex, the caller has to make sure the buffer
+// can't be destroyed while it is used, e.g. since the application
+// guarantees it for the duration of the current call.
+// Use the 'Locked' variant otherwise.
 Buffer& bufferAt(Device& dev, VkDeviceAddress address);
 Buffer& bufferAtLocked(Device& dev, VkDeviceAddress address);
+// Like bufferAtLocked but returns null instead of throwing when no
+// buffer contains the given address.
+Buffer* findBufferAtLocked(Device& dev, VkDeviceAddress address);
 
 // API
 VKAPI_ATTR VkResult VKAPI_CALL CreateBuffer(
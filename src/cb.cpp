@@ -22,32 +22,8 @@
 namespace vil {
 
 void copyChainInPlace(CommandBuffer& cb, const void*& pNext) {
-	VkBaseInStructure* last = nullptr;
-	auto it = static_cast<const VkBaseInStructure*>(pNext);
-	pNext = nullptr;
-
-	while(it) {
-		auto size = structSize(it->sType);
-		dlg_assertm_or(size > 0, it = it->pNext; continue,
-			"Unknown structure type: {}", it->sType);
-		dlg_assert(cb.builder().record_);
-
-		auto& rec = *cb.builder().record_;
-		auto buf = rec.alloc.allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
-		auto dst = reinterpret_cast<VkBaseInStructure*>(buf);
-		// TODO: technicallly UB to not construct object via placement new.
-		// In practice, this works everywhere since its only C PODs
-		std::memcpy(dst, it, size);
-
-		if(last) {
-			last->pNext = dst;
-		} else {
-			pNext = dst;
-		}
-
-		last = dst;
-		it = it->pNext;
-	}
+	dlg_assert(cb.builder().record_);
+	pNext = copyChain(cb.builder().record_->alloc, pNext);
 }
 
 const void* copyChain(CommandBuffer& cb, const void* pNext) {
@@ -68,8 +44,7 @@ void DescriptorState::bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstS
 		span<DescriptorSet* const> sets, span<const u32> dynOffsets) {
 	ExtZoneScoped;
 
-	this->descriptorSets = copyEnsureSizeUndef(cb, descriptorSets,
-		firstSet + sets.size());
+	dlg_assert(descriptorSets.size() >= firstSet + sets.size());
 
 	// NOTE: the "ds disturbing" part of vulkan is hard to grasp IMO.
 	// There may be errors here.
@@ -109,6 +84,8 @@ void DescriptorState::bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstS
 		descriptorSets[s].dsEntry = sets[i]->setEntry;
 		descriptorSets[s].dsID = sets[i]->id;
 		descriptorSets[s].dsPool = sets[i]->pool;
+		descriptorSets[s].descriptorBufferIndex = BoundDescriptorSet::noDescriptorBuffer;
+		descriptorSets[s].descriptorBufferOffset = 0u;
 
 		dlg_assert(dsLayout.numDynamicBuffers <= dynOffsets.size());
 		descriptorSets[s].dynamicOffsets = copySpan(cb, dynOffsets.data(), dsLayout.numDynamicBuffers);
@@ -125,6 +102,68 @@ void DescriptorState::bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstS
 #endif // DS_DISTURB_CHECKS
 }
 
+void DescriptorState::bindBufferSets(PipelineLayout& layout, u32 firstSet,
+		span<const u32> bufferIndices, span<const VkDeviceSize> offsets) {
+	dlg_assert(descriptorSets.size() >= firstSet + bufferIndices.size());
+	dlg_assert(bufferIndices.size() == offsets.size());
+
+	// Unlike for regular sets, we have to track disturbance here. A stale
+	// set would otherwise be decoded from whatever data is at its offset
+	// at submission time.
+	disturb(layout, firstSet, u32(bufferIndices.size()));
+
+	for(auto i = 0u; i < bufferIndices.size(); ++i) {
+		auto& bds = descriptorSets[firstSet + i];
+		bds = {};
+		bds.layout = &layout;
+		bds.descriptorBufferIndex = bufferIndices[i];
+		bds.descriptorBufferOffset = offsets[i];
+	}
+}
+
+void DescriptorState::disturb(const PipelineLayout& layout, u32 firstSet, u32 count) {
+	dlg_assert(descriptorSets.size() >= firstSet + count);
+
+	for(auto i = 0u; i < firstSet; ++i) {
+		auto& bds = descriptorSets[i];
+		if(bds.layout && !compatibleForSetN(*bds.layout, layout, i)) {
+			bds = {};
+		}
+	}
+
+	auto followingDisturbed = false;
+	for(auto i = firstSet; i < firstSet + count; ++i) {
+		auto& bds = descriptorSets[i];
+		if(bds.layout && !compatibleForSetN(*bds.layout, layout, i)) {
+			followingDisturbed = true;
+		}
+	}
+
+	if(followingDisturbed) {
+		for(auto i = firstSet + count; i < descriptorSets.size(); ++i) {
+			descriptorSets[i] = {};
+		}
+	}
+}
+
+DescriptorSnapshotKey DescriptorState::snapshotKey(u32 set) const {
+	dlg_assert(set < descriptorSets.size());
+	auto& bds = descriptorSets[set];
+	if(!bds.fromDescriptorBuffer()) {
+		return {bds.dsEntry, 0u};
+	}
+
+	dlg_assert(bds.layout && set < bds.layout->descriptors.size());
+	DescriptorSnapshotKey ret;
+	ret.ptr = bds.layout->descriptors[set].get();
+	if(bds.descriptorBufferIndex < descriptorBuffers.size()) {
+		ret.address = descriptorBuffers[bds.descriptorBufferIndex].address +
+			bds.descriptorBufferOffset;
+	}
+
+	return ret;
+}
+
 // CommandBuffer
 CommandBuffer::CommandBuffer(CommandPool& xpool, VkCommandBuffer xhandle) :
 		handle(xhandle), pool_(&xpool) {
@@ -191,7 +230,8 @@ void CommandBuffer::doReset(bool startRecord) {
 
 	// Make sure to never destroy a CommandBufferRecord inside the
 	// device lock.
-	IntrusivePtr<CommandRecord> keepAliveRecord;
+	CommandRecordPtr keepAliveRecord;
+	auto untracked = false;
 
 	{
 		std::lock_guard lock(dev->mutex);
@@ -224,6 +264,7 @@ void CommandBuffer::doReset(bool startRecord) {
 		// our data at the same time.
 		if(startRecord) {
 			++recordCount_;
+			untracked = !needsCommandTrackingLocked(*dev);
 			// actually start the new record below, outside of the critical section
 			// since it will allocate memory and it's not publicly exposed.
 			state_ = CommandBuffer::State::recording;
@@ -239,10 +280,16 @@ void CommandBuffer::doReset(bool startRecord) {
 		dlg_assert(!builder_.section_);
 
 		builder_.reset(*this);
+		builder_.record_->untracked = untracked;
 
 		computeState_ = &construct<ComputeState>(*this);
 		graphicsState_ = &construct<GraphicsState>(*this);
+		graphicsState_->dynamic = &construct<GraphicsDynamicState>(*this);
 		rayTracingState_ = &construct<RayTracingState>(*this);
+
+		computeShared_ = {};
+		graphicsShared_ = {};
+		rayTracingShared_ = {};
 	}
 }
 
@@ -257,9 +304,13 @@ void CommandBuffer::doEnd() {
 		dlg_assert(lblCmd);
 		dlg_assert(!builder_.section_->pop);
 		builder_.record_->pushLables.push_back(lblCmd->name);
+		builder_.foldFingerprint();
+		builder_.lastCommand_ = builder_.section_->cmd;
 		builder_.section_ = builder_.section_->parent;
 	}
 
+	builder_.foldFingerprint();
+
 	graphicsState_ = {};
 	computeState_ = {};
 	rayTracingState_ = {};
@@ -278,6 +329,10 @@ void CommandBuffer::doEnd() {
 
 	auto& rec = *builder_.record_;
 
+	// Remember how much memory this record needed, so that the next
+	// record can start with an appropriately sized block.
+	lastRecordMemSize_ = rec.alloc.usedSize();
+
 	// Make sure to never call CommandRecord destructor inside lock.
 	// Don't just call reset() here or move lastRecord_ so that always have a valid
 	// lastRecord_ as state (some other thread could query it before we lock)
@@ -297,6 +352,19 @@ void CommandBuffer::doEnd() {
 	}
 }
 
+std::size_t CommandBuffer::recordMemHint() const {
+	if(lastRecordMemSize_ == 0u) {
+		return CommandRecord::defaultFirstBlockSize;
+	}
+
+	// If the new record needs more memory, the following blocks will grow
+	// exponentially.
+	auto size = lastRecordMemSize_ + sizeof(LinMemBlock);
+	size = std::clamp<std::size_t>(size, LinBlockPool::minPooledSize,
+		LinAllocator::maxBlockSize);
+	return nextPOT(u32(size));
+}
+
 void CommandBuffer::popLabelSections() {
 	// See docs/debug-utils-label-nesting.md
 	while(auto* next = commandCast<BeginDebugUtilsLabelCmd*>(builder_.section_->cmd)) {
@@ -335,21 +403,77 @@ void CommandBuffer::invalidateLocked() {
 	this->state_ = State::invalid;
 }
 
-ComputeState& CommandBuffer::newComputeState() {
-	computeState_ = &construct<ComputeState>(*this, *computeState_);
+const ComputeState& CommandBuffer::computeState() {
+	computeShared_ = stateChunkAll;
 	return *computeState_;
 }
 
-GraphicsState& CommandBuffer::newGraphicsState() {
-	graphicsState_ = &construct<GraphicsState>(*this, *graphicsState_);
+const GraphicsState& CommandBuffer::graphicsState() {
+	graphicsShared_ = stateChunkAll;
 	return *graphicsState_;
 }
 
-RayTracingState& CommandBuffer::newRayTracingState() {
-	rayTracingState_ = &construct<RayTracingState>(*this, *rayTracingState_);
+const RayTracingState& CommandBuffer::rayTracingState() {
+	rayTracingShared_ = stateChunkAll;
 	return *rayTracingState_;
 }
 
+ComputeState& CommandBuffer::writableComputeState() {
+	return writableChunk(*this, computeState_, computeShared_, stateChunkState);
+}
+
+GraphicsState& CommandBuffer::writableGraphicsState() {
+	return writableChunk(*this, graphicsState_, graphicsShared_, stateChunkState);
+}
+
+RayTracingState& CommandBuffer::writableRayTracingState() {
+	return writableChunk(*this, rayTracingState_, rayTracingShared_, stateChunkState);
+}
+
+DescriptorState& CommandBuffer::writableDescriptorState(
+		VkPipelineBindPoint bindPoint, std::size_t minSets) {
+	DescriptorState* state {};
+	u32* shared {};
+	if(bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
+		state = &writableComputeState();
+		shared = &computeShared_;
+	} else if(bindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+		state = &writableGraphicsState();
+		shared = &graphicsShared_;
+	} else {
+		dlg_assert(bindPoint == VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR);
+		state = &writableRayTracingState();
+		shared = &rayTracingShared_;
+	}
+
+	writableChunk(*this, state->descriptorSets, *shared,
+		stateChunkDescriptorSets, minSets);
+	return *state;
+}
+
+span<BoundVertexBuffer> CommandBuffer::writableVertexBuffers(std::size_t minCount) {
+	auto& gs = writableGraphicsState();
+	return writableChunk(*this, gs.vertices, graphicsShared_,
+		stateChunkVertexBuffers, minCount);
+}
+
+GraphicsDynamicState& CommandBuffer::writableDynamicState() {
+	auto& gs = writableGraphicsState();
+	return writableChunk(*this, gs.dynamic, graphicsShared_, stateChunkDynamic);
+}
+
+span<VkViewport> CommandBuffer::writableViewports(std::size_t minCount) {
+	auto& dyn = writableDynamicState();
+	return writableChunk(*this, dyn.viewports, graphicsShared_,
+		stateChunkViewports, minCount);
+}
+
+span<VkRect2D> CommandBuffer::writableScissors(std::size_t minCount) {
+	auto& dyn = writableDynamicState();
+	return writableChunk(*this, dyn.scissors, graphicsShared_,
+		stateChunkScissors, minCount);
+}
+
 void CommandPool::onApiDestroy() {
 	// When a CommandPool is destroyed, all command buffers created from
 	// it are automatically freed.
@@ -360,6 +484,7 @@ void CommandPool::onApiDestroy() {
 
 	{
 		std::lock_guard lock(dev->mutex);
+		std::lock_guard snapshotLock(dev->snapshotMutex);
 		moved = std::move(cbs);
 	}
 
@@ -399,6 +524,15 @@ T& addCmd(CommandBuffer& cb, Args&&... args) {
 	return cmd;
 }
 
+// Whether the command buffer is currently recorded in pass-through mode.
+// The hot commands (binds, draws, dispatches, dynamic state) are then
+// directly forwarded, without building commands or tracking used handles.
+// Everything affecting image layouts or the section structure is
+// still tracked. See docs/own/lazyTracking.md
+inline bool untracked(CommandBuffer& cb) {
+	return cb.builder().record_->untracked;
+}
+
 // api
 // command pool
 VKAPI_ATTR VkResult VKAPI_CALL CreateCommandPool(
@@ -454,6 +588,10 @@ VKAPI_ATTR void VKAPI_CALL TrimCommandPool(
 		VkCommandPool                               commandPool,
 		VkCommandPoolTrimFlags                      flags) {
 	auto& pool = get(device, commandPool);
+
+	// Good opportunity to return cached record memory to the system as well
+	pool.dev->recordBlockPool.trim();
+
 	pool.dev->dispatch.TrimCommandPool(pool.dev->handle, pool.handle, flags);
 }
 
@@ -483,6 +621,7 @@ VKAPI_ATTR VkResult VKAPI_CALL AllocateCommandBuffers(
 
 		{
 			std::lock_guard lock(dev.mutex);
+			std::lock_guard snapshotLock(dev.snapshotMutex);
 			cb.pool().cbs.push_back(&cb);
 		}
 
@@ -527,6 +666,7 @@ VKAPI_ATTR void VKAPI_CALL FreeCommandBuffers(
 		{
 			// critical section here mainly for gui
 			std::lock_guard lock(dev.mutex);
+			std::lock_guard snapshotLock(dev.snapshotMutex);
 			pool.cbs.erase(it);
 		}
 	}
@@ -662,17 +802,13 @@ template<typename T>
 auto& useHandleImpl(CommandRecord& rec, Command& cmd, T& handle) {
 	ExtZoneScoped;
 	auto& set = GetUsedSet::get(rec, handle);
-	auto it = find(set, handle);
-
-	if(it == set.end()) {
+	auto [use, inserted] = set.findOrInsert(&handle, [&]{
 		RefHandle<T> rh(rec.alloc);
 		rh.handle.reset(&handle);
-		it = set.insert(std::move(rh)).first;
-	} else {
-		dlg_assert(handle.refCount > 1u);
-	}
+		return rh;
+	});
 
-	auto& use = const_cast<RefHandle<T>&>(*it);
+	dlg_assert(inserted || handle.refCount > 1u);
 	// use.commands.push_back(&cmd);
 	(void) cmd;
 	return use;
@@ -680,18 +816,13 @@ auto& useHandleImpl(CommandRecord& rec, Command& cmd, T& handle) {
 
 UsedImage& useHandleImpl(CommandRecord& rec, Command& cmd, Image& img) {
 	ExtZoneScoped;
-	auto& set = rec.used.images;
-	auto it = find(set, img);
-
-	if(it == set.end()) {
+	auto [use, inserted] = rec.used.images.findOrInsert(&img, [&]{
 		UsedImage rh(rec.alloc);
 		rh.handle.reset(&img);
-		it = set.insert(std::move(rh)).first;
-	} else {
-		dlg_assert(img.refCount > 1u);
-	}
+		return rh;
+	});
 
-	auto& use = const_cast<UsedImage&>(*it);
+	dlg_assert(inserted || img.refCount > 1u);
 	// use.commands.push_back(&cmd);
 	(void) cmd;
 	return use;
@@ -699,16 +830,13 @@ UsedImage& useHandleImpl(CommandRecord& rec, Command& cmd, Image& img) {
 
 UsedDescriptorSet& useHandleImpl(CommandRecord& rec, Command& cmd, DescriptorSet& ds) {
 	ExtZoneScoped;
-	auto& set = rec.used.descriptorSets;
-	auto it = find(set, ds);
-
-	if(it == set.end()) {
+	auto [use, inserted] = rec.used.descriptorSets.findOrInsert(&ds, [&]{
 		UsedDescriptorSet rh(rec.alloc);
 		rh.ds = static_cast<void*>(&ds);
-		it = set.insert(std::move(rh)).first;
-	}
+		return rh;
+	});
 
-	auto& use = const_cast<UsedDescriptorSet&>(*it);
+	(void) inserted;
 	// use.commands.push_back(&cmd);
 	(void) cmd;
 	return use;
@@ -760,6 +888,69 @@ void useHandle(CommandRecord& rec, Command& cmd, Image& image,
 	img.layoutChanges.push_back(layoutChange);
 }
 
+// NOTE: we don't reserve dst.size() + src.size() before merging. Secondaries
+// usually share most of their handles with the primary, reserving for the
+// sum would rehash into (and abandon) too large arrays for every secondary.
+// findOrInsert grows geometrically, keeping the FlatPtrSet memory bound.
+template<typename T>
+void mergeUsedSet(CommandRecord& dst, UsedHandleSet<T>& dstSet,
+		const UsedHandleSet<T>& srcSet) {
+	for(auto& entry : srcSet) {
+		dstSet.findOrInsert(entry.handle.get(), [&]{
+			RefHandle<T> rh(dst.alloc);
+			rh.handle = entry.handle;
+			return rh;
+		});
+	}
+}
+
+// Adds all handles used by the given secondary record to the
+// given record, for CmdExecuteCommands.
+void mergeUsedHandles(CommandRecord& dst, const CommandRecord& src) {
+	ExtZoneScoped;
+
+	static_assert(CommandRecord::UsedHandles::handleTypeCount == 17u);
+
+	mergeUsedSet(dst, dst.used.buffers, src.used.buffers);
+	mergeUsedSet(dst, dst.used.computePipes, src.used.computePipes);
+	mergeUsedSet(dst, dst.used.graphicsPipes, src.used.graphicsPipes);
+	mergeUsedSet(dst, dst.used.rtPipes, src.used.rtPipes);
+	mergeUsedSet(dst, dst.used.pipeLayouts, src.used.pipeLayouts);
+	mergeUsedSet(dst, dst.used.dsuTemplates, src.used.dsuTemplates);
+	mergeUsedSet(dst, dst.used.renderPasses, src.used.renderPasses);
+	mergeUsedSet(dst, dst.used.framebuffers, src.used.framebuffers);
+	mergeUsedSet(dst, dst.used.queryPools, src.used.queryPools);
+	mergeUsedSet(dst, dst.used.imageViews, src.used.imageViews);
+	mergeUsedSet(dst, dst.used.bufferViews, src.used.bufferViews);
+	mergeUsedSet(dst, dst.used.samplers, src.used.samplers);
+	mergeUsedSet(dst, dst.used.accelStructs, src.used.accelStructs);
+	mergeUsedSet(dst, dst.used.events, src.used.events);
+	mergeUsedSet(dst, dst.used.dsPools, src.used.dsPools);
+
+	// the pools of the descriptor sets were already merged above
+	auto& dsSet = dst.used.descriptorSets;
+	for(auto& uds : src.used.descriptorSets) {
+		dsSet.findOrInsert(uds.ds, [&]{
+			UsedDescriptorSet rh(dst.alloc);
+			rh.ds = uds.ds;
+			return rh;
+		});
+	}
+
+	auto& imgSet = dst.used.images;
+	for(auto& uimg : src.used.images) {
+		auto [use, inserted] = imgSet.findOrInsert(uimg.handle.get(), [&]{
+			UsedImage rh(dst.alloc);
+			rh.handle = uimg.handle;
+			return rh;
+		});
+
+		(void) inserted;
+		use.layoutChanges.insert(use.layoutChanges.end(),
+			uimg.layoutChanges.begin(), uimg.layoutChanges.end());
+	}
+}
+
 template<typename... Args>
 decltype(auto) useHandle(CommandBuffer& cb, Args&&... args) {
 	dlg_assert(cb.state() == CommandBuffer::State::recording);
@@ -902,12 +1093,44 @@ VKAPI_ATTR void VKAPI_CALL CmdPipelineBarrier(
 	cmd.record(*cb.dev, cb.handle, cb.pool().queueFamily);
 }
 
+// Returns a chain for the driver that is equal to the given chain of
+// the application, except that the VkRenderPassAttachmentBeginInfo
+// references the given (unwrapped) attachments. Only the links up to
+// the attachment info are copied. Returns nullptr if an unknown struct
+// precedes it.
+const void* forwardAttachmentChain(CommandBuffer& cb, const void* pNext,
+		const VkImageView* attachments) {
+	VkBaseOutStructure* first {};
+	VkBaseOutStructure* prev {};
+
+	auto* it = static_cast<const VkBaseInStructure*>(pNext);
+	for(; it; it = it->pNext) {
+		auto size = chainStructSize(it->sType);
+		if(!size) {
+			dlg_warn("Unknown struct {} before VkRenderPassAttachmentBeginInfo",
+				u32(it->sType));
+			return nullptr;
+		}
+
+		auto* raw = CommandAlloc(cb).alloc.allocate(size, alignof(std::max_align_t));
+		auto* copy = reinterpret_cast<VkBaseOutStructure*>(raw);
+		std::memcpy(copy, it, size);
+		(prev ? prev->pNext : first) = copy;
+		prev = copy;
+
+		if(it->sType == VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO) {
+			auto& attInfo = *reinterpret_cast<VkRenderPassAttachmentBeginInfo*>(copy);
+			attInfo.pAttachments = attachments;
+			return first;
+		}
+	}
+
+	return nullptr;
+}
+
 void cmdBeginRenderPass(CommandBuffer& cb,
 		VkRenderPassBeginInfo& rpBeginInfo,
 		const VkSubpassBeginInfo& subpassBeginInfo/*, ThreadMemScope& memScope*/) {
-	// copy the chain, we might have to modify it below. TODO
-	// rpBeginInfo.pNext = copyChainLocal(memScope, rpBeginInfo.pNext);
-
 	auto& cmd = addCmd<BeginRenderPassCmd, SectionType::begin>(cb);
 
 	cmd.clearValues = copySpan(cb, rpBeginInfo.pClearValues, rpBeginInfo.clearValueCount);
@@ -926,15 +1149,15 @@ void cmdBeginRenderPass(CommandBuffer& cb,
 
 	if(cmd.fb->imageless) {
 		constexpr auto sType = VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO;
-		auto* cAttInfo = findChainInfo<VkRenderPassAttachmentBeginInfo, sType>(rpBeginInfo);
-		// we can const_cast here since we copied the chain above
+		auto* cAttInfo = findChainInfo<VkRenderPassAttachmentBeginInfo, sType>(cmd.info);
+		dlg_assert(cAttInfo);
+
+		// we can const_cast here since the chain (including the
+		// attachments array) was deep-copied into the record above
 		auto* attInfo = const_cast<VkRenderPassAttachmentBeginInfo*>(cAttInfo);
-		dlg_assert(attInfo);
+		auto* recAttachments = const_cast<VkImageView*>(attInfo->pAttachments);
 
 		dlg_assert(cmd.rp->desc.attachments.size() == attInfo->attachmentCount);
-
-		// NOTE: we allocate from cb here because of dstAttInfo below.
-		auto fwdAttachments = alloc<VkImageView>(cb, attInfo->attachmentCount);
 		cmd.attachments = alloc<ImageView*>(cb, attInfo->attachmentCount);
 
 		for(auto i = 0u; i < attInfo->attachmentCount; ++i) {
@@ -948,20 +1171,20 @@ void cmdBeginRenderPass(CommandBuffer& cb,
 				ImageSubresourceLayout{attachment.ci.subresourceRange, finalLayout});
 
 			cmd.attachments[i] = &attachment;
-			fwdAttachments[i] = attachment.handle;
+			recAttachments[i] = attachment.handle;
 		}
 
-		attInfo->pAttachments = fwdAttachments.data();
-
-		// TODO: kinda hacky, we need a better general solution to deep-copy
-		// and unwrap handles in extension chain structs
-		auto* cDstAttInfo = findChainInfo<VkRenderPassAttachmentBeginInfo, sType>(cmd.info);
-		// we can const_cast here since we copied the chain above
-		auto* dstAttInfo = const_cast<VkRenderPassAttachmentBeginInfo*>(cDstAttInfo);
-		dlg_assert(dstAttInfo);
-
-		dstAttInfo->pAttachments = fwdAttachments.data();
-		dlg_assert(dstAttInfo->attachmentCount == fwdAttachments.size());
+		// The copy is only used for the record (which needs the unwrapped
+		// handles when it is re-recorded), we forward the application's
+		// chain since the copy drops structs we don't know.
+		// Only the attachment info (and the links before it) must be
+		// replaced when image views are wrapped.
+		if(HandleDesc<VkImageView>::wrap) {
+			auto* fwd = forwardAttachmentChain(cb, rpBeginInfo.pNext, recAttachments);
+			// We can't relink the chain around unknown structs, fall
+			// back to the copy then.
+			rpBeginInfo.pNext = fwd ? fwd : cmd.info.pNext;
+		}
 	} else {
 		dlg_assert(cmd.rp->desc.attachments.size() == cmd.fb->attachments.size());
 		cmd.attachments = alloc<ImageView*>(cb, cmd.fb->attachments.size());
@@ -1102,6 +1325,19 @@ VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorSets(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		ThreadMemScope memScope;
+		auto setHandles = memScope.allocUndef<VkDescriptorSet>(descriptorSetCount);
+		for(auto i = 0u; i < descriptorSetCount; ++i) {
+			setHandles[i] = get(*cb.dev, pDescriptorSets[i]).handle;
+		}
+
+		cb.dev->dispatch.CmdBindDescriptorSets(cb.handle, pipelineBindPoint,
+			get(*cb.dev, layout).handle, firstSet, descriptorSetCount,
+			setHandles.data(), dynamicOffsetCount, pDynamicOffsets);
+		return;
+	}
+
 	auto& cmd = addCmd<BindDescriptorSetCmd>(cb);
 
 	cmd.firstSet = firstSet;
@@ -1145,14 +1381,12 @@ VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorSets(
 	// Then we also don't need to track the pipeline layout
 
 	// update bound state
-	if(pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
-		cb.newComputeState().bind(cb, *cmd.pipeLayout, firstSet, cmd.sets,
-			{pDynamicOffsets, pDynamicOffsets + dynamicOffsetCount});
-	} else if(pipelineBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) {
-		cb.newGraphicsState().bind(cb, *cmd.pipeLayout, firstSet, cmd.sets,
-			{pDynamicOffsets, pDynamicOffsets + dynamicOffsetCount});
-	} else if(pipelineBindPoint == VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR) {
-		cb.newRayTracingState().bind(cb, *cmd.pipeLayout, firstSet, cmd.sets,
+	if(pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ||
+			pipelineBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS ||
+			pipelineBindPoint == VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR) {
+		auto& state = cb.writableDescriptorState(pipelineBindPoint,
+			firstSet + descriptorSetCount);
+		state.bind(cb, *cmd.pipeLayout, firstSet, cmd.sets,
 			{pDynamicOffsets, pDynamicOffsets + dynamicOffsetCount});
 	} else {
 		dlg_error("Unknown pipeline bind point");
@@ -1177,6 +1411,12 @@ VKAPI_ATTR void VKAPI_CALL CmdBindIndexBuffer(
 		VkDeviceSize                                offset,
 		VkIndexType                                 indexType) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdBindIndexBuffer(cb.handle,
+			get(*cb.dev, buffer).handle, offset, indexType);
+		return;
+	}
+
 	auto& cmd = addCmd<BindIndexBufferCmd>(cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1186,7 +1426,7 @@ VKAPI_ATTR void VKAPI_CALL CmdBindIndexBuffer(
 	cmd.offset = offset;
 	cmd.indexType = indexType;
 
-	auto& gs = cb.newGraphicsState();
+	auto& gs = cb.writableGraphicsState();
 	gs.indices.buffer = &buf;
 	gs.indices.offset = offset;
 	gs.indices.type = indexType;
@@ -1202,12 +1442,23 @@ span<VkBuffer> cmdBindVertexBuffers(CommandBuffer& cb, ThreadMemScope& tms,
 		const VkDeviceSize*                         pSizes,
 		const VkDeviceSize*                         pStrides) {
 
+	if(untracked(cb)) {
+		auto bufHandles = tms.alloc<VkBuffer>(bindingCount);
+		for(auto i = 0u; i < bindingCount; ++i) {
+			// can be null with nullDescriptor feature
+			if(pBuffers[i]) VIL_LIKELY {
+				bufHandles[i] = get(*cb.dev, pBuffers[i]).handle;
+			}
+		}
+
+		return bufHandles;
+	}
+
 	auto& cmd = addCmd<BindVertexBuffersCmd>(cb);
 	cmd.firstBinding = firstBinding;
 	cmd.buffers = alloc<BoundVertexBuffer>(cb, bindingCount);
 
-	auto& gs = cb.newGraphicsState();
-	gs.vertices = copyEnsureSizeUndef(cb, gs.vertices, firstBinding + bindingCount);
+	auto vertices = cb.writableVertexBuffers(firstBinding + bindingCount);
 
 	auto bufHandles = tms.alloc<VkBuffer>(bindingCount);
 	for(auto i = 0u; i < bindingCount; ++i) {
@@ -1225,7 +1476,7 @@ span<VkBuffer> cmdBindVertexBuffers(CommandBuffer& cb, ThreadMemScope& tms,
 			cmd.buffers[i] = {};
 		}
 
-		gs.vertices[firstBinding + i] = cmd.buffers[i];
+		vertices[firstBinding + i] = cmd.buffers[i];
 	}
 
 	return bufHandles;
@@ -1254,6 +1505,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDraw(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDraw(cb.handle,
+			vertexCount, instanceCount, firstVertex, firstInstance);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawCmd>(cb, cb);
 
 	cmd.vertexCount = vertexCount;
@@ -1278,6 +1535,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndexed(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDrawIndexed(cb.handle,
+			indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndexedCmd>(cb, cb);
 
 	cmd.firstInstance = firstInstance;
@@ -1302,6 +1565,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndirect(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDrawIndirect(cb.handle,
+			get(*cb.dev, buffer).handle, offset, drawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1329,6 +1598,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndexedIndirect(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDrawIndexedIndirect(cb.handle,
+			get(*cb.dev, buffer).handle, offset, drawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1358,6 +1633,14 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndirectCount(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDrawIndirectCount(cb.handle,
+			get(*cb.dev, buffer).handle, offset,
+			get(*cb.dev, countBuffer).handle, countBufferOffset,
+			maxDrawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCountCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1392,6 +1675,14 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawIndexedIndirectCount(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDrawIndexedIndirectCount(cb.handle,
+			get(*cb.dev, buffer).handle, offset,
+			get(*cb.dev, countBuffer).handle, countBufferOffset,
+			maxDrawCount, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawIndirectCountCmd>(cb, cb);
 
 	auto& buf = get(*cb.dev, buffer);
@@ -1423,6 +1714,11 @@ VKAPI_ATTR void VKAPI_CALL CmdDispatch(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDispatch(cb.handle, groupCountX, groupCountY, groupCountZ);
+		return;
+	}
+
 	auto& cmd = addCmd<DispatchCmd>(cb, cb);
 
 	cmd.groupsX = groupCountX;
@@ -1442,6 +1738,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDispatchIndirect(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDispatchIndirect(cb.handle,
+			get(*cb.dev, buffer).handle, offset);
+		return;
+	}
+
 	auto& cmd = addCmd<DispatchIndirectCmd>(cb, cb);
 	cmd.offset = offset;
 
@@ -1466,6 +1768,13 @@ VKAPI_ATTR void VKAPI_CALL CmdDispatchBase(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDispatchBase(cb.handle,
+			baseGroupX, baseGroupY, baseGroupZ,
+			groupCountX, groupCountY, groupCountZ);
+		return;
+	}
+
 	auto& cmd = addCmd<DispatchBaseCmd>(cb, cb);
 
 	cmd.baseGroupX = baseGroupX;
@@ -1859,6 +2168,8 @@ VKAPI_ATTR void VKAPI_CALL CmdExecuteCommands(
 		auto& childCmd = construct<ExecuteCommandsChildCmd>(cb);
 		childCmd.id_ = i;
 		childCmd.record_ = recordPtr.get();
+		cmd.stats_.fingerprint = combineHash64(cmd.stats_.fingerprint,
+			structuralFingerprint(childCmd));
 
 		if(!last) {
 			dlg_assert(!cmd.children_);
@@ -1869,40 +2180,12 @@ VKAPI_ATTR void VKAPI_CALL CmdExecuteCommands(
 			last->nextParent_ = &childCmd;
 		}
 
-		auto useAllHandles = [&](auto& set) {
-			for(auto& entry : set) {
-				useHandle(cb, cmd, *entry.handle);
-			}
-		};
-
 		auto& rec = *recordPtr;
+		mergeUsedHandles(*cb.builder().record_, rec);
 
-		static_assert(CommandRecord::UsedHandles::handleTypeCount == 17u);
-
-		useAllHandles(rec.used.buffers);
-		useAllHandles(rec.used.computePipes);
-		useAllHandles(rec.used.graphicsPipes);
-		useAllHandles(rec.used.rtPipes);
-		useAllHandles(rec.used.pipeLayouts);
-		useAllHandles(rec.used.dsuTemplates);
-		useAllHandles(rec.used.renderPasses);
-		useAllHandles(rec.used.framebuffers);
-		useAllHandles(rec.used.queryPools);
-		useAllHandles(rec.used.imageViews);
-		useAllHandles(rec.used.bufferViews);
-		useAllHandles(rec.used.samplers);
-		useAllHandles(rec.used.accelStructs);
-		useAllHandles(rec.used.events);
-		useAllHandles(rec.used.dsPools);
-
-		for(auto& uds : rec.used.descriptorSets) {
-			useHandle(cb, cmd, *static_cast<DescriptorSet*>(uds.ds));
-		}
-
-		for(auto& uimg : rec.used.images) {
-			auto& use = useHandle(cb, cmd, *uimg.handle);
-			use.layoutChanges.insert(use.layoutChanges.end(),
-				uimg.layoutChanges.begin(), uimg.layoutChanges.end());
+		// When a secondary record is missing commands, so is this one.
+		if(rec.untracked) {
+			cb.builder().record_->untracked = true;
 		}
 
 		cb.builder().record_->secondaries.push_back(std::move(recordPtr));
@@ -2021,6 +2304,15 @@ bool checkDebugLabelForLocalCapture(CommandBuffer& cb, std::string_view name) {
 
 		lci.name = name.substr(pos + 1, nextSep - pos - 1);
 
+		// We can't capture commands from untracked records. Disable
+		// lazy tracking so that the capture works for the next records.
+		if(untracked(cb)) {
+			dlg_info("LocalCapture '{}' in untracked record, disabling lazy tracking",
+				lci.name);
+			cb.dev->lazyTracking.store(false);
+			return true;
+		}
+
 		auto flagsString = name.substr(nextSep + 1);
 		auto nextBar = flagsString.find('|'); // npos is ok
 		while(!flagsString.empty()) {
@@ -2135,6 +2427,12 @@ VKAPI_ATTR void VKAPI_CALL CmdBindPipeline(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdBindPipeline(cb.handle, pipelineBindPoint,
+			get(*cb.dev, pipeline).handle);
+		return;
+	}
+
 	auto& cmd = addCmd<BindPipelineCmd>(cb);
 	cmd.bindPoint = pipelineBindPoint;
 
@@ -2143,17 +2441,17 @@ VKAPI_ATTR void VKAPI_CALL CmdBindPipeline(
 
 	if(pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
 		auto computePipe = static_cast<ComputePipeline*>(&pipe);
-		cb.newComputeState().pipe = computePipe;
+		cb.writableComputeState().pipe = computePipe;
 		cmd.pipe = computePipe;
 		useHandle(cb, cmd, *computePipe);
 	} else if(pipelineBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) {
 		auto gfxPipe = static_cast<GraphicsPipeline*>(&pipe);
-		cb.newGraphicsState().pipe = gfxPipe;
+		cb.writableGraphicsState().pipe = gfxPipe;
 		cmd.pipe = gfxPipe;
 		useHandle(cb, cmd, *gfxPipe);
 	} else if(pipelineBindPoint == VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR) {
 		auto rtPipe = static_cast<RayTracingPipeline*>(&pipe);
-		cb.newRayTracingState().pipe = rtPipe;
+		cb.writableRayTracingState().pipe = rtPipe;
 		cmd.pipe = rtPipe;
 		useHandle(cb, cmd, *rtPipe);
 	} else {
@@ -2273,6 +2571,12 @@ VKAPI_ATTR void VKAPI_CALL CmdPushConstants(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdPushConstants(cb.handle, get(*cb.dev, pipeLayout).handle,
+			stageFlags, offset, size, pValues);
+		return;
+	}
+
 	auto& cmd = addCmd<PushConstantsCmd>(cb);
 
 	// NOTE: See BindDescriptorSets for rationale on pipe layout handling here.
@@ -2357,15 +2661,18 @@ VKAPI_ATTR void VKAPI_CALL CmdSetViewport(
 		uint32_t                                    viewportCount,
 		const VkViewport*                           pViewports) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetViewport(cb.handle, firstViewport, viewportCount, pViewports);
+		return;
+	}
+
 	auto& cmd = addCmd<SetViewportCmd>(cb);
 	cmd.first = firstViewport;
 	cmd.viewports = copySpan(cb, pViewports, viewportCount);
 
-	auto& gs = cb.newGraphicsState();
-	gs.dynamic.viewports = copyEnsureSizeUndef(cb, gs.dynamic.viewports,
-		firstViewport + viewportCount);
+	auto viewports = cb.writableViewports(firstViewport + viewportCount);
 	std::copy(pViewports, pViewports + viewportCount,
-		gs.dynamic.viewports.begin() + firstViewport);
+		viewports.begin() + firstViewport);
 
 	cb.dev->dispatch.CmdSetViewport(cb.handle, firstViewport, viewportCount, pViewports);
 }
@@ -2376,15 +2683,18 @@ VKAPI_ATTR void VKAPI_CALL CmdSetScissor(
 		uint32_t                                    scissorCount,
 		const VkRect2D*                             pScissors) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetScissor(cb.handle, firstScissor, scissorCount, pScissors);
+		return;
+	}
+
 	auto& cmd = addCmd<SetScissorCmd>(cb);
 	cmd.first = firstScissor;
 	cmd.scissors = copySpan(cb, pScissors, scissorCount);
 
-	auto& gs = cb.newGraphicsState();
-	gs.dynamic.scissors = copyEnsureSizeUndef(cb, gs.dynamic.scissors,
-		firstScissor + scissorCount);
+	auto scissors = cb.writableScissors(firstScissor + scissorCount);
 	std::copy(pScissors, pScissors + scissorCount,
-		gs.dynamic.scissors.begin() + firstScissor);
+		scissors.begin() + firstScissor);
 
 	cb.dev->dispatch.CmdSetScissor(cb.handle, firstScissor, scissorCount, pScissors);
 }
@@ -2393,11 +2703,16 @@ VKAPI_ATTR void VKAPI_CALL CmdSetLineWidth(
 		VkCommandBuffer                             commandBuffer,
 		float                                       lineWidth) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetLineWidth(cb.handle, lineWidth);
+		return;
+	}
+
 	auto& cmd = addCmd<SetLineWidthCmd>(cb);
 	cmd.width = lineWidth;
 
-	auto& gs = cb.newGraphicsState();
-	gs.dynamic.lineWidth = lineWidth;
+	auto& dyn = cb.writableDynamicState();
+	dyn.lineWidth = lineWidth;
 	cb.dev->dispatch.CmdSetLineWidth(cb.handle, lineWidth);
 }
 
@@ -2407,11 +2722,17 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthBias(
 		float                                       depthBiasClamp,
 		float                                       depthBiasSlopeFactor) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetDepthBias(cb.handle,
+			depthBiasConstantFactor, depthBiasClamp, depthBiasSlopeFactor);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthBiasCmd>(cb);
 	cmd.state = {depthBiasConstantFactor, depthBiasClamp, depthBiasSlopeFactor};
 
-	auto& gs = cb.newGraphicsState();
-	gs.dynamic.depthBias = cmd.state;
+	auto& dyn = cb.writableDynamicState();
+	dyn.depthBias = cmd.state;
 
 	cb.dev->dispatch.CmdSetDepthBias(cb.handle,
 		depthBiasConstantFactor, depthBiasClamp, depthBiasSlopeFactor);
@@ -2421,12 +2742,17 @@ VKAPI_ATTR void VKAPI_CALL CmdSetBlendConstants(
 		VkCommandBuffer                             commandBuffer,
 		const float                                 blendConstants[4]) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetBlendConstants(cb.handle, blendConstants);
+		return;
+	}
+
 	auto& cmd = addCmd<SetBlendConstantsCmd>(cb);
 	std::memcpy(cmd.values.data(), blendConstants, sizeof(cmd.values));
 
-	auto& gs = cb.newGraphicsState();
-	std::memcpy(gs.dynamic.blendConstants.data(), blendConstants,
-		sizeof(gs.dynamic.blendConstants));
+	auto& dyn = cb.writableDynamicState();
+	std::memcpy(dyn.blendConstants.data(), blendConstants,
+		sizeof(dyn.blendConstants));
 
 	cb.dev->dispatch.CmdSetBlendConstants(cb.handle, blendConstants);
 }
@@ -2436,13 +2762,18 @@ VKAPI_ATTR void VKAPI_CALL CmdSetDepthBounds(
 		float                                       minDepthBounds,
 		float                                       maxDepthBounds) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetDepthBounds(cb.handle, minDepthBounds, maxDepthBounds);
+		return;
+	}
+
 	auto& cmd = addCmd<SetDepthBoundsCmd>(cb);
 	cmd.min = minDepthBounds;
 	cmd.max = maxDepthBounds;
 
-	auto& gs = cb.newGraphicsState();
-	gs.dynamic.depthBoundsMin = minDepthBounds;
-	gs.dynamic.depthBoundsMax = maxDepthBounds;
+	auto& dyn = cb.writableDynamicState();
+	dyn.depthBoundsMin = minDepthBounds;
+	dyn.depthBoundsMax = maxDepthBounds;
 
 	cb.dev->dispatch.CmdSetDepthBounds(cb.handle, minDepthBounds, maxDepthBounds);
 }
@@ -2452,16 +2783,21 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilCompareMask(
 		VkStencilFaceFlags                          faceMask,
 		uint32_t                                    compareMask) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetStencilCompareMask(cb.handle, faceMask, compareMask);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilCompareMaskCmd>(cb);
 	cmd.faceMask = faceMask;
 	cmd.value = compareMask;
 
-	auto& gs = cb.newGraphicsState();
+	auto& dyn = cb.writableDynamicState();
 	if(faceMask & VK_STENCIL_FACE_FRONT_BIT) {
-		gs.dynamic.stencilFront.compareMask = compareMask;
+		dyn.stencilFront.compareMask = compareMask;
 	}
 	if(faceMask & VK_STENCIL_FACE_BACK_BIT) {
-		gs.dynamic.stencilBack.compareMask = compareMask;
+		dyn.stencilBack.compareMask = compareMask;
 	}
 
 	cb.dev->dispatch.CmdSetStencilCompareMask(cb.handle, faceMask, compareMask);
@@ -2472,16 +2808,21 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilWriteMask(
 		VkStencilFaceFlags                          faceMask,
 		uint32_t                                    writeMask) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetStencilWriteMask(cb.handle, faceMask, writeMask);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilWriteMaskCmd>(cb);
 	cmd.faceMask = faceMask;
 	cmd.value = writeMask;
 
-	auto& gs = cb.newGraphicsState();
+	auto& dyn = cb.writableDynamicState();
 	if(faceMask & VK_STENCIL_FACE_FRONT_BIT) {
-		gs.dynamic.stencilFront.compareMask = writeMask;
+		dyn.stencilFront.writeMask = writeMask;
 	}
 	if(faceMask & VK_STENCIL_FACE_BACK_BIT) {
-		gs.dynamic.stencilBack.compareMask = writeMask;
+		dyn.stencilBack.writeMask = writeMask;
 	}
 
 	cb.dev->dispatch.CmdSetStencilWriteMask(cb.handle, faceMask, writeMask);
@@ -2492,16 +2833,21 @@ VKAPI_ATTR void VKAPI_CALL CmdSetStencilReference(
 		VkStencilFaceFlags                          faceMask,
 		uint32_t                                    reference) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetStencilReference(cb.handle, faceMask, reference);
+		return;
+	}
+
 	auto& cmd = addCmd<SetStencilReferenceCmd>(cb);
 	cmd.faceMask = faceMask;
 	cmd.value = reference;
 
-	auto& gs = cb.newGraphicsState();
+	auto& dyn = cb.writableDynamicState();
 	if(faceMask & VK_STENCIL_FACE_FRONT_BIT) {
-		gs.dynamic.stencilFront.reference = reference;
+		dyn.stencilFront.reference = reference;
 	}
 	if(faceMask & VK_STENCIL_FACE_BACK_BIT) {
-		gs.dynamic.stencilBack.reference = reference;
+		dyn.stencilBack.reference = reference;
 	}
 
 	cb.dev->dispatch.CmdSetStencilReference(cb.handle, faceMask, reference);
@@ -3162,6 +3508,16 @@ VKAPI_ATTR void VKAPI_CALL CmdTraceRaysKHR(
 		uint32_t                                    height,
 		uint32_t                                    depth) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdTraceRaysKHR(cb.handle,
+			pRaygenShaderBindingTable,
+			pMissShaderBindingTable,
+			pHitShaderBindingTable,
+			pCallableShaderBindingTable,
+			width, height, depth);
+		return;
+	}
+
 	auto& cmd = addCmd<TraceRaysCmd>(cb, cb);
 	cmd.raygenBindingTable = *pRaygenShaderBindingTable;
 	cmd.missBindingTable = *pMissShaderBindingTable;
@@ -3189,6 +3545,16 @@ VKAPI_ATTR void VKAPI_CALL CmdTraceRaysIndirectKHR(
 		const VkStridedDeviceAddressRegionKHR*      pCallableShaderBindingTable,
 		VkDeviceAddress                             indirectDeviceAddress) {
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdTraceRaysIndirectKHR(cb.handle,
+			pRaygenShaderBindingTable,
+			pMissShaderBindingTable,
+			pHitShaderBindingTable,
+			pCallableShaderBindingTable,
+			indirectDeviceAddress);
+		return;
+	}
+
 	auto& cmd = addCmd<TraceRaysIndirectCmd>(cb, cb);
 	cmd.raygenBindingTable = *pRaygenShaderBindingTable;
 	cmd.missBindingTable = *pMissShaderBindingTable;
@@ -3391,6 +3757,136 @@ VKAPI_ATTR void VKAPI_CALL CmdSetColorWriteEnableEXT(
 		attachmentCount, pColorWriteEnables);
 }
 
+// VK_EXT_descriptor_buffer
+VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorBuffersEXT(
+		VkCommandBuffer                             commandBuffer,
+		uint32_t                                    bufferCount,
+		const VkDescriptorBufferBindingInfoEXT*     pBindingInfos) {
+	auto& cb = getCommandBuffer(commandBuffer);
+
+	// The only extension struct allowed here holds a buffer handle
+	// we have to unwrap.
+	constexpr auto pushBufSType =
+		VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_PUSH_DESCRIPTOR_BUFFER_HANDLE_EXT;
+	auto unwrapPushBuf = [&](VkDescriptorBufferBindingInfoEXT& info, auto& allocator) {
+		auto* src = findChainInfo<VkDescriptorBufferBindingPushDescriptorBufferHandleEXT,
+			pushBufSType>(info);
+		info.pNext = nullptr;
+		if(src) {
+			auto& dst = allocator(*src);
+			dst.pNext = nullptr;
+			dst.buffer = get(*cb.dev, src->buffer).handle;
+			info.pNext = &dst;
+		}
+	};
+
+	if(untracked(cb)) {
+		ThreadMemScope memScope;
+		auto infos = memScope.copy(pBindingInfos, bufferCount);
+		auto allocator = [&](const auto& src) -> auto& {
+			return memScope.copy(&src, 1u)[0];
+		};
+		for(auto& info : infos) {
+			unwrapPushBuf(info, allocator);
+		}
+
+		cb.dev->dispatch.CmdBindDescriptorBuffersEXT(cb.handle,
+			bufferCount, infos.data());
+		return;
+	}
+
+	auto& cmd = addCmd<BindDescriptorBuffersCmd>(cb);
+	cmd.buffers = copySpan(cb, pBindingInfos, bufferCount);
+	auto allocator = [&](const auto& src) -> auto& {
+		return copySpan(cb, &src, 1u)[0];
+	};
+	for(auto& info : cmd.buffers) {
+		unwrapPushBuf(info, allocator);
+	}
+
+	// Binding descriptor buffers does not disturb the bound sets,
+	// they always refer to the buffers bound at the time of use.
+	cb.writableGraphicsState().descriptorBuffers = cmd.buffers;
+	cb.writableComputeState().descriptorBuffers = cmd.buffers;
+	cb.writableRayTracingState().descriptorBuffers = cmd.buffers;
+
+	cb.dev->dispatch.CmdBindDescriptorBuffersEXT(cb.handle,
+		bufferCount, cmd.buffers.data());
+}
+
+VKAPI_ATTR void VKAPI_CALL CmdSetDescriptorBufferOffsetsEXT(
+		VkCommandBuffer                             commandBuffer,
+		VkPipelineBindPoint                         pipelineBindPoint,
+		VkPipelineLayout                            layout,
+		uint32_t                                    firstSet,
+		uint32_t                                    setCount,
+		const uint32_t*                             pBufferIndices,
+		const VkDeviceSize*                         pOffsets) {
+	ExtZoneScoped;
+
+	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdSetDescriptorBufferOffsetsEXT(cb.handle,
+			pipelineBindPoint, get(*cb.dev, layout).handle, firstSet,
+			setCount, pBufferIndices, pOffsets);
+		return;
+	}
+
+	// Just remember the raw offsets here, the descriptors are only
+	// decoded when they are needed, see decodeDescriptorBufferLocked.
+	auto& cmd = addCmd<SetDescriptorBufferOffsetsCmd>(cb);
+	cmd.pipeBindPoint = pipelineBindPoint;
+	cmd.firstSet = firstSet;
+	cmd.bufferIndices = copySpan(cb, pBufferIndices, setCount);
+	cmd.offsets = copySpan(cb, pOffsets, setCount);
+
+	// See CmdBindDescriptorSets
+	auto pipeLayoutPtr = getPtr(*cb.dev, layout);
+	cmd.pipeLayout = pipeLayoutPtr.get();
+	useHandle(cb, cmd, *pipeLayoutPtr);
+
+	auto& state = cb.writableDescriptorState(pipelineBindPoint,
+		firstSet + setCount);
+	state.bindBufferSets(*cmd.pipeLayout, firstSet, cmd.bufferIndices,
+		cmd.offsets);
+
+	cb.dev->dispatch.CmdSetDescriptorBufferOffsetsEXT(cb.handle,
+		pipelineBindPoint, cmd.pipeLayout->handle, firstSet,
+		setCount, pBufferIndices, pOffsets);
+}
+
+VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorBufferEmbeddedSamplersEXT(
+		VkCommandBuffer                             commandBuffer,
+		VkPipelineBindPoint                         pipelineBindPoint,
+		VkPipelineLayout                            layout,
+		uint32_t                                    set) {
+	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdBindDescriptorBufferEmbeddedSamplersEXT(cb.handle,
+			pipelineBindPoint, get(*cb.dev, layout).handle, set);
+		return;
+	}
+
+	auto& cmd = addCmd<BindDescriptorBufferEmbeddedSamplersCmd>(cb);
+	cmd.pipeBindPoint = pipelineBindPoint;
+	cmd.set = set;
+
+	auto pipeLayoutPtr = getPtr(*cb.dev, layout);
+	cmd.pipeLayout = pipeLayoutPtr.get();
+	useHandle(cb, cmd, *pipeLayoutPtr);
+
+	// The set only consists of immutable samplers
+	auto& state = cb.writableDescriptorState(pipelineBindPoint, set + 1);
+	state.disturb(*cmd.pipeLayout, set, 1u);
+	auto& bds = state.descriptorSets[set];
+	bds = {};
+	bds.layout = cmd.pipeLayout;
+	bds.descriptorBufferIndex = BoundDescriptorSet::embeddedSamplers;
+
+	cb.dev->dispatch.CmdBindDescriptorBufferEmbeddedSamplersEXT(cb.handle,
+		pipelineBindPoint, cmd.pipeLayout->handle, set);
+}
+
 // VK_EXT_multi_draw
 VKAPI_ATTR void VKAPI_CALL CmdDrawMultiEXT(
 		VkCommandBuffer                             commandBuffer,
@@ -3402,6 +3898,12 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawMultiEXT(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDrawMultiEXT(cb.handle,
+			drawCount, pVertexInfo, instanceCount, firstInstance, stride);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawMultiCmd>(cb, cb);
 
 	cmd.vertexInfos = alloc<VkMultiDrawInfoEXT>(cb, drawCount);
@@ -3433,6 +3935,13 @@ VKAPI_ATTR void VKAPI_CALL CmdDrawMultiIndexedEXT(
 	ExtZoneScoped;
 
 	auto& cb = getCommandBuffer(commandBuffer);
+	if(untracked(cb)) {
+		cb.dev->dispatch.CmdDrawMultiIndexedEXT(cb.handle,
+			drawCount, pIndexInfo, instanceCount, firstInstance, stride,
+			pVertexOffset);
+		return;
+	}
+
 	auto& cmd = addCmd<DrawMultiIndexedCmd>(cb, cb);
 
 	cmd.indexInfos = alloc<VkMultiDrawIndexedInfoEXT>(cb, drawCount);
@@ -60,11 +60,11 @@ public:
 	// Returns the last complete recorded state.
 	// When command buffer is executable/pending, this is the current state.
 	// Otherwise it's the previous state.
-	IntrusivePtr<CommandRecord> lastRecordPtrLocked() const {
+	CommandRecordPtr lastRecordPtrLocked() const {
 		assertOwned(dev->mutex);
 		return lastRecord_;
 	}
-	IntrusivePtr<CommandRecord> lastRecordPtr() const {
+	CommandRecordPtr lastRecordPtr() const {
 		std::lock_guard lock(dev->mutex);
 		return lastRecordPtrLocked();
 	}
@@ -90,14 +90,25 @@ private:
 	// it can be useful to know when inspecting a command buffer.
 	// This is only updated when a command buffer recording is finished,
 	// i.e. by vkEndCommandBuffer.
-	IntrusivePtr<CommandRecord> lastRecord_;
+	CommandRecordPtr lastRecord_;
 	u32 recordCount_ {};
 
+	// The memory used by the last finished record, in bytes.
+	// Only accessed while recording (externally synchronized).
+	std::size_t lastRecordMemSize_ {};
+
 	// Only needed while recording.
 	ComputeState* computeState_ {};
 	GraphicsState* graphicsState_ {};
 	RayTracingState* rayTracingState_ {};
 
+	// Bitmasks of StateChunkBits, the parts of the current states
+	// that were captured by a command and therefore must not be
+	// changed in place anymore. See writableGraphicsState.
+	u32 computeShared_ {};
+	u32 graphicsShared_ {};
+	u32 rayTracingShared_ {};
+
 	u32 ignoreEndDebugLabels_ {}; // See docs/debug-utils-label-nesting.md
 	PushConstantData pushConstants_ {};
 
@@ -117,20 +128,39 @@ public: // Only public for recording, should not be accessed outside api
 	void popLabelSections();
 	auto& ignoreEndDebugLabels() { return ignoreEndDebugLabels_; }
 
-	const ComputeState& computeState() { return *computeState_; }
-	const GraphicsState& graphicsState() { return *graphicsState_; }
-	const RayTracingState& rayTracingState() { return *rayTracingState_; }
+	// Return the current state to be referenced by a command.
+	// The state is immutable from now on, changing it will create a copy.
+	const ComputeState& computeState();
+	const GraphicsState& graphicsState();
+	const RayTracingState& rayTracingState();
 	PushConstantData& pushConstants() { return pushConstants_; }
 
-	ComputeState& newComputeState();
-	GraphicsState& newGraphicsState();
-	RayTracingState& newRayTracingState();
+	// Return the current state for modification. If it was captured by a
+	// command, a shallow copy is created first. The chunks referenced by
+	// it are still shared, they have to be retrieved via the functions
+	// below to modify them.
+	ComputeState& writableComputeState();
+	GraphicsState& writableGraphicsState();
+	RayTracingState& writableRayTracingState();
+
+	// Return the respective chunk of the current state for modification,
+	// copying it first if it is shared. Spans are grown to the given
+	// minimum size, new elements are undefined.
+	DescriptorState& writableDescriptorState(VkPipelineBindPoint, std::size_t minSets);
+	span<BoundVertexBuffer> writableVertexBuffers(std::size_t minCount);
+	GraphicsDynamicState& writableDynamicState();
+	span<VkViewport> writableViewports(std::size_t minCount);
+	span<VkRect2D> writableScissors(std::size_t minCount);
 
 	// Expects device mutex to be locked
 	void clearPendingLocked();
 	void doReset(bool record);
 	void doEnd();
 
+	// Returns the size the first memory block of a new record
+	// should have, based on the memory used by previous records.
+	std::size_t recordMemHint() const;
+
 	RecordBuilder& builder() {
 		dlg_assert(state_ == State::recording);
 		return builder_;
@@ -817,6 +847,27 @@ VKAPI_ATTR void VKAPI_CALL CmdSetColorWriteEnableEXT(
     uint32_t                                    attachmentCount,
     const VkBool32*                             pColorWriteEnables);
 
+// VK_EXT_descriptor_buffer
+VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorBuffersEXT(
+    VkCommandBuffer                             commandBuffer,
+    uint32_t                                    bufferCount,
+    const VkDescriptorBufferBindingInfoEXT*     pBindingInfos);
+
+VKAPI_ATTR void VKAPI_CALL CmdSetDescriptorBufferOffsetsEXT(
+    VkCommandBuffer                             commandBuffer,
+    VkPipelineBindPoint                         pipelineBindPoint,
+    VkPipelineLayout                            layout,
+    uint32_t                                    firstSet,
+    uint32_t                                    setCount,
+    const uint32_t*                             pBufferIndices,
+    const VkDeviceSize*                         pOffsets);
+
+VKAPI_ATTR void VKAPI_CALL CmdBindDescriptorBufferEmbeddedSamplersEXT(
+    VkCommandBuffer                             commandBuffer,
+    VkPipelineBindPoint                         pipelineBindPoint,
+    VkPipelineLayout                            layout,
+    uint32_t                                    set);
+
 // VK_EXT_multi_draw
 VKAPI_ATTR void VKAPI_CALL CmdDrawMultiEXT(
     VkCommandBuffer                             commandBuffer,
@@ -121,4 +121,29 @@ void ensureSize(CommandAlloc ca, span<T>& buf, size_t size) {
 	buf = newBuf;
 }
 
+// Copy-on-write helpers for chunks of bound state, see StateChunkBits.
+// If the given bit is set in 'shared', the chunk is copied and the
+// bit cleared. The returned chunk can be modified in place.
+template<typename T>
+T& writableChunk(CommandAlloc ca, T*& chunk, u32& shared, u32 bit) {
+	if(shared & bit) {
+		chunk = &construct<T>(ca, *chunk);
+		shared &= ~bit;
+	}
+
+	return *chunk;
+}
+
+// Additionally grows the span to at least minSize, new elements are undefined.
+template<typename T>
+span<T> writableChunk(CommandAlloc ca, span<T>& chunk, u32& shared, u32 bit,
+		size_t minSize) {
+	if((shared & bit) || chunk.size() < minSize) {
+		chunk = copyEnsureSizeUndef(ca, chunk, minSize);
+		shared &= ~bit;
+	}
+
+	return chunk;
+}
+
 } // namespace vil
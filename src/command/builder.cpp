@@ -1,10 +1,7 @@
 #include <command/builder.hpp>
 #include <command/commands.hpp>
 #include <command/alloc.hpp>
-
-#ifdef VIL_COMMAND_CALLSTACKS
-	#include <backward/trace.hpp>
-#endif // VIL_COMMAND_CALLSTACKS
+#include <util/util.hpp>
 
 namespace vil {
 
@@ -22,11 +19,11 @@ RecordBuilder::RecordBuilder(Device* dev) {
 }
 
 void RecordBuilder::reset(Device* dev) {
-	record_ = IntrusivePtr<CommandRecord>(new CommandRecord(manualTag, dev));
+	record_ = CommandRecordPtr(new CommandRecord(manualTag, dev));
 	doReset(*this);
 }
 
-void RecordBuilder::reset(IntrusivePtr<CommandRecord> rec) {
+void RecordBuilder::reset(CommandRecordPtr rec) {
 	record_ = rec;
 	doReset(*this);
 }
@@ -36,7 +33,7 @@ RecordBuilder::RecordBuilder(CommandBuffer& cb) {
 }
 
 void RecordBuilder::reset(CommandBuffer& cb) {
-	record_ = IntrusivePtr<CommandRecord>(new CommandRecord(cb));
+	record_ = CommandRecordPtr(new CommandRecord(cb, cb.recordMemHint()));
 	doReset(*this);
 }
 
@@ -87,6 +84,7 @@ void RecordBuilder::endSection(Command* cmd) {
 		return;
 	}
 
+	foldFingerprint();
 	lastCommand_ = section_->cmd;
 	dlg_assert(!section_->pop); // we shouldn't be able to land here
 
@@ -102,6 +100,7 @@ void RecordBuilder::endSection(Command* cmd) {
 	// the application but not in the same nesting level they were created.
 	while(section_->parent && section_->pop) {
 		dlg_assert(commandCast<BeginDebugUtilsLabelCmd*>(section_->cmd));
+		foldFingerprint();
 		lastCommand_ = section_->cmd;
 
 		// reset it for future use
@@ -121,7 +120,7 @@ void RecordBuilder::append(Command& cmd) {
 	// don't want to access device. Should probably be passed
 	// to RecordBuilder on construction or be a public attribute or smth
 	if(record_->dev && record_->dev->captureCmdStack.load()) {
-		cmd.stacktrace = backward::load_here(record_->alloc, 16u);
+		cmd.stackID = record_->dev->stackTable.capture();
 	}
 #endif // VIL_COMMAND_CALLSTACKS
 
@@ -149,6 +148,7 @@ void RecordBuilder::append(Command& cmd) {
 
 	// append
 	if(lastCommand_) {
+		foldFingerprint();
 		dlg_assert(record_->commands);
 		lastCommand_->next = &cmd;
 	} else {
@@ -161,6 +161,15 @@ void RecordBuilder::append(Command& cmd) {
 	lastCommand_ = &cmd;
 }
 
+void RecordBuilder::foldFingerprint() {
+	if(!lastCommand_) {
+		return;
+	}
+
+	auto& fingerprint = section_->cmd->stats_.fingerprint;
+	fingerprint = combineHash64(fingerprint, structuralFingerprint(*lastCommand_));
+}
+
 std::vector<const Command*> RecordBuilder::lastCommand() const {
 	std::vector<const Command*> ret;
 	ret.push_back(lastCommand_);
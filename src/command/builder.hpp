@@ -28,7 +28,7 @@ struct RecordBuilder {
 		bool pop {};
     };
 
-	IntrusivePtr<CommandRecord> record_;
+	CommandRecordPtr record_;
 	Section* section_ {}; // the last, lowest, deepest-down section
 	Command* lastCommand_ {}; // the last added command in current section (might be null)
 
@@ -41,12 +41,20 @@ struct RecordBuilder {
 	// Commandbuffer-less construction - for loading serialized commands and testing
 	RecordBuilder(Device* dev);
 	void reset(Device* dev);
-	void reset(IntrusivePtr<CommandRecord>);
+	void reset(CommandRecordPtr);
 
 	void appendParent(ParentCommand& cmd);
 	void beginSection(SectionCommand& cmd);
 	void endSection(Command* cmd);
 	void append(Command& cmd);
+
+	// Adds lastCommand_ to the fingerprint of the current section.
+	// Commands are only added once they are complete, i.e. when the next
+	// command is appended or when the section is ended, since their
+	// parameters are set after add().
+	// Must be called for the last command of a record before finishing it.
+	void foldFingerprint();
+
 	std::vector<const Command*> lastCommand() const;
 
 	template<typename T, SectionType ST = SectionType::none, typename... Args>
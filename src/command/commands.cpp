@@ -159,6 +159,398 @@ bool Command::isDescendant(const Command& cmd) const {
 	return false;
 }
 
+u64 structuralFingerprint(const Command& cmd) {
+	auto ret = combineHash64(0u, u64(cmd.type()));
+	auto add = [&](u64 val) { ret = combineHash64(ret, val); };
+	auto addPtr = [&](const void* ptr) { add(reinterpret_cast<std::uintptr_t>(ptr)); };
+	auto addStr = [&](const char* str) {
+		// label names are usually re-created every frame
+		add(str ? std::hash<std::string_view>{}(str) : 0u);
+	};
+
+	// NOTE: only parameters that usually stay the same between frames.
+	// Descriptor sets, framebuffers, vertex buffers or draw parameters
+	// are not considered.
+	switch(cmd.type()) {
+		case CommandType::bindPipeline:
+			addPtr(static_cast<const BindPipelineCmd&>(cmd).pipe);
+			break;
+		case CommandType::beginRenderPass:
+			addPtr(static_cast<const BeginRenderPassCmd&>(cmd).rp);
+			break;
+		case CommandType::beginRendering: {
+			auto& rendering = static_cast<const BeginRenderingCmd&>(cmd);
+			add(rendering.colorAttachments.size());
+			add(rendering.layerCount);
+			add(rendering.viewMask);
+			break;
+		} case CommandType::beginDebugUtilsLabel:
+			addStr(static_cast<const BeginDebugUtilsLabelCmd&>(cmd).name);
+			break;
+		case CommandType::insertDebugUtilsLabel:
+			addStr(static_cast<const InsertDebugUtilsLabelCmd&>(cmd).name);
+			break;
+		case CommandType::bindDescriptorSet: {
+			auto& bds = static_cast<const BindDescriptorSetCmd&>(cmd);
+			addPtr(bds.pipeLayout);
+			add(bds.firstSet);
+			add(bds.sets.size());
+			break;
+		} case CommandType::pushConstants: {
+			auto& pcs = static_cast<const PushConstantsCmd&>(cmd);
+			addPtr(pcs.pipeLayout);
+			add(pcs.stages);
+			add(pcs.offset);
+			add(pcs.values.size());
+			break;
+		} default:
+			break;
+	}
+
+	// Only ParentCommands have children. Parent commands without
+	// children have an empty fingerprint anyways.
+	if(cmd.children()) {
+		auto& parent = static_cast<const ParentCommand&>(cmd);
+		add(parent.sectionStats().fingerprint);
+	}
+
+	return ret;
+}
+
+u64 recordingHash(const Command& cmd) {
+	auto ret = combineHash64(0u, u64(cmd.type()));
+	auto add = [&](u64 val) { ret = combineHash64(ret, val); };
+	auto addPtr = [&](const void* ptr) { add(reinterpret_cast<std::uintptr_t>(ptr)); };
+	auto addStr = [&](const char* str) {
+		add(str ? std::hash<std::string_view>{}(str) : 0u);
+	};
+	// NOTE: hashes padding bytes as well. Uninitialized padding or pNext
+	// chains only lead to differing hashes, never to wrong matches.
+	auto addBytes = [&](const void* data, std::size_t size) {
+		auto str = std::string_view(static_cast<const char*>(data), size);
+		add(size);
+		add(std::hash<std::string_view>{}(str));
+	};
+	auto addSpan = [&](auto span) {
+		addBytes(span.data(), span.size() * sizeof(span[0]));
+	};
+	auto addBarriers = [&](const auto& barrier) {
+		addSpan(barrier.memBarriers);
+		addSpan(barrier.bufBarriers);
+		addSpan(barrier.imgBarriers);
+		addSpan(barrier.images);
+		addSpan(barrier.buffers);
+	};
+	auto addAttachment = [&](const BeginRenderingCmd::Attachment& att) {
+		addPtr(att.view);
+		add(att.imageLayout);
+		add(att.resolveMode);
+		addPtr(att.resolveView);
+		add(att.resolveImageLayout);
+		add(att.loadOp);
+		add(att.storeOp);
+		addBytes(&att.clearValue, sizeof(att.clearValue));
+	};
+
+	switch(cmd.type()) {
+		case CommandType::root:
+		case CommandType::firstSubpass:
+		case CommandType::endRenderPass:
+		case CommandType::endRendering:
+		case CommandType::endDebugUtilsLabel:
+			break;
+		case CommandType::barrier: {
+			auto& barrier = static_cast<const BarrierCmd&>(cmd);
+			add(barrier.srcStageMask);
+			add(barrier.dstStageMask);
+			add(barrier.dependencyFlags);
+			addBarriers(barrier);
+			break;
+		} case CommandType::barrier2: {
+			auto& barrier = static_cast<const Barrier2Cmd&>(cmd);
+			add(barrier.flags);
+			addBarriers(barrier);
+			break;
+		} case CommandType::beginRenderPass: {
+			auto& rp = static_cast<const BeginRenderPassCmd&>(cmd);
+			addPtr(rp.rp);
+			addPtr(rp.fb);
+			addSpan(rp.attachments);
+			addSpan(rp.clearValues);
+			addBytes(&rp.info.renderArea, sizeof(rp.info.renderArea));
+			add(rp.subpassBeginInfo.contents);
+			break;
+		} case CommandType::nextSubpass:
+			add(static_cast<const NextSubpassCmd&>(cmd).beginInfo.contents);
+			break;
+		case CommandType::beginRendering: {
+			auto& rendering = static_cast<const BeginRenderingCmd&>(cmd);
+			add(rendering.layerCount);
+			add(rendering.viewMask);
+			add(rendering.flags);
+			addBytes(&rendering.renderArea, sizeof(rendering.renderArea));
+			add(rendering.colorAttachments.size());
+			for(auto& att : rendering.colorAttachments) {
+				addAttachment(att);
+			}
+			addAttachment(rendering.depthAttachment);
+			addAttachment(rendering.stencilAttachment);
+			break;
+		} case CommandType::draw: {
+			auto& draw = static_cast<const DrawCmd&>(cmd);
+			add(draw.vertexCount);
+			add(draw.instanceCount);
+			add(draw.firstVertex);
+			add(draw.firstInstance);
+			break;
+		} case CommandType::drawIndexed: {
+			auto& draw = static_cast<const DrawIndexedCmd&>(cmd);
+			add(draw.indexCount);
+			add(draw.instanceCount);
+			add(draw.firstIndex);
+			add(u32(draw.vertexOffset));
+			add(draw.firstInstance);
+			break;
+		} case CommandType::drawIndirect: {
+			auto& draw = static_cast<const DrawIndirectCmd&>(cmd);
+			addPtr(draw.buffer);
+			add(draw.offset);
+			add(draw.drawCount);
+			add(draw.stride);
+			add(draw.indexed);
+			break;
+		} case CommandType::drawIndirectCount: {
+			auto& draw = static_cast<const DrawIndirectCountCmd&>(cmd);
+			addPtr(draw.buffer);
+			add(draw.offset);
+			add(draw.maxDrawCount);
+			add(draw.stride);
+			addPtr(draw.countBuffer);
+			add(draw.countBufferOffset);
+			add(draw.indexed);
+			break;
+		} case CommandType::drawMulti: {
+			auto& draw = static_cast<const DrawMultiCmd&>(cmd);
+			addSpan(draw.vertexInfos);
+			add(draw.instanceCount);
+			add(draw.firstInstance);
+			break;
+		} case CommandType::drawMultiIndexed: {
+			auto& draw = static_cast<const DrawMultiIndexedCmd&>(cmd);
+			addSpan(draw.indexInfos);
+			add(draw.instanceCount);
+			add(draw.firstInstance);
+			add(draw.vertexOffset.has_value());
+			add(u32(draw.vertexOffset.value_or(0)));
+			break;
+		} case CommandType::dispatch: {
+			auto& dispatch = static_cast<const DispatchCmd&>(cmd);
+			add(dispatch.groupsX);
+			add(dispatch.groupsY);
+			add(dispatch.groupsZ);
+			break;
+		} case CommandType::dispatchIndirect: {
+			auto& dispatch = static_cast<const DispatchIndirectCmd&>(cmd);
+			addPtr(dispatch.buffer);
+			add(dispatch.offset);
+			break;
+		} case CommandType::dispatchBase: {
+			auto& dispatch = static_cast<const DispatchBaseCmd&>(cmd);
+			add(dispatch.baseGroupX);
+			add(dispatch.baseGroupY);
+			add(dispatch.baseGroupZ);
+			add(dispatch.groupsX);
+			add(dispatch.groupsY);
+			add(dispatch.groupsZ);
+			break;
+		} case CommandType::bindVertexBuffers: {
+			auto& bind = static_cast<const BindVertexBuffersCmd&>(cmd);
+			add(bind.firstBinding);
+			add(bind.buffers.size());
+			for(auto& buf : bind.buffers) {
+				addPtr(buf.buffer);
+				add(buf.offset);
+				add(buf.size);
+				add(buf.stride);
+			}
+			break;
+		} case CommandType::bindIndexBuffer: {
+			auto& bind = static_cast<const BindIndexBufferCmd&>(cmd);
+			addPtr(bind.buffer);
+			add(bind.offset);
+			add(bind.indexType);
+			break;
+		} case CommandType::bindDescriptorSet: {
+			auto& bds = static_cast<const BindDescriptorSetCmd&>(cmd);
+			addPtr(bds.pipeLayout);
+			add(bds.pipeBindPoint);
+			add(bds.firstSet);
+			add(bds.sets.size());
+			for(auto* ds : bds.sets) {
+				// The sets are allocated from the pool's memory, the record
+				// keeps the pool alive. So reading the id is safe even if
+				// the set was freed.
+				addPtr(ds);
+				add(ds ? ds->id : 0u);
+			}
+			addSpan(bds.dynamicOffsets);
+			break;
+		} case CommandType::bindPipeline: {
+			auto& bind = static_cast<const BindPipelineCmd&>(cmd);
+			add(bind.bindPoint);
+			addPtr(bind.pipe);
+			break;
+		} case CommandType::pushConstants: {
+			auto& pcs = static_cast<const PushConstantsCmd&>(cmd);
+			addPtr(pcs.pipeLayout);
+			add(pcs.stages);
+			add(pcs.offset);
+			addSpan(pcs.values);
+			break;
+		} case CommandType::setViewport: {
+			auto& set = static_cast<const SetViewportCmd&>(cmd);
+			add(set.first);
+			addSpan(set.viewports);
+			break;
+		} case CommandType::setScissor: {
+			auto& set = static_cast<const SetScissorCmd&>(cmd);
+			add(set.first);
+			addSpan(set.scissors);
+			break;
+		} case CommandType::setLineWidth: {
+			auto& set = static_cast<const SetLineWidthCmd&>(cmd);
+			addBytes(&set.width, sizeof(set.width));
+			break;
+		} case CommandType::setDepthBias: {
+			auto& set = static_cast<const SetDepthBiasCmd&>(cmd);
+			addBytes(&set.state, sizeof(set.state));
+			break;
+		} case CommandType::setDepthBounds: {
+			auto& set = static_cast<const SetDepthBoundsCmd&>(cmd);
+			addBytes(&set.min, sizeof(set.min));
+			addBytes(&set.max, sizeof(set.max));
+			break;
+		} case CommandType::setBlendConstants: {
+			auto& set = static_cast<const SetBlendConstantsCmd&>(cmd);
+			addBytes(set.values.data(), sizeof(set.values));
+			break;
+		} case CommandType::setStencilCompareMask: {
+			auto& set = static_cast<const SetStencilCompareMaskCmd&>(cmd);
+			add(set.faceMask);
+			add(set.value);
+			break;
+		} case CommandType::setStencilWriteMask: {
+			auto& set = static_cast<const SetStencilWriteMaskCmd&>(cmd);
+			add(set.faceMask);
+			add(set.value);
+			break;
+		} case CommandType::setStencilReference: {
+			auto& set = static_cast<const SetStencilReferenceCmd&>(cmd);
+			add(set.faceMask);
+			add(set.value);
+			break;
+		} case CommandType::beginDebugUtilsLabel: {
+			auto& label = static_cast<const BeginDebugUtilsLabelCmd&>(cmd);
+			addStr(label.name);
+			addBytes(label.color.data(), sizeof(label.color));
+			break;
+		} case CommandType::insertDebugUtilsLabel: {
+			auto& label = static_cast<const InsertDebugUtilsLabelCmd&>(cmd);
+			addStr(label.name);
+			addBytes(label.color.data(), sizeof(label.color));
+			break;
+		} case CommandType::copyBuffer: {
+			auto& copy = static_cast<const CopyBufferCmd&>(cmd);
+			addPtr(copy.src);
+			addPtr(copy.dst);
+			addSpan(copy.regions);
+			addPtr(copy.pNext);
+			break;
+		} case CommandType::copyImage: {
+			auto& copy = static_cast<const CopyImageCmd&>(cmd);
+			addPtr(copy.src);
+			addPtr(copy.dst);
+			add(copy.srcLayout);
+			add(copy.dstLayout);
+			addSpan(copy.copies);
+			addPtr(copy.pNext);
+			break;
+		} case CommandType::copyBufferToImage: {
+			auto& copy = static_cast<const CopyBufferToImageCmd&>(cmd);
+			addPtr(copy.src);
+			addPtr(copy.dst);
+			add(copy.dstLayout);
+			addSpan(copy.copies);
+			addPtr(copy.pNext);
+			break;
+		} case CommandType::copyImageToBuffer: {
+			auto& copy = static_cast<const CopyImageToBufferCmd&>(cmd);
+			addPtr(copy.src);
+			addPtr(copy.dst);
+			add(copy.srcLayout);
+			addSpan(copy.copies);
+			addPtr(copy.pNext);
+			break;
+		} case CommandType::blitImage: {
+			auto& blit = static_cast<const BlitImageCmd&>(cmd);
+			addPtr(blit.src);
+			addPtr(blit.dst);
+			add(blit.srcLayout);
+			add(blit.dstLayout);
+			add(blit.filter);
+			addSpan(blit.blits);
+			addPtr(blit.pNext);
+			break;
+		} case CommandType::updateBuffer: {
+			auto& update = static_cast<const UpdateBufferCmd&>(cmd);
+			addPtr(update.dst);
+			add(update.offset);
+			addSpan(update.data);
+			break;
+		} case CommandType::fillBuffer: {
+			auto& fill = static_cast<const FillBufferCmd&>(cmd);
+			addPtr(fill.dst);
+			add(fill.offset);
+			add(fill.size);
+			add(fill.data);
+			break;
+		} case CommandType::clearColorImage: {
+			auto& clear = static_cast<const ClearColorImageCmd&>(cmd);
+			addPtr(clear.dst);
+			add(clear.dstLayout);
+			addBytes(&clear.color, sizeof(clear.color));
+			addSpan(clear.ranges);
+			break;
+		} case CommandType::clearDepthStencilImage: {
+			auto& clear = static_cast<const ClearDepthStencilImageCmd&>(cmd);
+			addPtr(clear.dst);
+			add(clear.dstLayout);
+			addBytes(&clear.value, sizeof(clear.value));
+			addSpan(clear.ranges);
+			break;
+		} case CommandType::clearAttachment: {
+			auto& clear = static_cast<const ClearAttachmentCmd&>(cmd);
+			addSpan(clear.attachments);
+			addSpan(clear.rects);
+			break;
+		} default:
+			// Not supported (yet). Secondary records, for instance,
+			// would need their handles to be kept alive as well.
+			return 0u;
+	}
+
+	for(auto* child = cmd.children(); child; child = child->next) {
+		auto childHash = recordingHash(*child);
+		if(!childHash) {
+			return 0u;
+		}
+
+		add(childHash);
+	}
+
+	return ret;
+}
+
 std::string formatQueueFam(u32 fam) {
 	if(fam == VK_QUEUE_FAMILY_IGNORED) {
 		return "ignored";
@@ -594,21 +986,21 @@ void DrawCmdBase::displayGrahpicsState(Gui& gui, bool indices) const {
 	}
 
 	// dynamic state
-	if(state->pipe && !state->pipe->dynamicState.empty()) {
+	if(state->pipe && state->dynamic && !state->pipe->dynamicState.empty()) {
 		imGuiText("DynamicState");
 		ImGui::Indent();
 
 		// viewport
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_VIEWPORT)) {
 			auto count = state->pipe->viewportState.viewportCount;
-			dlg_assert(state->dynamic.viewports.size() >= count);
+			dlg_assert(state->dynamic->viewports.size() >= count);
 			if(count == 1) {
-				auto& vp = state->dynamic.viewports[0];
+				auto& vp = state->dynamic->viewports[0];
 				imGuiText("Viewport: pos ({}, {}), size ({}, {}), depth [{}, {}]",
 					vp.x, vp.y, vp.width, vp.height, vp.minDepth, vp.maxDepth);
 			} else if(count > 1) {
 				imGuiText("Viewports");
-				for(auto& vp : state->dynamic.viewports.first(count)) {
+				for(auto& vp : state->dynamic->viewports.first(count)) {
 					ImGui::Bullet();
 					imGuiText("pos ({}, {}), size ({}, {}), depth [{}, {}]",
 						vp.x, vp.y, vp.width, vp.height, vp.minDepth, vp.maxDepth);
@@ -618,14 +1010,14 @@ void DrawCmdBase::displayGrahpicsState(Gui& gui, bool indices) const {
 		// scissor
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_SCISSOR)) {
 			auto count = state->pipe->viewportState.scissorCount;
-			dlg_assert(state->dynamic.scissors.size() >= count);
+			dlg_assert(state->dynamic->scissors.size() >= count);
 			if(count == 1) {
-				auto& sc = state->dynamic.scissors[0];
+				auto& sc = state->dynamic->scissors[0];
 				imGuiText("Scissor: offset ({}, {}), extent ({} {})",
 					sc.offset.x, sc.offset.y, sc.extent.width, sc.extent.height);
 			} else if(count > 1) {
 				imGuiText("Scissors");
-				for(auto& sc : state->dynamic.scissors.first(count)) {
+				for(auto& sc : state->dynamic->scissors.first(count)) {
 					ImGui::Bullet();
 					imGuiText("offset ({} {}), extent ({} {})",
 						sc.offset.x, sc.offset.y, sc.extent.width, sc.extent.height);
@@ -635,45 +1027,45 @@ void DrawCmdBase::displayGrahpicsState(Gui& gui, bool indices) const {
 
 		// line width
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_LINE_WIDTH)) {
-			imGuiText("Line width: {}", state->dynamic.lineWidth);
+			imGuiText("Line width: {}", state->dynamic->lineWidth);
 		}
 
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_DEPTH_BIAS)) {
-			auto& db = state->dynamic.depthBias;
+			auto& db = state->dynamic->depthBias;
 			imGuiText("Depth bias: constant {}, clamp {}, slope {}",
 				db.constant, db.clamp, db.slope);
 		}
 
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_BLEND_CONSTANTS)) {
-			auto& bc = state->dynamic.blendConstants;
+			auto& bc = state->dynamic->blendConstants;
 			imGuiText("Blend Constants: {} {} {} {}",
 				bc[0], bc[1], bc[2], bc[3]);
 		}
 
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_DEPTH_BOUNDS)) {
 			imGuiText("Depth bounds: [{}, {}]",
-				state->dynamic.depthBoundsMin, state->dynamic.depthBoundsMax);
+				state->dynamic->depthBoundsMin, state->dynamic->depthBoundsMax);
 		}
 
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_STENCIL_COMPARE_MASK)) {
 			imGuiText("Stencil compare mask front: {}{}", std::hex,
-				state->dynamic.stencilFront.compareMask);
+				state->dynamic->stencilFront.compareMask);
 			imGuiText("Stencil compare mask back: {}{}", std::hex,
-				state->dynamic.stencilBack.compareMask);
+				state->dynamic->stencilBack.compareMask);
 		}
 
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_STENCIL_WRITE_MASK)) {
 			imGuiText("Stencil write mask front: {}{}", std::hex,
-				state->dynamic.stencilFront.writeMask);
+				state->dynamic->stencilFront.writeMask);
 			imGuiText("Stencil write mask back: {}{}", std::hex,
-				state->dynamic.stencilBack.writeMask);
+				state->dynamic->stencilBack.writeMask);
 		}
 
 		if(state->pipe->dynamicState.count(VK_DYNAMIC_STATE_STENCIL_REFERENCE)) {
 			imGuiText("Stencil reference front: {}{}", std::hex,
-				state->dynamic.stencilFront.reference);
+				state->dynamic->stencilFront.reference);
 			imGuiText("Stencil reference back: {}{}", std::hex,
-				state->dynamic.stencilBack.reference);
+				state->dynamic->stencilBack.reference);
 		}
 
 		ImGui::Unindent();
@@ -1604,7 +1996,7 @@ void ExecuteCommandsCmd::displayInspector(Gui& gui) const {
 			// We can convert raw pointer into IntrusivePtr here since
 			// we know that it's still alive; it's kept alive by our
 			// parent CommandRecord (secondaries)
-			gui.cbGui().select(IntrusivePtr<CommandRecord>(echild->record_));
+			gui.cbGui().select(CommandRecordPtr(echild->record_));
 			gui.activateTab(Gui::Tab::commandBuffer);
 		}
 
@@ -2112,6 +2504,26 @@ void SetColorWriteEnableCmd::record(const Device& dev, VkCommandBuffer cb, u32)
 		u32(writeEnables.size()), writeEnables.data());
 }
 
+void BindDescriptorBuffersCmd::record(const Device& dev, VkCommandBuffer cb, u32) const {
+	dlg_assert(dev.dispatch.CmdBindDescriptorBuffersEXT);
+	dev.dispatch.CmdBindDescriptorBuffersEXT(cb, u32(buffers.size()), buffers.data());
+}
+
+void SetDescriptorBufferOffsetsCmd::record(const Device& dev, VkCommandBuffer cb, u32) const {
+	dlg_assert(dev.dispatch.CmdSetDescriptorBufferOffsetsEXT);
+	dlg_assert(bufferIndices.size() == offsets.size());
+	dev.dispatch.CmdSetDescriptorBufferOffsetsEXT(cb, pipeBindPoint,
+		pipeLayout->handle, firstSet, u32(offsets.size()),
+		bufferIndices.data(), offsets.data());
+}
+
+void BindDescriptorBufferEmbeddedSamplersCmd::record(const Device& dev,
+		VkCommandBuffer cb, u32) const {
+	dlg_assert(dev.dispatch.CmdBindDescriptorBufferEmbeddedSamplersEXT);
+	dev.dispatch.CmdBindDescriptorBufferEmbeddedSamplersEXT(cb, pipeBindPoint,
+		pipeLayout->handle, set);
+}
+
 bool isIndirect(const Command& cmd) {
 	return
 		cmd.type() == CommandType::drawIndirect ||
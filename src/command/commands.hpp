@@ -141,6 +141,9 @@ enum class CommandType : u32 {
 	endRendering,
 	setVertexInput,
 	setColorWriteEnable,
+	bindDescriptorBuffers,
+	setDescriptorBufferOffsets,
+	bindDescriptorBufferEmbeddedSamplers,
 
 	count,
 };
@@ -209,7 +212,8 @@ struct Command {
 	Command* next {};
 
 #ifdef VIL_COMMAND_CALLSTACKS
-	span<void*> stacktrace {};
+	// The stack this command was recorded from, see Device::stackTable.
+	StackID stackID {};
 #endif // VIL_COMMAND_CALLSTACKS
 };
 
@@ -263,6 +267,15 @@ struct ParentCommand : Command {
 		};
 		BoundPipeNode* boundPipelines {};
 		u32 numPipeBinds {};
+
+		// Structural hash over all direct children, including the
+		// fingerprints of child sections, see structuralFingerprint.
+		// Built incrementally by RecordBuilder. Only covers the command types
+		// and the parameters that define the structure (pipelines, render
+		// passes, label names, layouts), nothing that usually changes
+		// every frame. Two sections with equal fingerprints can therefore
+		// be assumed to be identical for matching.
+		u64 fingerprint {};
 	};
 
 	void visit(CommandVisitor& v) const override { doVisit(v, *this); }
@@ -279,6 +292,20 @@ struct ParentCommand : Command {
 	ParentCommand* nextParent_ {};
 };
 
+// Returns the structural fingerprint of the given command: its type and
+// structure-defining parameters, combined with the fingerprint of its
+// children for parent commands. See SectionStats::fingerprint.
+u64 structuralFingerprint(const Command&);
+
+// Returns a hash of everything recording the given command (and all its
+// descendants) puts into a command buffer: all parameters and the
+// addresses of the used handles. Descriptor sets are additionally
+// identified by their id since they can be re-allocated at the same
+// address. As long as the handles are kept alive, two commands with the
+// same hash record the same calls.
+// Returns 0 if the command or one of its descendants isn't supported.
+u64 recordingHash(const Command&);
+
 // Base Command class for all commands containing their children, such
 // as BeginRenderPassCmd, BeginDebugUtilsLabelCmd or BeginConditionalRenderingCmd.
 struct SectionCommand : ParentCommand {
@@ -922,7 +949,7 @@ struct ExecuteCommandsCmd final : CmdDerive<ParentCommand, CommandType::executeC
 	void visit(CommandVisitor& v) const override { doVisit(v, *this); }
 	ParentCommand* firstChildParent() const override { return children_; }
 	const SectionStats& sectionStats() const override {
-		// needed only for numChildSections, empty otherwise.
+		// needed only for numChildSections and fingerprint, empty otherwise.
 		return stats_;
 	}
 };
@@ -1571,6 +1598,43 @@ struct SetColorWriteEnableCmd final : CmdDerive<Command, CommandType::setColorWr
 	Category category() const override { return Category::bind; }
 };
 
+// VK_EXT_descriptor_buffer
+struct BindDescriptorBuffersCmd final : CmdDerive<Command, CommandType::bindDescriptorBuffers> {
+	// The buffer handle in a chained
+	// VkDescriptorBufferBindingPushDescriptorBufferHandleEXT is unwrapped.
+	span<VkDescriptorBufferBindingInfoEXT> buffers;
+
+	std::string_view nameDesc() const override { return "BindDescriptorBuffers"; }
+	void record(const Device&, VkCommandBuffer cb, u32) const override;
+	void visit(CommandVisitor& v) const override { doVisit(v, *this); }
+	Category category() const override { return Category::bind; }
+};
+
+struct SetDescriptorBufferOffsetsCmd final : CmdDerive<Command, CommandType::setDescriptorBufferOffsets> {
+	VkPipelineBindPoint pipeBindPoint;
+	PipelineLayout* pipeLayout; // kept alive via shared_ptr in CommandBuffer
+	u32 firstSet;
+	span<u32> bufferIndices;
+	span<VkDeviceSize> offsets;
+
+	std::string_view nameDesc() const override { return "SetDescriptorBufferOffsets"; }
+	void record(const Device&, VkCommandBuffer cb, u32) const override;
+	void visit(CommandVisitor& v) const override { doVisit(v, *this); }
+	Category category() const override { return Category::bind; }
+};
+
+struct BindDescriptorBufferEmbeddedSamplersCmd final :
+		CmdDerive<Command, CommandType::bindDescriptorBufferEmbeddedSamplers> {
+	VkPipelineBindPoint pipeBindPoint;
+	PipelineLayout* pipeLayout; // kept alive via shared_ptr in CommandBuffer
+	u32 set;
+
+	std::string_view nameDesc() const override { return "BindDescriptorBufferEmbeddedSamplers"; }
+	void record(const Device&, VkCommandBuffer cb, u32) const override;
+	void visit(CommandVisitor& v) const override { doVisit(v, *this); }
+	Category category() const override { return Category::bind; }
+};
+
 // Visitor
 // Might seem overkill to have this here but it's useful in multiple
 // scenarios: in many cases we have extensive external functionality operating
@@ -1694,6 +1758,9 @@ struct CommandVisitor {
 	virtual void visit(const SetDiscardRectangleCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
 	virtual void visit(const SetVertexInputCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
 	virtual void visit(const SetColorWriteEnableCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
+	virtual void visit(const BindDescriptorBuffersCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
+	virtual void visit(const SetDescriptorBufferOffsetsCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
+	virtual void visit(const BindDescriptorBufferEmbeddedSamplersCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
 
 	virtual void visit(const CopyAccelStructCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
 	virtual void visit(const CopyAccelStructToMemoryCmd& cmd) { visit(static_cast<const Command&>(cmd)); }
@@ -1822,6 +1889,9 @@ struct TemplateCommandVisitor : CommandVisitor {
 	void visit(const SetDiscardRectangleCmd& cmd) override { f(cmd); }
 	void visit(const SetVertexInputCmd& cmd) override { f(cmd); }
 	void visit(const SetColorWriteEnableCmd& cmd) override { f(cmd); }
+	void visit(const BindDescriptorBuffersCmd& cmd) override { f(cmd); }
+	void visit(const SetDescriptorBufferOffsetsCmd& cmd) override { f(cmd); }
+	void visit(const BindDescriptorBufferEmbeddedSamplersCmd& cmd) override { f(cmd); }
 
 	void visit(const CopyAccelStructCmd& cmd) override { f(cmd); }
 	void visit(const CopyAccelStructToMemoryCmd& cmd) override { f(cmd); }
@@ -774,18 +774,6 @@ MatchVal match(MatchType mt, const DescriptorStateRef& a, const DescriptorStateR
 	return m;
 }
 
-bool same(span<void*> a, span<void*> b, unsigned offset = 1u) {
-	if(a.size() != b.size()) {
-		return false;
-	}
-
-	if(a.size() <= offset) {
-		return true;
-	}
-
-	return std::equal(a.begin() + offset, a.end(), b.begin() + offset);
-}
-
 // Adds the given stats to the given matcher
 void add(MatchVal& m, MatchType mt,
 		const ParentCommand::SectionStats& a,
@@ -818,6 +806,28 @@ void add(MatchVal& m, MatchType mt,
 	}
 }
 
+// Adds the given stats as a perfect match to the given matcher.
+// Used for structurally identical sections, the weights correspond
+// to add(MatchVal&, MatchType, SectionStats, SectionStats) above.
+void addIdentical(MatchVal& m, const ParentCommand::SectionStats& stats) {
+	const auto pipeWeight = 10.f;
+	auto weight = float(stats.numDispatches + stats.numDraws +
+		stats.numRayTraces + stats.numTransfers + stats.numSyncCommands +
+		stats.numTotalCommands) + pipeWeight * stats.numPipeBinds;
+	m.match += weight;
+	m.total += weight;
+}
+
+// Whether the two given commands, including their children, are
+// structurally identical, see SectionStats::fingerprint.
+bool sameStructure(const ParentCommand& a, const ParentCommand& b) {
+	auto& statsA = a.sectionStats();
+	auto& statsB = b.sectionStats();
+	return statsA.numTotalCommands == statsB.numTotalCommands &&
+		statsA.numChildSections == statsB.numChildSections &&
+		structuralFingerprint(a) == structuralFingerprint(b);
+}
+
 float approxTotalWeight(const ParentCommand& cmd) {
 	float ret = 10.f; // wild guess
 	ret += cmd.sectionStats().numPipeBinds * 10.f;
@@ -851,8 +861,7 @@ CommandSectionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 		MatchType mt, const ParentCommand& rootA, const ParentCommand& rootB) {
 	ZoneScoped;
 
-	// TODO: fast patch for &rootA == &rootB
-	// take additional parameter on whether the matches are really needed?
+	// TODO: take additional parameter on whether the matches are really needed?
 	// in some cases they are not, which would make this a lot cheaper.
 
 	CommandSectionMatch ret;
@@ -871,21 +880,51 @@ CommandSectionMatch match(LinAllocScope& retMem, LinAllocScope& localMem,
 	// Really hard-reject if they aren't the same?
 	// Should probably make this an option, there might be
 	// special cases I'm not thinkin of rn.
-	if(!same(rootA.stacktrace, rootB.stacktrace)) {
+	if(rootA.stackID != rootB.stackID) {
 		ret.match = MatchVal::noMatch();
 		return ret;
 	}
 #endif // VIL_COMMAND_CALLSTACKS
 
+	auto numSectionsA = rootA.sectionStats().numChildSections;
+	auto numSectionsB = rootB.sectionStats().numChildSections;
+
+	// Fast path: for structurally identical sections (e.g. the same
+	// record or the same frame recorded again), the child sections
+	// can simply be matched pairwise, no need to run the LMM.
+	if(sameStructure(rootA, rootB)) {
+		addIdentical(ret.match, rootA.sectionStats());
+
+		ret.children = retMem.alloc<CommandSectionMatch>(numSectionsA);
+		auto id = 0u;
+		auto itB = rootB.firstChildParent();
+		for(auto itA = rootA.firstChildParent(); itA; itA = itA->nextParent_) {
+			dlg_assert_or(itB && id < numSectionsA, break);
+
+			LinAllocScope localNext(localMem.tc);
+			auto childMatch = match(retMem, localNext, mt, *itA, *itB);
+			if(noMatch(childMatch.match) || childMatch.match.match <= 0.f) {
+				ret.match.total += approxTotalWeight(*itA);
+				ret.match.total += approxTotalWeight(*itB);
+			} else {
+				ret.children[id] = childMatch;
+				add(ret.match, childMatch.match);
+				++id;
+			}
+
+			itB = itB->nextParent_;
+		}
+
+		ret.children = ret.children.first(id);
+		return ret;
+	}
+
 	// consider sectionStats for rootMatch.
 	auto statsA = rootA.sectionStats();
 	auto statsB = rootB.sectionStats();
 	add(ret.match, mt, statsA, statsB);
 	dlg_assert(valid(ret.match));
 
-	auto numSectionsA = rootA.sectionStats().numChildSections;
-	auto numSectionsB = rootB.sectionStats().numChildSections;
-
 	// no child matching to do
 	// but make sure to account for the "lost" match values here as well
 	if(numSectionsA == 0u || numSectionsB == 0u) {
@@ -1205,7 +1244,7 @@ FindResult find(MatchType mt, const Command& srcParent, const Command& src,
 		// Really hard-reject if they aren't the same?
 		// Should probably make this an option, there might be
 		// special cases I'm not thinkin of rn.
-		if(!same(it->stacktrace, dst[0]->stacktrace)) {
+		if(it->stackID != dst[0]->stackID) {
 			continue;
 		}
 #endif // VIL_COMMAND_CALLSTACKS
@@ -1216,15 +1255,15 @@ FindResult find(MatchType mt, const Command& srcParent, const Command& src,
 		if(dst.size() > 1) {
 			dlg_assert(it->children());
 			auto newThresh = bestMatch / em;
-			auto restResult = find(mt, *it, *it->children(),
-				*dst[0], dst.subspan(1), dstDsState, newThresh);
+			auto& srcSection = static_cast<const ParentCommand&>(*it);
+			auto restResult = find(mt, srcSection, dst, dstDsState, newThresh);
 			if(restResult.hierarchy.empty()) {
 				// no candidate found
 				continue;
 			}
 
-			auto& rest = restResult.hierarchy;
-			currCmds.insert(currCmds.end(), rest.begin(), rest.end());
+			dlg_assert(restResult.hierarchy[0] == it);
+			currCmds = std::move(restResult.hierarchy);
 			childMatch = restResult.match;
 
 			// TODO: replace dynamic_cast with some 'isStateCmd(const Command&)'
@@ -1256,6 +1295,13 @@ FindResult find(MatchType mt, const Command& srcParent, const Command& src,
 			if(!dstBound.empty() || !srcBound.empty()) {
 				// TODO: consider dynamic offsets?
 				for(auto i = 0u; i < std::min(srcBound.size(), dstBound.size()); ++i) {
+					// The src state of sets from descriptor buffers isn't
+					// available anymore, it's only decoded on submission.
+					if(srcBound[i].fromDescriptorBuffer() ||
+							dstBound[i].fromDescriptorBuffer()) {
+						continue;
+					}
+
 					if(!srcBound[i].dsEntry || !dstBound[i].dsEntry) {
 						// TODO: not sure if this can happen. Do sets
 						// that are statically not used by pipeline
@@ -1273,14 +1319,14 @@ FindResult find(MatchType mt, const Command& srcParent, const Command& src,
 						continue;
 					}
 
-					auto dstDsCow = dstDsState.states.find(dstBound[i].dsEntry);
+					auto* dstDsCow = dstDsState.find(dstCmd->boundDescriptors(), i);
 					// TODO: we might not find it here due to the new
 					// descriptor set capturing rework.
-					if(dstDsCow == dstDsState.states.end()) {
+					if(!dstDsCow) {
 						continue;
 					}
 
-					auto [dstDs, dstLock] = access(*dstDsCow->second);
+					auto [dstDs, dstLock] = access(*dstDsCow);
 
 					auto res = vil::match(mt, *srcDs, dstDs);
 					m.match += res.match;
@@ -1331,6 +1377,30 @@ FindResult find(MatchType mt, const Command& srcParent, const Command& src,
 	return {bestCmds, bestMatch};
 }
 
+bool isStateCmd(const Command& cmd) {
+	auto category = cmd.category();
+	return category == CommandCategory::draw ||
+		category == CommandCategory::dispatch ||
+		category == CommandCategory::traceRays;
+}
+
+// Returns the child of 'srcParent' at the same position as 'dst'
+// in 'dstParent', if it has the same type. Expects the parents
+// to be structurally identical.
+const Command* findSamePosition(const ParentCommand& srcParent,
+		const ParentCommand& dstParent, const Command& dst) {
+	auto* src = srcParent.children();
+	for(auto* it = dstParent.children(); it && src; it = it->next) {
+		if(it == &dst) {
+			return src->type() == dst.type() ? src : nullptr;
+		}
+
+		src = src->next;
+	}
+
+	return nullptr;
+}
+
 FindResult find(MatchType mt, const ParentCommand& srcRoot,
 		span<const Command*> dstHierarchyToFind,
 		const CommandDescriptorSnapshot& dstDescriptors, float threshold) {
@@ -1343,11 +1413,49 @@ FindResult find(MatchType mt, const ParentCommand& srcRoot,
 	dlg_assert(dstHierarchyToFind.size() >= 2);
 	dlg_assert(dynamic_cast<const ParentCommand*>(dstHierarchyToFind[0]));
 
-	auto ret = find(mt, srcRoot, *srcRoot.children(),
-		*dstHierarchyToFind[0], dstHierarchyToFind.subspan(1),
+	// Fast path: as long as the sections are structurally identical,
+	// the equivalent command is the one at the same position.
+	// The remaining levels are found via matching below.
+	std::vector<const Command*> hierarchy {&srcRoot};
+	auto level = 1u;
+	for(; level < dstHierarchyToFind.size(); ++level) {
+		auto& srcParent = static_cast<const ParentCommand&>(*hierarchy.back());
+		auto& dstParent = static_cast<const ParentCommand&>(*dstHierarchyToFind[level - 1]);
+		if(!sameStructure(srcParent, dstParent)) {
+			break;
+		}
+
+		// With descriptors given, the final state command might be
+		// selected by its descriptors, can't do that positionally.
+		auto& dst = *dstHierarchyToFind[level];
+		auto last = (level + 1 == dstHierarchyToFind.size());
+		if(last && !dstDescriptors.empty() && isStateCmd(dst)) {
+			break;
+		}
+
+		auto* src = findSamePosition(srcParent, dstParent, dst);
+		if(!src) {
+			break;
+		}
+
+		hierarchy.push_back(src);
+	}
+
+	if(level == dstHierarchyToFind.size()) {
+		return {std::move(hierarchy), 1.f};
+	}
+
+	auto& srcParent = static_cast<const ParentCommand&>(*hierarchy.back());
+	if(!srcParent.children()) {
+		return {};
+	}
+
+	auto ret = find(mt, srcParent, *srcParent.children(),
+		*dstHierarchyToFind[level - 1], dstHierarchyToFind.subspan(level),
 		dstDescriptors, threshold);
 	if(!ret.hierarchy.empty()) {
-		ret.hierarchy.insert(ret.hierarchy.begin(), &srcRoot);
+		ret.hierarchy.insert(ret.hierarchy.begin(),
+			hierarchy.begin(), hierarchy.end());
 	}
 
 	return ret;
@@ -7,6 +7,7 @@
 #include <pipe.hpp>
 #include <cb.hpp>
 #include <ds.hpp>
+#include <descriptorBuffer.hpp>
 #include <util/util.hpp>
 
 // for used handles
@@ -34,8 +35,8 @@ void onRecordFree(const std::byte* buf, u32 size) {
 }
 
 // Record
-CommandRecord::CommandRecord(CommandBuffer& xcb) :
-		CommandRecord(manualTag, xcb.dev) {
+CommandRecord::CommandRecord(CommandBuffer& xcb, std::size_t firstBlockSize) :
+		CommandRecord(manualTag, xcb.dev, firstBlockSize) {
 	cb = &xcb;
 	recordID = xcb.recordCount();
 	queueFamily = xcb.pool().queueFamily;
@@ -45,8 +46,9 @@ CommandRecord::CommandRecord(CommandBuffer& xcb) :
 	}
 }
 
-CommandRecord::CommandRecord(ManualTag, Device* xdev) :
-		alloc(onRecordAlloc, onRecordFree),
+CommandRecord::CommandRecord(ManualTag, Device* xdev, std::size_t firstBlockSize) :
+		alloc(onRecordAlloc, onRecordFree,
+			xdev ? &xdev->recordBlockPool : nullptr, firstBlockSize),
 		dev(xdev),
 		cb(nullptr),
 		recordID(0u),
@@ -59,6 +61,11 @@ CommandRecord::CommandRecord(ManualTag, Device* xdev) :
 	++DebugStats::get().aliveRecords;
 }
 
+void ReclaimDeleter::operator()(CommandRecord* rec) const noexcept {
+	auto* reclaimer = rec->dev ? &rec->dev->reclaimer : nullptr;
+	reclaim(reclaimer, rec->reclaimNode, rec);
+}
+
 CommandRecord::~CommandRecord() {
 	ZoneScoped;
 
@@ -84,10 +91,13 @@ void bind(Device& dev, VkCommandBuffer cb, const ComputeState& state) {
 			state.pipe->handle);
 	}
 
+	if(!state.descriptorBuffers.empty()) {
+		dev.dispatch.CmdBindDescriptorBuffersEXT(cb,
+			u32(state.descriptorBuffers.size()), state.descriptorBuffers.data());
+	}
+
 	for(auto i = 0u; i < state.descriptorSets.size(); ++i) {
 		auto& bds = state.descriptorSets[i];
-		auto [ds, lock] = tryAccess(bds);
-		dlg_assert(ds);
 
 		// NOTE: we only need this since we don't track this during recording
 		// anymore at the moment.
@@ -96,6 +106,20 @@ void bind(Device& dev, VkCommandBuffer cb, const ComputeState& state) {
 			break;
 		}
 
+		if(bds.descriptorBufferIndex == BoundDescriptorSet::embeddedSamplers) {
+			dev.dispatch.CmdBindDescriptorBufferEmbeddedSamplersEXT(cb,
+				VK_PIPELINE_BIND_POINT_COMPUTE, bds.layout->handle, i);
+			continue;
+		} else if(bds.fromDescriptorBuffer()) {
+			dev.dispatch.CmdSetDescriptorBufferOffsetsEXT(cb,
+				VK_PIPELINE_BIND_POINT_COMPUTE, bds.layout->handle, i, 1u,
+				&bds.descriptorBufferIndex, &bds.descriptorBufferOffset);
+			continue;
+		}
+
+		auto [ds, lock] = tryAccess(bds);
+		dlg_assert(ds);
+
 		dlg_assert(ds->layout);
 		dev.dispatch.CmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE,
 			bds.layout->handle, i, 1u, &ds->handle,
@@ -155,39 +179,89 @@ CommandDescriptorSnapshot snapshotRelevantDescriptors(Device& dev, const Command
 	return snapshotRelevantDescriptorsLocked(cmd);
 }
 
-CommandDescriptorSnapshot snapshotRelevantDescriptorsLocked(const Command& cmd) {
-	CommandDescriptorSnapshot ret;
+DescriptorSetCow* CommandDescriptorSnapshot::find(const DescriptorSnapshotKey& key) const {
+	if(!states) {
+		return nullptr;
+	}
+
+	auto it = std::lower_bound(states->begin(), states->end(), key,
+		[](const Entry& entry, const DescriptorSnapshotKey& key) { return entry.key < key; });
+	if(it == states->end() || it->key != key) {
+		return nullptr;
+	}
+
+	return it->cow.get();
+}
+
+DescriptorSetCow* CommandDescriptorSnapshot::find(const DescriptorState& state,
+		u32 set) const {
+	return find(state.snapshotKey(set));
+}
+
+namespace {
 
+// Calls addCow(bds) for every bound descriptor set of the given command
+// that is not yet in the snapshot. addCow may return a null pointer
+// when the set can't be accessed. Sets from descriptor buffers are
+// decoded instead.
+template<typename F>
+void addRelevantDescriptors(CommandDescriptorSnapshot& snap, const Command& cmd,
+		F&& addCow) {
 	// TODO: replace dynamic_cast with some 'isStateCmd(const Command&)'
 	//  check that simply checks for category (draw | dispatch | traceRays)
 	auto* scmd = dynamic_cast<const StateCmdBase*>(&cmd);
 	if(!scmd) {
-		return ret;
+		return;
 	}
 
-	for(auto bds : scmd->boundDescriptors().descriptorSets) {
-		auto [ds, lock] = tryAccess(bds);
-		if(ds) {
-			ret.states.emplace(bds.dsEntry, ds->addCowLocked());
-		}
+	if(!snap.states) {
+		snap.states = std::make_shared<std::vector<CommandDescriptorSnapshot::Entry>>();
 	}
 
-	return ret;
+	auto& states = *snap.states;
+	auto& dsState = scmd->boundDescriptors();
+	for(auto s = 0u; s < dsState.descriptorSets.size(); ++s) {
+		auto& bds = dsState.descriptorSets[s];
+		auto key = dsState.snapshotKey(s);
+		auto it = std::lower_bound(states.begin(), states.end(), key,
+			[](auto& entry, const DescriptorSnapshotKey& key) { return entry.key < key; });
+		if(it != states.end() && it->key == key) {
+			continue;
+		}
+
+		auto cow = bds.fromDescriptorBuffer() ?
+			decodeDescriptorBufferLocked(dsState, bds) :
+			addCow(bds);
+		if(cow) {
+			states.insert(it, {key, std::move(cow)});
+		}
+	}
 }
 
-CommandDescriptorSnapshot snapshotRelevantDescriptorsValidLocked(const Command& cmd) {
+} // anon namespace
+
+CommandDescriptorSnapshot snapshotRelevantDescriptorsLocked(const Command& cmd) {
 	CommandDescriptorSnapshot ret;
-	auto* scmd = dynamic_cast<const StateCmdBase*>(&cmd);
-	if(!scmd) {
-		return ret;
-	}
+	addRelevantDescriptors(ret, cmd, [](const BoundDescriptorSet& bds) {
+		auto [ds, lock] = tryAccess(bds);
+		return ds ? ds->addCowLocked() : IntrusivePtr<DescriptorSetCow> {};
+	});
+
+	return ret;
+}
 
-	for(auto bds : scmd->boundDescriptors().descriptorSets) {
+void addRelevantDescriptorsValidLocked(CommandDescriptorSnapshot& snap,
+		const Command& cmd) {
+	addRelevantDescriptors(snap, cmd, [](const BoundDescriptorSet& bds) {
 		auto& ds = access(bds);
 		std::lock_guard lock(ds.pool->mutex);
-		ret.states.emplace(bds.dsEntry, ds.addCowLocked());
-	}
+		return ds.addCowLocked();
+	});
+}
 
+CommandDescriptorSnapshot snapshotRelevantDescriptorsValidLocked(const Command& cmd) {
+	CommandDescriptorSnapshot ret;
+	addRelevantDescriptorsValidLocked(ret, cmd);
 	return ret;
 }
 
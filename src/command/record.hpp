@@ -3,7 +3,9 @@
 #include <fwd.hpp>
 #include <nytl/span.hpp>
 #include <util/linalloc.hpp>
+#include <util/flatSet.hpp>
 #include <util/intrusive.hpp>
+#include <util/reclaim.hpp>
 #include <util/debugMutex.hpp>
 #include <threadContext.hpp>
 #include <imageLayout.hpp>
@@ -47,20 +49,73 @@ struct BoundDescriptorSet {
 
 	span<u32> dynamicOffsets;
 	PipelineLayout* layout {};
+
+	// Only set for sets bound from descriptor buffers (VK_EXT_descriptor_buffer).
+	// dsEntry and dsPool are null for them. The index refers to
+	// DescriptorState::descriptorBuffers, the offset into that buffer.
+	// The descriptor state is decoded when needed, see descriptorBuffer.hpp.
+	static constexpr auto noDescriptorBuffer = u32(-1);
+	static constexpr auto embeddedSamplers = u32(-2);
+	u32 descriptorBufferIndex {noDescriptorBuffer};
+	VkDeviceSize descriptorBufferOffset {};
+
+	bool fromDescriptorBuffer() const {
+		return descriptorBufferIndex != noDescriptorBuffer;
+	}
+};
+
+// Identifies a descriptor set in a CommandDescriptorSnapshot.
+// For regular sets, ptr is BoundDescriptorSet::dsEntry and address zero.
+// Sets from descriptor buffers have no identity beyond their data, for
+// them ptr is their DescriptorSetLayout and address the resolved address
+// of the set in the descriptor buffer (zero for embedded samplers).
+// Commands binding the same data with the same layout therefore share
+// the decoded state.
+struct DescriptorSnapshotKey {
+	const void* ptr {};
+	VkDeviceAddress address {};
 };
 
+inline bool operator<(const DescriptorSnapshotKey& a, const DescriptorSnapshotKey& b) {
+	return a.ptr < b.ptr || (a.ptr == b.ptr && a.address < b.address);
+}
+
+inline bool operator==(const DescriptorSnapshotKey& a, const DescriptorSnapshotKey& b) {
+	return a.ptr == b.ptr && a.address == b.address;
+}
+
+inline bool operator!=(const DescriptorSnapshotKey& a, const DescriptorSnapshotKey& b) {
+	return !(a == b);
+}
+
 using BufferViewDescriptorRef = BufferView*;
 
 struct DescriptorState {
+	// Might be shared with previous states of the record, see
+	// CommandBuffer::writableDescriptorState.
 	span<BoundDescriptorSet> descriptorSets;
 
 	// TODO: we don't track this correctly atm.
 	// important to do this, also fix in vil::bind(..., state) below then
 	span<std::byte> pushDescriptors;
 
-	// Will always re-allocate the descriptorSets span
+	// The bound descriptor buffers, see BindDescriptorBuffersCmd.
+	span<const VkDescriptorBufferBindingInfoEXT> descriptorBuffers;
+
+	// Expects descriptorSets to be writable and to hold at
+	// least firstSet + sets.size() elements.
 	void bind(CommandBuffer& cb, PipelineLayout& layout, u32 firstSet,
 		span<DescriptorSet* const> sets, span<const u32> offsets);
+	// Same as bind, for sets from descriptor buffers.
+	void bindBufferSets(PipelineLayout& layout, u32 firstSet,
+		span<const u32> bufferIndices, span<const VkDeviceSize> offsets);
+	// Disturbs the bound sets that are not compatible with the given
+	// layout when binding count sets at firstSet with it. Must be called
+	// before the new sets are written.
+	void disturb(const PipelineLayout& layout, u32 firstSet, u32 count);
+
+	// The key of the given bound set in a CommandDescriptorSnapshot.
+	DescriptorSnapshotKey snapshotKey(u32 set) const;
 };
 
 struct BoundVertexBuffer {
@@ -96,34 +151,44 @@ struct RenderPassInstanceState {
 	// NOTE: add preserve attachments? resolve attachments?
 };
 
+struct StencilState {
+	u32 writeMask {};
+	u32 compareMask {};
+	u32 reference {};
+};
+
+struct GraphicsDynamicState {
+	span<VkViewport> viewports;
+	span<VkRect2D> scissors;
+	float lineWidth {};
+	DynamicStateDepthBias depthBias {};
+	std::array<float, 4> blendConstants {};
+	float depthBoundsMin {};
+	float depthBoundsMax {};
+
+	StencilState stencilFront {};
+	StencilState stencilBack {};
+};
+
+// The states are built copy-on-write while recording: a state (and each
+// chunk it references, i.e. descriptorSets, vertices, dynamic and the
+// viewports/scissors in there) is immutable as soon as a command captured it.
+// Changing the state afterwards only copies the state itself and the
+// chunk that is actually changed, the others are shared.
+// See CommandBuffer::writableGraphicsState.
 struct GraphicsState : DescriptorState {
 	BoundIndexBuffer indices {};
 	span<BoundVertexBuffer> vertices;
 	GraphicsPipeline* pipe {};
 
+	// Always valid for states built while recording. Might be null
+	// for states loaded from a serialized record.
+	GraphicsDynamicState* dynamic {};
+
 	// NOTE: knowing this here would be convenient in a couple of places
 	// but we can't do to secondary commandbuffers not being required to
 	// specify the framaebuffer they are rendering into on recording time.
 	// const RenderPassInstanceState* rpi {};
-
-	struct StencilState {
-		u32 writeMask {};
-		u32 compareMask {};
-		u32 reference {};
-	};
-
-	struct {
-		span<VkViewport> viewports;
-		span<VkRect2D> scissors;
-		float lineWidth;
-		DynamicStateDepthBias depthBias;
-		std::array<float, 4> blendConstants;
-		float depthBoundsMin;
-		float depthBoundsMax;
-
-		StencilState stencilFront;
-		StencilState stencilBack;
-	} dynamic {};
 };
 
 struct ComputeState : DescriptorState {
@@ -134,6 +199,18 @@ struct RayTracingState : DescriptorState {
 	RayTracingPipeline* pipe;
 };
 
+// Parts of the bound state that are tracked separately for
+// copy-on-write while recording, see CommandBuffer::writableGraphicsState.
+enum StateChunkBits : u32 {
+	stateChunkState = (1u << 0u),
+	stateChunkDescriptorSets = (1u << 1u),
+	stateChunkVertexBuffers = (1u << 2u),
+	stateChunkDynamic = (1u << 3u),
+	stateChunkViewports = (1u << 4u),
+	stateChunkScissors = (1u << 5u),
+	stateChunkAll = 0xFFFFFFFFu,
+};
+
 // XXX: these must only be called while we can statically know that the record
 // associated with the given state is still valid. Otherwise its references
 // might be dangling or null (if unset).
@@ -141,8 +218,24 @@ void bind(Device&, VkCommandBuffer, const ComputeState&);
 
 // Represents a mapping of descriptor set pointers, as present
 // in Command(Record), to their respective states at submission time.
+// Copies share the same data. During submission, the snapshot is shared
+// by everything hooking that submission, see CommandSubmission::descriptors.
+// Entries are only ever added, never changed, so a set appears in a shared
+// snapshot at most once and with a single state.
 struct CommandDescriptorSnapshot {
-	std::unordered_map<void*, IntrusivePtr<DescriptorSetCow>> states;
+	struct Entry {
+		DescriptorSnapshotKey key {}; // DescriptorState::snapshotKey
+		IntrusivePtr<DescriptorSetCow> cow;
+	};
+
+	// Sorted by key.
+	std::shared_ptr<std::vector<Entry>> states;
+
+	// Returns the state of the given bound descriptor set or nullptr if
+	// it's not in the snapshot.
+	DescriptorSetCow* find(const DescriptorState&, u32 set) const;
+	DescriptorSetCow* find(const DescriptorSnapshotKey&) const;
+	bool empty() const { return !states || states->empty(); }
 };
 
 // Since command buffer recording can be a bottleneck, we use our
@@ -161,15 +254,9 @@ template<typename K, typename V,
 		typename Equal = std::equal_to<K>> using CommandAllocHashMap =
 	std::unordered_map<K, V, Hash, Equal,
 		LinearUnscopedAllocator<std::pair<const K, V>>>;
-template<typename K,
-		typename Hash = std::hash<K>,
-		typename Equal = std::equal_to<K>> using CommandAllocHashSet =
-	std::unordered_set<K, Hash, Equal,
-		LinearUnscopedAllocator<K>>;
 constexpr struct ManualTag {} manualTag;
 
 // NOTE: we don't need RefHandle.commands atm, so we comment it out.
-// Until we use C++20 transparent lookup, it's a major performance impact (see useHandleImpl in cb.cpp)
 
 // Links a 'DeviceHandle' to a 'CommandRecord'.
 template<typename T>
@@ -213,53 +300,28 @@ inline bool operator!=(const UsedDescriptorSet& a, const UsedDescriptorSet& b) {
 	return a.ds != b.ds;
 }
 
-struct RefHandleHash {
+struct RefHandleKey {
 	template<typename T>
-	size_t operator()(const RefHandle<T>& x) const {
-		auto ptr = x.handle.get();
-		return std::hash<std::remove_reference_t<decltype(ptr)>>{}(ptr);
+	const void* operator()(const RefHandle<T>& x) const {
+		return x.handle.get();
 	}
 };
 
-struct UsedDescriptorHash {
-	size_t operator()(const UsedDescriptorSet& x) const {
-		return std::hash<void*>{}(x.ds);
+struct UsedDescriptorKey {
+	const void* operator()(const UsedDescriptorSet& x) const {
+		return x.ds;
 	}
 };
 
+// The sets are keyed on the raw handle pointer, see FlatPtrSet.
 template<typename T>
-using UsedHandleSet = CommandAllocHashSet<RefHandle<T>, RefHandleHash>;
-
-template<typename K>
-auto find(UsedHandleSet<K>& used, K& elem) {
-	// TODO: better, transparent find with c++20
-	RefHandle<K> rh(ThreadContext::instance.linalloc_);
-	rh.handle = IntrusivePtr<K>(acquireOwnership, &elem);
-	auto it = used.find(rh);
-	(void) rh.handle.release();
-	return it;
-}
+using UsedHandleSet = FlatPtrSet<RefHandle<T>, RefHandleKey>;
+using UsedImageSet = FlatPtrSet<UsedImage, RefHandleKey>;
+using UsedDescriptorSetSet = FlatPtrSet<UsedDescriptorSet, UsedDescriptorKey>;
 
-// TODO: kinda hacky, only a template so we don't have to include stuff
-template<typename Image>
-auto find(CommandAllocHashSet<UsedImage, RefHandleHash>& used, Image& elem) {
-	// TODO: better, transparent find with c++20
-	UsedImage rh(ThreadContext::instance.linalloc_);
-	rh.handle = IntrusivePtr<Image>(acquireOwnership, &elem);
-	auto it = used.find(rh);
-	(void) rh.handle.release();
-	return it;
-}
-
-// TODO: kinda hacky, only a template so we don't have to include stuff
-template<typename DescriptorSet>
-inline auto find(CommandAllocHashSet<UsedDescriptorSet, UsedDescriptorHash>& used,
-		DescriptorSet& ds) {
-	// TODO: better, transparent find with c++20
-	UsedDescriptorSet rh(ThreadContext::instance.linalloc_);
-	rh.ds = &ds;
-	auto it = used.find(rh);
-	return it;
+template<typename T, typename KeyOf, typename H>
+auto find(FlatPtrSet<T, KeyOf>& used, H& handle) {
+	return used.find(static_cast<const void*>(&handle));
 }
 
 struct AccelStructCopy {
@@ -271,6 +333,11 @@ struct AccelStructCopy {
 // We represent it as extra, reference-counted object so we can display
 // old records as well.
 struct CommandRecord {
+	// The size of the first memory block of records without any
+	// size estimate. Kept small so that small records (e.g. secondary
+	// or transfer command buffers) don't pin large blocks.
+	static constexpr auto defaultFirstBlockSize = std::size_t(16u * 1024);
+
 	LinAllocator alloc;
 	Device* dev {};
 
@@ -297,6 +364,10 @@ struct CommandRecord {
 	// Labels allow nesting in ways that mess with a strict hierarchy view.
 	// Will display such records differently by default.
 	bool brokenHierarchyLabels {};
+	// Whether the record was recorded in pass-through mode, see
+	// docs/own/lazyTracking.md. Such records only contain a subset of
+	// the recorded commands (and used handles) and can't be hooked.
+	bool untracked {};
 	// The usageFlags passed to BeginCommandBuffer
 	VkCommandBufferUsageFlags usageFlags {};
 
@@ -334,8 +405,8 @@ struct CommandRecord {
 		UsedHandleSet<Event> events;
 		UsedHandleSet<DescriptorPool> dsPools;
 
-		CommandAllocHashSet<UsedDescriptorSet, UsedDescriptorHash> descriptorSets;
-		CommandAllocHashSet<UsedImage, RefHandleHash> images;
+		UsedDescriptorSetSet descriptorSets;
+		UsedImageSet images;
 
 		UsedHandles(LinAllocator& alloc);
 	} used;
@@ -343,7 +414,7 @@ struct CommandRecord {
 	// We have to keep the secondary records (via cmdExecuteCommands) alive
 	// since the command buffers can be reused by the application and
 	// we only reference the CommandRecord objects, don't copy them.
-	CommandAllocList<IntrusivePtr<CommandRecord>> secondaries;
+	CommandAllocList<CommandRecordPtr> secondaries;
 
 	// Ownership of this CommandRecord is shared: while generally it is
 	// not needed anymore as soon as the associated CommandBuffer is
@@ -352,12 +423,18 @@ struct CommandRecord {
 	// gui. We can't just transfer ownership in these cases in general
 	// though since it may still be in use by command buffer.
 	std::atomic<u32> refCount {0};
+	// Used to defer the destruction to the device's reclaim thread
+	// when the last reference is dropped, see ReclaimDeleter.
+	ReclaimNode reclaimNode {};
 
 	// For CommandHook: can store hooked versions of this record here.
 	std::vector<FinishPtr<CommandHookRecord>> hookRecords;
 
-	CommandRecord(CommandBuffer& cb);
-	explicit CommandRecord(ManualTag, Device* dev); // mainly for testing
+	// The first memory block of the record will have the given size.
+	// See CommandBuffer::recordMemHint.
+	CommandRecord(CommandBuffer& cb, std::size_t firstBlockSize);
+	explicit CommandRecord(ManualTag, Device* dev, // mainly for testing
+		std::size_t firstBlockSize = defaultFirstBlockSize);
 	~CommandRecord();
 
 	CommandRecord(CommandRecord&&) noexcept = delete;
@@ -387,6 +464,11 @@ CommandDescriptorSnapshot snapshotRelevantDescriptorsLocked(const Command&);
 // Like snapshotRelevantDescriptors but for when the caller can guarantee
 // that the descriptor sets are still valid. Faster.
 CommandDescriptorSnapshot snapshotRelevantDescriptorsValidLocked(const Command&);
+// Adds the descriptors relevant to the given command to an existing
+// snapshot. Sets already in the snapshot keep their state, no new
+// cow is created for them. Requires the device mutex to be locked and
+// the descriptor sets to be valid, see snapshotRelevantDescriptorsValidLocked.
+void addRelevantDescriptorsValidLocked(CommandDescriptorSnapshot&, const Command&);
 
 // Tries to find 'dst' in 'rec' and returns it full hierachy.
 // Returns empty vector if it can't be found.
@@ -563,7 +563,10 @@ void initAndSampleCopy(Device& dev, VkCommandBuffer cb,
 		dai.descriptorSetCount = 1u;
 		dai.pSetLayouts = &hook.sampleImageDsLayout_;
 		dai.descriptorPool = dev.dsPool;
-		VK_CHECK_DEV(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, &ds), dev);
+		{
+			std::lock_guard lock(dev.dsPoolMutex);
+			VK_CHECK_DEV(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, &ds), dev);
+		}
 
 		VkDescriptorImageInfo imgInfo {};
 		imgInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
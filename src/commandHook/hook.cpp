@@ -100,9 +100,11 @@ void invalidate(CommandHookRecord& rec) {
 // CommandHook
 CommandHook::CommandHook(Device& dev) {
 	dev_ = &dev;
+	setLockRank(mutex, LockRank::hook);
 	hookAccelStructBuilds = checkEnvBinary("VIL_CAPTURE_ACCEL_STRUCTS", true);
 	initImageCopyPipes(dev);
 	if(hasAppExt(dev, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME)) {
+		accelStructs_ = true;
 		initAccelStructCopy(dev);
 	}
 }
@@ -318,6 +320,12 @@ bool CommandHook::copiedDescriptorChanged(const CommandHookRecord& record) {
 	for(auto i = 0u; i < ops_.descriptorCopies.size(); ++i) {
 		auto [setID, bindingID, elemID, _1, _2] = ops_.descriptorCopies[i];
 
+		// The content of descriptor buffers may change anytime without
+		// us noticing, always assume it did.
+		if(dsState.descriptorSets[setID].fromDescriptorBuffer()) {
+			return true;
+		}
+
 		// We can safely access the ds here since we know that the record
 		// is still valid
 		auto& currDs = access(dsState.descriptorSets[setID]);
@@ -345,7 +353,6 @@ bool CommandHook::copiedDescriptorChanged(const CommandHookRecord& record) {
 
 void CommandHook::hook(QueueSubmitter& subm) {
 	auto& dev = *dev_;
-	keepAliveLC_.clear();
 
 	// sparse bindings can't be hooked
 	dlg_assert(subm.dstBatch->type == SubmissionType::command);
@@ -355,10 +362,13 @@ void CommandHook::hook(QueueSubmitter& subm) {
 	// retrieved & cleared by gui for whatever reason).
 	{
 		// We can't delete CompletedHook objects while holding
-		// device mutex since their destruction might trigger
-		// a CommandRecord destruction
+		// a mutex since their destruction might trigger
+		// a CommandRecord destruction, locking the device mutex.
 		std::vector<CompletedHook> keepAlive;
-		std::lock_guard lock(dev.mutex);
+		std::lock_guard lock(mutex);
+		keepAlive = std::move(keepAliveLC_);
+		keepAliveLC_.clear();
+
 		if(completed_.size() > maxCompletedHooks) {
 			auto upTo = completed_.size() - maxCompletedHooks;
 			for(auto i = 0u; i < upTo; ++i) {
@@ -369,12 +379,38 @@ void CommandHook::hook(QueueSubmitter& subm) {
 		}
 	}
 
-	// we put all of this in a critical section to protect against changes
+	// we put the matching in a critical section to protect against changes
 	// of target_ and ops_ and the list of hooked records.
-	// TODO: might be possible to just use internal mutex, try it.
-	// Would help performance, the hooked recording is in the critical
-	// section here as well and quite expensive.
-	std::lock_guard lock(dev.mutex);
+	{
+		std::lock_guard lock(dev.mutex);
+		std::lock_guard hookLock(mutex);
+		hookLocked(subm);
+	}
+
+	// Recording the hooked command buffers is expensive, we don't want
+	// to block the device mutex for it. The new hook records are only
+	// referenced by this submission until it is submitted.
+	std::vector<CommandHookRecord*> recorded;
+	for(auto& sub : subm.dstBatch->submissions) {
+		auto& cmdSub = std::get<CommandSubmission>(sub.data);
+		for(auto& cb : cmdSub.cbs) {
+			if(cb.hook && cb.hook->record->needsRecording()) {
+				cb.hook->record->recordCb(cb.hook->descriptorSnapshot);
+				recorded.push_back(cb.hook->record);
+			}
+		}
+	}
+
+	if(!recorded.empty()) {
+		std::lock_guard lock(dev.mutex);
+		for(auto* rec : recorded) {
+			rec->destroyUnused();
+		}
+	}
+}
+
+void CommandHook::hookLocked(QueueSubmitter& subm) {
+	assertOwned(dev_->mutex);
 
 	// fast early-outs
 	if(localCaptures_.empty() && !forceHook.load()) {
@@ -469,6 +505,11 @@ void CommandHook::hook(QueueSubmitter& subm) {
 		for(auto [cbID, cb] : enumerate(cmdSub.cbs)) {
 			auto& rec = *cb.cb->lastRecordLocked();
 
+			// We can't re-record untracked records, they are missing commands.
+			if(rec.untracked) {
+				continue;
+			}
+
 			VkCommandBuffer hooked = VK_NULL_HANDLE;
 			std::unique_ptr<CommandHookSubmission> hookData;
 
@@ -851,9 +892,14 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 			return {};
 		}
 
-		// we know for sure that all descriptorSets of the to-be-hooked
+		// All hooks of this submission share the snapshot, so each
+		// descriptor set is captured just once per submission, no matter
+		// how many local captures or targets hook it.
+		// We know for sure that all descriptorSets of the to-be-hooked
 		// command must still be valid.
-		return snapshotRelevantDescriptorsValidLocked(cmd);
+		auto& cmdSub = std::get<CommandSubmission>(subm.data);
+		addRelevantDescriptorsValidLocked(cmdSub.descriptors, cmd);
+		return cmdSub.descriptors;
 	};
 
 	if(foundHookRecord) {
@@ -893,11 +939,16 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 		}
 
 		auto hook = new CommandHookRecord(*this, record,
-			{dstCommand.begin(), dstCommand.end()},
-			descriptors, *ops, localCapture);
+			{dstCommand.begin(), dstCommand.end()}, *ops, localCapture);
 		hook->match = dstCommandMatch;
 		record.hookRecords.push_back(FinishPtr<CommandHookRecord>(hook));
 
+		// Otherwise recorded in hook, after leaving the critical section
+		if(hook->needsRecordingLocked()) {
+			hook->recordCb(descriptors);
+			hook->destroyUnused();
+		}
+
 		foundHookRecord = hook;
 	}
 
@@ -924,7 +975,7 @@ VkCommandBuffer CommandHook::doHook(CommandRecord& record,
 std::vector<CompletedHook> CommandHook::moveCompleted() {
 	std::vector<CompletedHook> moved;
 	{
-		std::lock_guard lock(dev_->mutex);
+		std::lock_guard lock(mutex);
 		moved = std::move(this->completed_);
 	}
 	return moved;
@@ -935,6 +986,9 @@ void CommandHook::clearCompleted() {
 }
 
 void CommandHook::invalidateRecordings(bool forceAll) {
+	// Released after unlocking, the reclaimer isn't running anymore
+	// when the device is destroyed. See HookRecordHandles.
+	std::vector<HookRecordHandlesPtr> keptHandles;
 	std::lock_guard lock(dev_->mutex);
 
 	// We have to increase the counter to invalidate all past recordings
@@ -957,12 +1011,70 @@ void CommandHook::invalidateRecordings(bool forceAll) {
 	}
 
 	records_ = nullptr;
+
+	// The ops might have changed, can't reuse the resources anymore
+	for(auto& res : reusable_) {
+		if(res.handles) {
+			keptHandles.push_back(std::move(res.handles));
+		}
+	}
+
+	clearReusable();
 }
 
-CommandHookState::CommandHookState() {
+HookRecordResources CommandHook::takeReusable(u64 key,
+		LocalCapture* localCapture, u32 queueFamily) {
+	assertOwned(dev_->mutex);
+
+	if(!allowReuse.load()) {
+		return {};
+	}
+
+	// prefer the most recent one
+	for(auto it = reusable_.rbegin(); it != reusable_.rend(); ++it) {
+		if(it->key != key || it->localCapture != localCapture ||
+				it->queueFamily != queueFamily) {
+			continue;
+		}
+
+		auto ret = std::move(*it);
+		reusable_.erase(std::next(it).base());
+		++DebugStats::get().reusedHookRecords;
+		return ret;
+	}
+
+	return {};
+}
+
+void CommandHook::addReusable(HookRecordResources&& res) {
+	assertOwned(dev_->mutex);
+
+	if(reusable_.size() >= maxReusableHookRecords) {
+		destroy(*dev_, reusable_.front());
+		reusable_.erase(reusable_.begin());
+	}
+
+	reusable_.push_back(std::move(res));
+}
+
+void CommandHook::clearReusable() {
+	assertOwned(dev_->mutex);
+
+	for(auto& res : reusable_) {
+		destroy(*dev_, res);
+	}
+
+	reusable_.clear();
+}
+
+CommandHookState::CommandHookState(Device& xdev) : dev(&xdev) {
 	++DebugStats::get().aliveHookStates;
 }
 
+void ReclaimDeleter::operator()(CommandHookState* state) const noexcept {
+	reclaim(&state->dev->reclaimer, state->reclaimNode, state);
+}
+
 CommandHookState::~CommandHookState() {
 	dlg_assert(DebugStats::get().aliveHookStates > 0);
 	--DebugStats::get().aliveHookStates;
@@ -974,7 +1086,7 @@ void CommandHook::updateHook(Update&& update) {
 		Target oldTarget;
 
 		{
-			std::lock_guard lock(dev_->mutex);
+			std::lock_guard lock(mutex);
 
 			if(update.newTarget) {
 				oldTarget = std::move(target_);
@@ -1001,19 +1113,19 @@ void CommandHook::updateHook(Update&& update) {
 }
 
 CommandHook::Ops CommandHook::ops() const {
-	std::lock_guard lock(dev_->mutex);
+	std::lock_guard lock(mutex);
 	return ops_;
 }
 
 CommandHook::Target CommandHook::target() const {
-	std::lock_guard lock(dev_->mutex);
+	std::lock_guard lock(mutex);
 	return target_;
 }
 
 void CommandHook::addLocalCapture(std::unique_ptr<LocalCapture>&& lc) {
-	IntrusivePtr<CommandRecord> keepAliveRecord;
+	CommandRecordPtr keepAliveRecord;
 
-	std::lock_guard lock(dev_->mutex);
+	std::lock_guard lock(mutex);
 	for(auto& completed : localCapturesCompleted_) {
 		if(completed->name == lc->name) {
 			return;
@@ -1041,7 +1153,7 @@ void CommandHook::addLocalCapture(std::unique_ptr<LocalCapture>&& lc) {
 }
 
 std::vector<LocalCapture*> CommandHook::localCaptures() const {
-	std::lock_guard lock(dev_->mutex);
+	std::lock_guard lock(mutex);
 	std::vector<LocalCapture*> ret;
 	ret.reserve(localCaptures_.size());
 	for(auto& lc : localCaptures_) {
@@ -1050,8 +1162,15 @@ std::vector<LocalCapture*> CommandHook::localCaptures() const {
 	return ret;
 }
 
+bool CommandHook::needsRecords() const {
+	std::lock_guard lock(mutex);
+	return forceHook.load() ||
+		!localCaptures_.empty() ||
+		(accelStructs_ && hookAccelStructBuilds.load());
+}
+
 std::vector<LocalCapture*> CommandHook::localCapturesOnceCompleted() const {
-	std::lock_guard lock(dev_->mutex);
+	std::lock_guard lock(mutex);
 	std::vector<LocalCapture*> ret;
 	ret.reserve(localCapturesCompleted_.size());
 	for(auto& lc : localCapturesCompleted_) {
@@ -7,6 +7,7 @@
 #include <nytl/bytes.hpp>
 #include <util/ownbuf.hpp>
 #include <util/util.hpp>
+#include <util/debugMutex.hpp>
 #include <frame.hpp>
 #include <cb.hpp>
 #include <vk/vulkan.h>
@@ -20,6 +21,7 @@ namespace vil {
 
 struct BeginRenderPassCmd;
 struct CommandHookState;
+struct HookRecordResources;
 
 enum class CommandHookTargetType {
 	none,
@@ -39,7 +41,7 @@ struct CommandHookTarget {
 	// Can be empty only when type == inFrame, in which case only a
 	// timing query is allowed as hookOp, which will then time the
 	// whole submission.
-	IntrusivePtr<CommandRecord> record {};
+	CommandRecordPtr record {};
 	// When hierarchy is empty, can only have a timing query as hookOp,
 	// which will then time the whole command buffer.
 	// If not empty, must be a valid hierarchy in 'record'.
@@ -96,8 +98,8 @@ struct CommandHookUpdate {
 // A vector of the last received states of finished submissions.
 struct CompletedHook {
 	u64 submissionID; // global submission id (dev.submissionCounter)
-	IntrusivePtr<CommandRecord> record;
-	IntrusivePtr<CommandHookState> state;
+	CommandRecordPtr record;
+	CommandHookStatePtr state;
 	CommandDescriptorSnapshot descriptorSnapshot;
 	std::vector<const Command*> command;
 	float match; // how much the command matched
@@ -142,12 +144,12 @@ struct LocalCapture {
 	LocalCaptureFlags flags;
 	std::string name;
 
-	// Protected by device mutex.
+	// Protected by CommandHook::mutex.
 	// NOTE: record, command might not always mirror completex.{record, command}.
 	//   LocalCaptures without once flags can be updated with more
 	//   recent recordings while we don't have a completed hook state
 	//   of them yet.
-	IntrusivePtr<CommandRecord> record;
+	CommandRecordPtr record;
 	std::vector<const Command*> command;
 	CompletedHook completed; // may be empty
 };
@@ -160,6 +162,10 @@ public:
 	// maximum number of completed hooks we store at a time.
 	static constexpr auto maxCompletedHooks = 8u;
 
+	// maximum number of resources of destroyed hook records we keep
+	// around for reuse, see HookRecordResources.
+	static constexpr auto maxReusableHookRecords = 4u;
+
 	// TODO: make setting?
 	static constexpr auto matchType = MatchType::mixed;
 
@@ -184,6 +190,13 @@ public:
 	// as we need it to have accelStruct data.
 	std::atomic<bool> hookAccelStructBuilds {true};
 
+	// Protects the capture state: ops, target, completed hooks and
+	// local captures (including their mutable members).
+	// Split from the device mutex so that the gui polling hook
+	// state and recording local captures don't need the device mutex.
+	// When both are needed, the device mutex must be locked first.
+	mutable vilDefMutex(mutex);
+
 public:
 	CommandHook(Device& dev);
 	~CommandHook();
@@ -196,6 +209,8 @@ public:
 	// Called with the device mutex unlocked.
 	// Assumes that the QueueSubmitter is a QueueSubmit command (i.e.
 	// not QueueBindSparse).
+	// Only the matching is done with the device mutex locked, new hook
+	// records are recorded afterwards, see CommandHookRecord::recordCb.
 	void hook(QueueSubmitter& subm);
 
 	// Updates the hook operations
@@ -214,6 +229,11 @@ public:
 	void clearCompleted();
 
 	void addLocalCapture(std::unique_ptr<LocalCapture>&&);
+
+	// Returns whether the hook might need complete records even when
+	// the gui is closed, i.e. for local captures, forced hooking or
+	// acceleration structure builds.
+	bool needsRecords() const;
 	std::vector<LocalCapture*> localCaptures() const;
 	std::vector<LocalCapture*> localCapturesOnceCompleted() const;
 
@@ -228,6 +248,10 @@ private:
 	// record was created. Exepcts the given record to be valid.
 	bool copiedDescriptorChanged(const CommandHookRecord&);
 
+	// Finds the commands to hook in the given submission and attaches
+	// the hook records. Expects the device mutex and our mutex to be locked.
+	void hookLocked(QueueSubmitter& subm);
+
 	VkCommandBuffer doHook(CommandRecord& record,
 		span<const Command*> dstCommand, // might be empty
 		float dstCommandMatch,
@@ -238,14 +262,25 @@ private:
 		span<const CommandSectionMatch> matchData,
 		Submission& subm, std::unique_ptr<CommandHookSubmission>& data);
 
+	// Returns (and removes) the matching resources from reusable_ or
+	// empty resources if there are none. Expects device mutex to be locked.
+	HookRecordResources takeReusable(u64 key, LocalCapture*, u32 queueFamily);
+	void addReusable(HookRecordResources&&);
+	void clearReusable();
+
 private:
 	friend struct CommandHookRecord;
 	friend struct CommandHookSubmission;
 
 	Device* dev_ {};
+	bool accelStructs_ {}; // whether the application uses accelStructs
 
 	u32 counter_ {0};
 	CommandHookRecord* records_ {}; // intrusive linked list
+
+	// Resources of destroyed hook records, oldest first.
+	// Only valid for the current counter_, cleared on invalidation.
+	std::vector<HookRecordResources> reusable_;
 									//
 	std::vector<CompletedHook> completed_;
 	Ops ops_;
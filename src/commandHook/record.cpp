@@ -16,14 +16,87 @@
 #include <cb.hpp>
 #include <rp.hpp>
 #include <ds.hpp>
+#include <sync.hpp>
+#include <queryPool.hpp>
 #include <vk/format_utils.h>
 
 namespace vil {
 
+namespace {
+
+// Takes over the buffer of the same capture slot of a previous,
+// structurally identical hook record (see HookRecordResources::state).
+// Only done when it has exactly the needed size: OwnBuffer::size is
+// used by the gui as size of the captured data.
+void reuseBuffer(OwnBuffer& dst, OwnBuffer* prev, VkDeviceSize size) {
+	if(!prev || !prev->buf || prev->size != size) {
+		return;
+	}
+
+	dlg_assert(!dst.buf);
+	dst = std::move(*prev);
+}
+
+CommandHookState* prevState(const HookRecordResources* reuse) {
+	return reuse ? reuse->state.get() : nullptr;
+}
+
+template<typename Set>
+void addRefs(std::vector<HookRecordHandles::Ref>& dst, const Set& used) {
+	for(auto& ref : used) {
+		using T = std::remove_reference_t<decltype(*ref.handle)>;
+		incRefCount(*ref.handle);
+		dst.push_back({ref.handle.get(), [](void* handle) {
+			decRefCount(*static_cast<T*>(handle));
+		}});
+	}
+}
+
+} // anon namespace
+
+HookRecordHandles::HookRecordHandles(const CommandRecord& rec) : dev(rec.dev) {
+	auto& used = rec.used;
+	addRefs(refs, used.buffers);
+	addRefs(refs, used.graphicsPipes);
+	addRefs(refs, used.computePipes);
+	addRefs(refs, used.rtPipes);
+	addRefs(refs, used.pipeLayouts);
+	addRefs(refs, used.dsuTemplates);
+	addRefs(refs, used.renderPasses);
+	addRefs(refs, used.framebuffers);
+	addRefs(refs, used.queryPools);
+	addRefs(refs, used.imageViews);
+	addRefs(refs, used.bufferViews);
+	addRefs(refs, used.samplers);
+	addRefs(refs, used.accelStructs);
+	addRefs(refs, used.events);
+	// the descriptor sets are allocated from their pool's memory
+	addRefs(refs, used.dsPools);
+	addRefs(refs, used.images);
+}
+
+HookRecordHandles::~HookRecordHandles() {
+	for(auto& ref : refs) {
+		ref.release(ref.handle);
+	}
+}
+
+void ReclaimDeleter::operator()(HookRecordHandles* handles) const noexcept {
+	reclaim(&handles->dev->reclaimer, handles->reclaimNode, handles);
+}
+
 // record
+struct CommandHookRecord::Deferred {
+	CommandHookOps ops;
+	HookRecordResources reuse;
+	// CommandHook::hookAccelStructBuilds at creation time, only set when
+	// the record builds acceleration structures.
+	bool hookAccelStructBuilds {};
+	bool recorded {};
+};
+
 CommandHookRecord::CommandHookRecord(CommandHook& xhook,
 	CommandRecord& xrecord, std::vector<const Command*> hooked,
-	const CommandDescriptorSnapshot& descriptors,
 	const CommandHookOps& ops, LocalCapture* xlocalCapture) :
 		hook(&xhook), record(&xrecord), hcommand(std::move(hooked)) {
 
@@ -41,22 +114,55 @@ CommandHookRecord::CommandHookRecord(CommandHook& xhook,
 
 	auto& dev = *xrecord.dev;
 
-	VkCommandBufferAllocateInfo allocInfo {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = dev.queueFamilies[record->queueFamily].commandPool;
-	allocInfo.commandBufferCount = 1;
+	// Check whether we can reuse the resources of a previous hook record
+	// for a structurally identical record.
+	deferred_ = std::make_unique<Deferred>();
+	deferred_->ops = ops;
+	deferred_->hookAccelStructBuilds = xrecord.buildsAccelStructs &&
+		hook->hookAccelStructBuilds.load();
+	auto& reuse = deferred_->reuse;
+	if(hasHookedCmd()) {
+		key_ = hookRecordKey(xrecord, hcommand);
+		reuse = hook->takeReusable(key_, xlocalCapture, xrecord.queueFamily);
+	}
+
+	if(reuse.cb) {
+		// Will implicitly be reset in BeginCommandBuffer, our pools
+		// are created with the reset flag.
+		this->commandPool = reuse.commandPool;
+		this->cb = reuse.cb;
+		reuse.commandPool = {};
+		reuse.cb = {};
+	} else {
+		VkCommandPoolCreateInfo cpci {};
+		cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		cpci.queueFamilyIndex = record->queueFamily;
+		VK_CHECK_DEV(dev.dispatch.CreateCommandPool(dev.handle, &cpci, nullptr, &this->commandPool), dev);
+		nameHandle(dev, this->commandPool, "CommandHookRecord:commandPool");
+
+		VkCommandBufferAllocateInfo allocInfo {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = this->commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VK_CHECK_DEV(dev.dispatch.AllocateCommandBuffers(dev.handle, &allocInfo, &this->cb), dev);
+		// command buffer is a dispatchable object
+		dev.setDeviceLoaderData(dev.handle, this->cb);
+		nameHandle(dev, this->cb, "CommandHookRecord:cb");
+	}
 
-	VK_CHECK_DEV(dev.dispatch.AllocateCommandBuffers(dev.handle, &allocInfo, &this->cb), dev);
-	// command buffer is a dispatchable object
-	dev.setDeviceLoaderData(dev.handle, this->cb);
-	nameHandle(dev, this->cb, "CommandHookRecord:cb");
+	dummyBuf = std::move(reuse.dummyBuf);
 
 	// query pool
 	if(ops.queryTime) {
 		auto validBits = dev.queueFamilies[xrecord.queueFamily].props.timestampValidBits;
 		if(validBits == 0u) {
 			dlg_info("Queue family {} does not support timing queries", xrecord.queueFamily);
+		} else if(reuse.queryPool) {
+			this->queryPool = reuse.queryPool;
+			reuse.queryPool = {};
 		} else {
 			VkQueryPoolCreateInfo qci {};
 			qci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
@@ -66,9 +172,33 @@ CommandHookRecord::CommandHookRecord(CommandHook& xhook,
 			nameHandle(dev, this->queryPool, "CommandHookRecord:queryPool");
 		}
 	}
+}
+
+void CommandHookRecord::recordCb(const CommandDescriptorSnapshot& descriptors) {
+	dlg_assert(needsRecording());
+	deferred_->recorded = true;
 
-	RecordInfo info {ops};
+	auto& dev = *record->dev;
+
+	if(hasHookedCmd()) {
+		recordingHash_ = recordingHash(*record->commands);
+		if(recordingHash_) {
+			descriptors_ = descriptors;
+		}
+	}
+
+	// The same commands were recorded into cb before, no need to
+	// do it again.
+	if(canResubmit(descriptors)) {
+		takeRecorded();
+		++DebugStats::get().resubmittedHookRecords;
+		return;
+	}
+
+	RecordInfo info {deferred_->ops};
+	info.hookAccelStructBuilds = deferred_->hookAccelStructBuilds;
 	info.descriptors = &descriptors;
+	info.reuse = &deferred_->reuse;
 	initState(info);
 
 	// TODO
@@ -100,6 +230,85 @@ CommandHookRecord::CommandHookRecord(CommandHook& xhook,
 	}
 }
 
+bool CommandHookRecord::needsRecording() const {
+	return deferred_ && !deferred_->recorded;
+}
+
+bool CommandHookRecord::needsRecordingLocked() const {
+	return needsRecording() && deferred_->hookAccelStructBuilds;
+}
+
+bool CommandHookRecord::canResubmit(const CommandDescriptorSnapshot& descriptors) const {
+	auto& reuse = deferred_->reuse;
+	if(!recordingHash_ || reuse.recordingHash != recordingHash_) {
+		return false;
+	}
+
+	dlg_assert(reuse.state);
+	dlg_assert(this->cb); // taken over in the constructor
+
+	// Only the copied descriptors are read while recording, see copyDs.
+	// A descriptor set has the same snapshot entry in both snapshots
+	// only if it wasn't changed in between.
+	auto& copies = deferred_->ops.descriptorCopies;
+	if(copies.empty()) {
+		return true;
+	}
+
+	auto* cmd = dynamic_cast<const StateCmdBase*>(hcommand.back());
+	dlg_assert_or(cmd, return false);
+
+	const DescriptorState& dsState = cmd->boundDescriptors();
+	for(auto& copy : copies) {
+		if(copy.set >= dsState.descriptorSets.size()) {
+			continue;
+		}
+
+		// The content of descriptor buffers may change anytime without
+		// us noticing.
+		if(dsState.descriptorSets[copy.set].fromDescriptorBuffer()) {
+			return false;
+		}
+
+		auto key = dsState.snapshotKey(copy.set);
+		auto* cow = descriptors.find(key);
+		if(!cow || cow != reuse.descriptors.find(key)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void CommandHookRecord::takeRecorded() {
+	auto& reuse = deferred_->reuse;
+
+	// Nobody else references the state, see the destructor. The captured
+	// data will be overwritten by the submission, only the results set
+	// when the submission completes have to be reset.
+	state = std::move(reuse.state);
+	state->neededTime = u64(-1);
+	state->indirectCommandCount = 0u;
+
+	descriptorSets = std::move(reuse.descriptorSets);
+	imageViews = std::move(reuse.imageViews);
+	bufferViews = std::move(reuse.bufferViews);
+
+	if(reuse.rp0) {
+		rp0 = std::exchange(reuse.rp0, VK_NULL_HANDLE);
+		rp1 = std::exchange(reuse.rp1, VK_NULL_HANDLE);
+		rp2 = std::exchange(reuse.rp2, VK_NULL_HANDLE);
+		splitRp_ = reuse.splitRp.get();
+		splitSubpass_ = reuse.splitSubpass;
+	}
+}
+
+void CommandHookRecord::destroyUnused() {
+	dlg_assert(deferred_ && deferred_->recorded);
+	destroy(*record->dev, deferred_->reuse);
+	deferred_.reset();
+}
+
 CommandHookRecord::~CommandHookRecord() {
 	ZoneScoped;
 
@@ -120,9 +329,62 @@ CommandHookRecord::~CommandHookRecord() {
 	// only where it's needed.
 	assertOwned(dev.mutex);
 
-	// destroy resources
-	auto commandPool = dev.queueFamilies[record->queueFamily].commandPool;
+	if(deferred_) {
+		destroy(dev, deferred_->reuse);
+	}
 
+	// Keep the resources around for a new hook record of the same command
+	// in a structurally identical record, see HookRecordResources.
+	// When the hook was invalidated, the resources might be outdated.
+	if(hook && hookCounter == hook->counter_ && hasHookedCmd() &&
+			accelStructOps.empty() && hook->allowReuse.load()) {
+		HookRecordResources res;
+		res.key = key_;
+		res.localCapture = localCapture;
+		res.queueFamily = record->queueFamily;
+		res.commandPool = commandPool;
+		res.cb = cb;
+		res.queryPool = queryPool;
+		res.rp0 = rp0;
+		res.rp1 = rp1;
+		res.rp2 = rp2;
+		res.dummyBuf = std::move(dummyBuf);
+
+		if(rp0) {
+			res.splitRp.reset(splitRp_);
+			res.splitSubpass = splitSubpass_;
+		}
+
+		// The one reference is ours, it's not needed anywhere else
+		if(state && state->refCount == 1u) {
+			// cb may only be resubmitted as a whole, together with
+			// everything it references.
+			if(recordingHash_ && !deferred_) {
+				res.recordingHash = recordingHash_;
+				res.descriptors = std::move(descriptors_);
+				res.handles.reset(new HookRecordHandles(*record));
+				res.descriptorSets = std::move(descriptorSets);
+				res.imageViews = std::move(imageViews);
+				res.bufferViews = std::move(bufferViews);
+				descriptorSets.clear();
+				imageViews.clear();
+				bufferViews.clear();
+			}
+
+			res.state = std::move(state);
+		}
+
+		commandPool = {};
+		cb = {};
+		queryPool = {};
+		rp0 = {};
+		rp1 = {};
+		rp2 = {};
+
+		hook->addReusable(std::move(res));
+	}
+
+	// destroy resources
 	for(auto imgView : imageViews) {
 		dev.dispatch.DestroyImageView(dev.handle, imgView, nullptr);
 	}
@@ -132,11 +394,14 @@ CommandHookRecord::~CommandHookRecord() {
 	}
 
 	if(!descriptorSets.empty()) {
+		std::lock_guard lock(dev.dsPoolMutex);
 		dev.dispatch.FreeDescriptorSets(dev.handle, dev.dsPool,
 			u32(descriptorSets.size()), descriptorSets.data());
 	}
 
-	dev.dispatch.FreeCommandBuffers(dev.handle, commandPool, 1, &cb);
+	// implicitly frees cb
+	dev.dispatch.DestroyCommandPool(dev.handle, commandPool, nullptr);
+
 	dev.dispatch.DestroyQueryPool(dev.handle, queryPool, nullptr);
 
 	dev.dispatch.DestroyRenderPass(dev.handle, rp0, nullptr);
@@ -163,7 +428,10 @@ void CommandHookRecord::initState(RecordInfo& info) {
 
 	auto& dev = *record->dev;
 
-	state.reset(new CommandHookState());
+	// Always a new state when recording, the gui must never see results
+	// of a previous capture. The buffers of a reused state are taken over
+	// while recording, see reuseBuffer.
+	state.reset(new CommandHookState(dev));
 	state->copiedAttachments.resize(info.ops.attachmentCopies.size());
 	state->copiedDescriptors.resize(info.ops.descriptorCopies.size());
 
@@ -240,10 +508,21 @@ void CommandHookRecord::initState(RecordInfo& info) {
 				dlg_warn("Can't split render pass (due to resolve attachments)");
 			} else {
 				info.splitRendering = true;
-				auto [rpi0, rpi1, rpi2] = splitInterruptable(desc);
-				rp0 = create(dev, rpi0);
-				rp1 = create(dev, rpi1);
-				rp2 = create(dev, rpi2);
+				splitRp_ = &rp;
+				splitSubpass_ = info.hookedSubpass;
+
+				auto* reuse = info.reuse;
+				if(reuse && reuse->rp0 && reuse->splitRp.get() == &rp &&
+						reuse->splitSubpass == info.hookedSubpass) {
+					rp0 = std::exchange(reuse->rp0, VK_NULL_HANDLE);
+					rp1 = std::exchange(reuse->rp1, VK_NULL_HANDLE);
+					rp2 = std::exchange(reuse->rp2, VK_NULL_HANDLE);
+				} else {
+					auto [rpi0, rpi1, rpi2] = splitInterruptable(desc);
+					rp0 = create(dev, rpi0);
+					rp1 = create(dev, rpi1);
+					rp2 = create(dev, rpi2);
+				}
 			}
 		}
 	} else if(careAboutRendering && info.beginRenderingCmd) {
@@ -436,6 +715,9 @@ void CommandHookRecord::hookRecordDst(Command& cmd, RecordInfo& info) {
 				VK_BUFFER_USAGE_TRANSFER_DST_BIT |
 				VK_BUFFER_USAGE_TRANSFORM_FEEDBACK_BUFFER_BIT_EXT |
 				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+			auto* prev = prevState(info.reuse);
+			reuseBuffer(state->transformFeedback,
+				prev ? &prev->transformFeedback : nullptr, xfbSize);
 			state->transformFeedback.ensure(dev, xfbSize, usage);
 
 			auto offset = VkDeviceSize(0u);
@@ -522,7 +804,7 @@ void CommandHookRecord::hookRecord(Command* cmd, RecordInfo& info) {
 	auto& dev = *record->dev;
 	while(cmd) {
 		// check if command needs additional, manual hook
-		if(cmd->category() == CommandCategory::buildAccelStruct && hook->hookAccelStructBuilds) {
+		if(cmd->category() == CommandCategory::buildAccelStruct && info.hookAccelStructBuilds) {
 
 			auto* basCmd = commandCast<BuildAccelStructsCmd*>(cmd);
 			auto* basCmdIndirect = commandCast<BuildAccelStructsCmd*>(cmd);
@@ -636,14 +918,14 @@ void CommandHookRecord::copyDs(Command& bcmd, RecordInfo& info,
 		return;
 	}
 
-	auto it = info.descriptors->states.find(dsState.descriptorSets[setID].dsEntry);
-	if(it == info.descriptors->states.end()) {
+	auto* cow = info.descriptors->find(dsState, setID);
+	if(!cow) {
 		dlg_error("Could not find descriptor in snapshot??");
 		return;
 	}
 
-	dstCow = it->second;
-	auto [ds, lock] = access(*it->second);
+	dstCow.reset(cow);
+	auto [ds, lock] = access(*cow);
 
 	if(bindingID >= ds.layout->bindings.size()) {
 		dlg_trace("bindingID out of range");
@@ -925,6 +1207,9 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 		}
 
 		auto& toWrite = isBefore ? state->transferSrcBefore : state->transferSrcAfter;
+		auto* prev = prevState(info.reuse);
+		auto* prevWrite = !prev ? nullptr :
+			isBefore ? &prev->transferSrcBefore : &prev->transferSrcAfter;
 
 		dlg_assert(img || buf);
 		if(img) {
@@ -940,6 +1225,7 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 
 			// we don't ever read the buffer from the gfxQueue so we can
 			// ignore queueFams here
+			reuseBuffer(toWrite.buf, prevWrite ? &prevWrite->buf : nullptr, size);
 			initAndCopy(dev, cb, toWrite.buf, 0u, *src, offset, size, {});
 		}
 	}
@@ -1002,6 +1288,10 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 		}
 
 		auto& toWrite = isBefore ? state->transferDstBefore : state->transferDstAfter;
+		auto* prev = prevState(info.reuse);
+		auto* prevWrite = !prev ? nullptr :
+			isBefore ? &prev->transferDstBefore : &prev->transferDstAfter;
+
 		dlg_assert(img || buf);
 		if(img) {
 			auto [src, layout, subres] = *img;
@@ -1016,6 +1306,7 @@ void CommandHookRecord::copyTransfer(Command& bcmd, RecordInfo& info, bool isBef
 
 			// we don't ever read the buffer from the gfxQueue so we can
 			// ignore queueFams here
+			reuseBuffer(toWrite.buf, prevWrite ? &prevWrite->buf : nullptr, size);
 			initAndCopy(dev, cb, toWrite.buf, 0u, *src, offset, size, {});
 		}
 	}
@@ -1052,9 +1343,12 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 			0, 1, &memBarrier, 0, nullptr, 0, nullptr);
 	}
 
+	auto* prev = prevState(info.reuse);
+
 	// indirect copy
 	if(info.ops.copyIndirectCmd) {
 		DebugLabel lbl(dev, cb, "vil:copyInderectCmd");
+		auto* prevIndirect = prev ? &prev->indirectCopy : nullptr;
 
 		// we don't ever read the buffer from the gfxQueue so we can
 		// ignore queueFams here
@@ -1065,11 +1359,13 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 			stride = cmd->stride ? cmd->stride : stride;
 			auto dstSize = cmd->drawCount * stride;
 			dlg_assert(cmd->buffer);
+			reuseBuffer(state->indirectCopy, prevIndirect, dstSize);
 			initAndCopy(dev, cb, state->indirectCopy,  0u,
 				*cmd->buffer, cmd->offset, dstSize, {});
 		} else if(auto* cmd = commandCast<DispatchIndirectCmd*>(&bcmd)) {
 			dlg_assert(cmd->buffer);
 			auto size = sizeof(VkDispatchIndirectCommand);
+			reuseBuffer(state->indirectCopy, prevIndirect, size);
 			initAndCopy(dev, cb, state->indirectCopy, 0u,
 				*cmd->buffer, cmd->offset, size, {});
 		} else if(auto* cmd = commandCast<DrawIndirectCountCmd*>(&bcmd)) {
@@ -1079,6 +1375,7 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 				sizeof(VkDrawIndexedIndirectCommand) :
 				sizeof(VkDrawIndirectCommand);
 			auto size = 4 + cmd->maxDrawCount * cmdSize;
+			reuseBuffer(state->indirectCopy, prevIndirect, size);
 			state->indirectCopy.ensure(dev, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 
 			// copy count
@@ -1094,6 +1391,7 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 				state->indirectCopy, 4u, cmd->maxDrawCount * cmdSize);
 		} else if(auto* cmd = commandCast<TraceRaysIndirectCmd*>(&bcmd)) {
 			auto size = sizeof(VkTraceRaysIndirectCommandKHR);
+			reuseBuffer(state->indirectCopy, prevIndirect, size);
 			initAndCopy(dev, cb, state->indirectCopy, cmd->indirectDeviceAddress,
 				size, {});
 		} else {
@@ -1134,13 +1432,17 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 		DebugLabel lbl(dev, cb, "vil:copyVertexBuffers");
 
 		auto* drawCmd = deriveCast<DrawCmdBase*>(&bcmd);
-		for(auto& vertbuf : drawCmd->state->vertices) {
+		dlg_assert(state->vertexBufCopies.empty());
+		for(auto [i, vertbuf] : enumerate(drawCmd->state->vertices)) {
 			auto& dst = state->vertexBufCopies.emplace_back();
 			if(!vertbuf.buffer) {
 				continue;
 			}
 
 			auto size = std::min(maxVertIndSize, vertbuf.buffer->ci.size - vertbuf.offset);
+			auto* prevBuf = (prev && i < prev->vertexBufCopies.size()) ?
+				&prev->vertexBufCopies[i] : nullptr;
+			reuseBuffer(dst, prevBuf, size);
 			initAndCopy(dev, cb, dst, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 				*vertbuf.buffer, vertbuf.offset, size, queueFams);
 		}
@@ -1154,6 +1456,7 @@ void CommandHookRecord::beforeDstOutsideRp(Command& bcmd, RecordInfo& info) {
 		auto& inds = drawCmd->state->indices;
 		if(inds.buffer) {
 			auto size = std::min(maxVertIndSize, inds.buffer->ci.size - inds.offset);
+			reuseBuffer(state->indexBufCopy, prev ? &prev->indexBufCopy : nullptr, size);
 			initAndCopy(dev, cb, state->indexBufCopy, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 				*inds.buffer, inds.offset, size, queueFams);
 		}
@@ -1406,6 +1709,70 @@ void CommandHookRecord::hookBefore(const BuildAccelStructsIndirectCmd& cmd) {
 	dlg_error("TODO: implement support for copying BuildAccelStructsIndirectCmd data");
 }
 
+u64 hookRecordKey(const CommandRecord& record, span<const Command* const> hcommand) {
+	dlg_assert(!hcommand.empty());
+	dlg_assert(hcommand[0] == record.commands);
+
+	auto ret = combineHash64(record.commands->stats_.fingerprint, record.queueFamily);
+	for(auto i = 1u; i < hcommand.size(); ++i) {
+		auto id = 0u;
+		for(auto* it = hcommand[i - 1]->children(); it && it != hcommand[i]; it = it->next) {
+			++id;
+		}
+
+		ret = combineHash64(ret, id);
+		ret = combineHash64(ret, structuralFingerprint(*hcommand[i]));
+	}
+
+	// the bound pipeline is not part of the hooked command's fingerprint
+	if(auto* stateCmd = dynamic_cast<const StateCmdBase*>(hcommand.back())) {
+		ret = combineHash64(ret, reinterpret_cast<std::uintptr_t>(stateCmd->boundPipe()));
+	}
+
+	return ret;
+}
+
+void destroy(Device& dev, HookRecordResources& res) {
+	assertOwned(dev.mutex);
+
+	// implicitly frees res.cb
+	dev.dispatch.DestroyCommandPool(dev.handle, res.commandPool, nullptr);
+	dev.dispatch.DestroyQueryPool(dev.handle, res.queryPool, nullptr);
+	dev.dispatch.DestroyRenderPass(dev.handle, res.rp0, nullptr);
+	dev.dispatch.DestroyRenderPass(dev.handle, res.rp1, nullptr);
+	dev.dispatch.DestroyRenderPass(dev.handle, res.rp2, nullptr);
+
+	for(auto imgView : res.imageViews) {
+		dev.dispatch.DestroyImageView(dev.handle, imgView, nullptr);
+	}
+
+	for(auto bufView : res.bufferViews) {
+		dev.dispatch.DestroyBufferView(dev.handle, bufView, nullptr);
+	}
+
+	if(!res.descriptorSets.empty()) {
+		std::lock_guard lock(dev.dsPoolMutex);
+		dev.dispatch.FreeDescriptorSets(dev.handle, dev.dsPool,
+			u32(res.descriptorSets.size()), res.descriptorSets.data());
+	}
+
+	res.commandPool = {};
+	res.cb = {};
+	res.queryPool = {};
+	res.rp0 = {};
+	res.rp1 = {};
+	res.rp2 = {};
+	res.splitRp = {};
+	res.dummyBuf = {};
+	res.state = {};
+	res.recordingHash = {};
+	res.descriptors = {};
+	res.handles = {};
+	res.descriptorSets.clear();
+	res.imageViews.clear();
+	res.bufferViews.clear();
+}
+
 void CommandHookRecord::finish() noexcept {
 	// NOTE: We don't do this since we can assume the record to remain
 	// valid until all submissions are finished. We can assume it to
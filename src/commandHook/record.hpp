@@ -4,9 +4,88 @@
 #include <util/ownbuf.hpp>
 #include <command/record.hpp>
 #include <commandHook/state.hpp>
+#include <rp.hpp>
 
 namespace vil {
 
+using HookRecordHandlesPtr = std::unique_ptr<HookRecordHandles, ReclaimDeleter>;
+
+// Resources of a destroyed CommandHookRecord that can be reused by a new
+// CommandHookRecord for the same command in a structurally identical record.
+// Most applications re-record their command buffers every frame, so each
+// frame needs a new hook record. This way, we don't have to allocate a new
+// command buffer, query pool, split render passes and copy destinations
+// for each of them. When the new record records exactly the same commands
+// with the same handles and descriptors, even the recorded command buffer
+// can be resubmitted as it is. Otherwise it has to be re-recorded.
+// Stored in CommandHook, only valid for the current hook counter.
+struct HookRecordResources {
+	u64 key {}; // see hookRecordKey
+	LocalCapture* localCapture {};
+	u32 queueFamily {};
+
+	VkCommandPool commandPool {};
+	VkCommandBuffer cb {};
+	VkQueryPool queryPool {};
+
+	// The split render passes are only valid for this render pass
+	// and subpass. Keeping the render pass alive makes sure it's not
+	// confused with a new one at the same address.
+	IntrusivePtr<RenderPass> splitRp {};
+	u32 splitSubpass {};
+	VkRenderPass rp0 {};
+	VkRenderPass rp1 {};
+	VkRenderPass rp2 {};
+
+	OwnBuffer dummyBuf {};
+
+	// The state of the previous hook record, only set when it isn't
+	// referenced anywhere else anymore. Unless cb is resubmitted, a new
+	// hook record only takes over its capture buffers of matching size.
+	CommandHookStatePtr state {};
+
+	// Only set when cb can be resubmitted without re-recording it,
+	// see CommandHookRecord::recordCb. The hash of the record cb was
+	// recorded for (see recordingHash) and the descriptors it was
+	// recorded with. In that case, state is set as well.
+	u64 recordingHash {};
+	CommandDescriptorSnapshot descriptors {};
+	// Keeps the handles used by the record alive, otherwise new handles
+	// could be created at their addresses and be confused with them.
+	HookRecordHandlesPtr handles {};
+	// Referenced by cb, see CommandHookRecord.
+	std::vector<VkDescriptorSet> descriptorSets;
+	std::vector<VkImageView> imageViews;
+	std::vector<VkBufferView> bufferViews;
+};
+
+// References to all handles used by a CommandRecord, see
+// HookRecordResources::handles. Destroyed via the Reclaimer of the
+// device since releasing the last reference of a handle might lock
+// the device mutex.
+struct HookRecordHandles {
+	struct Ref {
+		void* handle {};
+		void (*release)(void*) {};
+	};
+
+	Device* dev {};
+	ReclaimNode reclaimNode {};
+	std::vector<Ref> refs;
+
+	explicit HookRecordHandles(const CommandRecord&);
+	~HookRecordHandles();
+};
+
+// Returns the key under which resources for a hook record of the given
+// hooked command hierarchy can be reused. Based on the fingerprint of the
+// record (see SectionStats::fingerprint), the position of the hooked command
+// inside the record and its bound pipeline.
+u64 hookRecordKey(const CommandRecord&, span<const Command* const> hcommand);
+
+// Destroys all resources that are still set.
+void destroy(Device& dev, HookRecordResources&);
+
 // Internal representation of a hooked recording of a CommandRecord.
 // Is kept alive only as long as the associated Record is referencing this
 // (since it might resubmitted again, making this useful) or there are
@@ -40,6 +119,9 @@ struct CommandHookRecord {
 	// std::vector<IntrusivePtr<DescriptorSetCow>> dsState;
 
 	// == Resources ==
+	// Each hook record has its own command pool so that recording it
+	// doesn't need synchronization with other hook records.
+	VkCommandPool commandPool {};
 	VkCommandBuffer cb {};
 
 	// PERF: allocate resources from pool instead of giving each record
@@ -54,7 +136,7 @@ struct CommandHookRecord {
 	VkRenderPass rp1 {};
 	VkRenderPass rp2 {};
 
-	IntrusivePtr<CommandHookState> state {};
+	CommandHookStatePtr state {};
 	OwnBuffer dummyBuf {};
 
 	// AccelStruct-related stuff.
@@ -100,13 +182,51 @@ struct CommandHookRecord {
 	CommandHookRecord* next {};
 	CommandHookRecord* prev {};
 
+private:
+	u64 key_ {}; // see hookRecordKey, only set when there is a hooked command
+	// See HookRecordResources::recordingHash. Only set when cb was
+	// recorded for a hooked command and might be resubmitted by a
+	// later hook record.
+	u64 recordingHash_ {};
+	CommandDescriptorSnapshot descriptors_ {};
+	RenderPass* splitRp_ {}; // the render pass split into rp0, rp1, rp2
+	u32 splitSubpass_ {};
+
+	// What is needed to record cb, set from construction until
+	// destroyUnused. See recordCb.
+	struct Deferred;
+	std::unique_ptr<Deferred> deferred_;
+
 public:
 	CommandHookRecord(CommandHook& hook, CommandRecord& record,
 		std::vector<const Command*> hooked,
-		const CommandDescriptorSnapshot& descriptors,
 		const CommandHookOps& ops, LocalCapture* localCapture = nullptr);
 	~CommandHookRecord();
 
+	// The constructor only creates the resources, the command buffer is
+	// recorded here. CommandHook::hook calls this after leaving its
+	// critical section since recording is expensive, only the records
+	// hooking acceleration structure builds are recorded while the device
+	// mutex is locked (the builds modify the AccelStruct).
+	// When the command buffer taken over from a previous hook record
+	// already contains the same commands, it isn't recorded again,
+	// see canResubmit.
+	// Must be called exactly once, before cb is submitted. The given
+	// descriptors must be the snapshot of the hooked submission.
+	// No other thread accesses this record at that point: it
+	// can't be reused or destroyed while it has a writer.
+	void recordCb(const CommandDescriptorSnapshot& descriptors);
+
+	// Whether recordCb has to be called.
+	bool needsRecording() const;
+	// Whether recordCb has to be called while the device mutex is locked.
+	bool needsRecordingLocked() const;
+
+	// Destroys the resources of the previous hook record (see
+	// HookRecordResources) that could not be reused while recording.
+	// Must be called after recordCb, expects the device mutex to be locked.
+	void destroyUnused();
+
 	// Called when associated record is destroyed or hook replaced.
 	// Called while device mutex is locked.
 	// Might delete itself (or decrement reference count or something).
@@ -132,10 +252,25 @@ private:
 		unsigned* maxHookLevel {};
 
 		bool rebindComputeState {};
+		// Whether acceleration structure builds are hooked.
+		// Needs the device mutex to be locked.
+		bool hookAccelStructBuilds {};
+
+		// Resources of a previous hook record we can reuse.
+		// Everything that is taken is reset.
+		HookRecordResources* reuse {};
 	};
 
 	void initState(RecordInfo&);
 
+	// Whether cb, taken over from the reused resources of a previous hook
+	// record, can be resubmitted as it is. Requires the same commands to
+	// be recorded with the same handles (see recordingHash) and the copied
+	// descriptors to come from the same descriptor set snapshot.
+	bool canResubmit(const CommandDescriptorSnapshot&) const;
+	// Takes over everything cb references from the reused resources.
+	void takeRecorded();
+
 	// = Recording =
 	// Will record the given command. Uses the given RecordInfo to do
 	// additional operations if needed (such as rebinding the compute state,
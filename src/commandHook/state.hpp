@@ -2,6 +2,7 @@
 
 #include <fwd.hpp>
 #include <util/ownbuf.hpp>
+#include <util/reclaim.hpp>
 #include <vk/vulkan_core.h>
 #include <accelStruct.hpp>
 #include <variant>
@@ -87,6 +88,10 @@ struct CommandHookState {
 	// was already destroyed (e.g. because it was replaced and all submissions
 	// have finished).
 	std::atomic<u32> refCount {};
+	// Used to defer the destruction to the device's reclaim thread,
+	// see ReclaimDeleter.
+	ReclaimNode reclaimNode {};
+	Device* dev {};
 
 	// Time needed for the given command.
 	// Set to u64(-1) on error.
@@ -110,7 +115,7 @@ struct CommandHookState {
 	CopiedTransferIO transferDstBefore {};
 	CopiedTransferIO transferDstAfter {};
 
-	CommandHookState();
+	explicit CommandHookState(Device& dev);
 	~CommandHookState();
 };
 
@@ -91,13 +91,6 @@ void CommandHookSubmission::finish(Submission& subm) {
 	assertOwned(record->hook->dev_->mutex);
 	transmitTiming();
 
-	// This usually is a sign of a problem somewhere inside the layer.
-	// Either we are not correctly clearing completed states from the gui
-	// but still producing new ones or we have just *waaay* to many
-	// candidates and should somehow improve matching for this case.
-	dlg_assertlm(dlg_level_warn, record->hook->completed_.size() < 64,
-		"High number of hook states detected");
-
 	// indirect command readback
 	if(record->state->indirectCopy.buf) {
 		auto& bcmd = *record->hcommand.back();
@@ -144,6 +137,15 @@ void CommandHookSubmission::finish(Submission& subm) {
 
 	finishAccelStructBuilds();
 
+	std::lock_guard hookLock(record->hook->mutex);
+
+	// This usually is a sign of a problem somewhere inside the layer.
+	// Either we are not correctly clearing completed states from the gui
+	// but still producing new ones or we have just *waaay* to many
+	// candidates and should somehow improve matching for this case.
+	dlg_assertlm(dlg_level_warn, record->hook->completed_.size() < 64,
+		"High number of hook states detected");
+
 	CompletedHook* dstCompleted {};
 	if(record->localCapture) {
 		if(record->localCapture->flags & LocalCaptureBits::once) {
@@ -162,7 +164,7 @@ void CommandHookSubmission::finish(Submission& subm) {
 
 		if(record->localCapture->completed.state) {
 			// TODO: hacky af. Needed because we can't destroy the record
-			// here (intrusivePtr) since the device mutex is locked.
+			// here (intrusivePtr) since the device and hook mutex are locked.
 			// Maybe just change that?
 			dlg_assert(record->localCapture->completed.record);
 			record->hook->keepAliveLC_.push_back(std::move(record->localCapture->completed));
@@ -175,7 +177,7 @@ void CommandHookSubmission::finish(Submission& subm) {
 		dstCompleted = &record->hook->completed_.emplace_back();
 	}
 
-	dstCompleted->record = IntrusivePtr<CommandRecord>(record->record);
+	dstCompleted->record = CommandRecordPtr(record->record);
 	dstCompleted->match = record->match;
 	dstCompleted->state = record->state;
 	dstCompleted->command = record->hcommand;
@@ -219,6 +221,11 @@ void CommandHookSubmission::finishAccelStructBuilds() {
 	// Notify all accel struct builds that they have finished.
 	// We are guaranteed by the standard that all accelStructs build
 	// by the submission are still valid at this point.
+	if(record->accelStructOps.empty()) {
+		return;
+	}
+
+	std::lock_guard snapshotLock(record->record->dev->snapshotMutex);
 	for(auto& op : record->accelStructOps) {
 		if(auto* buildOp = std::get_if<CommandHookRecord::AccelStructBuild>(&op); buildOp) {
 			for(auto& build : buildOp->builds) {
@@ -0,0 +1,209 @@
+#include <completion.hpp>
+#include <device.hpp>
+#include <queue.hpp>
+#include <util/util.hpp>
+#include <util/profiling.hpp>
+#include <vkutil/enumString.hpp>
+#include <vector>
+
+namespace vil {
+
+CompletionTracker::~CompletionTracker() {
+	stop();
+}
+
+void CompletionTracker::start(Device& dev) {
+	dlg_assert(!thread_.joinable());
+	dlg_assert(!running_.load());
+
+	dev_ = &dev;
+	if(dev.timelineSemaphores) {
+		VkSemaphoreTypeCreateInfo tsci {};
+		tsci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		tsci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		tsci.initialValue = 0u;
+
+		VkSemaphoreCreateInfo sci {};
+		sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		sci.pNext = &tsci;
+		VK_CHECK(dev.dispatch.CreateSemaphore(dev.handle, &sci, nullptr,
+			&wakeSemaphore_));
+		nameHandle(dev, wakeSemaphore_, "CompletionTracker:wake");
+	}
+
+	exit_ = false;
+	running_.store(true);
+	thread_ = std::thread([this]{ threadMain(); });
+}
+
+void CompletionTracker::stop() {
+	running_.store(false);
+
+	if(thread_.joinable()) {
+		{
+			std::lock_guard lock(mutex_);
+			exit_ = true;
+		}
+
+		{
+			std::lock_guard lock(dev_->mutex);
+			waiting_ = false;
+			wake();
+		}
+
+		thread_.join();
+	}
+
+	if(wakeSemaphore_) {
+		dev_->dispatch.DestroySemaphore(dev_->handle, wakeSemaphore_, nullptr);
+		wakeSemaphore_ = {};
+	}
+}
+
+void CompletionTracker::notifyLocked() {
+	if(!waiting_) {
+		return;
+	}
+
+	assertOwned(dev_->mutex);
+	waiting_ = false;
+	wake();
+}
+
+void CompletionTracker::wake() {
+	if(wakeSemaphore_) {
+		VkSemaphoreSignalInfo si {};
+		si.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+		si.semaphore = wakeSemaphore_;
+		si.value = ++wakeValue_;
+		VK_CHECK_DEV(dev_->dispatch.SignalSemaphore(dev_->handle, &si), *dev_);
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		wake_ = true;
+	}
+
+	cv_.notify_one();
+}
+
+void CompletionTracker::wait(bool timeout) {
+	std::unique_lock lock(mutex_);
+	auto woken = [&]{ return exit_ || wake_; };
+	if(timeout) {
+		cv_.wait_for(lock, maxWait, woken);
+	} else {
+		cv_.wait(lock, woken);
+	}
+}
+
+void CompletionTracker::threadMain() {
+	auto& dev = *dev_;
+	const auto timeout = u64(std::chrono::nanoseconds(maxWait).count());
+
+	std::vector<Queue*> queues;
+	std::vector<VkSemaphore> semaphores;
+	std::vector<u64> values;
+
+	// Whether the last wait returned because a pending submission completed
+	auto completed = false;
+
+	while(true) {
+		{
+			std::lock_guard lock(mutex_);
+			if(exit_) {
+				break;
+			}
+
+			wake_ = false;
+		}
+
+		queues.clear();
+		semaphores.clear();
+		values.clear();
+
+		auto retired = false;
+		auto pending = false;
+
+		{
+			ZoneScopedN("retire");
+			std::lock_guard lock(dev.mutex);
+
+			auto count = dev.pending.size();
+			checkPendingSubmissionsLocked(dev);
+			retired = (dev.pending.size() < count);
+			pending = !dev.pending.empty();
+
+			// Wait for the first pending submission batch on each queue.
+			// Batches without submissions and sparse bindings don't signal
+			// our semaphore, they are only polled.
+			if(dev.timelineSemaphores) {
+				for(auto& batch : dev.pending) {
+					if(batch->type != SubmissionType::command ||
+							batch->submissions.empty() ||
+							contains(queues, batch->queue)) {
+						continue;
+					}
+
+					queues.push_back(batch->queue);
+					semaphores.push_back(batch->queue->submissionSemaphore);
+					values.push_back(batch->submissions.back().queueSubmitID);
+				}
+
+				semaphores.push_back(wakeSemaphore_);
+				values.push_back(wakeValue_ + 1);
+			}
+
+			waiting_ = true;
+		}
+
+		// When a submission signaled its semaphore but couldn't be retired
+		// (e.g. its fence isn't signaled yet or it isn't active since we
+		// couldn't track its dependencies), poll instead of waiting on
+		// the same value again.
+		auto poll = completed && !retired;
+		completed = false;
+
+		// Every new submission notifies us, no need to poll.
+		if(!pending) {
+			wait(false);
+			continue;
+		}
+
+		if(poll || queues.empty()) {
+			wait(true);
+			continue;
+		}
+
+		// Without timeline semaphores, queues is always empty. We can't
+		// wait on the fences: application fences might be destroyed any
+		// time and our own fences are reset (under the device mutex) when
+		// the submission is retired on another thread.
+		dlg_assert(dev.timelineSemaphores);
+
+		VkSemaphoreWaitInfo wi {};
+		wi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wi.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+		wi.semaphoreCount = u32(semaphores.size());
+		wi.pSemaphores = semaphores.data();
+		wi.pValues = values.data();
+
+		auto res = dev.dispatch.WaitSemaphores(dev.handle, &wi, timeout);
+		if(res == VK_SUCCESS) {
+			// Don't count wakeups as completion
+			u64 wakeValue {};
+			dev.dispatch.GetSemaphoreCounterValue(dev.handle, wakeSemaphore_,
+				&wakeValue);
+			completed = (wakeValue < values.back());
+		} else if(res != VK_TIMEOUT) {
+			dlg_error("vkWaitSemaphores error: {} ({})", vk::name(res), res);
+			if(res == VK_ERROR_DEVICE_LOST) {
+				onDeviceLost(dev);
+			}
+
+			wait(true);
+		}
+	}
+}
+
+} // namespace vil
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <vk/vulkan.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace vil {
+
+// Retires pending submissions (Device::pending) on a separate thread as
+// soon as they complete, instead of opportunistically on application
+// threads. Completion processing (e.g. CommandHookSubmission::finish,
+// image layout and acceleration structure state updates) therefore
+// doesn't happen inside application calls anymore.
+// With timeline semaphores, the thread waits for the first pending
+// submission on each queue via vkWaitSemaphores (waitAny), together with
+// a host-signaled semaphore that wakes it up for new submissions.
+// Batches that don't signal our timeline semaphore (empty and sparse
+// batches) and all batches on devices without timeline semaphores are
+// polled every maxWait instead. Fences can't be waited upon: the
+// application might destroy its fences any time and ours are reset when
+// the batch is retired on another thread.
+// Without pending submissions, the thread sleeps until notified.
+// Before start() and after stop(), submissions are only retired by the
+// opportunistic checks.
+class CompletionTracker {
+public:
+	// The maximum time the thread waits until it checks all pending
+	// submissions again.
+	static constexpr auto maxWait = std::chrono::milliseconds(10);
+
+public:
+	CompletionTracker() = default;
+	~CompletionTracker();
+
+	CompletionTracker(CompletionTracker&&) noexcept = delete;
+	CompletionTracker& operator=(CompletionTracker&&) noexcept = delete;
+
+	void start(Device& dev);
+
+	// Joins the thread. Must be called before anything the pending
+	// submissions reference is destroyed.
+	void stop();
+
+	// Wakes up the thread when it is waiting for completion, so it can
+	// also wait for a new submission. Must be called after adding a
+	// batch to dev.pending, with the device mutex still locked.
+	void notifyLocked();
+
+	bool running() const { return running_.load(); }
+
+private:
+	void threadMain();
+	// Waits until woken up, at most maxWait when timeout is true.
+	void wait(bool timeout);
+	void wake();
+
+	Device* dev_ {};
+	std::atomic<bool> running_ {};
+
+	// Host-signaled to interrupt vkWaitSemaphores, only with
+	// timeline semaphores.
+	VkSemaphore wakeSemaphore_ {};
+	u64 wakeValue_ {}; // synced via device mutex
+
+	// Whether the thread is waiting (or about to wait) and needs to
+	// be woken up for new submissions. Synced via device mutex.
+	bool waiting_ {};
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool exit_ {}; // synced via mutex_
+	bool wake_ {}; // synced via mutex_
+	std::thread thread_;
+};
+
+} // namespace vil
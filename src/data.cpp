@@ -2,7 +2,152 @@
 
 namespace vil {
 
-std::unordered_map<std::uint64_t, void*> dispatchableTable;
+// log2 of the initial slot count. The table grows when more than 3/4
+// of the slots are used.
+constexpr auto initialTableBits = 6u;
+
+DispatchableTable::DispatchableTable() {
+	auto* array = createArray(initialTableBits);
+	arrays_.emplace_back(array);
+	current_.store(array, std::memory_order_release);
+}
+
+DispatchableTable::~DispatchableTable() = default;
+
+DispatchableTable::Array* DispatchableTable::createArray(u32 bits) {
+	auto* array = new Array();
+	array->shift = 64u - bits;
+	array->mask = (u64(1u) << bits) - 1u;
+	array->slots = std::make_unique<Slot[]>(array->mask + 1);
+	return array;
+}
+
+bool DispatchableTable::insert(u64 key, void* data, u32 pin) {
+	dlg_assert(key);
+	std::lock_guard lock(writeMutex_);
+
+	if(find(key, pin)) {
+		return false;
+	}
+
+	if(pin != noPin) {
+		auto& pinned = pinned_[pin];
+		if(!pinned.key.load(std::memory_order_relaxed)) {
+			pinned.data.store(data, std::memory_order_relaxed);
+			pinned.key.store(key, std::memory_order_release);
+			return true;
+		}
+	}
+
+	auto* array = current_.load(std::memory_order_relaxed);
+	if(4 * (count_ + 1) > 3 * (array->mask + 1)) {
+		grow();
+		array = current_.load(std::memory_order_relaxed);
+	}
+
+	// Filling an empty slot doesn't move any entries, readers either
+	// see the slot empty or the complete entry. No need for the seqlock.
+	auto i = home(*array, key);
+	while(array->slots[i].key.load(std::memory_order_relaxed)) {
+		i = (i + 1) & array->mask;
+	}
+
+	array->slots[i].data.store(data, std::memory_order_relaxed);
+	array->slots[i].key.store(key, std::memory_order_release);
+	++count_;
+
+	return true;
+}
+
+void* DispatchableTable::erase(u64 key, u32 pin) {
+	std::lock_guard lock(writeMutex_);
+
+	if(pin != noPin) {
+		auto& pinned = pinned_[pin];
+		if(pinned.key.load(std::memory_order_relaxed) == key) {
+			auto* data = pinned.data.load(std::memory_order_relaxed);
+			pinned.key.store(0u, std::memory_order_release);
+			return data;
+		}
+	}
+
+	auto& array = *current_.load(std::memory_order_relaxed);
+	auto i = home(array, key);
+	while(true) {
+		auto slotKey = array.slots[i].key.load(std::memory_order_relaxed);
+		if(slotKey == key) {
+			break;
+		} else if(!slotKey) {
+			return nullptr;
+		}
+
+		i = (i + 1) & array.mask;
+	}
+
+	auto* data = array.slots[i].data.load(std::memory_order_relaxed);
+
+	// Backward shift deletion: move following entries of the probe
+	// sequence into the hole so lookups can still stop at empty slots.
+	// Since this moves entries, readers have to retry.
+	auto version = version_.load(std::memory_order_relaxed);
+	version_.store(version + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	for(auto j = (i + 1) & array.mask; ; j = (j + 1) & array.mask) {
+		auto slotKey = array.slots[j].key.load(std::memory_order_relaxed);
+		if(!slotKey) {
+			break;
+		}
+
+		// The entry has to stay when its home lies cyclically in (i, j]
+		auto h = home(array, slotKey);
+		auto stays = (i <= j) ? (i < h && h <= j) : (i < h || h <= j);
+		if(stays) {
+			continue;
+		}
+
+		array.slots[i].data.store(array.slots[j].data.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		array.slots[i].key.store(slotKey, std::memory_order_relaxed);
+		i = j;
+	}
+
+	array.slots[i].key.store(0u, std::memory_order_relaxed);
+	array.slots[i].data.store(nullptr, std::memory_order_relaxed);
+	--count_;
+
+	version_.store(version + 2, std::memory_order_release);
+	return data;
+}
+
+void DispatchableTable::grow() {
+	auto& old = *current_.load(std::memory_order_relaxed);
+	auto bits = 64u - old.shift + 1u;
+	auto* array = createArray(bits);
+
+	for(auto i = 0u; i < old.mask + 1; ++i) {
+		auto key = old.slots[i].key.load(std::memory_order_relaxed);
+		if(!key) {
+			continue;
+		}
+
+		auto j = home(*array, key);
+		while(array->slots[j].key.load(std::memory_order_relaxed)) {
+			j = (j + 1) & array->mask;
+		}
+
+		array->slots[j].data.store(old.slots[i].data.load(std::memory_order_relaxed),
+			std::memory_order_relaxed);
+		array->slots[j].key.store(key, std::memory_order_relaxed);
+	}
+
+	// The old array stays alive in arrays_, readers might still use it.
+	// It's not modified anymore.
+	arrays_.emplace_back(array);
+	current_.store(array, std::memory_order_release);
+}
+
+DispatchableTable dispatchableTable;
 std::unordered_map<void*, Device*> devByLoaderTable;
 std::shared_mutex dataMutex;
 
@@ -4,55 +4,170 @@
 #include <util/handleCast.hpp>
 #include <util/dlg.hpp>
 #include <vk/vulkan.h>
+#include <atomic>
 #include <cstring>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <shared_mutex>
+#include <type_traits>
+#include <vector>
 
 namespace vil {
 
-// PERF(low prio): use small buffer optimization for those (especially
-//   devices & instances, optimizing for the common case of just one
-//   instance/device here would likely reduce the overhead quite a bit).
-//   Look into using the vk_layer small-buffer hashtable implementation
+// Lock-free table of all dispatchable handles (instance, device, phdev,
+// queue, cb), mapping them to our data. There is a lookup on every call
+// with a dispatchable handle so readers never write shared memory:
+// they check a seqlock version, probe the current open-addressing array
+// and retry when a writer modified the array in the meantime.
+// Writers are serialized via a mutex. Growing the table publishes a new
+// array, the old ones are kept alive until the table is destroyed since
+// readers might still probe them. As the arrays double in size, this is
+// bounded by the size of the current array.
+// The first VkInstance and VkDevice are stored in dedicated slots,
+// for the common one-instance/one-device case a lookup is a single compare.
+class DispatchableTable {
+public:
+	// Index of the dedicated slot for handle type T, noPin if T has none.
+	static constexpr auto noPin = u32(-1);
+	template<typename T> static constexpr u32 pinSlot() {
+		if constexpr(std::is_same_v<T, VkInstance>) {
+			return 0u;
+		} else if constexpr(std::is_same_v<T, VkDevice>) {
+			return 1u;
+		} else {
+			return noPin;
+		}
+	}
+
+	DispatchableTable();
+	~DispatchableTable();
+
+	// Returns nullptr if the handle isn't in the table.
+	void* find(u64 key, u32 pin) const;
+	// Returns false if the handle is already in the table.
+	bool insert(u64 key, void* data, u32 pin);
+	// Returns the removed data, nullptr if the handle wasn't in the table.
+	void* erase(u64 key, u32 pin);
+
+	// Calls func(key, data) for every entry. Must not modify the table.
+	template<typename F>
+	void forEach(F&& func) {
+		std::lock_guard lock(writeMutex_);
+		for(auto& pinned : pinned_) {
+			auto key = pinned.key.load(std::memory_order_relaxed);
+			if(key) {
+				func(key, pinned.data.load(std::memory_order_relaxed));
+			}
+		}
+
+		auto& array = *current_.load(std::memory_order_relaxed);
+		for(auto i = 0u; i < array.mask + 1; ++i) {
+			auto key = array.slots[i].key.load(std::memory_order_relaxed);
+			if(key) {
+				func(key, array.slots[i].data.load(std::memory_order_relaxed));
+			}
+		}
+	}
+
+private:
+	struct Slot {
+		std::atomic<u64> key {}; // zero for empty slots
+		std::atomic<void*> data {};
+	};
+
+	struct Array {
+		u32 shift {}; // 64 - log2(slot count)
+		u64 mask {}; // slot count - 1
+		std::unique_ptr<Slot[]> slots;
+	};
+
+	static u64 home(const Array& array, u64 key) {
+		// fibonacci hashing, handles are pointers with meaningless low bits
+		return (key * 0x9E3779B97F4A7C15ull) >> array.shift;
+	}
+
+	static Array* createArray(u32 bits);
+	void grow();
+
+	alignas(64) std::atomic<Array*> current_ {};
+	// Odd while a writer modifies the current array
+	std::atomic<u32> version_ {};
+	Slot pinned_[2];
+
+	// only accessed by writers
+	alignas(64) std::mutex writeMutex_;
+	std::vector<std::unique_ptr<Array>> arrays_; // current and retired
+	u64 count_ {}; // entries in the current array
+};
+
+inline void* DispatchableTable::find(u64 key, u32 pin) const {
+	if(pin != noPin) {
+		auto& pinned = pinned_[pin];
+		if(pinned.key.load(std::memory_order_acquire) == key) {
+			return pinned.data.load(std::memory_order_relaxed);
+		}
+	}
+
+	while(true) {
+		auto version = version_.load(std::memory_order_acquire);
+		if(version & 1u) {
+			continue;
+		}
+
+		auto& array = *current_.load(std::memory_order_acquire);
+		void* ret = nullptr;
+		for(auto i = home(array, key); ; i = (i + 1) & array.mask) {
+			auto& slot = array.slots[i];
+			auto slotKey = slot.key.load(std::memory_order_acquire);
+			if(slotKey == key) {
+				ret = slot.data.load(std::memory_order_relaxed);
+				break;
+			} else if(!slotKey) {
+				break;
+			}
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(version_.load(std::memory_order_relaxed) == version) {
+			return ret;
+		}
+	}
+}
+
+extern DispatchableTable dispatchableTable;
 
-// Table of all dispatchable handles (instance, device, phdev, queue, cb)
-extern std::unordered_map<std::uint64_t, void*> dispatchableTable;
 // Table of device loaders (the first word in any VkDevice handle, no matter
 // where/how it is wrapped). This allows us in our public API implementation
 // to recognize VkDevice handles directly coming from the device (we can't
 // just use the dispatchableTable directly for that since it might
 // be wrapped by other layers).
 extern std::unordered_map<void*, Device*> devByLoaderTable;
-// Synchronizes access to those global tables
+// Synchronizes access to devByLoaderTable
 extern std::shared_mutex dataMutex;
 
 template<typename T>
 void* findData(T handle) {
-	std::shared_lock lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	return it == dispatchableTable.end() ? nullptr : it->second;
+	return dispatchableTable.find(handleToU64(handle),
+		DispatchableTable::pinSlot<T>());
 }
 
 template<typename R, typename T>
 R* findData(T handle) {
-	std::shared_lock lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	return static_cast<R*>(it == dispatchableTable.end() ? nullptr : it->second);
+	return static_cast<R*>(findData(handle));
 }
 
 template<typename R, typename T>
 R& getData(T handle) {
-	std::shared_lock lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	dlg_assert(it != dispatchableTable.end());
-	return *static_cast<R*>(it->second);
+	auto* data = findData(handle);
+	dlg_assert(data);
+	return *static_cast<R*>(data);
 }
 
 template<typename T>
 void insertData(T handle, void* data) {
-	std::lock_guard lock(dataMutex);
-	auto [_, success] = dispatchableTable.emplace(handleToU64(handle), data);
+	auto success = dispatchableTable.insert(handleToU64(handle), data,
+		DispatchableTable::pinSlot<T>());
 	dlg_assert(success);
 }
 
@@ -65,27 +180,18 @@ R& createData(T handle, Args&&... args) {
 
 template<typename T>
 void eraseData(T handle) {
-	std::lock_guard lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	if(it == dispatchableTable.end()) {
+	auto* data = dispatchableTable.erase(handleToU64(handle),
+		DispatchableTable::pinSlot<T>());
+	if(!data) {
 		dlg_error("Couldn't find data for {} ({})", handleToU64(handle), typeid(T).name());
-		return;
 	}
-
-	dispatchableTable.erase(it);
 }
 
 template<typename R, typename T>
 std::unique_ptr<R> moveDataOpt(T handle) {
-	std::lock_guard lock(dataMutex);
-	auto it = dispatchableTable.find(handleToU64(handle));
-	if(it == dispatchableTable.end()) {
-		return nullptr;
-	}
-
-	auto ptr = it->second;
-	dispatchableTable.erase(it);
-	return std::unique_ptr<R>(static_cast<R*>(ptr));
+	auto* data = dispatchableTable.erase(handleToU64(handle),
+		DispatchableTable::pinSlot<T>());
+	return std::unique_ptr<R>(static_cast<R*>(data));
 }
 
 template<typename R, typename T>
@@ -0,0 +1,433 @@
+#include <descriptorBuffer.hpp>
+#include <device.hpp>
+#include <wrap.hpp>
+#include <ds.hpp>
+#include <buffer.hpp>
+#include <image.hpp>
+#include <memory.hpp>
+#include <pipe.hpp>
+#include <accelStruct.hpp>
+#include <command/record.hpp>
+#include <util/refBatch.hpp>
+#include <util/profiling.hpp>
+#include <cstring>
+
+namespace vil {
+
+namespace {
+
+// Returns the size of a single descriptor of the given type in a
+// descriptor buffer. Returns 0 for types we don't decode.
+std::size_t descriptorSize(const Device& dev, VkDescriptorType type) {
+	auto& props = dev.descriptorBuffers->props;
+	auto robust = dev.enabledFeatures.robustBufferAccess;
+
+	switch(type) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+			return props.samplerDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+			return props.combinedImageSamplerDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+			return props.sampledImageDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+			return props.storageImageDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			return props.inputAttachmentDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+			return robust ? props.robustUniformBufferDescriptorSize :
+				props.uniformBufferDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+			return robust ? props.robustStorageBufferDescriptorSize :
+				props.storageBufferDescriptorSize;
+		case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+			return props.accelerationStructureDescriptorSize;
+		default:
+			return 0u;
+	}
+}
+
+// Returns the part of the given buffer address that can be read via
+// the host, i.e. is currently mapped. Empty if there is none.
+span<const std::byte> hostData(Device& dev, VkDeviceAddress address) {
+	auto* buf = findBufferAtLocked(dev, address);
+	if(!buf) {
+		return {};
+	}
+
+	auto* bind = std::get_if<FullMemoryBind>(&buf->memory);
+	if(!bind || bind->memState != FullMemoryBind::State::bound ||
+			!bind->memory || !bind->memory->map) {
+		return {};
+	}
+
+	auto& mem = *bind->memory;
+	auto mapEnd = mem.mapOffset + evalRange(mem.size, mem.mapOffset, mem.mapSize);
+	auto begin = bind->memOffset + (address - buf->deviceAddress);
+	auto end = std::min(bind->memOffset + buf->ci.size, mapEnd);
+	if(begin < mem.mapOffset || begin >= end) {
+		return {};
+	}
+
+	auto* data = static_cast<const std::byte*>(mem.map) + (begin - mem.mapOffset);
+	return {data, std::size_t(end - begin)};
+}
+
+void decodeBinding(Device& dev, DescriptorStateRef state, unsigned b,
+		span<const std::byte> data, RefCountBatch& refs) {
+	auto& binding = state.layout->bindings[b];
+	auto count = descriptorCount(state, b);
+	if(!count) {
+		return;
+	}
+
+	VkDeviceSize offset {};
+	dev.dispatch.GetDescriptorSetLayoutBindingOffsetEXT(dev.handle,
+		state.layout->handle, b, &offset);
+	if(offset >= data.size()) {
+		return;
+	}
+
+	data = data.subspan(offset);
+
+	auto type = binding.descriptorType;
+	if(type == VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK) {
+		// The data is stored directly in the buffer
+		auto dst = inlineUniformBlock(state, b);
+		auto size = std::min(dst.size(), data.size());
+		std::memcpy(dst.data(), data.data(), size);
+		return;
+	}
+
+	auto size = descriptorSize(dev, type);
+	if(!size) {
+		return;
+	}
+
+	auto& table = *dev.descriptorBuffers;
+	std::lock_guard lock(table.mutex);
+
+	for(auto e = 0u; e < count && (e + 1) * size <= data.size(); ++e) {
+		auto* pentry = table.findLocked(type, data.subspan(e * size, size));
+		if(!pentry) {
+			continue;
+		}
+
+		auto& entry = *pentry;
+		switch(category(type)) {
+			case DescriptorCategory::image: {
+				auto& dst = images(state, b)[e];
+				if(entry.imageView && containsHandle(dev.imageViews, entry.imageView)) {
+					dst.imageView = entry.imageView;
+					dst.layout = entry.layout;
+					refs.inc(*dst.imageView);
+				}
+
+				// immutable samplers were already filled in
+				if(!dst.sampler && entry.sampler &&
+						containsHandle(dev.samplers, entry.sampler)) {
+					dst.sampler = entry.sampler;
+					refs.inc(*dst.sampler);
+				}
+				break;
+			} case DescriptorCategory::buffer: {
+				auto* buf = findBufferAtLocked(dev, entry.address);
+				if(buf) {
+					auto& dst = buffers(state, b)[e];
+					dst.buffer = buf;
+					dst.offset = entry.address - buf->deviceAddress;
+					dst.range = entry.range;
+					refs.inc(*buf);
+				}
+				break;
+			} case DescriptorCategory::accelStruct: {
+				auto* accelStruct = tryAccelStructAtLocked(dev, entry.address);
+				if(accelStruct) {
+					auto& dst = accelStructs(state, b)[e];
+					dst.accelStruct = accelStruct;
+					refs.inc(*dst.accelStruct);
+				}
+				break;
+			} default:
+				break;
+		}
+	}
+}
+
+// Whether the handles the given entry refers to were destroyed.
+// The device mutex must be locked.
+bool deadLocked(Device& dev, VkDescriptorType type, const DescriptorBufferEntry& entry) {
+	switch(category(type)) {
+		case DescriptorCategory::image:
+			return (entry.imageView && !containsHandle(dev.imageViews, entry.imageView)) ||
+				(entry.sampler && !containsHandle(dev.samplers, entry.sampler));
+		case DescriptorCategory::buffer:
+			return !findBufferAtLocked(dev, entry.address);
+		case DescriptorCategory::accelStruct:
+			return !tryAccelStructAtLocked(dev, entry.address);
+		default:
+			return false;
+	}
+}
+
+} // anon namespace
+
+std::string DescriptorBufferTable::key(VkDescriptorType type, ReadBuf data) {
+	std::string ret(sizeof(type) + data.size(), '\0');
+	std::memcpy(ret.data(), &type, sizeof(type));
+	std::memcpy(ret.data() + sizeof(type), data.data(), data.size());
+	return ret;
+}
+
+VkDescriptorType DescriptorBufferTable::type(const std::string& key) {
+	dlg_assert(key.size() >= sizeof(VkDescriptorType));
+	VkDescriptorType ret;
+	std::memcpy(&ret, key.data(), sizeof(ret));
+	return ret;
+}
+
+const DescriptorBufferEntry* DescriptorBufferTable::findLocked(
+		VkDescriptorType type, ReadBuf data) const {
+	assertOwned(mutex);
+	auto it = entries.find(key(type, data));
+	return it == entries.end() ? nullptr : &it->second;
+}
+
+void DescriptorBufferTable::insertLocked(VkDescriptorType type, ReadBuf data,
+		const DescriptorBufferEntry& entry) {
+	assertOwned(mutex);
+	dlg_assert(!fullLocked());
+	entries.insert_or_assign(key(type, data), entry);
+}
+
+IntrusivePtr<DescriptorSetCow> decodeDescriptorBufferLocked(
+		const DescriptorState& state, const BoundDescriptorSet& bds) {
+	ZoneScoped;
+
+	dlg_assert(bds.fromDescriptorBuffer());
+	dlg_assert(bds.layout);
+
+	auto& dev = *bds.layout->dev;
+	assertOwned(dev.mutex);
+
+	auto setID = std::size_t(&bds - state.descriptorSets.data());
+	dlg_assert(setID < state.descriptorSets.size());
+	dlg_assert(setID < bds.layout->descriptors.size());
+	auto& dsLayout = *bds.layout->descriptors[setID];
+
+	span<const std::byte> data;
+	if(bds.descriptorBufferIndex != BoundDescriptorSet::embeddedSamplers) {
+		if(bds.descriptorBufferIndex >= state.descriptorBuffers.size()) {
+			dlg_warn("Descriptor buffer index {} out of range", bds.descriptorBufferIndex);
+			return {};
+		}
+
+		auto address = state.descriptorBuffers[bds.descriptorBufferIndex].address;
+		data = hostData(dev, address + bds.descriptorBufferOffset);
+		if(data.empty()) {
+			dlg_debug("Descriptor buffer not mapped, can't decode descriptors");
+			return {};
+		}
+	}
+
+	// The variable descriptor count isn't known for descriptor buffers.
+	// Just assume the maximum, we won't read past the mapped data.
+	auto varCount = 0u;
+	if(!dsLayout.bindings.empty() && (dsLayout.bindings.back().flags &
+			VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT)) {
+		varCount = dsLayout.bindings.back().descriptorCount;
+	}
+
+	IntrusivePtr<DescriptorSetCow> cow(new DescriptorSetCow());
+	cow->copy = newDescriptorStateCopy(dsLayout, varCount);
+
+	// embedded samplers only consist of the immutable samplers
+	if(!data.empty()) {
+		// Only increments since the state is new, flushing can't destroy anything
+		RefCountBatch refs;
+		DescriptorStateRef ref(*cow->copy);
+		for(auto b = 0u; b < dsLayout.bindings.size(); ++b) {
+			decodeBinding(dev, ref, b, data, refs);
+		}
+
+		refs.flush();
+	}
+
+	return cow;
+}
+
+// api
+VKAPI_ATTR void VKAPI_CALL GetDescriptorSetLayoutSizeEXT(
+		VkDevice                                    device,
+		VkDescriptorSetLayout                       layout,
+		VkDeviceSize*                               pLayoutSizeInBytes) {
+	auto& dsl = get(device, layout);
+	dsl.dev->dispatch.GetDescriptorSetLayoutSizeEXT(dsl.dev->handle,
+		dsl.handle, pLayoutSizeInBytes);
+}
+
+VKAPI_ATTR void VKAPI_CALL GetDescriptorSetLayoutBindingOffsetEXT(
+		VkDevice                                    device,
+		VkDescriptorSetLayout                       layout,
+		uint32_t                                    binding,
+		VkDeviceSize*                               pOffset) {
+	auto& dsl = get(device, layout);
+	dsl.dev->dispatch.GetDescriptorSetLayoutBindingOffsetEXT(dsl.dev->handle,
+		dsl.handle, binding, pOffset);
+}
+
+VKAPI_ATTR void VKAPI_CALL GetDescriptorEXT(
+		VkDevice                                    device,
+		const VkDescriptorGetInfoEXT*               pDescriptorInfo,
+		size_t                                      dataSize,
+		void*                                       pDescriptor) {
+	auto& dev = getDevice(device);
+
+	auto info = *pDescriptorInfo;
+	DescriptorBufferEntry entry;
+
+	VkSampler sampler {};
+	VkDescriptorImageInfo imgInfo {};
+	auto unwrapImageInfo = [&](const VkDescriptorImageInfo* src) {
+		if(!src) {
+			return src;
+		}
+
+		imgInfo = *src;
+		if(imgInfo.imageView) {
+			entry.imageView = &get(dev, imgInfo.imageView);
+			imgInfo.imageView = entry.imageView->handle;
+		}
+		if(imgInfo.sampler) {
+			entry.sampler = &get(dev, imgInfo.sampler);
+			imgInfo.sampler = entry.sampler->handle;
+		}
+
+		entry.layout = imgInfo.imageLayout;
+		return static_cast<const VkDescriptorImageInfo*>(&imgInfo);
+	};
+
+	auto addressInfo = [&](const VkDescriptorAddressInfoEXT* src) {
+		if(src) {
+			entry.address = src->address;
+			entry.range = src->range;
+		}
+	};
+
+	switch(info.type) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+			entry.sampler = &get(dev, *info.data.pSampler);
+			sampler = entry.sampler->handle;
+			info.data.pSampler = &sampler;
+			break;
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+			info.data.pCombinedImageSampler = unwrapImageInfo(info.data.pCombinedImageSampler);
+			break;
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+			info.data.pSampledImage = unwrapImageInfo(info.data.pSampledImage);
+			break;
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+			info.data.pStorageImage = unwrapImageInfo(info.data.pStorageImage);
+			break;
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			info.data.pInputAttachmentImage = unwrapImageInfo(info.data.pInputAttachmentImage);
+			break;
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+			addressInfo(info.data.pUniformBuffer);
+			break;
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+			addressInfo(info.data.pStorageBuffer);
+			break;
+		case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+			entry.address = info.data.accelerationStructure;
+			break;
+		default:
+			// texel buffers don't contain handles
+			break;
+	}
+
+	dev.dispatch.GetDescriptorEXT(dev.handle, &info, dataSize, pDescriptor);
+
+	if(!dev.descriptorBuffers || !descriptorSize(dev, info.type)) {
+		return;
+	}
+
+	ReadBuf data {static_cast<const std::byte*>(pDescriptor), dataSize};
+	auto& table = *dev.descriptorBuffers;
+	std::unique_lock lock(table.mutex);
+	if(table.fullLocked()) {
+		// Checking the handles requires the device mutex, which
+		// must be locked first.
+		lock.unlock();
+		std::shared_lock devLock(dev.mutex);
+		lock.lock();
+
+		if(table.fullLocked()) {
+			auto removed = table.pruneLocked([&](auto type, auto& entry) {
+				return deadLocked(dev, type, entry);
+			});
+			dlg_debug("Pruned {} descriptor buffer entries", removed);
+		}
+	}
+
+	table.insertLocked(info.type, data, entry);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL GetBufferOpaqueCaptureDescriptorDataEXT(
+		VkDevice                                    device,
+		const VkBufferCaptureDescriptorDataInfoEXT* pInfo,
+		void*                                       pData) {
+	auto& buf = get(device, pInfo->buffer);
+	auto fwd = *pInfo;
+	fwd.buffer = buf.handle;
+	return buf.dev->dispatch.GetBufferOpaqueCaptureDescriptorDataEXT(
+		buf.dev->handle, &fwd, pData);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL GetImageOpaqueCaptureDescriptorDataEXT(
+		VkDevice                                    device,
+		const VkImageCaptureDescriptorDataInfoEXT*  pInfo,
+		void*                                       pData) {
+	auto& img = get(device, pInfo->image);
+	auto fwd = *pInfo;
+	fwd.image = img.handle;
+	return img.dev->dispatch.GetImageOpaqueCaptureDescriptorDataEXT(
+		img.dev->handle, &fwd, pData);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL GetImageViewOpaqueCaptureDescriptorDataEXT(
+		VkDevice                                    device,
+		const VkImageViewCaptureDescriptorDataInfoEXT* pInfo,
+		void*                                       pData) {
+	auto& view = get(device, pInfo->imageView);
+	auto fwd = *pInfo;
+	fwd.imageView = view.handle;
+	return view.dev->dispatch.GetImageViewOpaqueCaptureDescriptorDataEXT(
+		view.dev->handle, &fwd, pData);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL GetSamplerOpaqueCaptureDescriptorDataEXT(
+		VkDevice                                    device,
+		const VkSamplerCaptureDescriptorDataInfoEXT* pInfo,
+		void*                                       pData) {
+	auto& sampler = get(device, pInfo->sampler);
+	auto fwd = *pInfo;
+	fwd.sampler = sampler.handle;
+	return sampler.dev->dispatch.GetSamplerOpaqueCaptureDescriptorDataEXT(
+		sampler.dev->handle, &fwd, pData);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL GetAccelerationStructureOpaqueCaptureDescriptorDataEXT(
+		VkDevice                                    device,
+		const VkAccelerationStructureCaptureDescriptorDataInfoEXT* pInfo,
+		void*                                       pData) {
+	auto& dev = getDevice(device);
+	auto fwd = *pInfo;
+	if(fwd.accelerationStructure) {
+		fwd.accelerationStructure = get(dev, fwd.accelerationStructure).handle;
+	}
+
+	return dev.dispatch.GetAccelerationStructureOpaqueCaptureDescriptorDataEXT(
+		dev.handle, &fwd, pData);
+}
+
+} // namespace vil
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/intrusive.hpp>
+#include <util/debugMutex.hpp>
+#include <vk/vulkan.h>
+#include <string>
+#include <unordered_map>
+
+namespace vil {
+
+// What a single descriptor returned by vkGetDescriptorEXT refers to.
+struct DescriptorBufferEntry {
+	ImageView* imageView {};
+	Sampler* sampler {};
+	VkImageLayout layout {};
+	VkDeviceAddress address {}; // buffers and acceleration structures
+	VkDeviceSize range {}; // buffers
+};
+
+// With VK_EXT_descriptor_buffer, descriptors are opaque data written by
+// the application directly into buffer memory, we never see the writes.
+// To still show the bound descriptors, we remember what each
+// vkGetDescriptorEXT call returned and map the data in the descriptor
+// buffer back to handles when the descriptors of a command are needed,
+// see decodeDescriptorBufferLocked. Recording stays cheap like this.
+// Entries are not removed when their handles are destroyed, the handles
+// must be validated on lookup. Only once the table is full, entries
+// of destroyed handles are dropped, see pruneLocked.
+struct DescriptorBufferTable {
+	// Upper bound for the number of remembered descriptors. Applications
+	// creating descriptors for short-lived handles over and over again
+	// would otherwise grow the table without bounds.
+	static constexpr auto defaultMaxEntries = std::size_t(1024u * 1024u);
+
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT props {};
+	std::size_t maxEntries {defaultMaxEntries};
+
+	DebugMutex mutex;
+	// Key: descriptor type, followed by the descriptor data
+	std::unordered_map<std::string, DescriptorBufferEntry> entries;
+
+	static std::string key(VkDescriptorType, ReadBuf data);
+	static VkDescriptorType type(const std::string& key);
+
+	// Returns the entry for the given descriptor data, nullptr if unknown.
+	const DescriptorBufferEntry* findLocked(VkDescriptorType, ReadBuf data) const;
+
+	// Remembers the given entry for the descriptor data, replacing
+	// a previous one. The table must not be full, see pruneLocked.
+	void insertLocked(VkDescriptorType, ReadBuf data, const DescriptorBufferEntry&);
+	bool fullLocked() const { return entries.size() >= maxEntries; }
+
+	// Makes room in the table. Removes all entries for which
+	// dead(type, entry) returns true, i.e. whose handles were destroyed.
+	// Only when that doesn't free up half of the table, arbitrary entries
+	// are dropped as well so that pruning stays amortized constant
+	// per inserted entry. Returns the number of removed entries.
+	template<typename F> std::size_t pruneLocked(F&& dead);
+};
+
+template<typename F>
+std::size_t DescriptorBufferTable::pruneLocked(F&& dead) {
+	auto oldSize = entries.size();
+	for(auto it = entries.begin(); it != entries.end();) {
+		if(dead(type(it->first), it->second)) {
+			it = entries.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	auto target = maxEntries / 2u;
+	while(entries.size() > target) {
+		entries.erase(entries.begin());
+	}
+
+	return oldSize - entries.size();
+}
+
+// Decodes the given descriptor set, bound from a descriptor buffer, into
+// a new standalone state. Descriptors that can't be mapped back to (alive)
+// handles stay empty, texel buffer descriptors are never decoded since
+// there is no VkBufferView for them.
+// Returns null when the descriptor buffer is not mapped, we can only read
+// the descriptors via the host.
+// The device mutex must be locked.
+IntrusivePtr<DescriptorSetCow> decodeDescriptorBufferLocked(
+	const DescriptorState& state, const BoundDescriptorSet& set);
+
+// api
+VKAPI_ATTR void VKAPI_CALL GetDescriptorSetLayoutSizeEXT(
+    VkDevice                                    device,
+    VkDescriptorSetLayout                       layout,
+    VkDeviceSize*                               pLayoutSizeInBytes);
+
+VKAPI_ATTR void VKAPI_CALL GetDescriptorSetLayoutBindingOffsetEXT(
+    VkDevice                                    device,
+    VkDescriptorSetLayout                       layout,
+    uint32_t                                    binding,
+    VkDeviceSize*                               pOffset);
+
+VKAPI_ATTR void VKAPI_CALL GetDescriptorEXT(
+    VkDevice                                    device,
+    const VkDescriptorGetInfoEXT*               pDescriptorInfo,
+    size_t                                      dataSize,
+    void*                                       pDescriptor);
+
+VKAPI_ATTR VkResult VKAPI_CALL GetBufferOpaqueCaptureDescriptorDataEXT(
+    VkDevice                                    device,
+    const VkBufferCaptureDescriptorDataInfoEXT* pInfo,
+    void*                                       pData);
+
+VKAPI_ATTR VkResult VKAPI_CALL GetImageOpaqueCaptureDescriptorDataEXT(
+    VkDevice                                    device,
+    const VkImageCaptureDescriptorDataInfoEXT*  pInfo,
+    void*                                       pData);
+
+VKAPI_ATTR VkResult VKAPI_CALL GetImageViewOpaqueCaptureDescriptorDataEXT(
+    VkDevice                                    device,
+    const VkImageViewCaptureDescriptorDataInfoEXT* pInfo,
+    void*                                       pData);
+
+VKAPI_ATTR VkResult VKAPI_CALL GetSamplerOpaqueCaptureDescriptorDataEXT(
+    VkDevice                                    device,
+    const VkSamplerCaptureDescriptorDataInfoEXT* pInfo,
+    void*                                       pData);
+
+VKAPI_ATTR VkResult VKAPI_CALL GetAccelerationStructureOpaqueCaptureDescriptorDataEXT(
+    VkDevice                                    device,
+    const VkAccelerationStructureCaptureDescriptorDataInfoEXT* pInfo,
+    void*                                       pData);
+
+} // namespace vil
@@ -10,6 +10,7 @@
 #include <cb.hpp>
 #include <rp.hpp>
 #include <ds.hpp>
+#include <descriptorBuffer.hpp>
 #include <sync.hpp>
 #include <swapchain.hpp>
 #include <overlay.hpp>
@@ -49,33 +50,46 @@ VkResult VKAPI_PTR SetDeviceLoaderDataNOOP(VkDevice, void*) {
 // device
 Device::Device() {
 	auto& dev = *this;
-	dev.swapchains.mutex = &dev.mutex;
-	dev.images.mutex = &dev.mutex;
-	dev.imageViews.mutex = &dev.mutex;
-	dev.buffers.mutex = &dev.mutex;
-	dev.framebuffers.mutex = &dev.mutex;
-	dev.renderPasses.mutex = &dev.mutex;
-	dev.commandBuffers.mutex = &dev.mutex;
-	dev.commandPools.mutex = &dev.mutex;
-	dev.fences.mutex = &dev.mutex;
-	dev.dsPools.mutex = &dev.mutex;
-	dev.dsLayouts.mutex = &dev.mutex;
-	dev.descriptorSets.mutex = &dev.mutex;
-	dev.buffers.mutex = &dev.mutex;
-	dev.deviceMemories.mutex = &dev.mutex;
-	dev.shaderModules.mutex = &dev.mutex;
-	dev.samplers.mutex = &dev.mutex;
-	dev.pipes.mutex = &dev.mutex;
-	dev.pipeLayouts.mutex = &dev.mutex;
-	dev.events.mutex = &dev.mutex;
-	dev.semaphores.mutex = &dev.mutex;
-	dev.queryPools.mutex = &dev.mutex;
-	dev.bufferViews.mutex = &dev.mutex;
-	dev.dsuTemplates.mutex = &dev.mutex;
-	dev.accelStructs.mutex = &dev.mutex;
+	setLockRank(dev.submissionMutex, LockRank::submission);
+	setLockRank(dev.mutex, LockRank::device);
+	setLockRank(dev.queueMutex, LockRank::queue);
+	setLockRank(dev.dsPoolMutex, LockRank::dsPool);
+	setLockRank(dev.snapshotMutex, LockRank::snapshot);
+
+	dev.swapchains.mutex = &dev.snapshotMutex;
+	dev.images.mutex = &dev.snapshotMutex;
+	dev.imageViews.mutex = &dev.snapshotMutex;
+	dev.buffers.mutex = &dev.snapshotMutex;
+	dev.framebuffers.mutex = &dev.snapshotMutex;
+	dev.renderPasses.mutex = &dev.snapshotMutex;
+	dev.commandBuffers.mutex = &dev.snapshotMutex;
+	dev.commandPools.mutex = &dev.snapshotMutex;
+	dev.fences.mutex = &dev.snapshotMutex;
+	dev.dsPools.mutex = &dev.snapshotMutex;
+	dev.dsLayouts.mutex = &dev.snapshotMutex;
+	dev.descriptorSets.mutex = &dev.snapshotMutex;
+	dev.buffers.mutex = &dev.snapshotMutex;
+	dev.deviceMemories.mutex = &dev.snapshotMutex;
+	dev.shaderModules.mutex = &dev.snapshotMutex;
+	dev.samplers.mutex = &dev.snapshotMutex;
+	dev.pipes.mutex = &dev.snapshotMutex;
+	dev.pipeLayouts.mutex = &dev.snapshotMutex;
+	dev.events.mutex = &dev.snapshotMutex;
+	dev.semaphores.mutex = &dev.snapshotMutex;
+	dev.queryPools.mutex = &dev.snapshotMutex;
+	dev.bufferViews.mutex = &dev.snapshotMutex;
+	dev.dsuTemplates.mutex = &dev.snapshotMutex;
+	dev.accelStructs.mutex = &dev.snapshotMutex;
 }
 
 Device::~Device() {
+	// Retiring submissions might reclaim objects, stop it first.
+	completion.stop();
+
+	// From here on, everything is destroyed immediately again.
+	// Must happen before anything the pending objects reference is destroyed.
+	reclaimer.stop();
+
 	// Vulkan spec requires that all pending submissions have finished.
 	while(!pending.empty()) {
 		// We don't have to lock the mutex at checkLocked here since
@@ -152,12 +166,6 @@ Device::~Device() {
 		dispatch.DestroySemaphore(handle, queue->submissionSemaphore, nullptr);
 	}
 
-	for(auto& qf : queueFamilies) {
-		if(qf.commandPool) {
-			dispatch.DestroyCommandPool(handle, qf.commandPool, nullptr);
-		}
-	}
-
 	queueFamilies.clear();
 	queues.clear();
 }
@@ -754,6 +762,24 @@ VkResult doCreateDevice(
 	dev.appExts = {extsBegin, extsEnd};
 	dev.allExts = {newExts.begin(), newExts.end()};
 
+	if(fpPhdevProps2 && hasAppExt(dev, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+		dev.descriptorBuffers = std::make_unique<DescriptorBufferTable>();
+		setLockRank(dev.descriptorBuffers->mutex, LockRank::descriptorBuffer);
+		auto& dbProps = dev.descriptorBuffers->props;
+		dbProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+
+		VkPhysicalDeviceProperties2 props2 {};
+		props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		props2.pNext = &dbProps;
+		fpPhdevProps2(phdev, &props2);
+		dbProps.pNext = nullptr;
+	}
+
+	dev.lazyTracking.store(checkEnvBinary("VIL_LAZY_TRACKING", false));
+	dev.lazyDescriptors.store(checkEnvBinary("VIL_LAZY_DESCRIPTORS", false));
+	auto deferDestruction = checkEnvBinary("VIL_DEFER_DESTRUCTION", true);
+	auto completionThread = checkEnvBinary("VIL_COMPLETION_THREAD", true);
+
 	dev.enabledFeatures = *pEnabledFeatures10;
 	dev.enabledFeatures11 = features11;
 	dev.enabledFeatures12 = features12;
@@ -1014,23 +1040,10 @@ VkResult doCreateDevice(
 	auto newEnd = std::unique(dev.usedQueueFamilyIndices.begin(), dev.usedQueueFamilyIndices.end());
 	dev.usedQueueFamilyIndices.erase(newEnd, dev.usedQueueFamilyIndices.end());
 
-	// Create queue families and their command pools
-	VkCommandPoolCreateInfo cpci {};
-	cpci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	cpci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
+	// Create queue families
 	dev.queueFamilies.resize(nqf);
 	for(auto i = 0u; i < nqf; ++i) {
-		cpci.queueFamilyIndex = u32(i);
-
-		auto& qfam = dev.queueFamilies[i];
-		qfam.props = qfprops[i];
-
-		if(find(dev.usedQueueFamilyIndices, i) != dev.usedQueueFamilyIndices.end()) {
-			VK_CHECK(dev.dispatch.CreateCommandPool(dev.handle, &cpci, nullptr, &qfam.commandPool));
-			nameHandle(dev, qfam.commandPool,
-				dlg::format("Device:queueFam[{}].commandPool", i).c_str());
-		}
+		dev.queueFamilies[i].props = qfprops[i];
 	}
 
 	// query memory stuff
@@ -1090,6 +1103,14 @@ VkResult doCreateDevice(
 	// init command hook
 	dev.commandHook = std::make_unique<CommandHook>(dev);
 
+	if(deferDestruction) {
+		dev.reclaimer.start();
+	}
+
+	if(completionThread) {
+		dev.completion.start(dev);
+	}
+
 #ifdef VIL_WITH_SWA
 	if(window) {
 		dlg_assert(window->presentQueue);
@@ -1199,26 +1220,6 @@ DebugLabel::~DebugLabel() {
 	}
 }
 
-bool Device::BufferAddressCmp::operator()(const Buffer* a, const Buffer* b) const {
-	dlg_assert(a && a->deviceAddress);
-	dlg_assert(b && b->deviceAddress);
-	if(a->deviceAddress == b->deviceAddress) {
-		return a < b;
-	}
-
-	return a->deviceAddress < b->deviceAddress;
-}
-
-bool Device::BufferAddressCmp::operator()(VkDeviceAddress a, const Buffer* b) const {
-	dlg_assert(b && b->deviceAddress);
-	return a < b->deviceAddress;
-}
-
-bool Device::BufferAddressCmp::operator()(const Buffer* a, VkDeviceAddress b) const {
-	dlg_assert(a && a->deviceAddress);
-	return a->deviceAddress < b;
-}
-
 // Defined here (instead of util/util.hpp) since they access Device
 bool supportedUsage(VkFormatFeatureFlags features, VkImageUsageFlags usages, bool has11) {
 	static constexpr struct {
@@ -1333,6 +1334,45 @@ void checkInitWindow(Device& dev) {
 #endif // VIL_WITH_SWA
 }
 
+bool needsCommandTrackingLocked(Device& dev) {
+	assertOwned(dev.mutex);
+
+	if(!dev.lazyTracking.load()) {
+		return true;
+	}
+
+	// As soon as the gui is visible, records might be inspected.
+	if(dev.window) {
+		return true;
+	}
+
+	auto* gui = dev.guiLocked();
+	if(gui && gui->visible()) {
+		return true;
+	}
+
+	return dev.commandHook->needsRecords();
+}
+
+bool needsDescriptorTrackingLocked(Device& dev) {
+	assertOwned(dev.mutex);
+
+	if(!dev.lazyDescriptors.load()) {
+		return true;
+	}
+
+	if(dev.window) {
+		return true;
+	}
+
+	auto* gui = dev.guiLocked();
+	if(gui && gui->visible()) {
+		return true;
+	}
+
+	return dev.commandHook->needsRecords();
+}
+
 void onDeviceLost(Device& dev) {
 	dlg_error("device lost");
 
@@ -5,8 +5,13 @@
 #include <data.hpp>
 #include <util/handleCast.hpp>
 #include <util/syncedMap.hpp>
+#include <util/addressMap.hpp>
 #include <util/debugMutex.hpp>
 #include <util/profiling.hpp>
+#include <util/linalloc.hpp>
+#include <util/reclaim.hpp>
+#include <util/stackTable.hpp>
+#include <completion.hpp>
 #include <nytl/span.hpp>
 
 #include <vk/vulkan.h>
@@ -100,11 +105,21 @@ struct Device {
 
 	// Only valid when EXT_device_address_binding_report enabled.
 	std::unique_ptr<DeviceAddressMap> addressMap;
+	// Only valid when the application enabled EXT_descriptor_buffer.
+	std::unique_ptr<DescriptorBufferTable> descriptorBuffers;
 
 	// Whether we are in integration testing mode
 	bool testing {};
 	std::atomic<bool> doFullSync {};
 	std::atomic<bool> captureCmdStack {};
+	// The stacks captured for commands when captureCmdStack is set.
+	StackTable stackTable;
+	// Whether command buffers may be recorded in pass-through mode while
+	// nothing needs their records. See docs/own/lazyTracking.md.
+	std::atomic<bool> lazyTracking {};
+	// Whether writes to descriptor sets from transient pools may only be
+	// journaled while nothing needs their state. See docs/own/lazyTracking.md.
+	std::atomic<bool> lazyDescriptors {};
 
 	// Aside from properties, only the families used by device
 	// are initialized.
@@ -117,9 +132,6 @@ struct Device {
 	std::vector<std::unique_ptr<Queue>> queues;
 	// A vector of all queue family indices for which a queue exists.
 	// Needed for concurrent resources.
-	// We additionally create a (resettable, primary) command pool
-	// for every used queue index (access them via Queue::commandPool, only
-	// managed here so we don't have multiple pools per family index).
 	std::vector<u32> usedQueueFamilyIndices;
 	// Global submission counter - counts for all queues.
 	// Is increased for every VkQueueSubmit call.
@@ -137,6 +149,21 @@ struct Device {
 	VkSampler linearSampler {};
 	VkSampler nearestSampler {};
 
+	// Shared memory block pool for the LinAllocator of CommandRecords.
+	// Avoids allocating/freeing system memory for every single record.
+	// Trimmed on vkTrimCommandPool.
+	LinBlockPool recordBlockPool;
+
+	// Destroys CommandRecord, CommandHookState and DescriptorStateCopy
+	// objects on a separate thread, see util/reclaim.hpp.
+	// Stopped first thing on device destruction.
+	Reclaimer reclaimer;
+
+	// Retires pending submissions on a separate thread when they
+	// complete, see completion.hpp. Stopped on device destruction,
+	// before the reclaimer.
+	CompletionTracker completion;
+
 	std::unique_ptr<DisplayWindow> window;
 
 	// Always valid, initialized on device creation.
@@ -148,13 +175,24 @@ struct Device {
 	std::vector<VkSemaphore> resetSemaphores; // list of semaphores that are waiting to be reset
 
 	// TODO: move to individual queues?
+	// Contains all submitted batches while submissionMutex is locked.
 	std::vector<std::unique_ptr<SubmissionBatch>> pending;
 
+	// Locked for the whole duration of an application submission while
+	// the device mutex is only locked to prepare and post-process it,
+	// not during the (potentially slow) driver call. Serializes
+	// submissions and makes sure that, while it is locked, the tracked
+	// state (e.g. pending) includes everything submitted so far. The gui
+	// locks it for the sync with pending submissions.
+	// Must be locked before the device mutex, see LockRank.
+	vilDefMutex(submissionMutex);
+
 	// Mutex for general shared access.
-	// While this mutex is locked, resources won't be inserted or
-	// erased from the resource tables below (and therefore can't
-	// logically be created or destroyed). Also used to synchronize
+	// While this mutex is locked, the api destroy functions can't
+	// destroy handles, see mustMoveUnset. Also used to synchronize
 	// shared access to most resources (that can be mutated).
+	// The hook capture state has its own lock, CommandHook::mutex.
+	// See LockRank for the order in which the device locks are acquired.
 	// vilDefSharedMutex(mutex);
 	TracySharedLockable(DebugSharedMutex, mutex);
 
@@ -167,32 +205,34 @@ struct Device {
 	// *not* on per-queue basis.
 	vilDefMutex(queueMutex);
 
+	// Only held around allocating and freeing sets of dsPool, which
+	// happens from the gui and while recording hook records, both
+	// without holding the device mutex.
+	vilDefMutex(dsPoolMutex);
+
+	// Guards the resource tables below and the links between handles
+	// the gui shows (e.g. Image::views, memory bindings, Handle::handle).
+	// Inserting into or erasing from the tables only needs this mutex,
+	// not the device mutex. The links are modified with both mutexes
+	// locked exclusively, so holding either one is enough to read them.
+	// The gui takes its snapshots with only this one locked shared,
+	// see Gui::snapshotLock.
+	vilDefSharedMutex(snapshotMutex);
+
 	// === VkBufferAddress lookup ===
 	// In various places we need the buffer belonging to a given buffer address.
-	// This data structure allows efficient insert, deletion and lookup.
-	// Must be synchronized via the device mutex, prefer the utility function
-	// in buffer.hpp.
-	struct BufferAddressEntry {
-		VkDeviceAddress address;
-		Buffer* buffer;
-	};
-
-	struct BufferAddressCmp {
-		using is_transparent = struct UghWtf {}; // See cppreference is_transparent
-		bool operator()(const Buffer* a, const Buffer* b) const;
-		bool operator()(VkDeviceAddress a, const Buffer* b) const;
-		bool operator()(const Buffer* a, VkDeviceAddress b) const;
-	};
-
-	std::set<Buffer*, BufferAddressCmp> bufferAddresses;
+	// Lookups don't lock, see AddressMap. The returned buffers are only
+	// guaranteed to stay alive while the device mutex is locked though.
+	// Prefer the utility functions in buffer.hpp.
+	AddressMap<Buffer> bufferAddresses;
 
 	// === VkAccelerationStructureKHR lookup ===
 	// When building top-level acceleration structured on the device, we
 	// need to retrieve the acceleration structure for a given VkDeviceAddress.
 	// This map allows it.
-	// Access must be synchronized via the device mutex, prefer the utility
+	// Same synchronization as bufferAddresses, prefer the utility
 	// function in accelStruct.hpp.
-	std::unordered_map<VkDeviceAddress, AccelStruct*> accelStructAddresses;
+	AddressMap<AccelStruct> accelStructAddresses;
 
 	// === Maps of all vulkan handles ===
 	SyncedRawUnorderedMap<VkDescriptorSet, DescriptorSet> descriptorSets;
@@ -235,7 +275,7 @@ struct Device {
 	// casted since the destructor is not virtual.
 	SyncedIntrusiveDerivedUnorderedMap<VkPipeline, Pipeline> pipes;
 
-	// NOTE: when adding new maps: also add mutex initializer in CreateDevice
+	// NOTE: when adding new maps: also add mutex initializer in Device()
 
 	// NOTE: keepAliveCount = 0 means it's disabled completely.
 	// TODO: documentation on keep alive.
@@ -303,6 +343,14 @@ void notifyMemoryResourceInvalidatedLocked(Device& dev, MemoryResource& res);
 // Lazily initializes the window, if needed.
 void checkInitWindow(Device& dev);
 
+// Returns whether command buffers begun now have to be fully tracked.
+// When this returns false, they are recorded in pass-through mode,
+// see docs/own/lazyTracking.md. Expects device mutex to be locked.
+bool needsCommandTrackingLocked(Device& dev);
+// Whether descriptor set state must be tracked eagerly, i.e. writes
+// can't just be journaled, see DescriptorPool::transient.
+bool needsDescriptorTrackingLocked(Device& dev);
+
 // Called when we detected VK_ERROR_DEVICE_LOST.
 // Might be called while dev mutex is locked.
 void onDeviceLost(Device& dev);
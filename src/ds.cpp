@@ -6,30 +6,122 @@
 #include <accelStruct.hpp>
 #include <threadContext.hpp>
 #include <util/util.hpp>
+#include <util/refBatch.hpp>
+#include <util/pages.hpp>
 #include <util/profiling.hpp>
 
 namespace vil {
 
 // Whether descriptor sets increase the refCount of the handles
 // written into the descriptors, effectively taking shared ownership of them.
-// Doing this has a huge performance impact (especially for applications
-// with many huge and dynamic descriptorSets). But not doing this means
-// that descriptor sets might contain invalid bindings. That is mainly
-// a problem for the resource viewer for descriptor sets at the moment
-// as we are able to filter them out like 99% of the times (the other times
-// we get valid new handles that were never bound but just happen
+// Not doing this means that descriptor sets might contain invalid bindings.
+// That is mainly a problem for the resource viewer for descriptor sets at
+// the moment as we are able to filter them out like 99% of the times (the
+// other times we get valid new handles that were never bound but just happen
 // to be at the address now, also not UB at least), and we can increase
-// this via Device::keepAliveCount
-// TODO: better documentation, make it a meson_option
+// this via Device::keepAliveCount.
+// The reference count changes of a call are coalesced via RefCountBatch,
+// so rewriting descriptors with the handles they already hold is cheap.
+// Journaled writes (see DescriptorPool::transient) then own references
+// as well, see DescriptorSet::materializeLocked.
+// Controlled via the descriptor-refs meson option.
 // TODO: we could try to explicitly detect the invalid bindings, as we
 //   do with descriptor sets already. See notes in ds3.hpp for details.
-constexpr auto refBindings = false;
+#ifdef VIL_DESCRIPTOR_REFS
+	constexpr auto refBindings = true;
+#else // VIL_DESCRIPTOR_REFS
+	constexpr auto refBindings = false;
+#endif // VIL_DESCRIPTOR_REFS
 
 // Whether we allow pool fragmentation. Setting this to false means we
 // might explicitly return an error from ds allocation (as valid per spec)
 // even though the driver could do it.
 constexpr auto enableDsFragmentationPath = false;
 
+// Heuristic for DescriptorPool::transient: a pool that was reset this
+// many times in a row, each time with at most transientResetSubmissions
+// submissions since the last reset, is considered transient.
+constexpr auto transientResetStreak = 4u;
+constexpr auto transientResetSubmissions = 64u;
+
+// The journal of a set may only grow to this multiple of the size of
+// the set itself. Otherwise the pool is not transient anymore, its
+// sets are probably just rewritten without the pool being reset.
+constexpr auto maxJournalSizeFac = 4u;
+
+// A write to a descriptor set that was journaled instead of applied
+// to its state. See DescriptorSet::materializeLocked.
+struct DescriptorJournalEntry {
+	DescriptorJournalEntry* next {};
+	u32 binding {};
+	u32 elem {};
+	u32 count {};
+	DescriptorCategory category {};
+
+	// Following this in memory: 'count' VkDescriptorImageInfo,
+	// VkDescriptorBufferInfo, VkBufferView or VkAccelerationStructureKHR
+	// with the (wrapped) handles of the application. Or 'count' bytes
+	// for inline uniform blocks.
+	// std::byte payload[];
+};
+
+static_assert(sizeof(DescriptorJournalEntry) % alignof(VkDescriptorBufferInfo) == 0u);
+
+u32 journalElemSize(DescriptorCategory cat) {
+	switch(cat) {
+		case DescriptorCategory::buffer: return sizeof(VkDescriptorBufferInfo);
+		case DescriptorCategory::image: return sizeof(VkDescriptorImageInfo);
+		case DescriptorCategory::bufferView: return sizeof(VkBufferView);
+		case DescriptorCategory::accelStruct: return sizeof(VkAccelerationStructureKHR);
+		case DescriptorCategory::inlineUniformBlock: return 1u;
+		case DescriptorCategory::none:
+			dlg_error("unreachable: Invalid descriptor category");
+			return 0u;
+	}
+
+	dlg_error("unreachable");
+	return 0u;
+}
+
+void advanceUntilValid(DescriptorSet& state, unsigned& binding, unsigned& elem);
+
+std::byte* payload(DescriptorJournalEntry& entry) {
+	return reinterpret_cast<std::byte*>(&entry) + sizeof(entry);
+}
+
+// Calls 'func(entry, j, binding, elem)' for each descriptor written
+// by the given (not circular) list of journal entries, in order.
+// 'j' is the index into the payload of the entry.
+template<typename F>
+void forEachJournaled(DescriptorSet& ds, DescriptorJournalEntry* entry, F&& func) {
+	for(; entry; entry = entry->next) {
+		auto binding = entry->binding;
+		auto elem = entry->elem;
+		for(auto j = 0u; j < entry->count; ++j, ++elem) {
+			advanceUntilValid(ds, binding, elem);
+			func(*entry, j, binding, elem);
+		}
+	}
+}
+
+// Allocates a journal entry for the given number of descriptors
+// from the pool. The payload is left uninitialized.
+// Requires the pool mutex to be locked.
+DescriptorJournalEntry& allocJournalEntry(DescriptorPool& pool,
+		DescriptorCategory cat, u32 binding, u32 elem, u32 count) {
+	assertOwned(pool.mutex);
+
+	auto size = sizeof(DescriptorJournalEntry) + count * journalElemSize(cat);
+	auto* mem = pool.journalAlloc.allocate(size, alignof(DescriptorJournalEntry));
+
+	auto& entry = *new(mem) DescriptorJournalEntry();
+	entry.binding = binding;
+	entry.elem = elem;
+	entry.count = count;
+	entry.category = cat;
+	return entry;
+}
+
 // util
 size_t descriptorSize(VkDescriptorType dsType) {
 	switch(category(dsType)) {
@@ -57,33 +149,22 @@ DescriptorStateRef::DescriptorStateRef(const DescriptorSet& ds) :
 	layout(ds.layout.get()), data(bindingData(ds)), variableDescriptorCount(ds.variableDescriptorCount) {
 }
 
+std::byte* cowBindingPtr(DescriptorSetCow& cow, unsigned binding);
+
+std::byte* bindingPtr(DescriptorStateRef state, unsigned binding) {
+	if(state.cow) {
+		return cowBindingPtr(*state.cow, binding);
+	}
+
+	return state.data + state.layout->bindings[binding].offset;
+}
+
 DescriptorStateRef::DescriptorStateRef(DescriptorStateCopy& ds) :
 	layout(ds.layout.get()),
 	data(reinterpret_cast<std::byte*>(&ds) + sizeof(DescriptorStateCopy)),
 	variableDescriptorCount(ds.variableDescriptorCount) {
 }
 
-template<typename T, typename O>
-void debugStatAdd(std::atomic<T>& dst, const O& val) {
-#ifdef VIL_DEBUG_STATS
-	dst.fetch_add(val, std::memory_order_relaxed);
-#else // VIL_DEBUG_STATS
-	(void) dst;
-	(void) val;
-#endif // VIL_DEBUG_STATS
-}
-
-template<typename T, typename O>
-void debugStatSub(std::atomic<T>& dst, const O& val) {
-#ifdef VIL_DEBUG_STATS
-	auto before = dst.fetch_sub(val, std::memory_order_relaxed);
-	dlg_assert(before >= val);
-#else // VIL_DEBUG_STATS
-	(void) dst;
-	(void) val;
-#endif // VIL_DEBUG_STATS
-}
-
 // Returns the total raw memory size needed by descriptor state of
 // the given layout, with the given variable descriptor count.
 size_t totalDescriptorMemSize(const DescriptorSetLayout& layout, u32 variableDescriptorCount) {
@@ -201,6 +282,8 @@ bool compatible(const DescriptorSetLayout& da, const DescriptorSetLayout& db,
 void initImmutableSamplers(DescriptorStateRef state) {
 	ZoneScoped;
 
+	RefCountBatch refs;
+
 	for(auto b = 0u; b < state.layout->bindings.size(); ++b) {
 		// If the binding holds immutable samplers, fill them in.
 		// We do this so we don't have to check for immutable samplers
@@ -221,23 +304,33 @@ void initImmutableSamplers(DescriptorStateRef state) {
 
 				binds[e].sampler = sampler;
 				if(refBindings) {
-					incRefCount(*sampler);
+					refs.inc(*sampler);
 				}
 			}
 		}
 	}
+
+	refs.flush();
 }
 
-void initDescriptorState(std::byte* data,
-		const DescriptorSetLayout& layout, u32 variableDescriptorCount) {
+void initDescriptorState(std::byte* data, const DescriptorSetLayout& layout,
+		u32 variableDescriptorCount, bool pageMemory) {
 	// Possibly faster path but strictly speaking UB I guess?
 	// Compbilers should probably optimize it to this tho
 	auto bindingSize = totalDescriptorMemSize(layout, variableDescriptorCount);
-	std::memset(data, 0x0, bindingSize);
+	if(pageMemory) {
+		// For huge sets (bindless arrays), this returns the pages to
+		// the OS instead of writing them. Most of them are usually never
+		// written by the application.
+		zeroPages(data, bindingSize);
+	} else {
+		std::memset(data, 0x0, bindingSize);
+	}
 }
 
 void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
-		DescriptorStateRef src, unsigned srcBindID, unsigned srcElemID) {
+		DescriptorStateRef src, unsigned srcBindID, unsigned srcElemID,
+		RefCountBatch& refs) {
 	auto& srcLayout = src.layout->bindings[srcBindID];
 	auto& dstLayout = dst.layout->bindings[dstBindID];
 	dlg_assert(srcLayout.descriptorType == dstLayout.descriptorType);
@@ -249,10 +342,10 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 			auto& dstBind = images(dst, dstBindID)[dstElemID];
 
 			if(refBindings) {
-				if(dstBind.sampler && !immutSampler) decRefCount(*dstBind.sampler);
-				if(srcCopy.sampler && !immutSampler) incRefCount(*srcCopy.sampler);
-				if(dstBind.imageView) decRefCount(*dstBind.imageView);
-				if(srcCopy.imageView) incRefCount(*srcCopy.imageView);
+				if(dstBind.sampler && !immutSampler) refs.dec(*dstBind.sampler);
+				if(srcCopy.sampler && !immutSampler) refs.inc(*srcCopy.sampler);
+				if(dstBind.imageView) refs.dec(*dstBind.imageView);
+				if(srcCopy.imageView) refs.inc(*srcCopy.imageView);
 			}
 
 			dstBind.imageView = std::move(srcCopy.imageView);
@@ -268,8 +361,8 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 			auto& dstBuf = buffers(dst, dstBindID)[dstElemID];
 
 			if(refBindings) {
-				if(dstBuf.buffer) decRefCount(*dstBuf.buffer);
-				if(srcBuf.buffer) incRefCount(*srcBuf.buffer);
+				if(dstBuf.buffer) refs.dec(*dstBuf.buffer);
+				if(srcBuf.buffer) refs.inc(*srcBuf.buffer);
 			}
 
 			dstBuf = srcBuf;
@@ -279,8 +372,8 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 			auto& dstBuf = bufferViews(dst, dstBindID)[dstElemID];
 
 			if(refBindings) {
-				if(dstBuf.bufferView) decRefCount(*dstBuf.bufferView);
-				if(srcBuf.bufferView) incRefCount(*srcBuf.bufferView);
+				if(dstBuf.bufferView) refs.dec(*dstBuf.bufferView);
+				if(srcBuf.bufferView) refs.inc(*srcBuf.bufferView);
 			}
 
 			dstBuf = srcBuf;
@@ -301,8 +394,8 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 			auto& dstAS = accelStructs(dst, dstBindID)[dstElemID];
 
 			if(refBindings) {
-				if(dstAS.accelStruct) decRefCount(*dstAS.accelStruct);
-				if(srcAS.accelStruct) incRefCount(*srcAS.accelStruct);
+				if(dstAS.accelStruct) refs.dec(*dstAS.accelStruct);
+				if(srcAS.accelStruct) refs.inc(*srcAS.accelStruct);
 			}
 
 			dstAS = srcAS;
@@ -313,33 +406,228 @@ void copy(DescriptorStateRef dst, unsigned dstBindID, unsigned dstElemID,
 	}
 }
 
+namespace {
+
+// Copies the descriptors [firstElem, endElem) of the given binding into a
+// zero-initialized state. Skips empty descriptors, writing them would commit
+// the pages of large copies (see allocStateCopy) for sparsely written
+// bindless arrays.
+void copyToZeroed(DescriptorStateRef dst, DescriptorStateRef src, unsigned binding,
+		u32 firstElem, u32 endElem, RefCountBatch& refs) {
+	auto copyNonEmpty = [&](auto srcElems) {
+		using Elem = std::decay_t<decltype(srcElems[0])>;
+		for(auto e = firstElem; e < endElem; ++e) {
+			if(!(srcElems[e] == Elem{})) {
+				vil::copy(dst, binding, e, src, binding, e, refs);
+			}
+		}
+	};
+
+	auto& layout = src.layout->bindings[binding];
+	switch(category(layout.descriptorType)) {
+		case DescriptorCategory::image:
+			copyNonEmpty(images(src, binding));
+			break;
+		case DescriptorCategory::buffer:
+			copyNonEmpty(buffers(src, binding));
+			break;
+		case DescriptorCategory::bufferView:
+			copyNonEmpty(bufferViews(src, binding));
+			break;
+		case DescriptorCategory::accelStruct:
+			copyNonEmpty(accelStructs(src, binding));
+			break;
+		default:
+			for(auto e = firstElem; e < endElem; ++e) {
+				vil::copy(dst, binding, e, src, binding, e, refs);
+			}
+			break;
+	}
+}
+
+bool chunkCopied(const DescriptorSetCow& cow, u32 chunk) {
+	auto& copied = cow.copiedChunks;
+	return !copied.empty() && (copied[chunk / 64u] & (1ull << (chunk % 64u)));
+}
+
+// Calls func(binding, firstElem, endElem) for the descriptors whose data
+// starts in one of the chunks [firstChunk, endChunk) of 'state' that were
+// not copied into the cow yet. See DescriptorSetCow::chunkSize.
+template<typename F>
+void forEachUncopied(const DescriptorSetCow& cow, DescriptorStateRef state,
+		u32 firstChunk, u32 endChunk, F&& func) {
+	constexpr auto chunkSize = DescriptorSetCow::chunkSize;
+	auto& bindings = state.layout->bindings;
+	for(auto b = 0u; b < bindings.size(); ++b) {
+		auto count = descriptorCount(state, b);
+		if(!count) {
+			continue;
+		}
+
+		auto& binding = bindings[b];
+		auto size = u32(descriptorSize(binding.descriptorType));
+		auto first = std::max(firstChunk, u32(binding.offset / chunkSize));
+		auto end = std::min(endChunk, u32((binding.offset + (count - 1) * size) / chunkSize + 1));
+		for(auto c = first; c < end; ++c) {
+			if(chunkCopied(cow, c)) {
+				continue;
+			}
+
+			auto chunkBegin = c * chunkSize;
+			auto firstElem = chunkBegin <= binding.offset ? 0u :
+				ceilDivide(chunkBegin - binding.offset, size);
+			auto endElem = std::min(count,
+				ceilDivide(chunkBegin + chunkSize - binding.offset, size));
+			if(firstElem < endElem) {
+				func(b, firstElem, endElem);
+			}
+		}
+	}
+}
+
+// Copies the chunks [firstChunk, endChunk) that were not copied yet from
+// cow.ds into cow.copy. With !refBindings, the copy "takes ownership" of the
+// reference counts increased when the cow was added.
+// Requires the cow mutex to be locked.
+void copyCowChunks(DescriptorSetCow& cow, u32 firstChunk, u32 endChunk,
+		RefCountBatch& refs) {
+	dlg_assert(cow.ds && cow.copy);
+	DescriptorStateRef srcRef(*cow.ds);
+	DescriptorStateRef dstRef(*cow.copy);
+
+	endChunk = std::min(endChunk, cow.chunkCount);
+	forEachUncopied(cow, srcRef, firstChunk, endChunk, [&](u32 b, u32 firstElem, u32 endElem) {
+		copyToZeroed(dstRef, srcRef, b, firstElem, endElem, refs);
+
+		// vil::copy does not copy immutable samplers
+		if(srcRef.layout->bindings[b].immutableSamplers) {
+			auto src = images(srcRef, b);
+			auto dst = images(dstRef, b);
+			for(auto e = firstElem; e < endElem; ++e) {
+				dst[e].sampler = src[e].sampler;
+				if(refBindings && dst[e].sampler) {
+					refs.inc(*dst[e].sampler);
+				}
+			}
+		}
+	});
+
+	for(auto c = firstChunk; c < endChunk; ++c) {
+		if(!chunkCopied(cow, c)) {
+			cow.copiedChunks[c / 64u] |= 1ull << (c % 64u);
+			++cow.copiedCount;
+		}
+	}
+}
+
+} // anon namespace
+
+// The data of bindings not copied yet is immutable while the cow mutex is
+// locked, see access. A binding that is only partially copied is completed
+// here since the binding must be returned as a contiguous span. The set
+// itself is detached from the cow on its next resolve.
+std::byte* cowBindingPtr(DescriptorSetCow& cow, unsigned binding) {
+	constexpr auto chunkSize = DescriptorSetCow::chunkSize;
+	dlg_assert(cow.ds && cow.copy);
+
+	DescriptorStateRef srcRef(*cow.ds);
+	auto& layout = srcRef.layout->bindings[binding];
+	auto count = descriptorCount(srcRef, binding);
+	if(!count) {
+		return srcRef.data + layout.offset;
+	}
+
+	auto size = u32(descriptorSize(layout.descriptorType));
+	auto first = u32(layout.offset / chunkSize);
+	auto end = u32((layout.offset + (count - 1) * size) / chunkSize + 1);
+
+	auto anyCopied = false;
+	auto allCopied = true;
+	for(auto c = first; c < end; ++c) {
+		auto copied = chunkCopied(cow, c);
+		anyCopied |= copied;
+		allCopied &= copied;
+	}
+
+	if(!anyCopied) {
+		return srcRef.data + layout.offset;
+	}
+
+	if(!allCopied) {
+		// Only increments, flushing can't destroy anything
+		RefCountBatch refs;
+		copyCowChunks(cow, first, end, refs);
+		refs.flush();
+	}
+
+	return DescriptorStateRef(*cow.copy).data + layout.offset;
+}
+
+// 'lastValid' is the last handle validated for the given set. Consecutive
+// descriptors often reference the same handle, we only look it up once.
 template<typename Set, typename Handle>
-bool validateIncRef(Device& dev, Set& set, Handle*& handle, bool checkReplace) {
+bool validateIncRef(Set& set, Handle*& handle, bool checkReplace,
+		RefCountBatch& refs, Handle*& lastValid) {
 	if(!handle) {
 		return false;
 	}
 
-	if(!checkReplace) {
-		incRefCount(*handle);
-		return true;
+	if(checkReplace && handle != lastValid) {
+		if(!containsHandle(set, handle)) {
+			dlg_debug("Detected destroyed handle in descriptorSet");
+			handle = nullptr;
+			return false;
+		}
+
+		lastValid = handle;
 	}
 
-	(void) dev;
+	refs.inc(*handle);
+	return true;
+}
 
-	// TODO: not fully exception safe
-	// Remove with c++20s better container lookup
-	IntrusivePtr<Handle> dummy(acquireOwnership, handle);
-	auto it = set.inner.find(dummy);
-	(void) dummy.release();
+// Resolves a wrapped handle from a descriptor journal. Returns null
+// when the handle was destroyed in the meantime.
+// Requires the device mutex to be locked.
+template<typename Set, typename VkHandle>
+auto* resolveJournaled(Set& set, VkHandle handle) {
+	using OurHandle = typename HandleDesc<VkHandle>::type;
+	if(!handle) {
+		return static_cast<OurHandle*>(nullptr);
+	}
 
-	if(it == set.inner.end()) {
-		dlg_debug("Detected destroyed handle in descriptorSet");
-		handle = nullptr;
-		return false;
+	// NOTE: we must not access the object before we know it's alive
+	auto* ptr = &unwrap(handle);
+	if(!containsHandle(set, ptr)) {
+		dlg_debug("Detected destroyed handle in descriptor journal");
+		return static_cast<OurHandle*>(nullptr);
 	}
 
-	incRefCount(*handle);
-	return true;
+	return ptr;
+}
+
+// Applies a handle from a descriptor journal to a descriptor.
+// With refBindings, the journal owns a reference to the handle. It's
+// exchanged with the reference of the descriptor, i.e. the journal
+// then owns the replaced handle, see DescriptorSet::unrefJournal.
+// Otherwise the handle is validated, see resolveJournaled.
+template<typename Set, typename T, typename VkHandle>
+void applyJournaled(Set& set, T*& dst, VkHandle& handle) {
+	if constexpr(refBindings) {
+		(void) set;
+		auto* old = dst;
+		dst = handle ? &unwrap(handle) : nullptr;
+		handle = old ? castDispatch<VkHandle>(*old) : VkHandle {};
+	} else {
+		dst = resolveJournaled(set, handle);
+	}
+}
+
+template<typename VkHandle>
+void unrefJournaled(RefCountBatch& refs, VkHandle handle) {
+	if(handle) {
+		refs.dec(unwrap(handle));
+	}
 }
 
 // NOTE: regarding checkIfValid
@@ -356,9 +644,7 @@ bool validateIncRef(Device& dev, Set& set, Handle*& handle, bool checkReplace) {
 // To minimize the chance for that case, we have the keepAliveXXX buffers
 // in Device, actually keeping handles alive for a time. But it might still
 // happen. Users that want to make absolutely sure false positives
-// can't happen should simply run with refBindings = true.
-// We *really* don't want refBindings = true since it's expensive, making
-// descriptor set updates and destruction a lot slower.
+// can't happen should simply run with refBindings = true (the default).
 static void doRefBindings(Device& dev, DescriptorStateRef state, bool checkIfValid) {
 	ZoneScopedN("refBindings");
 
@@ -368,6 +654,14 @@ static void doRefBindings(Device& dev, DescriptorStateRef state, bool checkIfVal
 	// ds/pool mutex is locked.
 	assertOwned(dev.mutex);
 
+	// Only increments, flushing can't destroy anything
+	RefCountBatch refs;
+	Buffer* lastBuffer {};
+	BufferView* lastBufferView {};
+	ImageView* lastImageView {};
+	Sampler* lastSampler {};
+	AccelStruct* lastAccelStruct {};
+
 	for(auto b = 0u; b < state.layout->bindings.size(); ++b) {
 		auto& binding = state.layout->bindings[b];
 		if(!descriptorCount(state, b)) {
@@ -377,23 +671,23 @@ static void doRefBindings(Device& dev, DescriptorStateRef state, bool checkIfVal
 		switch(category(binding.descriptorType)) {
 			case DescriptorCategory::buffer: {
 				for(auto& b : buffers(state, b)) {
-					validateIncRef(dev, dev.buffers, b.buffer, checkIfValid);
+					validateIncRef(dev.buffers, b.buffer, checkIfValid, refs, lastBuffer);
 				}
 				break;
 			} case DescriptorCategory::bufferView: {
 				for(auto& b : bufferViews(state, b)) {
-					validateIncRef(dev, dev.bufferViews, b.bufferView, checkIfValid);
+					validateIncRef(dev.bufferViews, b.bufferView, checkIfValid, refs, lastBufferView);
 				}
 				break;
 			} case DescriptorCategory::image: {
 				for(auto& b : images(state, b)) {
-					validateIncRef(dev, dev.imageViews, b.imageView, checkIfValid);
-					validateIncRef(dev, dev.samplers, b.sampler, checkIfValid);
+					validateIncRef(dev.imageViews, b.imageView, checkIfValid, refs, lastImageView);
+					validateIncRef(dev.samplers, b.sampler, checkIfValid, refs, lastSampler);
 				}
 				break;
 			} case DescriptorCategory::accelStruct: {
 				for(auto& b : accelStructs(state, b)) {
-					validateIncRef(dev, dev.accelStructs, b.accelStruct, checkIfValid);
+					validateIncRef(dev.accelStructs, b.accelStruct, checkIfValid, refs, lastAccelStruct);
 				}
 				break;
 			} case DescriptorCategory::inlineUniformBlock: {
@@ -404,6 +698,60 @@ static void doRefBindings(Device& dev, DescriptorStateRef state, bool checkIfVal
 				break;
 		}
 	}
+
+	refs.flush();
+}
+
+// Adds the decrements for the handles of the descriptors
+// [firstElem, endElem) in the given binding to 'refs'.
+void unrefBinding(DescriptorStateRef state, unsigned b, u32 firstElem,
+		u32 endElem, RefCountBatch& refs) {
+	auto& binding = state.layout->bindings[b];
+	endElem = std::min(endElem, descriptorCount(state, b));
+	if(firstElem >= endElem) {
+		return;
+	}
+
+	auto count = endElem - firstElem;
+	switch(category(binding.descriptorType)) {
+		case DescriptorCategory::buffer: {
+			for(auto& b : buffers(state, b).subspan(firstElem, count)) {
+				if(b.buffer) {
+					refs.dec(*b.buffer);
+				}
+			}
+			break;
+		} case DescriptorCategory::bufferView: {
+			for(auto& b : bufferViews(state, b).subspan(firstElem, count)) {
+				if(b.bufferView) {
+					refs.dec(*b.bufferView);
+				}
+			}
+			break;
+		} case DescriptorCategory::image: {
+			for(auto& b : images(state, b).subspan(firstElem, count)) {
+				if(b.imageView) {
+					refs.dec(*b.imageView);
+				}
+				if(b.sampler) {
+					refs.dec(*b.sampler);
+				}
+			}
+			break;
+		} case DescriptorCategory::accelStruct: {
+			for(auto& b : accelStructs(state, b).subspan(firstElem, count)) {
+				if(b.accelStruct) {
+					refs.dec(*b.accelStruct);
+				}
+			}
+			break;
+		} case DescriptorCategory::inlineUniformBlock: {
+			// no-op, we just have raw bytes here
+			break;
+		} case DescriptorCategory::none:
+			dlg_error("unreachable: invalid descriptor type");
+			break;
+	}
 }
 
 void unrefBindings(DescriptorStateRef state) {
@@ -412,55 +760,44 @@ void unrefBindings(DescriptorStateRef state) {
 	dlg_assert(state.layout);
 	assertNotOwned(state.layout->dev->mutex);
 
+	RefCountBatch refs;
 	for(auto b = 0u; b < state.layout->bindings.size(); ++b) {
-		auto& binding = state.layout->bindings[b];
-		if(!descriptorCount(state, b)) {
-			continue;
-		}
+		unrefBinding(state, b, 0u, u32(-1), refs);
+	}
 
-		switch(category(binding.descriptorType)) {
-			case DescriptorCategory::buffer: {
-				for(auto& b : buffers(state, b)) {
-					if(b.buffer) {
-						decRefCount(*b.buffer);
-					}
-				}
-				break;
-			} case DescriptorCategory::bufferView: {
-				for(auto& b : bufferViews(state, b)) {
-					if(b.bufferView) {
-						decRefCount(*b.bufferView);
-					}
-				}
-				break;
-			} case DescriptorCategory::image: {
-				for(auto& b : images(state, b)) {
-					if(b.imageView) {
-						decRefCount(*b.imageView);
-					}
-					if(b.sampler) {
-						decRefCount(*b.sampler);
-					}
-				}
-				break;
-			} case DescriptorCategory::accelStruct: {
-				for(auto& b : accelStructs(state, b)) {
-					if(b.accelStruct) {
-						decRefCount(*b.accelStruct);
-					}
-				}
-				break;
-			} case DescriptorCategory::inlineUniformBlock: {
-				// no-op, we just have raw bytes here
-				break;
-			} case DescriptorCategory::none:
-				dlg_error("unreachable: invalid descriptor type");
-				break;
-		}
+	refs.flush();
+}
+
+namespace {
+
+// DescriptorStateCopy objects of at least this size are allocated
+// directly via pages, see allocStateCopy.
+constexpr auto minPagedStateCopySize = 64 * 1024u;
+
+// Returns zero-initialized memory for a DescriptorStateCopy.
+// Large copies (i.e. of bindless descriptor arrays) are allocated
+// via pages so that the untouched parts don't commit any memory.
+std::byte* allocStateCopy(std::size_t memSize) {
+	if(memSize >= minPagedStateCopySize) {
+		return allocPages(memSize);
 	}
+
+	return new std::byte[memSize]();
 }
 
-void DescriptorStateCopy::Deleter::operator()(DescriptorStateCopy* copy) const {
+void freeStateCopy(std::byte* mem, std::size_t memSize) {
+	if(memSize >= minPagedStateCopySize) {
+		freePages(mem, memSize);
+	} else {
+		delete[] mem;
+	}
+}
+
+struct DestroyDescriptorStateCopy {
+	void operator()(DescriptorStateCopy* copy) const noexcept;
+};
+
+void DestroyDescriptorStateCopy::operator()(DescriptorStateCopy* copy) const noexcept {
 	// we have a reference on the bindings in any case
 	unrefBindings(DescriptorStateRef(*copy));
 
@@ -476,21 +813,30 @@ void DescriptorStateCopy::Deleter::operator()(DescriptorStateCopy* copy) const {
 	// Binding elements since they are all trivial
 	auto ptr = reinterpret_cast<std::byte*>(copy);
 	TracyFreeS(ptr, 8);
-	delete[] ptr;
+	freeStateCopy(ptr, memSize);
 }
 
-DescriptorStateCopyPtr DescriptorSet::copyLockedState() {
-	ZoneScoped;
+} // anon namespace
+
+void DescriptorStateCopy::Deleter::operator()(DescriptorStateCopy* copy) const {
+	auto& dev = *copy->layout->dev;
+	reclaim<DescriptorStateCopy, DestroyDescriptorStateCopy>(&dev.reclaimer,
+		copy->reclaimNode, copy);
+}
+
+namespace {
 
+// Allocates a zero-initialized DescriptorStateCopy for the given layout.
+DescriptorStateCopy* allocDescriptorStateCopy(DescriptorSetLayout& layout,
+		u32 variableDescriptorCount) {
 	// NOTE: when this assert fails somewhere, we have to adjust the code (storing stuff
 	// that is up-to-pointer-aligned directly behind the state object in memory).
 	static_assert(sizeof(DescriptorStateCopy) % alignof(void*) == 0u);
-	assertOwned(pool->mutex);
 
-	auto bindingSize = totalDescriptorMemSize(*this->layout, this->variableDescriptorCount);
+	auto bindingSize = totalDescriptorMemSize(layout, variableDescriptorCount);
 	auto memSize = sizeof(DescriptorStateCopy) + bindingSize;
 
-	auto* mem = new std::byte[memSize]();
+	auto* mem = allocStateCopy(memSize);
 	TracyAllocS(mem, memSize, 8);
 
 	debugStatAdd(DebugStats::get().descriptorCopyMem, u32(memSize));
@@ -499,25 +845,66 @@ DescriptorStateCopyPtr DescriptorSet::copyLockedState() {
 	auto* copy = new(mem) DescriptorStateCopy();
 	dlg_assert(reinterpret_cast<std::byte*>(copy) == mem);
 
-	copy->variableDescriptorCount = this->variableDescriptorCount;
-	copy->layout = this->layout;
+	copy->variableDescriptorCount = variableDescriptorCount;
+	copy->layout.reset(&layout);
+
+	return copy;
+}
+
+} // anon namespace
+
+DescriptorStateCopyPtr newDescriptorStateCopy(DescriptorSetLayout& layout,
+		u32 variableDescriptorCount) {
+	ZoneScoped;
+
+	auto* copy = allocDescriptorStateCopy(layout, variableDescriptorCount);
+	DescriptorStateRef ref(*copy);
+
+	// the memory is already zero-initialized.
+	// The copy owns a reference to all its bindings, including
+	// the immutable samplers.
+	initImmutableSamplers(ref);
+
+	RefCountBatch refs;
+	for(auto b = 0u; b < layout.bindings.size(); ++b) {
+		if(!layout.bindings[b].immutableSamplers.get()) {
+			continue;
+		}
+
+		for(auto& elem : images(ref, b)) {
+			refs.inc(*elem.sampler);
+		}
+	}
+
+	refs.flush();
+
+	return DescriptorStateCopyPtr(copy);
+}
+
+DescriptorStateCopyPtr DescriptorSet::copyLockedState() {
+	ZoneScoped;
+	assertOwned(pool->mutex);
+
+	auto* copy = allocDescriptorStateCopy(*this->layout, this->variableDescriptorCount);
 
 	DescriptorStateRef srcRef(*this);
 	auto dstRef = srcRef;
-	dstRef.data = mem + sizeof(DescriptorStateCopy);
+	dstRef.data = reinterpret_cast<std::byte*>(copy) + sizeof(DescriptorStateCopy);
 
-	initDescriptorState(dstRef.data, *this->layout, this->variableDescriptorCount);
+	// the memory is already zero-initialized
 	initImmutableSamplers(dstRef);
 
 	// copy descriptors
+	// Only increments since the state is new, flushing can't destroy anything
+	RefCountBatch refs;
 	for(auto b = 0u; b < this->layout->bindings.size(); ++b) {
-		for(auto e = 0u; e < descriptorCount(srcRef, b); ++e) {
-			// with !refBindings, we "take ownership" of the increased
-			// reference count here
-			vil::copy(dstRef, b, e, srcRef, b, e);
-		}
+		// with !refBindings, we "take ownership" of the increased
+		// reference count here
+		copyToZeroed(dstRef, srcRef, b, 0u, descriptorCount(srcRef, b), refs);
 	}
 
+	refs.flush();
+
 	return DescriptorStateCopyPtr(copy);
 }
 
@@ -525,6 +912,8 @@ DescriptorStateCopyPtr DescriptorSet::validateAndCopyLocked() {
 	assertOwned(dev().mutex);
 	assertOwned(pool->mutex);
 
+	materializeLocked();
+
 	// We need to reference all bindings when they aren't referenced
 	// at the moment. This will also validate them (i.e. set the ones
 	// we detect as destroyed to null)
@@ -563,6 +952,8 @@ IntrusivePtr<DescriptorSetCow> DescriptorSet::addCowLocked() {
 	assertOwned(dev().mutex);
 	assertOwned(pool->mutex);
 
+	materializeLocked();
+
 	if(!cow_) {
 		// TODO PERF: get from a pool or something
 		// (low prio since only relevant for gui stuff)
@@ -580,14 +971,224 @@ IntrusivePtr<DescriptorSetCow> DescriptorSet::addCowLocked() {
 	return IntrusivePtr<DescriptorSetCow>(cow_);
 }
 
+bool DescriptorSet::journalLocked(DescriptorJournalEntry& entry) {
+	assertOwned(pool->mutex);
+
+	// We don't know which bindings the journal will modify when
+	// materialized, resolve the cow completely.
+	resolveCowLocked(0u, u32(-1));
+
+	if(journal_) {
+		entry.next = journal_->next;
+		journal_->next = &entry;
+	} else {
+		entry.next = &entry;
+	}
+
+	journal_ = &entry;
+	journalSize_ += u32(sizeof(entry) + entry.count * journalElemSize(entry.category));
+
+	auto setSize = sizeof(DescriptorSet) +
+		totalDescriptorMemSize(*layout, variableDescriptorCount);
+	if(journalSize_ <= maxJournalSizeFac * setSize) {
+		return true;
+	}
+
+	pool->transient = false;
+	return false;
+}
+
+void DescriptorSet::materializeLocked() {
+	assertOwned(dev().mutex);
+	assertOwned(pool->mutex);
+
+	if(!journal_) {
+		return;
+	}
+
+	ZoneScoped;
+	dlg_assert(!cow_);
+
+	auto& dev = this->dev();
+	auto* first = journal_->next;
+	journal_->next = nullptr; // break the cycle
+
+	// NOTE: with refBindings, this must not unreference anything since
+	// we might be called with the device mutex locked. The references
+	// of replaced handles are moved into the journal instead.
+	forEachJournaled(*this, first, [&](DescriptorJournalEntry& entry,
+			u32 j, u32 binding, u32 elem) {
+		auto& layout = this->layout->bindings[binding];
+		auto* data = payload(entry);
+
+		switch(entry.category) {
+			case DescriptorCategory::image: {
+				auto& info = reinterpret_cast<VkDescriptorImageInfo*>(data)[j];
+				auto& dst = images(*this, binding)[elem];
+				dst.layout = info.imageLayout;
+				if(needsImageView(layout.descriptorType)) {
+					applyJournaled(dev.imageViews, dst.imageView, info.imageView);
+				}
+				if(needsSampler(layout.descriptorType) && !layout.immutableSamplers) {
+					applyJournaled(dev.samplers, dst.sampler, info.sampler);
+				}
+				break;
+			} case DescriptorCategory::buffer: {
+				auto& info = reinterpret_cast<VkDescriptorBufferInfo*>(data)[j];
+				auto& dst = buffers(*this, binding)[elem];
+				applyJournaled(dev.buffers, dst.buffer, info.buffer);
+				dst.offset = info.offset;
+				dst.range = dst.buffer ?
+					evalRange(dst.buffer->ci.size, info.offset, info.range) :
+					info.range;
+				break;
+			} case DescriptorCategory::bufferView: {
+				auto& handle = reinterpret_cast<VkBufferView*>(data)[j];
+				applyJournaled(dev.bufferViews,
+					bufferViews(*this, binding)[elem].bufferView, handle);
+				break;
+			} case DescriptorCategory::accelStruct: {
+				auto& handle = reinterpret_cast<VkAccelerationStructureKHR*>(data)[j];
+				applyJournaled(dev.accelStructs,
+					accelStructs(*this, binding)[elem].accelStruct, handle);
+				break;
+			} case DescriptorCategory::inlineUniformBlock: {
+				inlineUniformBlock(*this, binding)[elem] = data[j];
+				break;
+			} case DescriptorCategory::none:
+				dlg_error("unreachable: Invalid descriptor type");
+				break;
+		}
+	});
+
+	if(refBindings) {
+		// the entries now hold the references of the replaced handles
+		journal_->next = retired_;
+		retired_ = first;
+	}
+
+	// The memory is only reclaimed on pool reset or in demoteTransientPool
+	journal_ = nullptr;
+	journalSize_ = 0u;
+}
+
+void DescriptorSet::unrefJournal(RefCountBatch& refs) {
+	if(!refBindings) {
+		dlg_assert(!retired_);
+		return;
+	}
+
+	auto unref = [&](DescriptorJournalEntry& entry, u32 j, u32 binding, u32) {
+		auto& layout = this->layout->bindings[binding];
+		auto* data = payload(entry);
+
+		switch(entry.category) {
+			case DescriptorCategory::image: {
+				auto& info = reinterpret_cast<VkDescriptorImageInfo*>(data)[j];
+				if(needsImageView(layout.descriptorType)) {
+					unrefJournaled(refs, info.imageView);
+				}
+				if(needsSampler(layout.descriptorType) && !layout.immutableSamplers) {
+					unrefJournaled(refs, info.sampler);
+				}
+				break;
+			} case DescriptorCategory::buffer:
+				unrefJournaled(refs, reinterpret_cast<VkDescriptorBufferInfo*>(data)[j].buffer);
+				break;
+			case DescriptorCategory::bufferView:
+				unrefJournaled(refs, reinterpret_cast<VkBufferView*>(data)[j]);
+				break;
+			case DescriptorCategory::accelStruct:
+				unrefJournaled(refs, reinterpret_cast<VkAccelerationStructureKHR*>(data)[j]);
+				break;
+			case DescriptorCategory::inlineUniformBlock:
+			case DescriptorCategory::none:
+				break;
+		}
+	};
+
+	if(journal_) {
+		auto* first = journal_->next;
+		journal_->next = nullptr; // break the cycle
+		forEachJournaled(*this, first, unref);
+		journal_ = nullptr;
+		journalSize_ = 0u;
+	}
+
+	forEachJournaled(*this, retired_, unref);
+	retired_ = nullptr;
+}
+
+// Materializes the journals of all sets of the given pool and frees
+// their memory. Called when the pool isn't transient anymore.
+// Must be called without the pool mutex locked.
+void demoteTransientPool(DescriptorPool& pool) {
+	ZoneScoped;
+
+	// the journals might hold the last references, see unrefJournal
+	RefCountBatch refs;
+
+	{
+		std::lock_guard devLock(pool.dev->mutex);
+		std::lock_guard lock(pool.mutex);
+
+		dlg_assert(!pool.transient);
+		for(auto* it = pool.usedEntries; it; it = it->next) {
+			dlg_assert(it->set);
+			it->set->materializeLocked();
+			it->set->unrefJournal(refs);
+		}
+
+		pool.journalAlloc.reset();
+	}
+
+	refs.flush();
+}
+
+// Makes sure all journaled writes of the given set are applied.
+// Must be called without any pool mutex locked.
+void materialize(DescriptorSet& ds) {
+	{
+		auto lock = ds.lock();
+		if(!ds.journaledLocked()) {
+			return;
+		}
+	}
+
+	std::lock_guard devLock(ds.dev().mutex);
+	auto lock = ds.lock();
+	ds.materializeLocked();
+}
+
 std::unique_lock<LockableBase(DebugMutex)> DescriptorSet::checkResolveCow() {
 	std::unique_lock objLock(pool->mutex);
+	if(cow_) {
+		resolveCowLocked(0u, u32(-1));
+	}
+
+	return objLock;
+}
+
+std::unique_lock<LockableBase(DebugMutex)> DescriptorSet::checkResolveCow(
+		u32 dataBegin, u32 dataEnd) {
+	dlg_assert(dataBegin < dataEnd);
+	std::unique_lock objLock(pool->mutex);
+	if(cow_) {
+		constexpr auto chunkSize = DescriptorSetCow::chunkSize;
+		resolveCowLocked(dataBegin / chunkSize, (dataEnd - 1) / chunkSize + 1);
+	}
+
+	return objLock;
+}
+
+void DescriptorSet::resolveCowLocked(u32 firstChunk, u32 endChunk) {
+	assertOwned(pool->mutex);
 	if(!cow_) {
-		return objLock;
+		return;
 	}
 
 	dlg_assert(cow_->ds == this);
-	dlg_assert(!cow_->copy);
+	dlg_assert(!journal_);
 
 	// Check if there is anybody interested in the cow.
 	// This isn't a race, nobody is able to access cow_ from the outside
@@ -598,23 +1199,50 @@ std::unique_lock<LockableBase(DebugMutex)> DescriptorSet::checkResolveCow() {
 	if(cow_->refCount.load() == 1u) {
 		// With !refBindings, we referenced all bindings when a cow was
 		// added so we have to unref them here since we will never
-		// create the cow-owned copy that takes ownership of the increased
-		// counts.
+		// copy them into the cow, taking ownership of the increased
+		// counts. The chunks already copied are owned by cow_->copy.
 		if(!refBindings) {
-			unrefBindings(*this);
+			RefCountBatch refs;
+			forEachUncopied(*cow_, *this, 0u, u32(-1), [&](u32 b, u32 firstElem, u32 endElem) {
+				unrefBinding(*this, b, firstElem, endElem, refs);
+			});
+
+			refs.flush();
 		}
 
 		cow_->ds = nullptr; // just as a debug marker, see ~DescriptorSetCow
 		cow_.reset();
-	} else {
-		// here we have to resolve the cow
-		std::unique_lock cowLock(cow_->mutex);
-		cow_->copy = this->copyLockedState();
-		cow_->ds = nullptr; // just as a debug marker, see ~DescriptorSetCow
+		return;
 	}
 
-	cow_.reset();
-	return objLock;
+	// here we have to resolve the cow, at least partially
+	ZoneScopedN("resolveCow");
+	std::unique_lock cowLock(cow_->mutex);
+	auto& cow = *cow_;
+
+	if(!cow.copy) {
+		// The chunks that are not copied yet stay zero-initialized.
+		// Don't init the immutable samplers either, they are copied
+		// with their chunk.
+		cow.copy.reset(allocDescriptorStateCopy(*layout, variableDescriptorCount));
+
+		auto memSize = totalDescriptorMemSize(*layout, variableDescriptorCount);
+		cow.chunkCount = std::max(ceilDivide(u32(memSize), DescriptorSetCow::chunkSize), 1u);
+		cow.copiedChunks.resize((cow.chunkCount + 63u) / 64u);
+	}
+
+	// Only increments since the copy takes over the references
+	RefCountBatch refs;
+	copyCowChunks(cow, firstChunk, endChunk, refs);
+	refs.flush();
+
+	// Once all chunks are copied, the cow is independent of the set
+	if(cow.copiedCount == cow.chunkCount) {
+		cow.ds = nullptr;
+		cow.copiedChunks = {};
+		cowLock.unlock();
+		cow_.reset();
+	}
 }
 
 void destroy(DescriptorSet& ds, bool unlink) {
@@ -629,6 +1257,10 @@ void destroy(DescriptorSet& ds, bool unlink) {
 	ds.checkResolveCow();
 
 	if(refBindings) {
+		RefCountBatch refs;
+		ds.unrefJournal(refs);
+		refs.flush();
+
 		unrefBindings(ds);
 	}
 
@@ -664,13 +1296,10 @@ void destroy(DescriptorSet& ds, bool unlink) {
 		dlg_assert(pool.flags & VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
 
 		// unlink setEntry
-		dlg_assert(!setEntry->next == (setEntry == pool.highestEntry));
 		dlg_assert(!setEntry->prev == (setEntry == pool.usedEntries));
 
 		if(setEntry->next) {
 			setEntry->next->prev = setEntry->prev;
-		} else {
-			pool.highestEntry = setEntry->prev;
 		}
 
 		if(setEntry->prev) {
@@ -679,8 +1308,9 @@ void destroy(DescriptorSet& ds, bool unlink) {
 			pool.usedEntries = setEntry->next;
 		}
 
-		if(setEntry == pool.lastEntry) {
-			pool.lastEntry = setEntry->prev;
+		// return data
+		if(setEntry->block != TlsfAllocator::invalid) {
+			pool.dataAlloc.free(setEntry->block);
 		}
 
 		// return to free list
@@ -702,7 +1332,7 @@ span<BufferDescriptor> buffers(DescriptorStateRef state, unsigned binding) {
 		count = state.variableDescriptorCount;
 	}
 
-	auto ptr = state.data + layout.offset;
+	auto ptr = bindingPtr(state, binding);
 	auto d = std::launder(reinterpret_cast<BufferDescriptor*>(ptr));
 	return {d, count};
 }
@@ -717,7 +1347,7 @@ span<ImageDescriptor> images(DescriptorStateRef state, unsigned binding) {
 		count = state.variableDescriptorCount;
 	}
 
-	auto ptr = state.data + layout.offset;
+	auto ptr = bindingPtr(state, binding);
 	auto d = std::launder(reinterpret_cast<ImageDescriptor*>(ptr));
 	return {d, count};
 }
@@ -732,7 +1362,7 @@ span<BufferViewDescriptor> bufferViews(DescriptorStateRef state, unsigned bindin
 		count = state.variableDescriptorCount;
 	}
 
-	auto ptr = state.data + layout.offset;
+	auto ptr = bindingPtr(state, binding);
 	auto d = std::launder(reinterpret_cast<BufferViewDescriptor*>(ptr));
 	return {d, count};
 }
@@ -747,7 +1377,7 @@ span<std::byte> inlineUniformBlock(DescriptorStateRef state, unsigned binding) {
 		count = state.variableDescriptorCount;
 	}
 
-	auto ptr = state.data + layout.offset;
+	auto ptr = bindingPtr(state, binding);
 	return {ptr, count};
 }
 span<AccelStructDescriptor> accelStructs(DescriptorStateRef state, unsigned binding) {
@@ -761,7 +1391,7 @@ span<AccelStructDescriptor> accelStructs(DescriptorStateRef state, unsigned bind
 		count = state.variableDescriptorCount;
 	}
 
-	auto ptr = state.data + layout.offset;
+	auto ptr = bindingPtr(state, binding);
 	auto d = std::launder(reinterpret_cast<AccelStructDescriptor*>(ptr));
 	return {d, count};
 }
@@ -1035,10 +1665,9 @@ void initResetPoolEntries(DescriptorPool& dsPool) {
 	}
 
 	dsPool.freeEntries = &dsPool.entries[0];
-
 	dsPool.usedEntries = nullptr;
-	dsPool.lastEntry = nullptr;
-	dsPool.highestEntry = nullptr;
+	dsPool.dataAlloc.reset();
+	dsPool.journalAlloc.reset();
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorPool(
@@ -1060,10 +1689,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorPool(
 	dsPool.maxSets = pCreateInfo->maxSets;
 	dsPool.poolSizes = {pCreateInfo->pPoolSizes, pCreateInfo->pPoolSizes + pCreateInfo->poolSizeCount};
 	dsPool.flags = pCreateInfo->flags;
-
-	// init descriptor entries
-	dsPool.entries = std::make_unique<DescriptorPool::SetEntry[]>(dsPool.maxSets);
-	initResetPoolEntries(dsPool);
+	setLockSite(dsPool.mutex, LockSite::descriptorPool);
 
 	// init descriptor data
 	dsPool.dataSize = dsPool.maxSets * sizeof(DescriptorSet);
@@ -1071,16 +1697,27 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorPool(
 		dsPool.dataSize += descriptorSize(pool.type) * pool.descriptorCount;
 	}
 
+	// The sets are suballocated with an alignment while the sizes of
+	// inline uniform blocks are only multiples of 4.
+	dsPool.dataSize = TlsfAllocator::paddedSize(dsPool.dataSize, dsPool.maxSets);
+
 	// NOTE: no idea why this was needed for the nvidia rtxgi samples.
 	// Maybe we don't calculate the size correctly in some edge cases?
 	// constexpr auto overAllocFac = 4u;
 	// dsPool.dataSize *= overAllocFac;
 	// dsPool.dataSize = std::max<u32>(dsPool.dataSize, 1024 * 1024 * 64);
 
-	dsPool.data = std::make_unique<std::byte[]>(dsPool.dataSize);
+	// Allocated via pages, only the parts actually written by sets
+	// commit memory. Pools for bindless sets are often huge.
+	dsPool.data = PageMemory(dsPool.dataSize);
+	dsPool.dataAlloc.init(dsPool.dataSize, dsPool.maxSets);
 	debugStatAdd(DebugStats::get().descriptorPoolMem, dsPool.dataSize);
 	TracyAlloc(dsPool.data.get(), dsPool.dataSize);
 
+	// init descriptor entries
+	dsPool.entries = std::make_unique<DescriptorPool::SetEntry[]>(dsPool.maxSets);
+	initResetPoolEntries(dsPool);
+
 	*pDescriptorPool = castDispatch<VkDescriptorPool>(dsPool);
 	dev.dsPools.mustEmplace(*pDescriptorPool, std::move(dsPoolPtr));
 
@@ -1115,6 +1752,22 @@ VKAPI_ATTR VkResult VKAPI_CALL ResetDescriptorPool(
 
 	initResetPoolEntries(dsPool);
 
+	// Pools that are reset about once per frame are transient,
+	// see DescriptorPool::transient.
+	auto submission = dev.submissionCounter.load();
+	if(submission - dsPool.lastResetSubmission <= transientResetSubmissions) {
+		++dsPool.resetStreak;
+	} else {
+		dsPool.resetStreak = 0u;
+	}
+
+	dsPool.lastResetSubmission = submission;
+	dsPool.transient = false;
+	if(dsPool.resetStreak >= transientResetStreak && dev.lazyDescriptors.load()) {
+		std::lock_guard devLock(dev.mutex);
+		dsPool.transient = !needsDescriptorTrackingLocked(dev);
+	}
+
 	{
 		ZoneScopedN("dispatch");
 		return dev.dispatch.ResetDescriptorPool(dev.handle, dsPool.handle, flags);
@@ -1138,128 +1791,42 @@ VkResult findEntry(DescriptorPool& pool, u32 memSize,
 		return VK_ERROR_OUT_OF_POOL_MEMORY;
 	}
 
-	auto highestOffset = 0u;
-	if(pool.highestEntry) {
-		highestOffset = pool.highestEntry->offset + pool.highestEntry->size;
-	}
-
-	if(highestOffset + memSize <= pool.dataSize) {
-		dlg_assert(pool.freeEntries);
-		auto& entry = *pool.freeEntries;
-		pool.freeEntries = entry.next;
-
-		if(pool.highestEntry) {
-			pool.highestEntry->next = &entry;
-		} else {
-			pool.usedEntries = &entry;
-		}
-
-		entry.offset = highestOffset;
-		entry.size = memSize;
-		entry.next = nullptr;
-		entry.prev = pool.highestEntry;
-
-		pool.highestEntry = &entry;
-		setEntry = &entry;
-		data = &pool.data[entry.offset];
-	} else {
-		ZoneScopedN("findData - fragmented");
-
-		// otherwise we can't get fragmentation at all
+	auto allocation = pool.dataAlloc.alloc(memSize);
+	if(allocation.block == TlsfAllocator::invalid) {
+		// Pools without FREE_DESCRIPTOR_SET_BIT can't fragment, we
+		// always compute enough space for maxSets sets.
 		dlg_assert(pool.flags & VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
 
-		auto offset = 0u;
-		auto it = pool.lastEntry;
-
-		// Try to use position of last allocation
-		if(it) {
-			auto nextOff = pool.dataSize;
-			if(it->next) {
-				nextOff = it->next->offset;
-			}
-
-			offset = it->offset + it->size;
-			auto fits = (offset + memSize <= nextOff);
-			it = (fits) ? it->next : nullptr;
+		if constexpr(!enableDsFragmentationPath) {
+			dlg_trace("returning fragmented pool");
+			return VK_ERROR_FRAGMENTED_POOL;
 		}
 
-		// Start search at 0
-		if(!it) {
-			offset = 0u;
-			it = pool.usedEntries;
-
-			// skip special fragmented entries
-			// PERF: this makes fragmented entries extra hurtful.
-			// We could probably append them at the end instead with
-			// some additional trickery so we don't have to do this here.
-			while(it && it->offset == u32(-1)) {
-				it = it->next;
-			}
-
-			while(it) {
-				auto& entry = *it;
-				if(offset + memSize <= it->offset) {
-					break;
-				}
-				offset = entry.offset + entry.size;
-				it = it->next;
-			}
-		}
+		dlg_warn("Fragmentation of descriptor pool detected. Slow path");
+		data = new std::byte[memSize];
+		allocation.offset = u32(-1);
+		memSize = u32(-1);
+	} else {
+		data = &pool.data[allocation.offset];
+	}
 
-		if(offset + memSize > pool.dataSize) {
-			if constexpr(enableDsFragmentationPath) {
-				dlg_assert(pool.freeEntries);
-				auto& entry = *pool.freeEntries;
-				pool.freeEntries = entry.next;
-				setEntry = &entry;
-
-				dlg_assert(!it);
-				dlg_warn("Fragmentation of descriptor pool detected. Slow path");
-				data = new std::byte[memSize];
-
-				// dummy setEntry so we can put it into our linked list
-				entry.offset = u32(-1);
-				entry.size = u32(-1);
-				entry.next = pool.usedEntries;
-				entry.prev = nullptr;
-				pool.usedEntries = &entry;
-			} else {
-				dlg_trace("returning fragmented pool");
-				return VK_ERROR_FRAGMENTED_POOL;
-			}
-		} else {
-			// reserve entry
-			dlg_assert(pool.freeEntries);
-			auto& entry = *pool.freeEntries;
-			pool.freeEntries = entry.next;
-			setEntry = &entry;
-
-			// it == null can't happen, we should have landed
-			// in some earlier branch.
-			dlg_assert(it);
-			dlg_assert(pool.usedEntries && pool.highestEntry);
-
-			entry.offset = offset;
-			entry.size = memSize;
-
-			// insert entry before 'it'
-			entry.prev = it->prev;
-			entry.next = it;
-
-			dlg_assert(!it->prev == (it == pool.usedEntries));
-			if(it->prev) {
-				it->prev->next = &entry;
-			} else {
-				pool.usedEntries = &entry;
-			}
+	auto& entry = *pool.freeEntries;
+	pool.freeEntries = entry.next;
 
-			it->prev = &entry;
+	entry.offset = allocation.offset;
+	entry.size = memSize;
+	entry.block = allocation.block;
 
-			pool.lastEntry = &entry;
-			data = &pool.data[offset];
-		}
+	// insert at front of usedEntries
+	entry.prev = nullptr;
+	entry.next = pool.usedEntries;
+	if(pool.usedEntries) {
+		pool.usedEntries->prev = &entry;
 	}
 
+	pool.usedEntries = &entry;
+	setEntry = &entry;
+
 	return VK_SUCCESS;
 }
 
@@ -1294,7 +1861,8 @@ VkResult initDescriptorSet(Device& dev, DescriptorPool& pool, VkDescriptorSet& h
 	ds.id = ++pool.lastID;
 	setEntry->set = &ds;
 
-	initDescriptorState(bindingData(ds), *ds.layout, ds.variableDescriptorCount);
+	auto inPool = (setEntry->offset != u32(-1));
+	initDescriptorState(bindingData(ds), *ds.layout, ds.variableDescriptorCount, inPool);
 	handle = castDispatch<VkDescriptorSet>(ds);
 
 	if(!HandleDesc<VkDescriptorSet>::wrap) {
@@ -1411,39 +1979,36 @@ VKAPI_ATTR VkResult VKAPI_CALL FreeDescriptorSets(
 	}
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
+// Updates a single descriptor and unwraps the handles in the given info.
+void update(Device& dev, RefCountBatch& refs, BufferViewDescriptor& binding,
 		VkBufferView& handle) {
-	auto& binding = bufferViews(state, bind)[elem];
-
 	BufferView* newView {};
 	if(handle) VIL_LIKELY {
-		newView = &get(*state.layout->dev, handle);
+		newView = &get(dev, handle);
 		handle = newView->handle;
 	}
 
 	if(refBindings) {
 		if(binding.bufferView) {
-			decRefCount(*binding.bufferView);
+			refs.dec(*binding.bufferView);
 		}
 		if(newView) {
-			incRefCount(*newView);
+			refs.inc(*newView);
 		}
 	}
 
 	binding.bufferView = newView;
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
-		VkDescriptorImageInfo& img) {
-	auto& dev = *state.layout->dev;
-
-	auto& binding = images(state, bind)[elem];
+// The sampler is only updated if 'updateSampler' is true, i.e. if it's
+// needed and not immutable in the layout.
+void update(Device& dev, RefCountBatch& refs, ImageDescriptor& binding,
+		VkDescriptorImageInfo& img,
+		bool updateView, bool updateSampler) {
 	binding.layout = img.imageLayout;
 
-	auto& layout = state.layout->bindings[bind];
-
 	// update imageView, if needed
-	if(needsImageView(layout.descriptorType)) {
+	if(updateView) {
 		ImageView* newView {};
 		if(img.imageView) VIL_LIKELY { // can be VK_NULL_HANDLE
 			newView = &get(dev, img.imageView);
@@ -1452,10 +2017,10 @@ void update(DescriptorSet& state, unsigned bind, unsigned elem,
 
 		if(refBindings) {
 			if(binding.imageView) {
-				decRefCount(*binding.imageView);
+				refs.dec(*binding.imageView);
 			}
 			if(newView) {
-				incRefCount(*newView);
+				refs.inc(*newView);
 			}
 		}
 
@@ -1463,49 +2028,41 @@ void update(DescriptorSet& state, unsigned bind, unsigned elem,
 	}
 
 	// update sampler, if needed
-	if(needsSampler(layout.descriptorType)) {
-		if(layout.immutableSamplers) {
-			// immutable samplers are initialized at the beginning and
-			// never unset.
-			dlg_assert(binding.sampler);
-			dlg_assert(binding.sampler == layout.immutableSamplers[elem].get());
-		} else {
-			Sampler* newSampler {};
-			if(img.sampler) VIL_LIKELY { // can be VK_NULL_HANDLE
-				newSampler = &get(dev, img.sampler);
-				img.sampler = newSampler->handle;
-			}
+	if(updateSampler) {
+		Sampler* newSampler {};
+		if(img.sampler) VIL_LIKELY { // can be VK_NULL_HANDLE
+			newSampler = &get(dev, img.sampler);
+			img.sampler = newSampler->handle;
+		}
 
-			if(refBindings) {
-				if(binding.sampler) {
-					decRefCount(*binding.sampler);
-				}
-				if(newSampler) {
-					incRefCount(*newSampler);
-				}
+		if(refBindings) {
+			if(binding.sampler) {
+				refs.dec(*binding.sampler);
+			}
+			if(newSampler) {
+				refs.inc(*newSampler);
 			}
-
-			binding.sampler = newSampler;
 		}
+
+		binding.sampler = newSampler;
 	}
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
+void update(Device& dev, RefCountBatch& refs, BufferDescriptor& binding,
 		VkDescriptorBufferInfo& info) {
-	auto& binding = buffers(state, bind)[elem];
 	Buffer* newBuffer {};
 
 	if(info.buffer) VIL_LIKELY { // can be VK_NULL_HANDLE
-		newBuffer = &get(*state.layout->dev, info.buffer);
+		newBuffer = &get(dev, info.buffer);
 		info.buffer = newBuffer->handle;
 	}
 
 	if(refBindings) {
 		if(binding.buffer) {
-			decRefCount(*binding.buffer);
+			refs.dec(*binding.buffer);
 		}
 		if(newBuffer) {
-			incRefCount(*newBuffer);
+			refs.inc(*newBuffer);
 		}
 	}
 
@@ -1519,28 +2076,86 @@ void update(DescriptorSet& state, unsigned bind, unsigned elem,
 	}
 }
 
-void update(DescriptorSet& state, unsigned bind, unsigned elem,
+void update(Device& dev, RefCountBatch& refs, AccelStructDescriptor& binding,
 		VkAccelerationStructureKHR& handle) {
-	auto& binding = accelStructs(state, bind)[elem];
 	AccelStruct* newAS {};
 
 	if(handle) VIL_LIKELY { // can be VK_NULL_HANDLE
-		newAS = &get(*state.layout->dev, handle);
+		newAS = &get(dev, handle);
 		handle = newAS->handle;
 	}
 
 	if(refBindings) {
 		if(binding.accelStruct) {
-			decRefCount(*binding.accelStruct);
+			refs.dec(*binding.accelStruct);
 		}
 		if(newAS) {
-			incRefCount(*newAS);
+			refs.inc(*newAS);
 		}
 	}
 
 	binding.accelStruct = newAS;
 }
 
+// Only unwraps the handles in the given info, for journaled writes.
+// With refBindings, the journal owns a reference to the unwrapped
+// handles. See DescriptorSet::materializeLocked.
+template<typename VkHandle>
+void unwrapDescriptor(Device& dev, RefCountBatch& refs, VkHandle& handle) {
+	if(handle) VIL_LIKELY {
+		auto& obj = get(dev, handle);
+		handle = obj.handle;
+		if(refBindings) {
+			refs.inc(obj);
+		}
+	}
+}
+
+void unwrapDescriptor(Device& dev, RefCountBatch& refs, VkDescriptorImageInfo& img,
+		bool updateView, bool updateSampler) {
+	if(updateView) {
+		unwrapDescriptor(dev, refs, img.imageView);
+	}
+	if(updateSampler) {
+		unwrapDescriptor(dev, refs, img.sampler);
+	}
+}
+
+void unwrapDescriptor(Device& dev, RefCountBatch& refs, VkDescriptorBufferInfo& info) {
+	unwrapDescriptor(dev, refs, info.buffer);
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkBufferView& handle, RefCountBatch& refs) {
+	update(*state.layout->dev, refs, bufferViews(state, bind)[elem], handle);
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkDescriptorImageInfo& img, RefCountBatch& refs) {
+	auto& binding = images(state, bind)[elem];
+	auto& layout = state.layout->bindings[bind];
+
+	auto updateView = needsImageView(layout.descriptorType);
+	auto updateSampler = needsSampler(layout.descriptorType) && !layout.immutableSamplers;
+
+	// immutable samplers are initialized at the beginning and
+	// never unset.
+	dlg_assert(!layout.immutableSamplers || (binding.sampler &&
+		binding.sampler == layout.immutableSamplers[elem].get()));
+
+	update(*state.layout->dev, refs, binding, img, updateView, updateSampler);
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkDescriptorBufferInfo& info, RefCountBatch& refs) {
+	update(*state.layout->dev, refs, buffers(state, bind)[elem], info);
+}
+
+void update(DescriptorSet& state, unsigned bind, unsigned elem,
+		VkAccelerationStructureKHR& handle, RefCountBatch& refs) {
+	update(*state.layout->dev, refs, accelStructs(state, bind)[elem], handle);
+}
+
 void update(DescriptorSet& state, unsigned bind, unsigned offset,
 		std::byte src) {
 	auto buf = inlineUniformBlock(state, bind);
@@ -1565,6 +2180,30 @@ void advanceUntilValid(DescriptorSet& state, unsigned& binding, unsigned& elem)
 	}
 }
 
+// Returns the byte range of binding data modified by an update of 'count'
+// descriptors starting at the given binding and element,
+// see advanceUntilValid. Used to resolve the cow, see checkResolveCow.
+std::pair<u32, u32> updatedDataRange(const DescriptorSet& state, u32 binding,
+		u32 elem, u32 count) {
+	dlg_assert(count > 0u);
+	auto dataOffset = [&](u32 b, u32 e) {
+		auto& layout = state.layout->bindings[b];
+		return u32(layout.offset + e * descriptorSize(layout.descriptorType));
+	};
+
+	auto begin = dataOffset(binding, elem);
+	auto last = elem + (count - 1u);
+	auto bcount = descriptorCount(state, binding);
+	while(last >= bcount) {
+		last -= bcount;
+		++binding;
+		dlg_assert(binding < state.layout->bindings.size());
+		bcount = descriptorCount(state, binding);
+	}
+
+	return {begin, dataOffset(binding, last + 1)};
+}
+
 // NOTE: in UpdateDescriptorSets(WithTemplate), we don't invalidate
 // command records even more, even though it would be needed in most
 // cases (excluding update_after_bind stuff) but we don't need that
@@ -1588,6 +2227,10 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(
 
 	ThreadMemScope memScope;
 
+	// With refBindings, reference count changes are applied at the end
+	// of this function, after we released all locks.
+	RefCountBatch refs;
+
 	auto writes = memScope.allocUndef<VkWriteDescriptorSet>(descriptorWriteCount);
 	auto imageInfos = memScope.allocUndef<VkDescriptorImageInfo>(totalWriteCount);
 	auto bufferInfos = memScope.allocUndef<VkDescriptorBufferInfo>(totalWriteCount);
@@ -1623,7 +2266,15 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(
 		// That's why we need all handles being written to descriptorSets
 		// to be wrapped, so we don't have to lock the device mutex to
 		// access the maps.
-		auto lock = ds.checkResolveCow();
+		auto [dataBegin, dataEnd] = updatedDataRange(ds, write.dstBinding,
+			write.dstArrayElement, write.descriptorCount);
+		auto lock = ds.checkResolveCow(dataBegin, dataEnd);
+
+		// Writes to sets of transient pools are only journaled, see
+		// DescriptorPool::transient. Once a set has a journal, all writes
+		// are journaled until it is materialized, keeping their order.
+		auto journaled = ds.pool->transient || ds.journaledLocked();
+		const void* journalSrc {};
 
 		for(auto j = 0u; j < write.descriptorCount; ++j, ++dstElem) {
 			advanceUntilValid(ds, dstBinding, dstElem);
@@ -1636,32 +2287,56 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(
 					dlg_assert(write.pImageInfo);
 					auto& info = imageInfos[writeOff + j];
 					info = write.pImageInfo[j];
-					update(ds, dstBinding, dstElem, info);
+					journalSrc = write.pImageInfo;
+					if(journaled) {
+						unwrapDescriptor(dev, refs, info, needsImageView(layout.descriptorType),
+							needsSampler(layout.descriptorType) && !layout.immutableSamplers);
+					} else {
+						update(ds, dstBinding, dstElem, info, refs);
+					}
 					break;
 				} case DescriptorCategory::buffer: {
 					dlg_assert(write.pBufferInfo);
 					auto& info = bufferInfos[writeOff + j];
 					info = write.pBufferInfo[j];
-					update(ds, dstBinding, dstElem, info);
+					journalSrc = write.pBufferInfo;
+					if(journaled) {
+						unwrapDescriptor(dev, refs, info);
+					} else {
+						update(ds, dstBinding, dstElem, info, refs);
+					}
 					break;
 				} case DescriptorCategory::bufferView: {
 					dlg_assert(write.pTexelBufferView);
 					auto& info = bufferViews[writeOff + j];
 					info = write.pTexelBufferView[j];
-					update(ds, dstBinding, dstElem, info);
+					journalSrc = write.pTexelBufferView;
+					if(journaled) {
+						unwrapDescriptor(dev, refs, info);
+					} else {
+						update(ds, dstBinding, dstElem, info, refs);
+					}
 					break;
 				} case DescriptorCategory::accelStruct: {
 					dlg_assert(accelStructWrite);
 					dlg_assert(j < accelStructWrite->accelerationStructureCount);
 					auto& info = accelStructs[writeOff + j];
 					info = accelStructWrite->pAccelerationStructures[j];
-					update(ds, dstBinding, dstElem, info);
+					journalSrc = accelStructWrite->pAccelerationStructures;
+					if(journaled) {
+						unwrapDescriptor(dev, refs, info);
+					} else {
+						update(ds, dstBinding, dstElem, info, refs);
+					}
 					break;
 				} case DescriptorCategory::inlineUniformBlock: {
 					dlg_assert(inlineUniformWrite);
 					dlg_assert(j < inlineUniformWrite->dataSize);
 					auto ptr = reinterpret_cast<const std::byte*>(inlineUniformWrite->pData);
-					update(ds, dstBinding, dstElem, ptr[j]);
+					journalSrc = ptr;
+					if(!journaled) {
+						update(ds, dstBinding, dstElem, ptr[j]);
+					}
 					break;
 				} case DescriptorCategory::none:
 					dlg_error("unreachable: Invalid descriptor type");
@@ -1669,6 +2344,23 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(
 			}
 		}
 
+		if(journaled && journalSrc) {
+			// journalSrc still references the application's data,
+			// with the wrapped handles
+			auto cat = category(write.descriptorType);
+			auto& entry = allocJournalEntry(*ds.pool, cat, write.dstBinding,
+				write.dstArrayElement, write.descriptorCount);
+			std::memcpy(payload(entry), journalSrc,
+				write.descriptorCount * journalElemSize(cat));
+			if(!ds.journalLocked(entry)) {
+				lock.unlock();
+				// the journal must own its references before it
+				// is materialized, see unrefJournal
+				refs.flush();
+				demoteTransientPool(*ds.pool);
+			}
+		}
+
 		writes[i].pImageInfo = imageInfos.data() + writeOff;
 		writes[i].pBufferInfo = bufferInfos.data() + writeOff;
 		writes[i].pTexelBufferView = bufferViews.data() + writeOff;
@@ -1699,15 +2391,27 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(
 		auto srcBinding = copyInfo.srcBinding;
 		auto srcElem = copyInfo.srcArrayElement;
 
-		auto lock = dst.checkResolveCow();
+		// copies are rare, we just apply the journals first
+		materialize(src);
+		materialize(dst);
+
+		if(copyInfo.descriptorCount == 0u) {
+			continue;
+		}
+
+		auto [dataBegin, dataEnd] = updatedDataRange(dst, dstBinding, dstElem,
+			copyInfo.descriptorCount);
+		auto lock = dst.checkResolveCow(dataBegin, dataEnd);
 
 		for(auto j = 0u; j < copyInfo.descriptorCount; ++j, ++srcElem, ++dstElem) {
 			advanceUntilValid(dst, dstBinding, dstElem);
 			advanceUntilValid(src, srcBinding, srcElem);
-			copy(dst, dstBinding, dstElem, src, srcBinding, srcElem);
+			copy(dst, dstBinding, dstElem, src, srcBinding, srcElem, refs);
 		}
 	}
 
+	refs.flush();
+
 	{
 		ZoneScopedN("dispatch");
 		return dev.dispatch.UpdateDescriptorSets(dev.handle,
@@ -1716,6 +2420,217 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSets(
 	}
 }
 
+bool compileUpdatePlan(DescriptorUpdateTemplate& dut, DescriptorSetLayout& layout) {
+	dut.plan.clear();
+
+	for(auto& entry : dut.entries) {
+		auto cat = category(entry.descriptorType);
+		if(cat == DescriptorCategory::none) {
+			dlg_error("Invalid/unknown descriptor type");
+			return false;
+		}
+
+		// this is a special case defined in VK_EXT_inline_uniform_block.
+		// dstArrayElement and descriptorCount are in bytes, the
+		// stride is ignored.
+		auto stride = entry.stride;
+		if(cat == DescriptorCategory::inlineUniformBlock) {
+			stride = 1u;
+		}
+
+		auto binding = entry.dstBinding;
+		auto elem = entry.dstArrayElement;
+		auto srcOffset = u32(entry.offset);
+		auto remaining = entry.descriptorCount;
+
+		while(remaining > 0u) {
+			// like advanceUntilValid, updates overflow into the next binding
+			while(binding < layout.bindings.size() &&
+					elem >= layout.bindings[binding].descriptorCount) {
+				++binding;
+				elem = 0u;
+			}
+
+			if(binding >= layout.bindings.size()) {
+				dlg_error("Descriptor update template entry out of bounds");
+				return false;
+			}
+
+			auto& bind = layout.bindings[binding];
+			dlg_assert(category(bind.descriptorType) == cat);
+
+			auto& op = dut.plan.emplace_back();
+			op.srcOffset = srcOffset;
+			op.srcStride = stride;
+			op.dstOffset = u32(bind.offset + elem * descriptorSize(bind.descriptorType));
+			op.binding = binding;
+			op.elem = elem;
+			op.count = std::min(remaining, bind.descriptorCount - elem);
+			op.category = cat;
+			op.updateView = needsImageView(bind.descriptorType);
+			op.updateSampler = needsSampler(bind.descriptorType) && !bind.immutableSamplers;
+			op.variableCount = bind.flags & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+			srcOffset += op.count * stride;
+			elem += op.count;
+			remaining -= op.count;
+		}
+	}
+
+	return true;
+}
+
+bool applyUpdatePlan(const DescriptorUpdateTemplate& dut, DescriptorSet& ds,
+		std::byte* src, bool journaled, RefCountBatch& refs) {
+	auto& dev = *ds.layout->dev;
+	auto* dst = bindingData(ds);
+	auto demote = false;
+
+	for(auto& op : dut.plan) {
+		auto count = op.count;
+		if(op.variableCount) VIL_UNLIKELY {
+			// the variable descriptor count of the set might be lower
+			auto setCount = ds.variableDescriptorCount;
+			dlg_assertm(op.elem + count <= setCount,
+				"Descriptor update out of bounds for variable count binding");
+			count = op.elem < setCount ? std::min(count, setCount - op.elem) : 0u;
+		}
+
+		auto* srcData = src + op.srcOffset;
+		auto* dstData = dst + op.dstOffset;
+
+		if(journaled && count > 0u) {
+			// must happen before we unwrap the handles in place below
+			auto elemSize = journalElemSize(op.category);
+			auto& entry = allocJournalEntry(*ds.pool, op.category, op.binding,
+				op.elem, count);
+			auto* dstPayload = payload(entry);
+			for(auto j = 0u; j < count; ++j) {
+				std::memcpy(dstPayload + j * elemSize, srcData + j * op.srcStride, elemSize);
+			}
+
+			// Keep journaling the remaining ops, they must be
+			// materialized in order.
+			demote |= !ds.journalLocked(entry);
+		}
+
+		// TODO: the reinterpret_casts here are UB in C++ I guess, see
+		// the generic path in UpdateDescriptorSetWithTemplate.
+		switch(op.category) {
+			case DescriptorCategory::buffer: {
+				auto* dstDesc = std::launder(reinterpret_cast<BufferDescriptor*>(dstData));
+				for(auto j = 0u; j < count; ++j) {
+					auto& info = *reinterpret_cast<VkDescriptorBufferInfo*>(srcData + j * op.srcStride);
+					if(journaled) {
+						unwrapDescriptor(dev, refs, info);
+					} else {
+						update(dev, refs, dstDesc[j], info);
+					}
+				}
+				break;
+			} case DescriptorCategory::image: {
+				auto* dstDesc = std::launder(reinterpret_cast<ImageDescriptor*>(dstData));
+				for(auto j = 0u; j < count; ++j) {
+					auto& info = *reinterpret_cast<VkDescriptorImageInfo*>(srcData + j * op.srcStride);
+					if(journaled) {
+						unwrapDescriptor(dev, refs, info, op.updateView, op.updateSampler);
+					} else {
+						update(dev, refs, dstDesc[j], info, op.updateView, op.updateSampler);
+					}
+				}
+				break;
+			} case DescriptorCategory::bufferView: {
+				auto* dstDesc = std::launder(reinterpret_cast<BufferViewDescriptor*>(dstData));
+				for(auto j = 0u; j < count; ++j) {
+					auto& handle = *reinterpret_cast<VkBufferView*>(srcData + j * op.srcStride);
+					if(journaled) {
+						unwrapDescriptor(dev, refs, handle);
+					} else {
+						update(dev, refs, dstDesc[j], handle);
+					}
+				}
+				break;
+			} case DescriptorCategory::accelStruct: {
+				auto* dstDesc = std::launder(reinterpret_cast<AccelStructDescriptor*>(dstData));
+				for(auto j = 0u; j < count; ++j) {
+					auto& handle = *reinterpret_cast<VkAccelerationStructureKHR*>(srcData + j * op.srcStride);
+					if(journaled) {
+						unwrapDescriptor(dev, refs, handle);
+					} else {
+						update(dev, refs, dstDesc[j], handle);
+					}
+				}
+				break;
+			} case DescriptorCategory::inlineUniformBlock: {
+				if(!journaled) {
+					std::memcpy(dstData, srcData, count);
+				}
+				break;
+			} case DescriptorCategory::none:
+				dlg_error("unreachable: Invalid descriptor type");
+				break;
+		}
+	}
+
+	return !demote;
+}
+
+void applyUpdateEntries(const DescriptorUpdateTemplate& dut, DescriptorSet& ds,
+		std::byte* src, RefCountBatch& refs) {
+	for(auto& entry : dut.entries) {
+		auto dstBinding = entry.dstBinding;
+		auto dstElem = entry.dstArrayElement;
+		auto dsType = ds.layout->bindings[dstBinding].descriptorType;
+
+		// see VK_EXT_inline_uniform_block, stride must be ignored
+		auto stride = entry.stride;
+		if(category(dsType) == DescriptorCategory::inlineUniformBlock) {
+			stride = 1u;
+		}
+
+		for(auto j = 0u; j < entry.descriptorCount; ++j, ++dstElem) {
+			advanceUntilValid(ds, dstBinding, dstElem);
+
+			// TODO: such an assertion here would be nice. Track used
+			// layout in update?
+			// dlg_assert(write.descriptorType == type);
+
+			auto* data = src + (entry.offset + j * stride);
+
+			// TODO: the reinterpret_cast here is UB in C++ I guess.
+			// Assuming the caller did it correctly (really creating
+			// the objects e.g. via placement new) we could probably also
+			// do it correctly by using placement new (copy) into 'fwdData'
+			// instead of the memcpy in UpdateDescriptorSetWithTemplate.
+			switch(category(dsType)) {
+				case DescriptorCategory::image: {
+					auto& img = *reinterpret_cast<VkDescriptorImageInfo*>(data);
+					update(ds, dstBinding, dstElem, img, refs);
+					break;
+				} case DescriptorCategory::buffer: {
+					auto& buf = *reinterpret_cast<VkDescriptorBufferInfo*>(data);
+					update(ds, dstBinding, dstElem, buf, refs);
+					break;
+				} case DescriptorCategory::bufferView: {
+					auto& bufView = *reinterpret_cast<VkBufferView*>(data);
+					update(ds, dstBinding, dstElem, bufView, refs);
+					break;
+				} case DescriptorCategory::accelStruct: {
+					auto& accelStruct = *reinterpret_cast<VkAccelerationStructureKHR*>(data);
+					update(ds, dstBinding, dstElem, accelStruct, refs);
+					break;
+				} case DescriptorCategory::inlineUniformBlock: {
+					auto ptr = reinterpret_cast<const std::byte*>(data);
+					update(ds, dstBinding, dstElem, *ptr);
+					break;
+				} case DescriptorCategory::none:
+					dlg_error("Invalid/unknown descriptor type");
+					break;
+			}
+		}
+	}
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorUpdateTemplate(
 		VkDevice                                    device,
 		const VkDescriptorUpdateTemplateCreateInfo* pCreateInfo,
@@ -1751,6 +2666,14 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorUpdateTemplate(
 		pCreateInfo->pDescriptorUpdateEntries + pCreateInfo->descriptorUpdateEntryCount
 	};
 
+	if(pCreateInfo->templateType == VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET) {
+		if(compileUpdatePlan(dut, dsLayout)) {
+			dut.planLayout.reset(&dsLayout);
+		} else {
+			dut.plan.clear();
+		}
+	}
+
 	*pDescriptorUpdateTemplate = castDispatch<VkDescriptorUpdateTemplate>(dut);
 	dev.dsuTemplates.mustEmplace(*pDescriptorUpdateTemplate, std::move(dutPtr));
 
@@ -1784,6 +2707,12 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSetWithTemplate(
 	auto& dev = *dut.dev;
 	auto& ds  = get(dev, descriptorSet);
 
+	// Only the plan path below can journal writes
+	auto planned = (dut.planLayout.get() == ds.layout.get());
+	if(!planned) {
+		materialize(ds);
+	}
+
 	// NOTE: we need this lock here since, technically, the ds could
 	// be accessed by another thread during the update e.g. if the ds has
 	// UPDATE_UNUSED_WHILE_PENDING.
@@ -1792,9 +2721,29 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSetWithTemplate(
 	// That's why we need all handles being written to descriptorSets
 	// to be wrapped, so we don't have to lock the device mutex to
 	// access the maps.
-	auto lock = ds.checkResolveCow();
+	// Only copy the binding data modified by the template into the cow.
+	// For variable count bindings, the range may exceed the data, that's
+	// fine, see resolveCowLocked.
+	auto dataBegin = u32(-1);
+	auto dataEnd = 0u;
+	if(planned) {
+		for(auto& op : dut.plan) {
+			auto& bind = ds.layout->bindings[op.binding];
+			auto size = u32(descriptorSize(bind.descriptorType));
+			dataBegin = std::min(dataBegin, op.dstOffset);
+			dataEnd = std::max(dataEnd, op.dstOffset + op.count * size);
+		}
+	}
+
+	if(dataBegin >= dataEnd) {
+		dataBegin = 0u;
+		dataEnd = u32(-1);
+	}
+
+	auto lock = ds.checkResolveCow(dataBegin, dataEnd);
 
 	ThreadMemScope memScope;
+	RefCountBatch refs; // see UpdateDescriptorSets
 	std::byte* ptr;
 
 	// Our implementation has massive overhead compared to
@@ -1818,53 +2767,16 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSetWithTemplate(
 		ptr = (std::byte*) pData;
 	}
 
-	for(auto& entry : dut.entries) {
-		auto dstBinding = entry.dstBinding;
-		auto dstElem = entry.dstArrayElement;
-		auto dsType = ds.layout->bindings[dstBinding].descriptorType;
-
-		for(auto j = 0u; j < entry.descriptorCount; ++j, ++dstElem) {
-			// PERF Could we maybe determine this statically
-			// in CreateDescriptorUpdateTemplate?
-			advanceUntilValid(ds, dstBinding, dstElem);
-
-			// TODO: such an assertion here would be nice. Track used
-			// layout in update?
-			// dlg_assert(write.descriptorType == type);
-
-			auto* data = ptr + (entry.offset + j * entry.stride);
-
-			// TODO: the reinterpret_cast here is UB in C++ I guess.
-			// Assuming the caller did it correctly (really creating
-			// the objects e.g. via placement new) we could probably also
-			// do it correctly by using placement new (copy) into 'fwdData'
-			// instead of the memcpy above.
-			switch(category(dsType)) {
-				case DescriptorCategory::image: {
-					auto& img = *reinterpret_cast<VkDescriptorImageInfo*>(data);
-					update(ds, dstBinding, dstElem, img);
-					break;
-				} case DescriptorCategory::buffer: {
-					auto& buf = *reinterpret_cast<VkDescriptorBufferInfo*>(data);
-					update(ds, dstBinding, dstElem, buf);
-					break;
-				} case DescriptorCategory::bufferView: {
-					auto& bufView = *reinterpret_cast<VkBufferView*>(data);
-					update(ds, dstBinding, dstElem, bufView);
-					break;
-				} case DescriptorCategory::accelStruct: {
-					auto& accelStruct = *reinterpret_cast<VkAccelerationStructureKHR*>(data);
-					update(ds, dstBinding, dstElem, accelStruct);
-					break;
-				} case DescriptorCategory::inlineUniformBlock: {
-					auto ptr = reinterpret_cast<const std::byte*>(data);
-					update(ds, dstBinding, dstElem, *ptr);
-					break;
-				} case DescriptorCategory::none:
-					dlg_error("Invalid/unknown descriptor type");
-					break;
-			}
-		}
+	// Fast path: the set was allocated with the layout the template
+	// was created (and compiled) for. This should almost always be the case.
+	auto demote = false;
+	if(planned) VIL_LIKELY {
+		// see UpdateDescriptorSets
+		auto journaled = ds.pool->transient || ds.journaledLocked();
+		demote = !applyUpdatePlan(dut, ds, ptr, journaled, refs);
+	} else {
+		// Generic path, e.g. for sets of compatible but different layouts.
+		applyUpdateEntries(dut, ds, ptr, refs);
 	}
 
 	{
@@ -1872,6 +2784,13 @@ VKAPI_ATTR void VKAPI_CALL UpdateDescriptorSetWithTemplate(
 		dev.dispatch.UpdateDescriptorSetWithTemplate(dev.handle, ds.handle,
 			dut.handle, static_cast<const void*>(ptr));
 	}
+
+	lock.unlock();
+	refs.flush();
+
+	if(demote) {
+		demoteTransientPool(*ds.pool);
+	}
 }
 
 u32 totalUpdateDataSize(const DescriptorUpdateTemplate& dut) {
@@ -1928,12 +2847,20 @@ DescriptorSetCow::~DescriptorSetCow() {
 
 std::pair<DescriptorStateRef, std::unique_lock<DebugMutex>> access(DescriptorSetCow& cow) {
 	std::unique_lock cowLock(cow.mutex);
-	if(cow.copy) {
+	if(!cow.ds) {
+		dlg_assert(cow.copy);
 		cowLock.unlock();
 		return {DescriptorStateRef(*cow.copy), std::move(cowLock)};
 	}
 
-	dlg_assert(cow.ds);
+	// NOTE: see below, the chunks not copied yet are immutable while
+	// we hold the lock. See bindingPtr for the merged view.
+	if(cow.copy) {
+		DescriptorStateRef ref(*cow.ds);
+		ref.cow = &cow;
+		return {ref, std::move(cowLock)};
+	}
+
 	// TODO: private now. Would be nice to have this assert tho
 	// dlg_assert(cow.ds->cow == &cow);
 
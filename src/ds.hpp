@@ -3,6 +3,10 @@
 #include <fwd.hpp>
 #include <handle.hpp>
 #include <util/intrusive.hpp>
+#include <util/reclaim.hpp>
+#include <util/tlsf.hpp>
+#include <util/pages.hpp>
+#include <util/linalloc.hpp>
 #include <util/debugMutex.hpp>
 #include <util/profiling.hpp>
 #include <nytl/span.hpp>
@@ -14,6 +18,7 @@
 namespace vil {
 
 struct DescriptorStateCopy;
+struct DescriptorJournalEntry;
 
 // Describes the type of the descriptor data.
 enum class DescriptorCategory {
@@ -43,6 +48,7 @@ struct DescriptorPoolSetEntry {
 	// But it's not that expensive to store them here and might be faster.
 	u32 offset {};
 	u32 size {};
+	u32 block {}; // allocation in DescriptorPool::dataAlloc
 	DescriptorPoolSetEntry* next {};
 	DescriptorPoolSetEntry* prev {};
 	DescriptorSet* set {};
@@ -69,24 +75,34 @@ struct DescriptorPool : SharedDeviceHandle {
 	// DescriptorPool creation and then suballocate that to the individual
 	// descriptor sets. We want to guarantee fast allocation and
 	// freeing (even when using FreeDescriptorSets instead of
-	// ResetDescriptorPool) we use a linked list of entries.
+	// ResetDescriptorPool) so we use size-class free lists
+	// for the suballocation, O(1) independent of fragmentation.
 	u32 dataSize {};
-	std::unique_ptr<std::byte[]> data;
+	PageMemory data;
+	TlsfAllocator dataAlloc;
 	std::unique_ptr<SetEntry[]> entries;
 
-	// Linked list of the alive descriptor sets, sorted by offset.
+	// Linked list of the alive descriptor sets, unordered.
 	SetEntry* usedEntries {};
 
-	// The last link of the usedEntries list.
-	SetEntry* highestEntry {};
-
-	// The entry we last allocated that wasn't highestEntry.
-	// Only used for fragmentating pools.
-	SetEntry* lastEntry {};
-
 	// Linked list of unused SetEntry objects. NOT a list of free spaces.
 	SetEntry* freeEntries {};
 
+	// Whether the pool is considered transient, i.e. it is reset
+	// about once per frame and its sets are therefore not expected to
+	// be inspected. Writes to sets of transient pools are only journaled,
+	// see DescriptorSet::materializeLocked and docs/own/lazyTracking.md.
+	// Set in ResetDescriptorPool, synchronized by the application.
+	// Unset (with the mutex locked) when the journal of a set grows too
+	// large, i.e. the pool isn't reset anymore.
+	bool transient {};
+	u32 resetStreak {};
+	u64 lastResetSubmission {};
+
+	// Memory for the journals of the sets. Reset with the pool.
+	// Protected by mutex.
+	LinAllocator journalAlloc;
+
 	~DescriptorPool();
 };
 
@@ -191,6 +207,11 @@ struct DescriptorStateRef {
 	std::byte* data {};
 	u32 variableDescriptorCount {};
 
+	// Only set for the merged view of a partially resolved DescriptorSetCow,
+	// data then points to the state of cow->ds. See bindingPtr.
+	// The cow mutex must be locked while this is used.
+	DescriptorSetCow* cow {};
+
 	DescriptorStateRef() = default;
 	DescriptorStateRef(const DescriptorSet&);
 
@@ -202,6 +223,9 @@ struct DescriptorStateRef {
 u32 descriptorCount(DescriptorStateRef, unsigned binding);
 u32 totalDescriptorCount(DescriptorStateRef);
 
+// Returns the start of the descriptors of the given binding.
+std::byte* bindingPtr(DescriptorStateRef, unsigned binding);
+
 // NOTE: retrieving the span itself does not need to lock the state's
 // mutex. The caller must manually synchronize access to the bindings by locking
 // the state's mutex.
@@ -225,11 +249,20 @@ struct DescriptorStateCopy {
 	u32 variableDescriptorCount {};
 	u32 _pad {};
 
+	// The Deleter defers the destruction to the device's reclaim thread
+	ReclaimNode reclaimNode {};
+
 	// std::byte data[]; // following this in memory
 };
 
 using DescriptorStateCopyPtr = std::unique_ptr<DescriptorStateCopy, DescriptorStateCopy::Deleter>;
 
+// Creates a new state copy for the given layout that does not originate
+// from a DescriptorSet. Immutable samplers are filled in, all other
+// descriptors are empty. Used for descriptor buffers, see descriptorBuffer.hpp.
+DescriptorStateCopyPtr newDescriptorStateCopy(DescriptorSetLayout&,
+	u32 variableDescriptorCount);
+
 // Vulkan descriptor set handle.
 // PERF: make sure to keep this as small as possible. Space for it is
 //   statically allocated on descriptorPool creation.
@@ -255,7 +288,14 @@ public:
 
 	// requires device *and* pool mutex to be locked
 	IntrusivePtr<DescriptorSetCow> addCowLocked();
+
+	// Locks the pool mutex and makes sure that the binding data in byte
+	// range [dataBegin, dataEnd) can be modified, i.e. copies it into
+	// the cow first, if there is one. The overload without range
+	// resolves the whole state. See DescriptorSetCow::chunkSize.
 	std::unique_lock<LockableBase(DebugMutex)> checkResolveCow();
+	std::unique_lock<LockableBase(DebugMutex)> checkResolveCow(
+		u32 dataBegin, u32 dataEnd);
 	std::unique_lock<LockableBase(DebugMutex)> lock() {
 		dlg_assert(pool);
 		return std::unique_lock<LockableBase(DebugMutex)>(pool->mutex);
@@ -264,8 +304,24 @@ public:
 	// requires device *and* pool mutex to be locked
 	DescriptorStateCopyPtr validateAndCopyLocked();
 
+	// Applies all journaled writes to the state of this set.
+	// requires device *and* pool mutex to be locked
+	void materializeLocked();
+	// With descriptor refs, journal entries own references to their
+	// handles. Releases them, also those of already materialized entries.
+	// Must be called before the journal memory is freed.
+	// requires pool mutex to be locked (or the set to be unreachable)
+	void unrefJournal(RefCountBatch& refs);
+	// requires pool mutex to be locked
+	bool journaledLocked() const { return journal_; }
+	// Appends the given entry to the journal. Returns false when the
+	// journal grew too large. The pool is then not transient anymore and
+	// demoteTransientPool must be called once the pool mutex is unlocked.
+	[[nodiscard]] bool journalLocked(DescriptorJournalEntry& entry);
+
 private:
 	DescriptorStateCopyPtr copyLockedState();
+	void resolveCowLocked(u32 firstChunk, u32 endChunk);
 
 private:
 	// Protected by pool->mutex
@@ -273,6 +329,17 @@ private:
 	// unsets this.
 	IntrusivePtr<DescriptorSetCow> cow_ {};
 
+	// Writes that were not applied to the state yet. Points to the
+	// last entry, the list is circular. Only set for sets of transient
+	// pools, see DescriptorPool::transient. Never set while cow_ is set.
+	// Protected by pool->mutex
+	DescriptorJournalEntry* journal_ {};
+	u32 journalSize_ {}; // in bytes, including the entries
+	// Entries that were already materialized. With descriptor refs, they
+	// hold the references of the handles they replaced in the state.
+	// Not circular. Protected by pool->mutex
+	DescriptorJournalEntry* retired_ {};
+
 	// Following this in memory
 	// Protected by pool->mutex
 	// std::byte bindingData[];
@@ -280,35 +347,75 @@ private:
 
 // Copy-on-write mechanism on a descriptor state.
 // See DescriptorSet::cow.
+// The cow is resolved in chunks of the binding data: when the application
+// modifies a descriptor, only the chunk containing it is copied into 'copy',
+// the rest is still read from the descriptor set. So for large (bindless)
+// sets, updating a single element does not copy the whole state.
+// Since bindings are read as contiguous spans, reading a binding that
+// is only partially copied copies its remaining chunks, see bindingPtr.
 struct DescriptorSetCow {
-	// Mutex protects ds and copy. Needed since accessing the cow
-	// and resolving it may happen in parallel from multiple threads.
+	// Size of the chunks of binding data, in bytes. A descriptor belongs
+	// to the chunk its data starts in.
+	static constexpr u32 chunkSize = 4096u;
+
+	// Mutex protects ds, copy and copiedChunks. Needed since accessing
+	// the cow and resolving it may happen in parallel from multiple threads.
 	DebugMutex mutex;
 
-	// Only set when the cow still references the descriptor sets original
-	// content. Otherwise null. Once unset, won't be set again.
+	// Only set when the cow still references (some of) the descriptor
+	// sets original content. Otherwise null. Once unset, won't be set again.
 	DescriptorSet* ds {};
 
-	// Only set when the cow has made its own copy. Otherwise null.
-	// Once set, won't be unset again.
+	// Only set when the cow has made its own (possibly partial) copy.
+	// Otherwise null. Once set, won't be unset again.
+	// Chunks that were not copied yet are zero-initialized.
 	DescriptorStateCopyPtr copy {};
 
+	// Bitset of the chunks already copied into 'copy' while ds is
+	// still set. Cleared when all chunks were copied.
+	std::vector<u64> copiedChunks;
+	u32 copiedCount {};
+	u32 chunkCount {};
+
 	// DescriptorSetCow is intrusively reference counted since multiple
 	// consumers may want to reference the same descriptor state.
 	std::atomic<u32> refCount {};
 
-	DescriptorSetCow() = default;
+	DescriptorSetCow() { setLockSite(mutex, LockSite::descriptorSetCow); }
 	~DescriptorSetCow();
 };
 
 std::pair<DescriptorStateRef, std::unique_lock<DebugMutex>> access(DescriptorSetCow& cow);
 
+// A run of consecutive descriptors of a single binding that is written
+// by a descriptor update template. See DescriptorUpdateTemplate::plan.
+struct DescriptorUpdateOp {
+	u32 srcOffset {}; // offset of the first descriptor in the update data
+	u32 srcStride {};
+	u32 dstOffset {}; // offset of the first descriptor in the binding data
+	u32 binding {};
+	u32 elem {}; // first element, byte offset for inline uniform blocks
+	u32 count {};
+	DescriptorCategory category {};
+	bool updateView {}; // image ops: whether the image view is written
+	bool updateSampler {}; // image ops: whether the (non-immutable) sampler is written
+	bool variableCount {}; // binding has a variable descriptor count
+};
+
 struct DescriptorUpdateTemplate : SharedDeviceHandle {
 	static constexpr auto objectType = VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE;
 
 	VkDescriptorUpdateTemplate handle {};
 	std::vector<VkDescriptorUpdateTemplateEntry> entries;
 
+	// For templates of type VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET
+	// we compile the entries for the descriptorSetLayout on creation, so
+	// that updating a descriptor set with that layout is just a loop
+	// over the ops, without walking the bindings.
+	// Empty for push descriptor templates.
+	IntrusivePtr<DescriptorSetLayout> planLayout;
+	std::vector<DescriptorUpdateOp> plan;
+
 	~DescriptorUpdateTemplate();
 };
 
@@ -316,6 +423,25 @@ struct DescriptorUpdateTemplate : SharedDeviceHandle {
 // with the given template must have.
 u32 totalUpdateDataSize(const DescriptorUpdateTemplate&);
 
+// Compiles the entries of the given template into DescriptorUpdateOps
+// for the given layout, splitting them at binding boundaries.
+// Returns false if the entries aren't valid for the layout.
+bool compileUpdatePlan(DescriptorUpdateTemplate&, DescriptorSetLayout&);
+
+// Applies the compiled plan of the given template to a set with the
+// layout it was compiled for. Unwraps the handles in the given update
+// data. When 'journaled' is true, the writes are only journaled, see
+// DescriptorSet::materializeLocked.
+// Returns false when the journal grew too large, see journalLocked.
+bool applyUpdatePlan(const DescriptorUpdateTemplate&, DescriptorSet&,
+	std::byte* data, bool journaled, RefCountBatch& refs);
+
+// Applies the entries of the given template without a plan, e.g. to sets
+// of a layout that is compatible to but not the same as planLayout.
+// Unwraps the handles in the given update data.
+void applyUpdateEntries(const DescriptorUpdateTemplate&, DescriptorSet&,
+	std::byte* data, RefCountBatch& refs);
+
 // API
 VKAPI_ATTR VkResult VKAPI_CALL CreateDescriptorSetLayout(
     VkDevice                                    device,
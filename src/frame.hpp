@@ -12,7 +12,7 @@ struct FrameSubmission {
 	SubmissionType type {};
 	u64 submissionID {}; // global submission id
 	std::vector<BindSparseSubmission> sparseBinds;
-	std::vector<IntrusivePtr<CommandRecord>> submissions; // for command submission
+	std::vector<CommandRecordPtr> submissions; // for command submission
 
 	FrameSubmission();
 	~FrameSubmission();
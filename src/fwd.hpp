@@ -23,6 +23,9 @@ using i64 = std::int64_t;
 
 using std::size_t;
 
+// Identifies an interned call stack, see StackTable. 0 means no stack.
+using StackID = u32;
+
 class Gui;
 struct RenderBuffer;
 
@@ -70,6 +73,7 @@ struct CommandHook;
 struct CommandHookSubmission;
 struct CommandHookRecord;
 struct CommandHookState;
+struct HookRecordHandles;
 struct LocalCapture;
 struct CommandHookOps;
 struct CompletedHook;
@@ -99,6 +103,9 @@ struct BuildAccelStructsCmd;
 struct BuildAccelStructsIndirectCmd;
 struct AccelStructState;
 struct DescriptorSetCow;
+struct DescriptorState;
+struct BoundDescriptorSet;
+struct DescriptorBufferTable;
 
 struct MemoryBind;
 struct FullMemoryBind;
@@ -123,6 +130,7 @@ struct Draw;
 struct ThreadMemScope;
 struct LinAllocScope;
 struct LinAllocator;
+class RefCountBatch;
 
 struct AccelTriangles;
 struct AccelAABBs;
@@ -157,8 +165,18 @@ using IntrusivePtr = HandledPtr<T, RefCountHandler<T, D>>;
 
 template<typename T> using FinishPtr = HandledPtr<T, FinishHandler<T>>;
 
+// Defers the destruction to the Reclaimer of the associated device,
+// see util/reclaim.hpp.
+struct ReclaimDeleter {
+	void operator()(CommandRecord*) const noexcept;
+	void operator()(CommandHookState*) const noexcept;
+	void operator()(HookRecordHandles*) const noexcept;
+};
+
 using CommandBufferPtr = IntrusiveWrappedPtr<CommandBuffer>;
 using AccelStructStatePtr = IntrusivePtr<AccelStructState>;
+using CommandRecordPtr = IntrusivePtr<CommandRecord, ReclaimDeleter>;
+using CommandHookStatePtr = IntrusivePtr<CommandHookState, ReclaimDeleter>;
 
 template<typename V, typename T>
 decltype(auto) constexpr templatize(T&& value) {
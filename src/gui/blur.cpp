@@ -119,9 +119,6 @@ void destroyBuffers(GuiBlur& blur, VkDescriptorPool dsPool) {
 	}
 
 	auto& dev = *blur.dev;
-	dev.dispatch.FreeDescriptorSets(dev.handle, dsPool, 2u, blur.steps.data());
-	blur.steps = {};
-
 	ThreadMemScope memScope;
 	auto sets = memScope.alloc<VkDescriptorSet>(blur.renderBuffers.size());
 
@@ -132,7 +129,13 @@ void destroyBuffers(GuiBlur& blur, VkDescriptorPool dsPool) {
 		buf = {};
 	}
 
-	dev.dispatch.FreeDescriptorSets(dev.handle, dsPool, u32(sets.size()), sets.data());
+	{
+		std::lock_guard lock(dev.dsPoolMutex);
+		dev.dispatch.FreeDescriptorSets(dev.handle, dsPool, 2u, blur.steps.data());
+		dev.dispatch.FreeDescriptorSets(dev.handle, dsPool, u32(sets.size()), sets.data());
+	}
+
+	blur.steps = {};
 
 	dev.dispatch.DestroyImageView(dev.handle, blur.view0, nullptr);
 	dev.dispatch.DestroyImageView(dev.handle, blur.view1, nullptr);
@@ -219,7 +222,10 @@ void resize(GuiBlur& blur, VkExtent2D size, VkSwapchainKHR swapchain,
 	dai.descriptorSetCount = sets.size();
 	dai.pSetLayouts = layouts.data();
 	dai.descriptorPool = dsPool;
-	VK_CHECK(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, sets.data()));
+	{
+		std::lock_guard lock(dev.dsPoolMutex);
+		VK_CHECK(dev.dispatch.AllocateDescriptorSets(dev.handle, &dai, sets.data()));
+	}
 
 	ivi.format = swapchainFormat;
 	ivi.subresourceRange.baseArrayLayer = 0u;
@@ -421,6 +421,7 @@ void CommandRecordGui::drawSelected(Draw& draw) {
 			refButtonD(*gui_, rec->cb);
 			imGuiText("cb name: {}", rec->cbName ? rec->cbName : "<unnamed>");
 			imGuiText("broken labels: {}{}", std::boolalpha, rec->brokenHierarchyLabels);
+			imGuiText("untracked: {}", rec->untracked);
 			imGuiText("record id: {}", rec->recordID);
 			imGuiText("refCount: {}", rec->refCount);
 			imGuiText("num hook records: {}", rec->hookRecords.size());
@@ -439,7 +440,7 @@ void CommandRecordGui::drawSelected(Draw& draw) {
 	ImGui::EndChild();
 }
 
-void CommandRecordGui::select(IntrusivePtr<CommandRecord> record, Command* cmd) {
+void CommandRecordGui::select(CommandRecordPtr record, Command* cmd) {
 	assertNotOwned(gui_->dev().mutex);
 
 	// Unset hooks
@@ -464,7 +465,7 @@ void CommandRecordGui::select(IntrusivePtr<CommandRecord> record, Command* cmd)
 	commandViewer_.updateFromSelector(true);
 }
 
-void CommandRecordGui::select(IntrusivePtr<CommandRecord> record, CommandBufferPtr cb) {
+void CommandRecordGui::select(CommandRecordPtr record, CommandBufferPtr cb) {
 	assertNotOwned(gui_->dev().mutex);
 
 	clearSelection(true);
@@ -480,7 +481,7 @@ void CommandRecordGui::showSwapchainSubmissions(Swapchain& swapchain, bool initi
 	std::vector<FrameSubmission> lastFrame;
 
 	{
-		std::lock_guard lock(dev.mutex);
+		auto lock = gui_->snapshotLock();
 		lastFrame = swapchain.frameSubmissions[0].batches;
 	}
 
@@ -525,6 +526,11 @@ void CommandRecordGui::displaySubmission(FrameSubmission& batch, u32 subID) {
 		name = rec->cbName;
 	}
 
+	// Records recorded in pass-through mode only contain a subset
+	// of their commands, see docs/own/lazyTracking.md
+	const auto label = rec->untracked ?
+		dlg::format("{} (untracked)", name) : std::string(name);
+
 	auto flags = ImGuiTreeNodeFlags_FramePadding |
 		ImGuiTreeNodeFlags_OpenOnArrow |
 		ImGuiTreeNodeFlags_OpenOnDoubleClick |
@@ -538,7 +544,7 @@ void CommandRecordGui::displaySubmission(FrameSubmission& batch, u32 subID) {
 	const auto opened = openedRecords_.count(rec.get());
 	ImGui::SetNextItemOpen(opened);
 
-	const auto open = ImGui::TreeNodeEx(id.c_str(), flags, "%s", name);
+	const auto open = ImGui::TreeNodeEx(id.c_str(), flags, "%s", label.c_str());
 	if(ImGui::IsItemActivated() && !ImGui::IsItemToggledOpen()) {
 		submission_ = &batch;
 		record_ = rec;
@@ -804,7 +810,7 @@ void addMatches(
 
 void CommandRecordGui::updateRecords(const FrameMatch& frameMatch,
 		std::vector<FrameSubmission>&& records,
-		IntrusivePtr<CommandRecord> newRecordGiven,
+		CommandRecordPtr newRecordGiven,
 		std::vector<const Command*> newCommandGiven) {
 	ThreadMemScope tms;
 
@@ -818,7 +824,7 @@ void CommandRecordGui::updateRecords(const FrameMatch& frameMatch,
 	auto& transitionedSections = tmp_.transitionedSections;
 
 	FrameSubmission* newSubmission = nullptr;
-	IntrusivePtr<CommandRecord> newRecord {};
+	CommandRecordPtr newRecord {};
 	std::vector<const Command*> newCommand {};
 
 	for(auto batchMatch : frameMatch.matches) {
@@ -927,7 +933,7 @@ void CommandRecordGui::updateRecords(const FrameMatch& frameMatch,
 }
 
 void CommandRecordGui::updateRecords(std::vector<FrameSubmission> records,
-		IntrusivePtr<CommandRecord> newRecord,
+		CommandRecordPtr newRecord,
 		std::vector<const Command*> newCommand) {
 	// update records
 	ThreadMemScope tms;
@@ -937,7 +943,7 @@ void CommandRecordGui::updateRecords(std::vector<FrameSubmission> records,
 		std::move(newRecord), std::move(newCommand));
 }
 
-void CommandRecordGui::updateRecord(IntrusivePtr<CommandRecord> record,
+void CommandRecordGui::updateRecord(CommandRecordPtr record,
 		std::vector<const Command*> newCommandGiven) {
 
 	dlg_assert(record);
@@ -28,8 +28,8 @@ public:
 	// TODO: somewhat misleading, will not consider the given swapchain but just
 	// use dev.swapchain for updates. See todo on multi-swapchain support
 	void showSwapchainSubmissions(Swapchain& swapchain, bool initial = false);
-	void select(IntrusivePtr<CommandRecord> record, Command* cmd = nullptr);
-	void select(IntrusivePtr<CommandRecord> record, CommandBufferPtr cb);
+	void select(CommandRecordPtr record, Command* cmd = nullptr);
+	void select(CommandRecordPtr record, CommandBufferPtr cb);
 	void showLocalCaptures(LocalCapture& lc);
 
 	auto& commandViewer() { return commandViewer_; }
@@ -48,19 +48,19 @@ private:
 
 	// In single-record mode, updates the shown record.
 	// When the given newCommand is empty, will try to find it in the record.
-	void updateRecord(IntrusivePtr<CommandRecord> record,
+	void updateRecord(CommandRecordPtr record,
 		std::vector<const Command*> newCommand);
 
 	// In frame-record mode, updates the shown frame.
 	// When the given newRecord is empty, will try to find it in the frame.
 	// When the given newCommand is empty, will try to find it in the record.
 	void updateRecords(const FrameMatch&, std::vector<FrameSubmission>&&,
-		IntrusivePtr<CommandRecord> newRecord,
+		CommandRecordPtr newRecord,
 		std::vector<const Command*> newCommand);
 
 	// Helper for the function above, will perform a full frame match.
 	void updateRecords(std::vector<FrameSubmission>,
-		IntrusivePtr<CommandRecord> newRecord,
+		CommandRecordPtr newRecord,
 		std::vector<const Command*> newCommand);
 
 	void showLoadPopup();
@@ -88,7 +88,7 @@ private:
 	FrameSubmission* submission_ {};
 
 	// The currently selected record.
-	IntrusivePtr<CommandRecord> record_ {};
+	CommandRecordPtr record_ {};
 	// Might be empty, signalling that no command is secleted.
 	std::vector<const Command*> command_ {};
 
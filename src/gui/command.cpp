@@ -44,7 +44,8 @@ namespace vil {
 namespace {
 
 #ifdef VIL_COMMAND_CALLSTACKS
-void display(span<void*> st, unsigned offset = 6u) {
+// The first frames are inside the layer, not interesting.
+void display(span<void* const> st, unsigned offset = 4u) {
 	if (st.size() <= offset) {
 		imGuiText("No callstack");
 		return;
@@ -499,7 +500,7 @@ void CommandViewer::displayDsList() {
 			auto& ds = dss[setID];
 
 			// No descriptor set bound
-			if(!ds.dsEntry) {
+			if(!ds.dsEntry && !ds.fromDescriptorBuffer()) {
 				if(showUnboundSets) {
 					auto label = dlg::format("Descriptor Set {}: unbound", setID);
 					auto flags = ImGuiTreeNodeFlags_Bullet |
@@ -523,10 +524,29 @@ void CommandViewer::displayDsList() {
 			}
 
 			// TODO: this can happen now with descriptor cows
-			auto stateIt = dsState.states.find(ds.dsEntry);
-			dlg_assert_or(stateIt != dsState.states.end(), continue);
+			auto* dsCowPtr = dsState.find(cmd->boundDescriptors(), setID);
+			if(!dsCowPtr && ds.fromDescriptorBuffer()) {
+				// could not be decoded, e.g. since the buffer isn't mapped
+				auto label = dlg::format("Descriptor Set {}: descriptor buffer", setID);
+				auto flags = ImGuiTreeNodeFlags_Bullet |
+					ImGuiTreeNodeFlags_Leaf |
+					ImGuiTreeNodeFlags_NoTreePushOnOpen |
+					ImGuiTreeNodeFlags_SpanFullWidth |
+					ImGuiTreeNodeFlags_FramePadding;
+				ImGui::TreeNodeEx(label.c_str(), flags);
+
+				if(ImGui::IsItemHovered()) {
+					ImGui::BeginTooltip();
+					imGuiText("Descriptors can only be shown for mapped descriptor buffers");
+					ImGui::EndTooltip();
+				}
+
+				continue;
+			}
 
-			auto& dsCow = *stateIt->second;
+			dlg_assert_or(dsCowPtr, continue);
+
+			auto& dsCow = *dsCowPtr;
 
 			auto label = dlg::format("Descriptor Set {}", setID);
 			ImGui::SetNextItemOpen(true, ImGuiCond_Once);
@@ -830,20 +850,25 @@ void CommandViewer::displayDs(Draw& draw) {
 		return;
 	}
 
-	auto* setEntry = dss[setID].dsEntry;
-	if(!setEntry) {
+	auto& bds = dss[setID];
+	if(!bds.dsEntry && !bds.fromDescriptorBuffer()) {
 		ImGui::Text("DescriptorSet null");
 		dlg_warn("DescriptorSet null? Shouldn't happen");
 		return;
 	}
 
 	const auto& descriptors = selection().descriptorSnapshot();
-	auto stateIt = descriptors.states.find(setEntry);
-	dlg_assert_or(stateIt != descriptors.states.end(), return);
+	auto* dsCowPtr = descriptors.find(cmd->boundDescriptors(), setID);
+	if(!dsCowPtr && bds.fromDescriptorBuffer()) {
+		ImGui::Text("Descriptor buffer not mapped, can't show descriptors");
+		return;
+	}
+
+	dlg_assert_or(dsCowPtr, return);
 
 	// NOTE: while holding this lock we MUST not lock the device or
 	// queue mutex.
-	auto& dsCow = *stateIt->second;
+	auto& dsCow = *dsCowPtr;
 	auto [dsState, lock] = access(dsCow);
 
 	if(bindingID >= dsState.layout->bindings.size()) {
@@ -1563,9 +1588,10 @@ void CommandViewer::displayCommand() {
 
 #ifdef VIL_COMMAND_CALLSTACKS
 	auto flags = ImGuiTreeNodeFlags_FramePadding;
-	if(!command_.back()->stacktrace.empty() && ImGui::TreeNodeEx("StackTrace", flags)) {
+	auto stack = dev().stackTable.get(command_.back()->stackID);
+	if(!stack.empty() && ImGui::TreeNodeEx("StackTrace", flags)) {
 		ImGui::PushFont(gui_->monoFont);
-		display(command_.back()->stacktrace);
+		display(stack);
 		ImGui::PopFont();
 		ImGui::TreePop();
 	}
@@ -30,12 +30,12 @@ bool CommandSelection::update() {
 			return false;
 		}
 
-		IntrusivePtr<CommandRecord> record;
-		IntrusivePtr<CommandHookState> state;
+		CommandRecordPtr record;
+		CommandHookStatePtr state;
 		CommandDescriptorSnapshot descriptors;
 
 		{
-			std::lock_guard lock(dev_->mutex);
+			std::lock_guard lock(hook.mutex);
 
 			// check if the LocalCapture has found something new.
 			if(localCapture_->completed.state == state_) {
@@ -73,7 +73,7 @@ bool CommandSelection::update() {
 	auto swapchain = dev.swapchain();
 
 	auto frameForSubmissionLocked = [&](u32 submissionID) -> const FrameSubmissions* {
-		assertOwned(dev.mutex);
+		assertOwnedOrShared(dev.mutex);
 		if(!swapchain) {
 			dlg_warn("lost swapchain");
 			return nullptr;
@@ -98,7 +98,7 @@ bool CommandSelection::update() {
 			auto id1 = completed[completed.size() - 1].submissionID;
 			auto id2 = completed[completed.size() - 2].submissionID;
 
-			std::lock_guard lock(dev.mutex);
+			std::shared_lock lock(dev.mutex);
 			auto* frame1 = frameForSubmissionLocked(id1);
 			auto* frame2 = frameForSubmissionLocked(id2);
 			multipleMatchesInLastFrame = frame1 && (frame1 == frame2);
@@ -125,7 +125,7 @@ bool CommandSelection::update() {
 				selType == SelectionType::submission);
 
 			{
-				std::lock_guard lock(dev.mutex);
+				std::shared_lock lock(dev.mutex);
 				auto* frame = frameForSubmissionLocked(res.submissionID);
 				if(!frame) {
 					continue;
@@ -191,7 +191,7 @@ bool CommandSelection::update() {
 	return true;
 }
 
-void CommandSelection::select(IntrusivePtr<CommandRecord> record,
+void CommandSelection::select(CommandRecordPtr record,
 		std::vector<const Command*> cmd) {
 	unselect();
 
@@ -208,7 +208,7 @@ void CommandSelection::select(IntrusivePtr<CommandRecord> record,
 
 void CommandSelection::select(std::vector<FrameSubmission> frame,
 		u32 submissionID,
-		IntrusivePtr<CommandRecord> record,
+		CommandRecordPtr record,
 		std::vector<const Command*> cmd) {
 	unselect();
 
@@ -248,7 +248,7 @@ void CommandSelection::select(std::vector<FrameSubmission> frame,
 }
 
 void CommandSelection::select(CommandBufferPtr cb,
-		IntrusivePtr<CommandRecord> record,
+		CommandRecordPtr record,
 		std::vector<const Command*> cmd) {
 	unselect();
 	dlg_assert(cb);
@@ -272,11 +272,11 @@ void CommandSelection::select(const LocalCapture& lc) {
 
 	mode_ = UpdateMode::localCapture;
 
-	IntrusivePtr<CommandRecord> record;
-	IntrusivePtr<CommandHookState> state;
+	CommandRecordPtr record;
+	CommandHookStatePtr state;
 
 	{
-		std::lock_guard lock(dev_->mutex);
+		std::lock_guard lock(dev_->commandHook->mutex);
 		record = lc.record;
 		state = lc.completed.state;
 		command_ = lc.command;
@@ -48,7 +48,7 @@ public:
 
 	// Sets updateMode to 'none'
 	// 'cmd' must be empty or a valid hierarchy inside 'record'
-	void select(IntrusivePtr<CommandRecord> record,
+	void select(CommandRecordPtr record,
 		std::vector<const Command*> cmd);
 
 	// Sets updateMode to swapchain
@@ -57,13 +57,13 @@ public:
 	// 'cmd' must be empty or a valid hierarchy inside 'record'
 	void select(std::vector<FrameSubmission> frame,
 		u32 submissionID,
-		IntrusivePtr<CommandRecord> record,
+		CommandRecordPtr record,
 		std::vector<const Command*> cmd);
 
 	// Sets updateMode to 'commandBuffer'
 	// 'cmd' must be empty or a valid hierarchy inside record
 	void select(CommandBufferPtr cb,
-		IntrusivePtr<CommandRecord> record,
+		CommandRecordPtr record,
 		std::vector<const Command*> cmd);
 
 	// LocalCapture mode
@@ -83,13 +83,13 @@ public:
 
 	UpdateMode updateMode() const { return mode_; }
 	SelectionType selectionType() const;
-	IntrusivePtr<CommandHookState> completedHookState() const { return state_; }
+	CommandHookStatePtr completedHookState() const { return state_; }
 
 	// Returns null when selectType is not 'command'
 	span<const Command* const> command() const { return command_; }
 	// Returns null when in 'swapchain' mode and selectionType
 	// is not 'record' or 'command'
-	IntrusivePtr<CommandRecord> record() const { return record_; }
+	CommandRecordPtr record() const { return record_; }
 	// Returns null when not in 'swapchain' mode or when selectionType
 	// is 'none'. Points inside frame()
 	FrameSubmission* submission() const { return submission_; }
@@ -111,12 +111,12 @@ private:
 	Device* dev_ {};
 
 	UpdateMode mode_ {};
-	IntrusivePtr<CommandHookState> state_; // the last received state
+	CommandHookStatePtr state_; // the last received state
 	CommandDescriptorSnapshot descriptors_; // last snapshotted descriptors
 
 	// The currently selected record.
 	// In swapchain mode: part of selectedBatch_
-	IntrusivePtr<CommandRecord> record_ {};
+	CommandRecordPtr record_ {};
 	// The selected command (hierarchy) inside selectedRecord_.
 	// Might be empty, signalling that no command is secleted.
 	std::vector<const Command*> command_ {};
@@ -27,6 +27,7 @@
 #include <nytl/bytes.hpp>
 #include <nytl/vecOps.hpp>
 #include <util/profiling.hpp>
+#include <util/lockProfile.hpp>
 #include <imgio/file.hpp>
 
 #include <vil_api.h>
@@ -1009,7 +1010,7 @@ void Gui::drawOverviewUI(Draw& draw) {
 			bool found = false;
 
 			{
-				std::lock_guard lock(dev.mutex);
+				std::lock_guard lock(dev.commandHook->mutex);
 				found = !!lc.completed.state;
 			}
 
@@ -1033,7 +1034,7 @@ void Gui::drawOverviewUI(Draw& draw) {
 		std::vector<float> hist;
 
 		{
-			std::lock_guard lock(dev.mutex);
+			auto lock = snapshotLock();
 			for(auto& timing : swapchain->frameTimings) {
 				using MS = std::chrono::duration<float, std::ratio<1, 1000>>;
 				hist.push_back(std::chrono::duration_cast<MS>(timing).count());
@@ -1074,10 +1075,16 @@ void Gui::drawOverviewUI(Draw& draw) {
 		imGuiText("alive image views: {}", stats.aliveImagesViews);
 		imGuiText("threadContext memory: {} MB", stats.threadContextMem / (1024.f * 1024.f));
 		imGuiText("command memory: {} MB", stats.commandMem / (1024.f * 1024.f));
+		imGuiText("avg memory per record: {} KB", stats.aliveRecords == 0u ? 0.f :
+			stats.commandMem / (1024.f * stats.aliveRecords));
+		imGuiText("live block memory: {} MB", stats.liveBlockMem / (1024.f * 1024.f));
+		imGuiText("pooled block memory: {} MB", stats.pooledBlockMem / (1024.f * 1024.f));
 		imGuiText("ds copy memory: {} MB", stats.descriptorCopyMem / (1024.f * 1024.f));
 		imGuiText("ds pool memory: {} MB", stats.descriptorPoolMem / (1024.f * 1024.f));
 		imGuiText("alive hook records: {}", stats.aliveHookRecords);
 		imGuiText("alive hook states: {}", stats.aliveHookStates);
+		imGuiText("reused hook records: {}", stats.reusedHookRecords);
+		imGuiText("resubmitted hook records: {}", stats.resubmittedHookRecords);
 		imGuiText("layer buffer memory: {} MB", stats.ownBufferMem / (1024.f * 1024.f));
 		imGuiText("layer image memory: {} MB", stats.copiedImageMem / (1024.f * 1024.f));
 		ImGui::Separator();
@@ -1118,6 +1125,24 @@ void Gui::drawOverviewUI(Draw& draw) {
 			ImGui::SetTooltip("Captures and shows callstacks of each command");
 		}
 
+		auto lazy = dev.lazyTracking.load();
+		if(ImGui::Checkbox("Lazy command tracking", &lazy)) {
+			dev.lazyTracking.store(lazy);
+		}
+		if(ImGui::IsItemHovered() && showHelp) {
+			ImGui::SetTooltip("Forward commands without tracking them\n"
+				"while the gui is not visible");
+		}
+
+		auto lazyDs = dev.lazyDescriptors.load();
+		if(ImGui::Checkbox("Lazy descriptor tracking", &lazyDs)) {
+			dev.lazyDescriptors.store(lazyDs);
+		}
+		if(ImGui::IsItemHovered() && showHelp) {
+			ImGui::SetTooltip("Only journal descriptor writes to sets of\n"
+				"transient pools while the gui is not visible");
+		}
+
 		ImGui::Checkbox("Show ImGui Demo", &showImguiDemo_);
 
 		auto force = dev.commandHook->forceHook.load();
@@ -1149,11 +1174,12 @@ void Gui::drawMemoryUI(Draw&) {
 	VkDeviceSize heapAlloc[VK_MAX_MEMORY_HEAPS] {};
 
 	{
-		std::lock_guard lock(dev().mutex);
-		for(auto& [_, mem] : dev().deviceMemories.inner) {
-			auto heap = memProps.memoryTypes[mem->typeIndex].heapIndex;
-			heapAlloc[heap] += mem->size;
-		}
+		auto lock = snapshotLock();
+		dev().deviceMemories.forEachLocked([&](auto& entry) {
+			auto& mem = *entry.second;
+			auto heap = memProps.memoryTypes[mem.typeIndex].heapIndex;
+			heapAlloc[heap] += mem.size;
+		});
 	}
 
 	VkPhysicalDeviceMemoryBudgetPropertiesEXT memBudget {};
@@ -1230,6 +1256,98 @@ void Gui::drawMemoryUI(Draw&) {
 	}
 }
 
+void Gui::drawOverheadUI(Draw&) {
+#ifndef VIL_LOCK_PROFILING
+	ImGui::TextWrapped("Lock profiling is only available when the layer "
+		"is built with debug checks or the lock-profile option");
+	return;
+#endif // VIL_LOCK_PROFILING
+
+	auto enabled = lockProfileEnabled();
+	if(ImGui::Checkbox("Profile locks", &enabled)) {
+		setLockProfileEnabled(enabled);
+	}
+
+	if(ImGui::IsItemHovered()) {
+		ImGui::SetTooltip("Records how long the layer's locks were waited "
+			"for and held. Has some overhead itself.");
+	}
+
+	ImGui::SameLine();
+	if(ImGui::Button("Reset")) {
+		resetLockProfile();
+	}
+
+	auto printNs = [](u64 ns) {
+		if(ns >= 1000u * 1000u) {
+			imGuiText("{}{}{} ms", std::fixed, std::setprecision(2), ns / (1000.f * 1000.f));
+		} else {
+			imGuiText("{}{}{} us", std::fixed, std::setprecision(2), ns / 1000.f);
+		}
+	};
+
+	auto plotHist = [](const char* label, const auto& hist) {
+		std::array<float, lockProfileBucketCount> vals;
+		for(auto i = 0u; i < hist.size(); ++i) {
+			vals[i] = float(hist[i]);
+		}
+
+		ImGui::PlotHistogram(label, vals.data(), int(vals.size()),
+			0, nullptr, 0.f, FLT_MAX, {300, 60});
+	};
+
+	auto sites = collectLockProfile();
+	auto flags = ImGuiTableFlags_Resizable | ImGuiTableFlags_Borders;
+	if(ImGui::BeginTable("Locks", 8u, flags)) {
+		ImGui::TableSetupColumn("Lock");
+		ImGui::TableSetupColumn("Count");
+		ImGui::TableSetupColumn("Contended");
+		ImGui::TableSetupColumn("Wait total");
+		ImGui::TableSetupColumn("Wait max");
+		ImGui::TableSetupColumn("Hold total");
+		ImGui::TableSetupColumn("Hold avg");
+		ImGui::TableSetupColumn("Hold max");
+		ImGui::TableHeadersRow();
+
+		for(auto& site : sites) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			imGuiText("{}", site.name);
+
+			// histograms in log2 ns buckets
+			if(ImGui::IsItemHovered() && site.count > 0u) {
+				ImGui::BeginTooltip();
+				plotHist("wait", site.waitHist);
+				plotHist("hold", site.holdHist);
+				ImGui::EndTooltip();
+			}
+
+			ImGui::TableNextColumn();
+			imGuiText("{}", site.count);
+
+			ImGui::TableNextColumn();
+			imGuiText("{}", site.contended);
+
+			ImGui::TableNextColumn();
+			printNs(site.waitNs);
+
+			ImGui::TableNextColumn();
+			printNs(site.maxWaitNs);
+
+			ImGui::TableNextColumn();
+			printNs(site.holdNs);
+
+			ImGui::TableNextColumn();
+			printNs(site.count == 0u ? 0u : site.holdNs / site.count);
+
+			ImGui::TableNextColumn();
+			printNs(site.maxHoldNs);
+		}
+
+		ImGui::EndTable();
+	}
+}
+
 void Gui::draw(Draw& draw, bool fullscreen) {
 	ZoneScoped;
 
@@ -1402,6 +1520,7 @@ void Gui::draw(Draw& draw, bool fullscreen) {
 			tabItem(ICON_FA_IMAGES " Resources", Tab::resources);
 			tabItem(ICON_FA_MEMORY " Memory", Tab::memory);
 			tabItem(ICON_FA_LIST " Commands", Tab::commandBuffer);
+			tabItem(ICON_FA_STOPWATCH " Layer Overhead", Tab::overhead);
 
 			ImGui::SameLine();
 			const auto start = ImGui::GetCursorScreenPos();
@@ -1429,6 +1548,7 @@ void Gui::draw(Draw& draw, bool fullscreen) {
 			switch(activeTab_) {
 				case Tab::overview: drawOverviewUI(draw); break;
 				case Tab::memory: drawMemoryUI(draw); break;
+				case Tab::overhead: drawOverheadUI(draw); break;
 				case Tab::commandBuffer: tabs_.cb->draw(draw); break;
 				case Tab::resources: tabs_.resources->draw(draw); break;
 				default: break;
@@ -1454,6 +1574,10 @@ void Gui::draw(Draw& draw, bool fullscreen) {
 	ImGui::Render();
 }
 
+Gui::SnapshotLock Gui::snapshotLock() const {
+	return SnapshotLock(dev_->snapshotMutex);
+}
+
 void Gui::apiHandleDestroyed(const Handle& handle, VkObjectType type) {
 	(void) type;
 	assertOwned(dev().mutex);
@@ -1711,11 +1835,14 @@ VkResult Gui::tryRender(Draw& draw, FrameInfo& info) {
 	dev().dispatch.EndCommandBuffer(draw.cb);
 
 	// == Critical section ==
-	// Important we already lock this mutex here since we need to make
-	// sure no new submissions are done by application while we process
-	// and evaluate the pending submissions
-	// NOTE: lock order is important here! First lock device mutex,
-	// later on lock queue mutex, that's how we must always do it.
+	// Important we already lock the submission mutex here since we need to
+	// make sure no new submissions are done by application while we process
+	// and evaluate the pending submissions. Application submissions don't
+	// hold the device mutex during the driver call, only while the
+	// submission mutex is locked all submitted work is in dev.pending.
+	// NOTE: lock order is important here! First lock the submission mutex,
+	// then the device mutex and later on the queue mutex, see LockRank.
+	std::unique_lock submLock(dev().submissionMutex);
 	std::unique_lock devLock(dev().mutex);
 
 	dlg_assert(currDraw_ == &draw);
@@ -2435,7 +2562,10 @@ vku::DynDs Gui::allocDs(const vku::DynDsLayout& layout, StringParam name) {
 	dsai.pSetLayouts = &layout.vkHandle();
 
 	VkDescriptorSet ds;
-	VK_CHECK(dev_->dispatch.AllocateDescriptorSets(dev_->handle, &dsai, &ds));
+	{
+		std::lock_guard lock(dev_->dsPoolMutex);
+		VK_CHECK(dev_->dispatch.AllocateDescriptorSets(dev_->handle, &dsai, &ds));
+	}
 
 	auto ret = vku::DynDs(dev_->dsPool, layout, ds);
 
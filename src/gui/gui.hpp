@@ -3,6 +3,7 @@
 #include <gui/render.hpp>
 #include <gui/blur.hpp>
 #include <util/util.hpp>
+#include <util/debugMutex.hpp>
 #include <nytl/bytes.hpp>
 #include <nytl/vec.hpp>
 #include <vkutil/handles.hpp>
@@ -32,6 +33,7 @@ public:
 		resources,
 		commandBuffer,
 		memory,
+		overhead,
 	};
 
 	struct Event {
@@ -136,6 +138,16 @@ public:
 	ImageViewer& standaloneImageViewer();
 
 	Device& dev() const { return *dev_; }
+
+	// Locks Device::snapshotMutex in shared mode, for copying the device
+	// state the gui shows. The gui only takes snapshots of what it
+	// needs under this lock and draws from them afterwards, it never
+	// draws while holding it. Handle creation, e.g. vkCreateImageView,
+	// therefore never waits for the gui drawing. Since the device mutex
+	// isn't locked, the gui doesn't wait for submissions or recordings
+	// either. Modifying the device state still needs the device mutex.
+	using SnapshotLock = std::shared_lock<SharedLockableBase(DebugSharedMutex)>;
+	[[nodiscard]] SnapshotLock snapshotLock() const;
 	VkRenderPass rp() const { return rp_; }
 	float dt() const { return dt_; }
 	float uiScale() const { return uiScale_; }
@@ -192,6 +204,7 @@ private:
 	void draw(Draw&, bool fullscreen);
 	void drawOverviewUI(Draw&);
 	void drawMemoryUI(Draw&);
+	void drawOverheadUI(Draw&);
 	void ensureFontAtlas(VkCommandBuffer cb);
 
 	void uploadDraw(Draw&, const ImDrawData&);
@@ -75,7 +75,7 @@ struct Draw {
 	std::vector<UsedImage> usedImages;
 	std::vector<Buffer*> usedBuffers;
 
-	IntrusivePtr<CommandHookState> usedHookState;
+	CommandHookStatePtr usedHookState;
 
 	// All the semaphores of submissions (Submission::ourSemaphore) we
 	// waited upon. When the draw finishes, they should be returned
@@ -86,11 +86,22 @@ void ResourceGui::init(Gui& gui) {
 }
 
 void ResourceGui::drawMemoryResDesc(Draw&, MemoryResource& res) {
-	std::lock_guard lock(gui_->dev().mutex);
+	// make sure the memory objects stay alive while we render this
+	std::vector<IntrusivePtr<DeviceMemory>> memories;
 
 	if(res.memory.index() == 1) {
 		if(ImGui::TreeNode("Sparse memory bindings")) {
-			auto& memState = std::get<1>(res.memory);
+			SparseMemoryState memState;
+			{
+				auto lock = gui_->snapshotLock();
+				memState = std::get<1>(res.memory);
+				for(auto& bind : memState.imageBinds) {
+					memories.emplace_back(bind.memory);
+				}
+				for(auto& bind : memState.opaqueBinds) {
+					memories.emplace_back(bind.memory);
+				}
+			}
 
 			auto printOpaqueLabel = false;
 			if(!memState.imageBinds.empty()) {
@@ -193,7 +204,13 @@ void ResourceGui::drawMemoryResDesc(Draw&, MemoryResource& res) {
 			ImGui::TreePop();
 		}
 	} else {
-		auto& memBind = std::get<0>(res.memory);
+		FullMemoryBind memBind;
+		{
+			auto lock = gui_->snapshotLock();
+			memBind = std::get<0>(res.memory);
+			memories.emplace_back(memBind.memory);
+		}
+
 		if(memBind.memory) {
 			ImGui::Text("Bound to memory ");
 			ImGui::SameLine();
@@ -217,7 +234,7 @@ void ResourceGui::drawImageContents(Draw& draw, Image& image, bool doSelect) {
 	IntrusivePtr<Swapchain> swapchain;
 
 	{
-		std::lock_guard lock(gui_->dev().mutex);
+		auto lock = gui_->snapshotLock();
 		swapchain.reset(image.swapchain);
 	}
 
@@ -265,7 +282,7 @@ void ResourceGui::drawImageContents(Draw& draw, Image& image, bool doSelect) {
 		FullMemoryBind::State memState {};
 
 		{
-			std::lock_guard lock(image.dev->mutex);
+			auto lock = gui_->snapshotLock();
 			auto& memBind = std::get<0>(image.memory);
 			memState = memBind.memState;
 			if(memState == FullMemoryBind::State::bound) {
@@ -285,26 +302,34 @@ void ResourceGui::drawImageContents(Draw& draw, Image& image, bool doSelect) {
 			return;
 		}
 	} else if(image.memory.index() == 1) {
-		std::lock_guard lock(image.dev->mutex);
-		draw.usedImages.push_back({image_.object, layout});
-		imageHandle = image.handle;
+		const char* invalidBinds {};
 
-		auto& memBind = std::get<1>(image.memory);
-		for(auto& bind : memBind.imageBinds) {
-			if(!bind.memory) {
-				imGuiText("Can't display image since it contains invalid "
-					"memory bindings (non-opaque), cannot be accessed");
-				return;
+		{
+			auto lock = gui_->snapshotLock();
+			draw.usedImages.push_back({image_.object, layout});
+			imageHandle = image.handle;
+
+			auto& memBind = std::get<1>(image.memory);
+			for(auto& bind : memBind.imageBinds) {
+				if(!bind.memory) {
+					invalidBinds = "non-opaque";
+					break;
+				}
 			}
-		}
 
-		for(auto& bind : memBind.opaqueBinds) {
-			if(!bind.memory) {
-				imGuiText("Can't display image since it contains invalid "
-					"memory bindings (opaque), cannot be accessed");
-				return;
+			for(auto& bind : memBind.opaqueBinds) {
+				if(!invalidBinds && !bind.memory) {
+					invalidBinds = "opaque";
+					break;
+				}
 			}
 		}
+
+		if(invalidBinds) {
+			imGuiText("Can't display image since it contains invalid "
+				"memory bindings ({}), cannot be accessed", invalidBinds);
+			return;
+		}
 	}
 
 	if(!imageHandle) {
@@ -380,7 +405,7 @@ void ResourceGui::drawDesc(Draw& draw, Image& image) {
 	// make sure the views stay alive while we render this
 	std::vector<IntrusivePtr<ImageView>> views;
 	{
-		std::lock_guard lock(gui_->dev().mutex);
+		auto lock = gui_->snapshotLock();
 		for(auto* view : image.views) {
 			views.emplace_back(view);
 		}
@@ -422,7 +447,7 @@ void ResourceGui::showBufferViewer(Draw& draw, Buffer& buffer) {
 		//   We do the real check (and insert) in the copyBuffer callback.
 		FullMemoryBind::State state;
 		{
-			std::lock_guard lock(buffer.dev->mutex);
+			auto lock = gui_->snapshotLock();
 			state = std::get<0>(buffer.memory).memState;
 		}
 
@@ -437,17 +462,25 @@ void ResourceGui::showBufferViewer(Draw& draw, Buffer& buffer) {
 			return;
 		}
 	} else if(buffer.memory.index() == 1u) {
-		std::lock_guard lock(buffer.dev->mutex);
+		auto invalidBinds = false;
 
-		auto& memBind = std::get<1>(buffer.memory);
-		dlg_assert(memBind.imageBinds.empty());
-		for(auto& bind : memBind.opaqueBinds) {
-			if(!bind.memory) {
-				imGuiText("Can't display buffer since it contains invalid "
-					"memory bindings (opaque), cannot be accessed");
-				return;
+		{
+			auto lock = gui_->snapshotLock();
+			auto& memBind = std::get<1>(buffer.memory);
+			dlg_assert(memBind.imageBinds.empty());
+			for(auto& bind : memBind.opaqueBinds) {
+				if(!bind.memory) {
+					invalidBinds = true;
+					break;
+				}
 			}
 		}
+
+		if(invalidBinds) {
+			imGuiText("Can't display buffer since it contains invalid "
+				"memory bindings (opaque), cannot be accessed");
+			return;
+		}
 	}
 
 	gui_->addPostRender([&](Draw& draw) { this->copyBuffer(draw); });
@@ -554,13 +587,12 @@ void ResourceGui::drawDesc(Draw&, DescriptorSet& ds) {
 
 	ImGui::Text("Bindings");
 
-	// NOTE: with refBindings == false in ds.cpp, we MIGHT get incorrect handles
-	//   here. But the chance is small when device has keepAlive maps.
+	// NOTE: with refBindings == false in ds.cpp (see the descriptor-refs
+	//   meson option), we MIGHT get incorrect handles here.
+	//   But the chance is small when device has keepAlive maps.
 	//   Even when the handles are incorrect, that's only because a view
 	//   was destroyed and then a view of the same type constructed
 	//   at the same memory address, we validate them inside addCowLocked.
-	// TODO: also re-evaluate whether the performance impact of refBindings
-	//   is really that large. It really shouldn't be.
 
 	dlg_assert(ds_.state);
 	auto state = DescriptorStateRef(*ds_.state);
@@ -957,7 +989,7 @@ void ResourceGui::drawDesc(Draw&, CommandPool& cp) {
 	std::vector<CommandBuffer*> cbsCopy;
 
 	{
-		std::lock_guard lock(cp.dev->mutex);
+		auto lock = gui_->snapshotLock();
 		cbsCopy = cp.cbs;
 	}
 
@@ -1002,42 +1034,79 @@ void ResourceGui::drawDesc(Draw&, DeviceMemory& mem) {
 
 	drawList->AddRectFilled(start, end, bgCol);
 
+	// we don't draw while holding the lock
+	struct Alloc {
+		MemoryResource* resource;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+	};
+
+	std::vector<Alloc> allocs;
 	{
-		std::lock_guard lock(gui_->dev().mutex);
+		auto lock = gui_->snapshotLock();
+		allocs.reserve(mem.allocations.size());
 		for(auto* bind : mem.allocations) {
-			auto resOff = width * float(bind->memOffset) / mem.size;
-			auto resSize = width * float(bind->memSize) / mem.size;
+			allocs.push_back({bind->resource, bind->memOffset, bind->memSize});
+		}
+	}
+
+	// The resource might have been destroyed since we took the snapshot,
+	// we only access it while it's still bound.
+	auto stillBound = [&](const MemoryResource* resource) {
+		assertOwnedOrShared(gui_->dev().snapshotMutex);
+		for(auto* bind : mem.allocations) {
+			if(bind->resource == resource) {
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	for(auto& alloc : allocs) {
+		auto resOff = width * float(alloc.offset) / mem.size;
+		auto resSize = width * float(alloc.size) / mem.size;
 
-			auto resPos = start;
-			resPos.x += resOff;
+		auto resPos = start;
+		resPos.x += resOff;
 
-			auto rectSize = ImVec2(resSize, height);
+		auto rectSize = ImVec2(resSize, height);
 
-			auto col = allocCol;
-			auto name = dlg::format("{}", (void*) bind);
+		auto col = allocCol;
+		auto name = dlg::format("{}", (void*) alloc.resource);
 
-			ImGui::SetCursorScreenPos(resPos);
-			ImGui::InvisibleButton(name.c_str(), rectSize);
+		ImGui::SetCursorScreenPos(resPos);
+		ImGui::InvisibleButton(name.c_str(), rectSize);
 
-			// TODO: add more details, e.g. for sparse bindings
+		// TODO: add more details, e.g. for sparse bindings
 
-			auto* resource = bind->resource;
-			if(ImGui::IsItemHovered()) {
-				col = allocHoverCol;
+		auto* resource = alloc.resource;
+		if(ImGui::IsItemHovered()) {
+			col = allocHoverCol;
 
-				ImGui::BeginTooltip();
-				imGuiText("{}", vil::name(*resource, resource->memObjectType, true, true));
-				imGuiText("Offset: {}", sepfmt(bind->memOffset));
-				imGuiText("Size: {}", sepfmt(bind->memSize));
-				ImGui::EndTooltip();
+			std::string resName = "<Destroyed>";
+			{
+				auto lock = gui_->snapshotLock();
+				if(stillBound(resource)) {
+					resName = vil::name(*resource, resource->memObjectType, true, true);
+				}
 			}
-			if(ImGui::IsItemClicked()) {
+
+			ImGui::BeginTooltip();
+			imGuiText("{}", resName);
+			imGuiText("Offset: {}", sepfmt(alloc.offset));
+			imGuiText("Size: {}", sepfmt(alloc.size));
+			ImGui::EndTooltip();
+		}
+		if(ImGui::IsItemClicked()) {
+			auto lock = gui_->snapshotLock();
+			if(stillBound(resource)) {
 				select(*resource, resource->memObjectType);
 			}
-
-			auto resEnd = ImVec2(resPos.x + rectSize.x, resPos.y + rectSize.y);
-			drawList->AddRectFilled(resPos, resEnd, col);
 		}
+
+		auto resEnd = ImVec2(resPos.x + rectSize.x, resPos.y + rectSize.y);
+		drawList->AddRectFilled(resPos, resEnd, col);
 	}
 }
 
@@ -1100,11 +1169,15 @@ void ResourceGui::drawDesc(Draw&, ImageView& view) {
 	// data
 	ImGui::NextColumn();
 
+	// make sure the image stays alive while we render this
+	IntrusivePtr<Image> img;
 	{
-		std::lock_guard lock(gui_->dev().mutex);
-		refButtonD(*gui_, view.img);
+		auto lock = gui_->snapshotLock();
+		img.reset(view.img);
 	}
 
+	refButtonD(*gui_, img.get());
+
 	ImGui::Text("%s", vk::name(ci.viewType));
 	imguiPrintRange(ci.subresourceRange.baseArrayLayer, ci.subresourceRange.layerCount);
 	imguiPrintRange(ci.subresourceRange.baseMipLevel, ci.subresourceRange.levelCount);
@@ -1120,7 +1193,7 @@ void ResourceGui::drawDesc(Draw&, ImageView& view) {
 	// make sure fbs stay alive while we show them
 	std::vector<IntrusivePtr<Framebuffer>> fbs;
 	{
-		std::lock_guard lock(gui_->dev().mutex);
+		auto lock = gui_->snapshotLock();
 		for(auto* fb : view.fbs) {
 			fbs.emplace_back(fb);
 		}
@@ -1159,7 +1232,7 @@ void ResourceGui::drawDesc(Draw&, Framebuffer& fb) {
 		// make sure the views stay alive while we render this
 		std::vector<IntrusivePtr<ImageView>> views;
 		{
-			std::lock_guard lock(gui_->dev().mutex);
+			auto lock = gui_->snapshotLock();
 			for(auto* view : fb.attachments) {
 				views.emplace_back(view);
 			}
@@ -1336,7 +1409,7 @@ void ResourceGui::drawDesc(Draw&, Swapchain& swapchain) {
 	// make sure the views stay alive while we render this
 	std::vector<IntrusivePtr<Image>> images;
 	{
-		std::lock_guard lock(gui_->dev().mutex);
+		auto lock = gui_->snapshotLock();
 		for(auto* img : swapchain.images) {
 			images.emplace_back(img);
 		}
@@ -1373,7 +1446,7 @@ void ResourceGui::drawDesc(Draw& draw, AccelStruct& accelStruct) {
 	AccelStructStatePtr state;
 
 	{
-		std::shared_lock lock(gui_->dev().mutex);
+		auto lock = gui_->snapshotLock();
 		state = accelStruct.lastValid;
 	}
 
@@ -1429,8 +1502,10 @@ void ResourceGui::drawDesc(Draw& draw, AccelStruct& accelStruct) {
 		auto& dev = gui_->dev();
 
 		auto blasResolver = [&](u64 address) -> std::pair<AccelStruct*, AccelStructStatePtr> {
-			assertOwnedOrShared(dev.mutex);
-			auto* blas = tryAccelStructAtLocked(dev, address);
+			// Accel structs are only removed from the address map with
+			// the snapshot mutex locked, see AccelStruct::onApiDestroy
+			assertOwnedOrShared(dev.snapshotMutex);
+			auto* blas = dev.accelStructAddresses.findExact(address);
 			dlg_assert(blas);
 			if(!blas) {
 				return {nullptr, nullptr};
@@ -1442,15 +1517,28 @@ void ResourceGui::drawDesc(Draw& draw, AccelStruct& accelStruct) {
 		if(inis.instances.empty()) {
 			imGuiText("No instances.");
 		} else if(ImGui::TreeNode("Instances")) {
-			std::shared_lock lock(dev.mutex);
+			// make sure the blases stay alive while we render this
+			std::vector<IntrusivePtr<AccelStruct>> blases;
+			blases.reserve(inis.instances.size());
+			{
+				auto lock = gui_->snapshotLock();
+				for(auto& ini : inis.instances) {
+					AccelStruct* blas {};
+					if(ini.accelerationStructureReference) {
+						blas = blasResolver(ini.accelerationStructureReference).first;
+					}
+
+					blases.emplace_back(blas);
+				}
+			}
 
-			for(auto& ini : inis.instances) {
+			for(auto [i, ini] : enumerate(inis.instances)) {
 				if(!ini.accelerationStructureReference) {
 					imGuiText("null instance");
 					continue;
 				}
 
-				auto [blas, state] = blasResolver(ini.accelerationStructureReference);
+				auto& blas = blases[i];
 				if(!blas) {
 					imGuiText("Error: invalid instance");
 					continue;
@@ -1479,7 +1567,7 @@ void ResourceGui::drawDesc(Draw& draw, AccelStruct& accelStruct) {
 		}
 
 		auto blasStateResolver = [&](u64 address) -> AccelStructStatePtr {
-			std::shared_lock lock(dev.mutex);
+			auto lock = gui_->snapshotLock();
 			return blasResolver(address).second;
 		};
 
@@ -1546,38 +1634,42 @@ void ResourceGui::updateResourceList() {
 	filter_ = newFilter_;
 
 	auto typeHandler = ObjectTypeHandler::handler(filter_);
-	std::lock_guard lock(gui_->dev().mutex);
-
-	// find new handles
 	auto foundSelected = false;
-	if(filter_ == VK_OBJECT_TYPE_DESCRIPTOR_SET) {
-		for(auto& dsPool : dev.dsPools.inner) {
-			ds_.pools.push_back(dsPool.second);
-
-			auto it = dsPool.second->usedEntries;
-			while(it) {
-				dlg_assert(it->set);
-
-				auto& entry = ds_.entries.emplace_back();
-				entry.pool = dsPool.second.get();
-				entry.entry = it;
-				entry.id = it->set->id;
-				it = it->next;
+	{
+		auto lock = gui_->snapshotLock();
+
+		// find new handles
+		if(filter_ == VK_OBJECT_TYPE_DESCRIPTOR_SET) {
+			dev.dsPools.forEachLocked([&](auto& dsPool) {
+				ds_.pools.push_back(dsPool.second);
+
+				// the entries are modified with only the pool mutex locked
+				std::lock_guard poolLock(dsPool.second->mutex);
+				auto it = dsPool.second->usedEntries;
+				while(it) {
+					dlg_assert(it->set);
+
+					auto& entry = ds_.entries.emplace_back();
+					entry.pool = dsPool.second.get();
+					entry.entry = it;
+					entry.id = it->set->id;
+					it = it->next;
+
+					if(entry.entry == ds_.selected.entry) {
+						foundSelected = true;
+					}
+				}
+			});
+		} else {
+			handles_ = typeHandler->resources(dev, search_);
 
-				if(entry.entry == ds_.selected.entry) {
+			for(auto& handle : handles_) {
+				typeHandler->visit(incRefCountVisitor, *handle);
+				if(handle == handle_) {
 					foundSelected = true;
 				}
 			}
 		}
-	} else {
-		handles_ = typeHandler->resources(dev, search_);
-
-		for(auto& handle : handles_) {
-			typeHandler->visit(incRefCountVisitor, *handle);
-			if(handle == handle_) {
-				foundSelected = true;
-			}
-		}
 	}
 
 	// we updated the list and our selection wasn't in there anymore
@@ -1657,7 +1749,7 @@ void ResourceGui::draw(Draw& draw) {
 			return;
 		} else {
 			// lock mutex due to access to res.handle
-			std::lock_guard lock(gui_->dev().mutex);
+			auto lock = gui_->snapshotLock();
 			isDestroyed = (res.handle == VK_NULL_HANDLE);
 		}
 	});
@@ -573,14 +573,13 @@ unsigned ShaderDebugger::arrayLength(unsigned varID, span<const spvm_word> indic
 	auto* baseCmd = selection().command().back();
 	auto* cmd = deriveCast<const StateCmdBase*>(baseCmd);
 	auto& dsState = selection().descriptorSnapshot();
-	auto dss = cmd->boundDescriptors().descriptorSets;
+	auto& bound = cmd->boundDescriptors();
 
-	dlg_assert(setID < dss.size());
-	auto& cmdDS = dss[setID];
+	dlg_assert(setID < bound.descriptorSets.size());
 
-	auto stateIt = dsState.states.find(cmdDS.dsEntry);
-	dlg_assert(stateIt != dsState.states.end());
-	auto [ds, lock] = access(*stateIt->second);
+	auto* dsCow = dsState.find(bound, setID);
+	dlg_assert_or(dsCow, return 0);
+	auto [ds, lock] = access(*dsCow);
 
 	// For samplers, we didn't do a copy and so have to early-out here
 	auto dsCopyIt = varIDToDsCopyMap_.find(varID);
@@ -769,14 +768,13 @@ void ShaderDebugger::loadVar(unsigned srcID, span<const spvm_word> indices,
 	auto* baseCmd = selection().command().back();
 	auto* cmd = deriveCast<const StateCmdBase*>(baseCmd);
 	auto& dsState = selection().descriptorSnapshot();
-	auto dss = cmd->boundDescriptors().descriptorSets;
+	auto& bound = cmd->boundDescriptors();
 
-	dlg_assert(setID < dss.size());
-	auto& cmdDS = dss[setID];
+	dlg_assert(setID < bound.descriptorSets.size());
 
-	auto stateIt = dsState.states.find(cmdDS.dsEntry);
-	dlg_assert(stateIt != dsState.states.end());
-	auto [ds, lock] = access(*stateIt->second);
+	auto* dsCow = dsState.find(bound, setID);
+	dlg_assert_or(dsCow, return);
+	auto [ds, lock] = access(*dsCow);
 
 	// For samplers, we didn't do a copy and so have to early-out here
 	auto dsCopyIt = varIDToDsCopyMap_.find(srcID);
@@ -100,35 +100,31 @@ bool matchesSearch(Handle& handle, VkObjectType objectType, std::string_view sea
 	return findSubstrCI(label, search) != -1;
 }
 
-template<typename... Args>
-std::vector<Handle*> findHandles(const std::unordered_map<Args...>& map,
+template<typename K, typename T, template<typename...> typename P>
+std::vector<Handle*> findHandles(SyncedUnorderedMap<K, T, P>& map,
 		std::string_view search) {
 	std::vector<Handle*> ret;
-	for(auto& entry : map) {
+	map.forEachLocked([&](auto& entry) {
 		auto& handle = *entry.second;
-		if(!matchesSearch(handle, handle.objectType, search)) {
-			continue;
+		if(matchesSearch(handle, handle.objectType, search)) {
+			ret.push_back(&handle);
 		}
-
-		ret.push_back(&handle);
-	}
+	});
 
 	std::sort(ret.begin(), ret.end());
 	return ret;
 }
 
-template<typename... Args>
-std::vector<Handle*> findHandles(const std::unordered_set<Args...>& set,
+template<typename T, template<typename...> typename P>
+std::vector<Handle*> findHandles(SyncedUnorderedSet<T, P>& set,
 		std::string_view search) {
 	std::vector<Handle*> ret;
-	for(auto& entry : set) {
+	set.forEachLocked([&](auto& entry) {
 		auto& handle = *entry;
-		if(!matchesSearch(handle, handle.objectType, search)) {
-			continue;
+		if(matchesSearch(handle, handle.objectType, search)) {
+			ret.push_back(&handle);
 		}
-
-		ret.push_back(&handle);
-	}
+	});
 
 	std::sort(ret.begin(), ret.end());
 	return ret;
@@ -155,13 +151,13 @@ struct ObjectTypeMapImpl : ObjectTypeHandler {
 		using VKHT = decltype(std::declval<HT>().handle);
 		auto vkht = u64ToHandle<VKHT>(id);
 
-		auto& handle = getLocked(dev, vkht);
+		auto& handle = get(dev, vkht);
 		fwdID = handleToU64(handle.handle);
 
 		return &handle;
 	}
 	std::vector<Handle*> resources(Device& dev, std::string_view search) const override {
-		return findHandles((dev.*DevMapPtr).inner, search);
+		return findHandles(dev.*DevMapPtr, search);
 	}
 	void visit(ResourceVisitor& visitor, Handle& handle) const override {
 		return visitor.visit(static_cast<HT&>(handle));
@@ -183,7 +179,7 @@ struct DescriptorSetTypeImpl : ObjectTypeHandler {
 		assertOwned(dev.mutex);
 
 		auto vkds = u64ToHandle<VkDescriptorSet>(id);
-		auto& handle = getLocked(dev, vkds);
+		auto& handle = get(dev, vkds);
 		fwdID = handleToU64(handle.handle);
 
 		return &handle;
@@ -332,6 +328,7 @@ VKAPI_ATTR VkResult VKAPI_CALL SetDebugUtilsObjectNameEXT(
 		auto* handle = findHandle(devd, pNameInfo->objectType,
 			pNameInfo->objectHandle, fwd.objectHandle);
 		if(handle) {
+			std::lock_guard snapshotLock(devd.snapshotMutex);
 			handle->name = pNameInfo->pObjectName;
 		}
 	}
@@ -22,6 +22,7 @@ void Image::onApiDestroy() {
 	MemoryResource::onApiDestroy();
 
 	std::lock_guard lock(dev->mutex);
+	std::lock_guard snapshotLock(dev->snapshotMutex);
 	for(auto* view : this->views) {
 		view->img = nullptr;
 	}
@@ -60,6 +61,7 @@ ImageView::~ImageView() {
 	--DebugStats::get().aliveImagesViews;
 
 	std::lock_guard lock(dev->mutex);
+	std::lock_guard snapshotLock(dev->snapshotMutex);
 	if(this->img) {
 		auto it = std::find(this->img->views.begin(), this->img->views.end(), this);
 		dlg_assert(it != this->img->views.end());
@@ -368,6 +370,7 @@ void bindImageMemory(Image& img, DeviceMemory& mem, u64 offset) {
 
 	// access to the given memory and image must be internally synced
 	std::lock_guard lock(dev.mutex);
+	std::lock_guard snapshotLock(dev.snapshotMutex);
 	dlg_assert(img.memory.index() == 0u);
 	auto& memBind = std::get<0>(img.memory);
 
@@ -460,6 +463,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateImageView(
 
 	{
 		std::lock_guard lock(dev.mutex);
+		std::lock_guard snapshotLock(dev.snapshotMutex);
 		view.img->views.push_back(&view);
 	}
 
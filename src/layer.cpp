@@ -12,6 +12,7 @@
 #include <pipe.hpp>
 #include <shader.hpp>
 #include <ds.hpp>
+#include <descriptorBuffer.hpp>
 #include <platform.hpp>
 #include <queue.hpp>
 #include <overlay.hpp>
@@ -654,6 +655,16 @@ static const std::unordered_map<std::string_view, HookedFunction> funcPtrTable {
 	VIL_DEV_HOOK_ALIAS_CORE(GetDescriptorSetLayoutSupportKHR,
 		GetDescriptorSetLayoutSupport, VK_KHR_MAINTENANCE_3_EXTENSION_NAME),
 
+	// descriptorBuffer.hpp
+	VIL_DEV_HOOK_EXT(GetDescriptorSetLayoutSizeEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(GetDescriptorSetLayoutBindingOffsetEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(GetDescriptorEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(GetBufferOpaqueCaptureDescriptorDataEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(GetImageOpaqueCaptureDescriptorDataEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(GetImageViewOpaqueCaptureDescriptorDataEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(GetSamplerOpaqueCaptureDescriptorDataEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(GetAccelerationStructureOpaqueCaptureDescriptorDataEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+
 	// pipe.hpp
 	VIL_DEV_HOOK(CreateGraphicsPipelines, VK_API_VERSION_1_0),
 	VIL_DEV_HOOK(CreateComputePipelines, VK_API_VERSION_1_0),
@@ -889,6 +900,10 @@ static const std::unordered_map<std::string_view, HookedFunction> funcPtrTable {
 
 	VIL_DEV_HOOK_EXT(CmdSetColorWriteEnableEXT, VK_EXT_COLOR_WRITE_ENABLE_EXTENSION_NAME),
 
+	VIL_DEV_HOOK_EXT(CmdBindDescriptorBuffersEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(CmdSetDescriptorBufferOffsetsEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+	VIL_DEV_HOOK_EXT(CmdBindDescriptorBufferEmbeddedSamplersEXT, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME),
+
 	VIL_DEV_HOOK_EXT(CmdDrawMultiEXT, VK_EXT_MULTI_DRAW_EXTENSION_NAME),
 	VIL_DEV_HOOK_EXT(CmdDrawMultiIndexedEXT, VK_EXT_MULTI_DRAW_EXTENSION_NAME),
 
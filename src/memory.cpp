@@ -76,6 +76,7 @@ void MemoryResource::onApiDestroy() {
 	std::lock_guard lock(dev->mutex);
 
 	// unregister at memory
+	std::unique_lock snapshotLock(dev->snapshotMutex);
 	std::visit(Visitor{
 		[](FullMemoryBind& bind) {
 			dlg_assertm(!!bind.memory ==
@@ -106,6 +107,7 @@ void MemoryResource::onApiDestroy() {
 			mem.imageBinds.clear();
 		}
 	}, memory);
+	snapshotLock.unlock();
 
 	notifyApiHandleDestroyedLocked(*dev, *this, memObjectType);
 }
@@ -121,10 +123,14 @@ void DeviceMemory::onApiDestroy() {
 			[&](FullMemoryBind& bind) {
 				dlg_assert(bind.memState == FullMemoryBind::State::bound);
 				dlg_assert(bind.memory == this);
-				bind.memory = nullptr;
-				bind.memState = FullMemoryBind::State::memoryDestroyed;
-				bind.memOffset = 0u;
-				bind.memSize = 0u;
+
+				{
+					std::lock_guard snapshotLock(dev->snapshotMutex);
+					bind.memory = nullptr;
+					bind.memState = FullMemoryBind::State::memoryDestroyed;
+					bind.memOffset = 0u;
+					bind.memSize = 0u;
+				}
 
 				notifyMemoryResourceInvalidatedLocked(*dev, res);
 			},
@@ -138,14 +144,19 @@ void DeviceMemory::onApiDestroy() {
 				//   otherwise using the resource is invalid
 				dlg_assert(bind->memory == this);
 				auto& dst = *const_cast<MemoryBind*>(bind);
-				dst.memory = nullptr;
-				dst.memOffset = 0u;
+
+				{
+					std::lock_guard snapshotLock(dev->snapshotMutex);
+					dst.memory = nullptr;
+					dst.memOffset = 0u;
+				}
 
 				notifyMemoryResourceInvalidatedLocked(*dev, *dst.resource);
 			}
 		}, res.memory);
 	}
 
+	std::lock_guard snapshotLock(dev->snapshotMutex);
 	allocations.clear();
 }
 
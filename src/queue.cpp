@@ -34,6 +34,7 @@ void finish(SubmissionBatch& batch) {
 				} else {
 					auto& accelStructCopies = scb.cb->lastRecordLocked()->accelStructCopies;
 					dlg_assert(accelStructCopies.size() == scb.accelStructCopies.size());
+					std::lock_guard snapshotLock(dev.snapshotMutex);
 					for(auto [i, copy] : enumerate(accelStructCopies)) {
 						copy.dst->lastValid = scb.accelStructCopies[i];
 					}
@@ -193,13 +194,14 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 
 	VkResult res;
 
-	// Lock order is important here, lock dev mutex before queue mutex.
-	// We lock the dev mutex to sync with gui.
+	// The device mutex is only locked to prepare and post-process the
+	// submission, not while calling into the driver, submission can take
+	// a long time. The submission mutex keeps submissions in order and
+	// the gui from seeing submitted work that isn't in dev.pending yet.
+	// Lock order: submission mutex, dev mutex, queue mutex.
+	std::lock_guard submLock(dev.submissionMutex);
+
 	{
-		// TODO PERF: locking the dev mutex here is terrible for performance,
-		// queueSubmit can take a long time and applications might parallelize
-		// around it.
-		// Maybe we can handle this with a separate gui/submission sync mutex?
 		std::lock_guard devLock(dev.mutex);
 
 		addSubmissionSyncLocked(submitter);
@@ -208,44 +210,47 @@ VkResult doSubmit(Queue& queue, span<const VkSubmitInfo2> submits,
 		} else {
 			addGuiSyncLocked(submitter);
 		}
+	}
 
-		{
-			ZoneScopedN("dispatch.QueueSubmit");
-			std::lock_guard queueLock(dev.queueMutex);
-
-			if(legacy) {
-				auto downgraded = submitter.memScope.alloc<VkSubmitInfo>(submitter.submitInfos.size());
-				for(auto i = 0u; i < submitter.submitInfos.size(); ++i) {
-					downgraded[i] = downgrade(dev, submitter.memScope,
-						submitter.submitInfos[i]);
-				}
-
-				res = dev.dispatch.QueueSubmit(queue.handle,
-					u32(downgraded.size()),
-					downgraded.data(),
-					submitter.submFence);
-			} else {
-				res = dev.dispatch.QueueSubmit2(queue.handle,
-					u32(submitter.submitInfos.size()),
-					submitter.submitInfos.data(),
-					submitter.submFence);
+	{
+		ZoneScopedN("dispatch.QueueSubmit");
+		std::lock_guard queueLock(dev.queueMutex);
+
+		if(legacy) {
+			auto downgraded = submitter.memScope.alloc<VkSubmitInfo>(submitter.submitInfos.size());
+			for(auto i = 0u; i < submitter.submitInfos.size(); ++i) {
+				downgraded[i] = downgrade(dev, submitter.memScope,
+					submitter.submitInfos[i]);
 			}
-		}
 
-		if(res != VK_SUCCESS) {
-			dlg_trace("vkQueueSubmit error: {} ({})", vk::name(res), res);
-			if(res == VK_ERROR_DEVICE_LOST) {
-				onDeviceLost(dev);
-			}
+			res = dev.dispatch.QueueSubmit(queue.handle,
+				u32(downgraded.size()),
+				downgraded.data(),
+				submitter.submFence);
+		} else {
+			res = dev.dispatch.QueueSubmit2(queue.handle,
+				u32(submitter.submitInfos.size()),
+				submitter.submitInfos.data(),
+				submitter.submFence);
+		}
+	}
 
-			cleanupOnErrorLocked(submitter);
-			return res;
+	if(res != VK_SUCCESS) {
+		dlg_trace("vkQueueSubmit error: {} ({})", vk::name(res), res);
+		if(res == VK_ERROR_DEVICE_LOST) {
+			onDeviceLost(dev);
 		}
 
-		postProcessLocked(submitter);
-		dev.pending.push_back(std::move(submitter.dstBatch));
+		std::lock_guard devLock(dev.mutex);
+		cleanupOnErrorLocked(submitter);
+		return res;
 	}
 
+	std::lock_guard devLock(dev.mutex);
+	postProcessLocked(submitter);
+	dev.pending.push_back(std::move(submitter.dstBatch));
+	dev.completion.notifyLocked();
+
 	return res;
 }
 
@@ -372,13 +377,10 @@ VKAPI_ATTR VkResult VKAPI_CALL QueueBindSparse(
 
 	VkResult res;
 
-	// Lock order is important here, lock dev mutex before queue mutex.
-	// We lock the dev mutex to sync with gui.
+	// See doSubmit, the device mutex isn't locked during the driver call.
+	std::lock_guard submLock(dev.submissionMutex);
+
 	{
-		// TODO PERF: locking the dev mutex here is terrible for performance,
-		// queueSubmit can take a long time and applications might parallelize
-		// around it.
-		// Maybe we can handle this with a separate gui/submission sync mutex?
 		std::lock_guard devLock(dev.mutex);
 
 		addSubmissionSyncLocked(submitter);
@@ -387,30 +389,33 @@ VKAPI_ATTR VkResult VKAPI_CALL QueueBindSparse(
 		} else {
 			addGuiSyncLocked(submitter);
 		}
+	}
 
-		{
-			ZoneScopedN("dispatch.QueueSubmit");
-			std::lock_guard queueLock(dev.queueMutex);
-			res = queue.dev->dispatch.QueueBindSparse(queue.handle,
-				u32(submitter.bindSparseInfos.size()),
-				submitter.bindSparseInfos.data(),
-				submitter.submFence);
-		}
-
-		if(res != VK_SUCCESS) {
-			dlg_trace("vkQueueBindSparse error: {} ({})", vk::name(res), res);
-			if(res == VK_ERROR_DEVICE_LOST) {
-				onDeviceLost(dev);
-			}
+	{
+		ZoneScopedN("dispatch.QueueSubmit");
+		std::lock_guard queueLock(dev.queueMutex);
+		res = queue.dev->dispatch.QueueBindSparse(queue.handle,
+			u32(submitter.bindSparseInfos.size()),
+			submitter.bindSparseInfos.data(),
+			submitter.submFence);
+	}
 
-			cleanupOnErrorLocked(submitter);
-			return res;
+	if(res != VK_SUCCESS) {
+		dlg_trace("vkQueueBindSparse error: {} ({})", vk::name(res), res);
+		if(res == VK_ERROR_DEVICE_LOST) {
+			onDeviceLost(dev);
 		}
 
-		postProcessLocked(submitter);
-		dev.pending.push_back(std::move(submitter.dstBatch));
+		std::lock_guard devLock(dev.mutex);
+		cleanupOnErrorLocked(submitter);
+		return res;
 	}
 
+	std::lock_guard devLock(dev.mutex);
+	postProcessLocked(submitter);
+	dev.pending.push_back(std::move(submitter.dstBatch));
+	dev.completion.notifyLocked();
+
 	return res;
 }
 
@@ -603,6 +608,7 @@ void activateLocked(Submission& subm) {
 		activateLocked(cmdSub);
 	} else if(subm.parent->type == SubmissionType::bindSparse) {
 		auto& bindSub = std::get<BindSparseSubmission>(subm.data);
+		std::lock_guard snapshotLock(dev.snapshotMutex);
 		activateLocked(bindSub);
 	} else {
 		dlg_error("unreachable");
@@ -3,6 +3,7 @@
 #include <fwd.hpp>
 #include <handle.hpp>
 #include <sync.hpp>
+#include <command/record.hpp> // CommandDescriptorSnapshot
 #include <util/intrusive.hpp>
 #include <vk/vulkan.h>
 #include <vector>
@@ -58,9 +59,6 @@ struct Queue : Handle {
 // All data we store for a queue family.
 struct QueueFamily {
 	VkQueueFamilyProperties props;
-
-	// Resettable command pool.
-	VkCommandPool commandPool {};
 };
 
 struct SubmittedCommandBuffer {
@@ -123,6 +121,11 @@ struct CommandSubmission {
 	// The CommandBuffer record must stay valid while the submission
 	// is still pending (anything else is an application error).
 	std::vector<SubmittedCommandBuffer> cbs;
+
+	// The descriptor states captured for this submission, shared by all
+	// hooks of the submission. Only filled (in the critical section of
+	// CommandHook::hook) for the commands that are actually hooked.
+	CommandDescriptorSnapshot descriptors;
 };
 
 // A single Submission done via one VkSubmitInfo in vkQueueSubmit.
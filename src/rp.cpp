@@ -16,6 +16,7 @@ Framebuffer::~Framebuffer() {
 	}
 
 	std::lock_guard lock(dev->mutex);
+	std::lock_guard snapshotLock(dev->snapshotMutex);
 	for(auto* attachment : attachments) {
 		auto it = find(attachment->fbs, this);
 		dlg_assert(it != attachment->fbs.end());
@@ -92,9 +93,12 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateFramebuffer(
 	fb.attachments = std::move(views);
 	fb.imageless = imageless;
 
-	for(auto* view : fb.attachments) {
+	{
 		std::lock_guard lock(dev.mutex);
-		view->fbs.push_back(&fb);
+		std::lock_guard snapshotLock(dev.snapshotMutex);
+		for(auto* view : fb.attachments) {
+			view->fbs.push_back(&fb);
+		}
 	}
 
 	*pFramebuffer = castDispatch<VkFramebuffer>(fb);
@@ -176,6 +176,9 @@ constexpr auto creators = std::array{
 	&CommandCreator<EndRenderingCmd>::load,
 	&CommandCreator<SetVertexInputCmd>::load,
 	&CommandCreator<SetColorWriteEnableCmd>::load,
+	&CommandCreator<BindDescriptorBuffersCmd>::load,
+	&CommandCreator<SetDescriptorBufferOffsetsCmd>::load,
+	&CommandCreator<BindDescriptorBufferEmbeddedSamplersCmd>::load,
 };
 
 Command& loadCommand(CommandLoader& loader) {
@@ -669,6 +672,8 @@ void serialize(CommandLoader& loader, LoadBuf& io, ExecuteCommandsCmd& cmd) {
 	for(auto i = 0u; i < count; ++i) {
 		auto& child = construct<ExecuteCommandsChildCmd>(loader.rec);
 		serialize(loader, io, child);
+		cmd.stats_.fingerprint = combineHash64(cmd.stats_.fingerprint,
+			structuralFingerprint(child));
 
 		if(!last) {
 			dlg_assert(!cmd.children_);
@@ -811,7 +816,7 @@ void serialize(Slz& slz, IO& io, Cmd& cmd) {
 // TODO: serializing of RootCommand currently not handled symmetrically
 
 // entry points
-void loadRecord(StateLoader& loader, IntrusivePtr<CommandRecord> recPtr, LoadBuf& io) {
+void loadRecord(StateLoader& loader, CommandRecordPtr recPtr, LoadBuf& io) {
 	RecordBuilder builder;
 	builder.reset(recPtr);
 
@@ -831,6 +836,7 @@ void loadRecord(StateLoader& loader, IntrusivePtr<CommandRecord> recPtr, LoadBuf
 	loader.commandToOffset[rec.commands] = off;
 
 	loadChildren(cslz, cslz.io);
+	builder.foldFingerprint();
 }
 
 void saveRecord(StateSaver& saver, SaveBuf& io, CommandRecord& rec) {
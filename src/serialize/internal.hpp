@@ -31,7 +31,7 @@ void flushPending(StateSaver& saver);
 
 // loader
 struct StateLoader {
-	std::vector<IntrusivePtr<CommandRecord>> records;
+	std::vector<CommandRecordPtr> records;
 
 	std::unordered_map<u64, Command*> offsetToCommand;
 	std::unordered_map<const Command*, u64> commandToOffset;
@@ -55,7 +55,7 @@ struct StateLoader {
 u64 addNoFlush(StateSaver& slz, const CommandRecord& rec);
 
 // commands.cpp
-void loadRecord(StateLoader& loader, IntrusivePtr<CommandRecord> rec, LoadBuf& io);
+void loadRecord(StateLoader& loader, CommandRecordPtr rec, LoadBuf& io);
 void saveRecord(StateSaver& saver, SaveBuf& io, CommandRecord& rec);
 
 // handles.cpp
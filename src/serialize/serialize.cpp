@@ -177,7 +177,7 @@ void destroy(StateLoader& loader) {
 	delete &loader;
 }
 
-IntrusivePtr<CommandRecord> getRecord(const StateLoader& loader, u64 id) {
+CommandRecordPtr getRecord(const StateLoader& loader, u64 id) {
 	dlg_assertm_or(id < loader.records.size(), return nullptr, "id {}, size {}",
 		id, loader.records.size());
 	return loader.records[id];
@@ -64,7 +64,7 @@ using StateLoaderPtr = std::unique_ptr<StateLoader, SerializerDeleter>;
 StateLoaderPtr createStateLoader(ReadBuf);
 
 // Returns the record with the given id, nullptr if it does not exist.
-IntrusivePtr<CommandRecord> getRecord(const StateLoader&, u64 id);
+CommandRecordPtr getRecord(const StateLoader&, u64 id);
 
 // Returns the command with the given id, nullptr if it does not exist.
 // NOTE: there is currently no way to get the record associated with it.
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fwd.hpp>
+#include <util/dlg.hpp>
 #include <atomic>
 
 namespace vil {
@@ -15,6 +16,11 @@ struct DebugStats {
 	std::atomic<u32> aliveImagesViews {};
 	std::atomic<u32> aliveHookRecords {};
 	std::atomic<u32> aliveHookStates {};
+	// number of hook records created with the resources of a previous one
+	std::atomic<u32> reusedHookRecords {};
+	// number of hook records that resubmitted the command buffer of a
+	// previous one without recording it again
+	std::atomic<u32> resubmittedHookRecords {};
 
 	std::atomic<u64> threadContextMem {};
 	std::atomic<u64> commandMem {};
@@ -23,7 +29,33 @@ struct DebugStats {
 
 	std::atomic<u64> ownBufferMem {};
 	std::atomic<u64> copiedImageMem {};
+
+	// LinBlockPool memory. Blocks currently in use vs blocks cached
+	// in pools or thread magazines.
+	std::atomic<u64> liveBlockMem {};
+	std::atomic<u64> pooledBlockMem {};
 };
 
+template<typename T, typename O>
+void debugStatAdd(std::atomic<T>& dst, const O& val) {
+#ifdef VIL_DEBUG_STATS
+	dst.fetch_add(val, std::memory_order_relaxed);
+#else // VIL_DEBUG_STATS
+	(void) dst;
+	(void) val;
+#endif // VIL_DEBUG_STATS
+}
+
+template<typename T, typename O>
+void debugStatSub(std::atomic<T>& dst, const O& val) {
+#ifdef VIL_DEBUG_STATS
+	auto before = dst.fetch_sub(val, std::memory_order_relaxed);
+	dlg_assert(before >= val);
+#else // VIL_DEBUG_STATS
+	(void) dst;
+	(void) val;
+#endif // VIL_DEBUG_STATS
+}
+
 } // namespace vil
 
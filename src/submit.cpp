@@ -124,9 +124,11 @@ void init(QueueSubmitter& subm, Queue& queue, SubmissionType type,
 		subm.globalSubmitID = ++dev.submissionCounter;
 
 		// Check all pending submissions for completion, to possibly return
-		// resources to fence/semaphore pools
-		// check all submissions for completion
-		checkPendingSubmissionsLocked(dev);
+		// resources to fence/semaphore pools. Not needed when the
+		// completion thread does it.
+		if(!dev.completion.running()) {
+			checkPendingSubmissionsLocked(dev);
+		}
 	}
 
 	subm.dstBatch = std::make_unique<SubmissionBatch>();
@@ -855,6 +857,11 @@ bool potentiallyWritesLocked(const Submission& subm, const Image* img, const Buf
 			auto& cb = scb.cb;
 			auto& rec = *cb->lastRecordLocked();
 
+			// we don't know which handles untracked records use
+			if(rec.untracked) {
+				return true;
+			}
+
 			if(buf) {
 				auto it = find(rec.used.buffers, const_cast<Buffer&>(*buf));
 				if(it != rec.used.buffers.end()) {
@@ -30,6 +30,7 @@ void Swapchain::destroy() {
 
 		{
 			std::lock_guard lock(dev->mutex);
+			std::lock_guard snapshotLock(dev->snapshotMutex);
 			img->swapchain = nullptr;
 			img->handle = {};
 
@@ -48,6 +49,7 @@ void Swapchain::destroy() {
 	// in other places since the api for swapchain/overlay retrieval
 	// can't be threadsafe, by design.
 	std::lock_guard lock(dev->mutex);
+	std::lock_guard snapshotLock(dev->snapshotMutex);
 	images.clear();
 }
 
@@ -133,6 +135,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(
 
 	// use data from old swapchain
 	if(oldChain) {
+		std::lock_guard snapshotLock(dev.snapshotMutex);
 		swapd.presentCounter = oldChain->presentCounter;
 		swapd.lastPresent = std::move(oldChain->lastPresent);
 		swapd.frameTimings = std::move(oldChain->frameTimings);
@@ -148,7 +151,7 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(
 	auto imgs = memScope.alloc<VkImage>(imgCount);
 	VK_CHECK(dev.dispatch.GetSwapchainImagesKHR(dev.handle, swapd.handle, &imgCount, imgs.data()));
 
-	swapd.images.resize(imgCount);
+	std::vector<Image*> images(imgCount);
 	for(auto i = 0u; i < imgCount; ++i) {
 		auto imgPtr = IntrusivePtr<Image>(new Image());
 		auto& img = *imgPtr;
@@ -178,12 +181,17 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(
 		// img.ci.pQueueFamilyIndices = sci.pQueueFamilyIndices;
 		// img.ci.queueFamilyIndexCount = sci.queueFamilyIndexCount;
 
-		swapd.images[i] = &img;
+		images[i] = &img;
 
 		auto handleDown = castDispatch<VkImage>(img);
 		dev.images.mustEmplace(handleDown, std::move(imgPtr));
 	}
 
+	{
+		std::lock_guard snapshotLock(dev.snapshotMutex);
+		swapd.images = std::move(images);
+	}
+
 	dlg_trace(">> Createswapchain. platform: {}, dev.gui {}", platform, dev.gui());
 
 	if(savedOverlay) {
@@ -292,6 +300,7 @@ void swapchainPresent(Swapchain& swapchain) {
 	FrameSubmissions keepAliveFrameSubmissions;
 
 	auto lock = std::lock_guard(swapchain.dev->mutex);
+	auto snapshotLock = std::lock_guard(swapchain.dev->snapshotMutex);
 	++swapchain.presentCounter;
 	keepAliveFrameSubmissions = std::move(swapchain.frameSubmissions.back());
 
@@ -0,0 +1,189 @@
+// Compares building the bound graphics state for a synthetic command
+// buffer with 10k draws the previous way (copying the whole state on every
+// change) with the copy-on-write chunks used now (see StateChunkBits).
+// Run via 'viltest bench_' or 'meson test --benchmark'.
+
+#include "../bugged.hpp"
+#include <command/alloc.hpp>
+#include <util/linalloc.hpp>
+#include <util/dlg.hpp>
+#include <chrono>
+
+using namespace vil;
+
+namespace {
+
+constexpr auto numDraws = 10 * 1000u;
+constexpr auto numRecords = 32u;
+
+// Fake handles, only used as pointer values
+GraphicsPipeline* fakePipe(u32 id) {
+	return reinterpret_cast<GraphicsPipeline*>(std::uintptr_t(0x1000u + 0x100u * id));
+}
+
+Buffer* fakeBuffer(u32 id) {
+	return reinterpret_cast<Buffer*>(std::uintptr_t(0x100000u + 0x100u * id));
+}
+
+template<typename F>
+double measureMs(F&& func) {
+	using Clock = std::chrono::steady_clock;
+	auto start = Clock::now();
+	func();
+	auto diff = Clock::now() - start;
+	return std::chrono::duration<double, std::milli>(diff).count();
+}
+
+// The previous way: every change creates a full copy of the state,
+// including dynamic state and all spans that are touched.
+struct FullCopyBuilder {
+	LinAllocator& alloc;
+	GraphicsState* state {};
+
+	GraphicsState& change() {
+		state = &construct<GraphicsState>(alloc, *state);
+		state->dynamic = &construct<GraphicsDynamicState>(alloc, *state->dynamic);
+		return *state;
+	}
+
+	span<BoundDescriptorSet> descriptorSets(std::size_t count) {
+		auto& gs = change();
+		gs.descriptorSets = copyEnsureSizeUndef(alloc, gs.descriptorSets, count);
+		return gs.descriptorSets;
+	}
+
+	span<BoundVertexBuffer> vertexBuffers(std::size_t count) {
+		auto& gs = change();
+		gs.vertices = copyEnsureSizeUndef(alloc, gs.vertices, count);
+		return gs.vertices;
+	}
+
+	span<VkViewport> viewports(std::size_t count) {
+		auto& dyn = *change().dynamic;
+		dyn.viewports = copyEnsureSizeUndef(alloc, dyn.viewports, count);
+		return dyn.viewports;
+	}
+
+	GraphicsState& writable() { return change(); }
+	const GraphicsState& capture() { return *state; }
+};
+
+// Mirrors the CommandBuffer::writable* functions
+struct CowBuilder {
+	LinAllocator& alloc;
+	GraphicsState* state {};
+	u32 shared {};
+
+	span<BoundDescriptorSet> descriptorSets(std::size_t count) {
+		auto& gs = writable();
+		return writableChunk(alloc, gs.descriptorSets, shared,
+			stateChunkDescriptorSets, count);
+	}
+
+	span<BoundVertexBuffer> vertexBuffers(std::size_t count) {
+		auto& gs = writable();
+		return writableChunk(alloc, gs.vertices, shared,
+			stateChunkVertexBuffers, count);
+	}
+
+	span<VkViewport> viewports(std::size_t count) {
+		auto& gs = writable();
+		auto& dyn = writableChunk(alloc, gs.dynamic, shared, stateChunkDynamic);
+		return writableChunk(alloc, dyn.viewports, shared,
+			stateChunkViewports, count);
+	}
+
+	GraphicsState& writable() {
+		return writableChunk(alloc, state, shared, stateChunkState);
+	}
+
+	const GraphicsState& capture() {
+		shared = stateChunkAll;
+		return *state;
+	}
+};
+
+// Typical scene: pipeline and global descriptors change rarely,
+// per-object descriptors, vertex and index buffers for every draw.
+template<typename Builder>
+const GraphicsState* record(Builder& builder, u64& checksum) {
+	const GraphicsState* last {};
+	for(auto i = 0u; i < numDraws; ++i) {
+		if(i % 64 == 0u) {
+			builder.writable().pipe = fakePipe(i / 64);
+
+			auto vps = builder.viewports(1u);
+			vps[0] = {0.f, 0.f, 1920.f, 1080.f, 0.f, 1.f};
+
+			auto sets = builder.descriptorSets(2u);
+			sets[0] = {};
+			sets[0].dsID = i;
+		}
+
+		auto sets = builder.descriptorSets(2u);
+		sets[1] = {};
+		sets[1].dsID = i;
+
+		auto vbs = builder.vertexBuffers(2u);
+		vbs[0] = {fakeBuffer(2 * i), 0u, 0u, 0u};
+		vbs[1] = {fakeBuffer(2 * i + 1), 64u, 0u, 0u};
+
+		auto& gs = builder.writable();
+		gs.indices.buffer = fakeBuffer(i);
+		gs.indices.offset = 16u * i;
+
+		// draw
+		last = &builder.capture();
+		checksum += last->descriptorSets[1].dsID + last->vertices[1].offset +
+			last->indices.offset;
+	}
+
+	return last;
+}
+
+template<typename Builder>
+void initState(Builder& builder, LinAllocator& alloc) {
+	builder.state = &construct<GraphicsState>(alloc);
+	builder.state->dynamic = &construct<GraphicsDynamicState>(alloc);
+}
+
+} // anon namespace
+
+TEST(bench_graphicsState_draws) {
+	LinAllocator alloc;
+
+	auto oldSum = u64(0u);
+	auto oldMem = std::size_t(0u);
+	auto oldMs = measureMs([&]{
+		for(auto r = 0u; r < numRecords; ++r) {
+			alloc.reset();
+			FullCopyBuilder builder {alloc};
+			initState(builder, alloc);
+			record(builder, oldSum);
+			oldMem = alloc.usedSize();
+		}
+	});
+
+	auto newSum = u64(0u);
+	auto newMem = std::size_t(0u);
+	auto newMs = measureMs([&]{
+		for(auto r = 0u; r < numRecords; ++r) {
+			alloc.reset();
+			CowBuilder builder {alloc};
+			initState(builder, alloc);
+			auto& last = *record(builder, newSum);
+			newMem = alloc.usedSize();
+
+			// sanity check of the final state
+			EXPECT(last.pipe, fakePipe((numDraws - 1) / 64));
+			EXPECT(last.dynamic->viewports.size(), 1u);
+		}
+	});
+
+	EXPECT(oldSum, newSum);
+
+	dlg_info("graphics state, {} draws: full copy {} ms ({} KiB), "
+		"copy-on-write {} ms ({} KiB)", numDraws,
+		oldMs / numRecords, oldMem / 1024,
+		newMs / numRecords, newMem / 1024);
+}
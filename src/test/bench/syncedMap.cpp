@@ -0,0 +1,123 @@
+// Compares handle lookups from many threads at once in a map guarded
+// by a single shared mutex (how SyncedUnorderedMap worked previously,
+// with the device mutex) with the sharded SyncedUnorderedMap.
+// Mirrors many threads recording CmdBind* or updating descriptors.
+// Run via 'viltest bench_' or 'meson test --benchmark'.
+
+#include "../bugged.hpp"
+#include <util/syncedMap.hpp>
+#include <util/dlg.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+constexpr auto numHandles = 16 * 1024u;
+constexpr auto numThreads = 8u;
+constexpr auto lookupsPerThread = 500 * 1000u;
+
+struct FakeHandle {
+	u64 data[4] {};
+};
+
+// Handles look like pointers, we don't want the keys to be consecutive
+u64 fakeKey(u32 id) {
+	return 0x100000u + 0x40u * u64(id);
+}
+
+// How SyncedUnorderedMap worked before, every lookup locks the
+// same mutex.
+struct SingleLockMap {
+	DebugSharedMutex mutex;
+	std::unordered_map<u64, std::unique_ptr<FakeHandle>> inner;
+
+	FakeHandle* find(u64 key) {
+		std::shared_lock lock(mutex);
+		auto it = inner.find(key);
+		return it == inner.end() ? nullptr : it->second.get();
+	}
+};
+
+// Runs the given lookup function on numThreads threads at the same time.
+// Returns the number of handles found.
+template<typename F>
+u64 runThreads(F&& find) {
+	std::atomic<bool> start {};
+	std::atomic<u64> found {};
+
+	std::vector<std::thread> threads;
+	for(auto t = 0u; t < numThreads; ++t) {
+		threads.emplace_back([&, t]{
+			while(!start.load(std::memory_order_acquire)) {
+				std::this_thread::yield();
+			}
+
+			// simple lcg to get a different access pattern per thread
+			auto state = u32(t * 7919u + 1u);
+			auto count = u64(0u);
+			for(auto i = 0u; i < lookupsPerThread; ++i) {
+				state = state * 1664525u + 1013904223u;
+				count += (find(fakeKey(state % numHandles)) != nullptr);
+			}
+
+			found.fetch_add(count, std::memory_order_relaxed);
+		});
+	}
+
+	start.store(true, std::memory_order_release);
+	for(auto& thread : threads) {
+		thread.join();
+	}
+
+	return found.load();
+}
+
+template<typename F>
+double measureMs(F&& func) {
+	using Clock = std::chrono::steady_clock;
+	auto start = Clock::now();
+	func();
+	auto diff = Clock::now() - start;
+	return std::chrono::duration<double, std::milli>(diff).count();
+}
+
+} // anon namespace
+
+TEST(bench_syncedMap_lookup) {
+	constexpr auto expected = u64(numThreads) * lookupsPerThread;
+
+	SingleLockMap oldMap;
+	for(auto i = 0u; i < numHandles; ++i) {
+		oldMap.inner.emplace(fakeKey(i), std::make_unique<FakeHandle>());
+	}
+
+	auto oldFound = u64(0u);
+	auto oldMs = measureMs([&]{
+		oldFound = runThreads([&](u64 key) { return oldMap.find(key); });
+	});
+	EXPECT(oldFound, expected);
+
+	TracySharedLockable(DebugSharedMutex, devMutex);
+	SyncedUniqueUnorderedMap<u64, FakeHandle> newMap;
+	newMap.mutex = &devMutex;
+	for(auto i = 0u; i < numHandles; ++i) {
+		newMap.add(fakeKey(i));
+	}
+
+	auto newFound = u64(0u);
+	auto newMs = measureMs([&]{
+		newFound = runThreads([&](u64 key) { return newMap.find(key); });
+	});
+	EXPECT(newFound, expected);
+	EXPECT(newMap.size(), std::size_t(numHandles));
+
+	dlg_info("handle lookup, {} threads x {} lookups: single lock {} ms, "
+		"{} shards {} ms", numThreads, lookupsPerThread, oldMs,
+		syncedMapShardCount, newMs);
+}
@@ -0,0 +1,252 @@
+// Compares the descriptor pool data suballocation used previously (a
+// linked list of allocations sorted by offset, walked first-fit once the
+// pool fragments) with the size-class free lists used now (TlsfAllocator).
+// Churns sets of random sizes through a long-lived, mostly full pool.
+// Run via 'viltest bench_' or 'meson test --benchmark'.
+
+#include "../bugged.hpp"
+#include <util/tlsf.hpp>
+#include <util/dlg.hpp>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+constexpr auto maxSets = 8 * 1024u;
+constexpr auto minSetSize = 64u;
+constexpr auto maxSetSize = 2048u;
+constexpr auto numOps = 200 * 1000u;
+
+template<typename F>
+double measureMs(F&& func) {
+	using Clock = std::chrono::steady_clock;
+	auto start = Clock::now();
+	func();
+	auto diff = Clock::now() - start;
+	return std::chrono::duration<double, std::milli>(diff).count();
+}
+
+// The previous DescriptorPool allocation scheme, see findEntry in
+// ds.cpp before it used TlsfAllocator.
+struct SortedListAllocator {
+	struct Entry {
+		u32 offset {};
+		u32 size {};
+		Entry* next {};
+		Entry* prev {};
+	};
+
+	u32 dataSize {};
+	std::unique_ptr<Entry[]> entries;
+	Entry* usedEntries {};
+	Entry* highestEntry {};
+	Entry* lastEntry {};
+	Entry* freeEntries {};
+
+	void init(u32 size, u32 count) {
+		dataSize = size;
+		entries = std::make_unique<Entry[]>(count);
+		for(auto i = 0u; i + 1 < count; ++i) {
+			entries[i].next = &entries[i + 1];
+		}
+		freeEntries = &entries[0];
+	}
+
+	Entry* alloc(u32 memSize) {
+		if(!freeEntries) {
+			return nullptr;
+		}
+
+		auto highestOffset = 0u;
+		if(highestEntry) {
+			highestOffset = highestEntry->offset + highestEntry->size;
+		}
+
+		if(highestOffset + memSize <= dataSize) {
+			auto& entry = *freeEntries;
+			freeEntries = entry.next;
+			if(highestEntry) {
+				highestEntry->next = &entry;
+			} else {
+				usedEntries = &entry;
+			}
+
+			entry.offset = highestOffset;
+			entry.size = memSize;
+			entry.next = nullptr;
+			entry.prev = highestEntry;
+			highestEntry = &entry;
+			return &entry;
+		}
+
+		auto offset = 0u;
+		auto it = lastEntry;
+		if(it) {
+			auto nextOff = it->next ? it->next->offset : dataSize;
+			offset = it->offset + it->size;
+			it = (offset + memSize <= nextOff) ? it->next : nullptr;
+		}
+
+		if(!it) {
+			offset = 0u;
+			it = usedEntries;
+			while(it) {
+				if(offset + memSize <= it->offset) {
+					break;
+				}
+				offset = it->offset + it->size;
+				it = it->next;
+			}
+		}
+
+		if(offset + memSize > dataSize || !it) {
+			return nullptr;
+		}
+
+		auto& entry = *freeEntries;
+		freeEntries = entry.next;
+		entry.offset = offset;
+		entry.size = memSize;
+		entry.prev = it->prev;
+		entry.next = it;
+		if(it->prev) {
+			it->prev->next = &entry;
+		} else {
+			usedEntries = &entry;
+		}
+
+		it->prev = &entry;
+		lastEntry = &entry;
+		return &entry;
+	}
+
+	void free(Entry* entry) {
+		if(entry->next) {
+			entry->next->prev = entry->prev;
+		} else {
+			highestEntry = entry->prev;
+		}
+
+		if(entry->prev) {
+			entry->prev->next = entry->next;
+		} else {
+			usedEntries = entry->next;
+		}
+
+		if(entry == lastEntry) {
+			lastEntry = entry->prev;
+		}
+
+		entry->next = freeEntries;
+		entry->prev = nullptr;
+		freeEntries = entry;
+	}
+};
+
+struct Op {
+	bool alloc;
+	u32 size; // for alloc
+	u32 slot; // for free, index into the alive list
+};
+
+// Pre-generates the operations so that both allocators do the same
+// work. Fills the pool to ~75% first, then alternates between
+// randomly freeing and allocating sets.
+std::vector<Op> generateOps() {
+	std::mt19937 rng(7u);
+	std::uniform_int_distribution<u32> sizeDist(minSetSize / 8u, maxSetSize / 8u);
+
+	std::vector<Op> ops;
+	auto alive = 0u;
+	for(auto i = 0u; i < (3 * maxSets) / 4; ++i) {
+		ops.push_back({true, 8u * sizeDist(rng), 0u});
+		++alive;
+	}
+
+	for(auto i = 0u; i < numOps; ++i) {
+		if(alive > 0u && (rng() % 2u == 0u || alive == maxSets)) {
+			ops.push_back({false, 0u, u32(rng() % alive)});
+			--alive;
+		} else {
+			ops.push_back({true, 8u * sizeDist(rng), 0u});
+			++alive;
+		}
+	}
+
+	return ops;
+}
+
+template<typename Handle, typename Alloc, typename Free>
+u32 run(const std::vector<Op>& ops, Alloc&& alloc, Free&& free) {
+	std::vector<Handle> alive;
+	alive.reserve(maxSets);
+	auto failed = 0u;
+
+	for(auto& op : ops) {
+		if(op.alloc) {
+			Handle handle;
+			if(alloc(op.size, handle)) {
+				alive.push_back(handle);
+			} else {
+				++failed;
+			}
+		} else if(!alive.empty()) {
+			auto slot = op.slot % alive.size();
+			free(alive[slot]);
+			alive[slot] = alive.back();
+			alive.pop_back();
+		}
+	}
+
+	for(auto& handle : alive) {
+		free(handle);
+	}
+
+	return failed;
+}
+
+} // anon namespace
+
+TEST(bench_tlsf_churn) {
+	auto ops = generateOps();
+
+	// average set size * maxSets, like the pool size computation
+	constexpr auto poolSize = maxSets * ((minSetSize + maxSetSize) / 2u);
+
+	SortedListAllocator oldAlloc;
+	oldAlloc.init(poolSize, maxSets);
+
+	auto oldFailed = 0u;
+	auto oldMs = measureMs([&]{
+		using Entry = SortedListAllocator::Entry;
+		oldFailed = run<Entry*>(ops, [&](u32 size, Entry*& entry) {
+			entry = oldAlloc.alloc(size);
+			return entry != nullptr;
+		}, [&](Entry* entry) {
+			oldAlloc.free(entry);
+		});
+	});
+
+	TlsfAllocator newAlloc;
+	newAlloc.init(poolSize, maxSets);
+
+	auto newFailed = 0u;
+	auto newMs = measureMs([&]{
+		newFailed = run<u32>(ops, [&](u32 size, u32& block) {
+			block = newAlloc.alloc(size).block;
+			return block != TlsfAllocator::invalid;
+		}, [&](u32 block) {
+			newAlloc.free(block);
+		});
+	});
+
+	// everything was freed again
+	EXPECT(newAlloc.freeSize(), newAlloc.size());
+
+	dlg_info("descriptor pool churn, {} ops: sorted list {} ms ({} failed), "
+		"tlsf {} ms ({} failed)", ops.size(), oldMs, oldFailed, newMs, newFailed);
+}
@@ -0,0 +1,182 @@
+// Compares the insert throughput of the set used for
+// CommandRecord::UsedHandles (FlatPtrSet) with the previously used
+// node-based std::unordered_set on a linear allocator.
+// Run via 'viltest bench_' or 'meson test --benchmark'.
+
+#include "../bugged.hpp"
+#include <util/flatSet.hpp>
+#include <util/linalloc.hpp>
+#include <util/dlg.hpp>
+#include <unordered_set>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+struct FakeHandle {
+	u64 data[4] {};
+};
+
+// Mirrors RefHandle, without the reference counting
+struct Use {
+	FakeHandle* handle {};
+};
+
+struct UseKey {
+	const void* operator()(const Use& use) const { return use.handle; }
+};
+
+struct UseHash {
+	std::size_t operator()(const Use& use) const {
+		return std::hash<FakeHandle*>{}(use.handle);
+	}
+};
+
+inline bool operator==(const Use& a, const Use& b) {
+	return a.handle == b.handle;
+}
+
+using OldSet = std::unordered_set<Use, UseHash, std::equal_to<Use>,
+	LinearUnscopedAllocator<Use>>;
+using NewSet = FlatPtrSet<Use, UseKey>;
+
+// Typical record: a few hundred distinct handles, used many times
+constexpr auto numHandles = 256u;
+constexpr auto numUses = 16 * 1024u;
+constexpr auto numRecords = 64u;
+
+std::vector<u32> generateUses() {
+	std::vector<u32> ret(numUses);
+	auto state = u32(12345u);
+	for(auto& id : ret) {
+		// simple LCG, deterministic
+		state = state * 1664525u + 1013904223u;
+		id = (state >> 8u) % numHandles;
+	}
+
+	return ret;
+}
+
+template<typename F>
+double measureMs(F&& func) {
+	using Clock = std::chrono::steady_clock;
+	auto start = Clock::now();
+	func();
+	auto diff = Clock::now() - start;
+	return std::chrono::duration<double, std::milli>(diff).count();
+}
+
+void useOld(OldSet& set, FakeHandle& handle) {
+	// like the previous find(): build a temporary element for lookup
+	Use tmp {&handle};
+	auto it = set.find(tmp);
+	if(it == set.end()) {
+		set.insert(tmp);
+	}
+}
+
+void useNew(NewSet& set, FakeHandle& handle) {
+	(void) set.findOrInsert(&handle, [&]{ return Use{&handle}; });
+}
+
+} // anon namespace
+
+TEST(bench_usedHandles_insert) {
+	std::vector<FakeHandle> handles(numHandles);
+	auto uses = generateUses();
+
+	LinAllocator alloc;
+	auto oldSize = std::size_t(0u);
+	auto oldMs = measureMs([&]{
+		for(auto r = 0u; r < numRecords; ++r) {
+			alloc.reset();
+			OldSet set(alloc);
+			for(auto id : uses) {
+				useOld(set, handles[id]);
+			}
+
+			oldSize = set.size();
+		}
+	});
+
+	auto newSize = std::size_t(0u);
+	auto newMs = measureMs([&]{
+		for(auto r = 0u; r < numRecords; ++r) {
+			alloc.reset();
+			NewSet set(alloc);
+			for(auto id : uses) {
+				useNew(set, handles[id]);
+			}
+
+			newSize = set.size();
+		}
+	});
+
+	EXPECT(oldSize, newSize);
+
+	auto total = double(numRecords * numUses);
+	dlg_info("used handles insert: unordered_set {} ms ({} ns/use), "
+		"FlatPtrSet {} ms ({} ns/use)", oldMs, 1000 * 1000 * oldMs / total,
+		newMs, 1000 * 1000 * newMs / total);
+}
+
+TEST(bench_usedHandles_merge) {
+	// merging the used handles of secondary records into a primary one,
+	// as done by CmdExecuteCommands
+	constexpr auto numSecondaries = 16u;
+
+	std::vector<FakeHandle> handles(numHandles);
+	auto uses = generateUses();
+
+	LinAllocator srcAlloc;
+	std::vector<std::unique_ptr<OldSet>> oldSrcs;
+	std::vector<std::unique_ptr<NewSet>> newSrcs;
+	for(auto s = 0u; s < numSecondaries; ++s) {
+		auto& oldSet = *oldSrcs.emplace_back(std::make_unique<OldSet>(srcAlloc));
+		auto& newSet = *newSrcs.emplace_back(std::make_unique<NewSet>(srcAlloc));
+		for(auto i = 0u; i < numUses / numSecondaries; ++i) {
+			auto id = uses[s * (numUses / numSecondaries) + i];
+			useOld(oldSet, handles[id]);
+			useNew(newSet, handles[id]);
+		}
+	}
+
+	LinAllocator alloc;
+	auto oldSize = std::size_t(0u);
+	auto oldMs = measureMs([&]{
+		for(auto r = 0u; r < numRecords; ++r) {
+			alloc.reset();
+			OldSet set(alloc);
+			for(auto& src : oldSrcs) {
+				for(auto& use : *src) {
+					useOld(set, *use.handle);
+				}
+			}
+
+			oldSize = set.size();
+		}
+	});
+
+	auto newSize = std::size_t(0u);
+	auto newMs = measureMs([&]{
+		for(auto r = 0u; r < numRecords; ++r) {
+			alloc.reset();
+			NewSet set(alloc);
+			for(auto& src : newSrcs) {
+				for(auto& use : *src) {
+					useNew(set, *use.handle);
+				}
+			}
+
+			newSize = set.size();
+		}
+	});
+
+	EXPECT(oldSize, newSize);
+
+	dlg_info("used handles merge: unordered_set {} ms, FlatPtrSet {} ms",
+		oldMs, newMs);
+}
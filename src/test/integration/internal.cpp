@@ -12,13 +12,19 @@
 #include <layer.hpp>
 #include <sync.hpp>
 #include <image.hpp>
+#include <buffer.hpp>
 #include <queue.hpp>
 #include <cb.hpp>
 #include <ds.hpp>
 #include <rp.hpp>
+#include <pipe.hpp>
+#include <stats.hpp>
 #include <vkutil/enumString.hpp>
 #include "./internal.hpp"
 #include "../data/simple.comp.spv.h" // see simple.comp; compiled manually
+#include "../data/a.vert.spv.h" // see a.vert; compiled manually
+#include <chrono>
+#include <thread>
 
 using namespace tut;
 
@@ -274,26 +280,10 @@ TEST(int_secondary_cb) {
 	DestroyCommandPool(setup.dev, cmdPool, nullptr);
 }
 
-TEST(int_copy_transfer) {
-	auto& stp = gSetup;
-
-	// setup texture
-	auto tc = TextureCreation();
-	auto tex0 = Texture(stp, tc);
-	auto tex1 = Texture(stp, tc);
-
-	// setup command pool & buffer
-	VkCommandPool cmdPool = setupCommandPool();
-	VkCommandBuffer cb = allocCommandBuffer(cmdPool);
-
-	auto& vilCB = unwrap(cb);
-	dlg_assert(vilCB.state() == CommandBuffer::State::initial);
-
-	// record commands
-	VkCommandBufferBeginInfo cbi {};
-	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	VK_CHECK(BeginCommandBuffer(cb, &cbi));
-
+// Records a copy from 'src' to 'dst', with the barriers that
+// transition them into the transfer layouts.
+void recordImageCopy(VkCommandBuffer cb, Texture& src, Texture& dst,
+		const TextureCreation& tc) {
 	// barrier
 	VkImageMemoryBarrier imgBarriers[2] {};
 
@@ -304,7 +294,7 @@ TEST(int_copy_transfer) {
 	imgBarriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	imgBarriers[0].subresourceRange.layerCount = 1u;
 	imgBarriers[0].subresourceRange.levelCount = 1u;
-	imgBarriers[0].image = tex0.image;
+	imgBarriers[0].image = src.image;
 
 	imgBarriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	imgBarriers[1].dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
@@ -313,7 +303,7 @@ TEST(int_copy_transfer) {
 	imgBarriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	imgBarriers[1].subresourceRange.layerCount = 1u;
 	imgBarriers[1].subresourceRange.levelCount = 1u;
-	imgBarriers[1].image = tex1.image;
+	imgBarriers[1].image = dst.image;
 
 	CmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
 		VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0u, nullptr, 0u, nullptr,
@@ -326,8 +316,31 @@ TEST(int_copy_transfer) {
 	region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	region.dstSubresource.layerCount = 1u;
 	region.extent = tc.ici.extent;
-	CmdCopyImage(cb, tex0.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		tex1.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
+	CmdCopyImage(cb, src.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		dst.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
+}
+
+TEST(int_copy_transfer) {
+	auto& stp = gSetup;
+
+	// setup texture
+	auto tc = TextureCreation();
+	auto tex0 = Texture(stp, tc);
+	auto tex1 = Texture(stp, tc);
+
+	// setup command pool & buffer
+	VkCommandPool cmdPool = setupCommandPool();
+	VkCommandBuffer cb = allocCommandBuffer(cmdPool);
+
+	auto& vilCB = unwrap(cb);
+	dlg_assert(vilCB.state() == CommandBuffer::State::initial);
+
+	// record commands
+	VkCommandBufferBeginInfo cbi {};
+	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	VK_CHECK(BeginCommandBuffer(cb, &cbi));
+
+	recordImageCopy(cb, tex0, tex1, tc);
 
 	EndCommandBuffer(cb);
 	dlg_assert(vilCB.state() == CommandBuffer::State::executable);
@@ -767,6 +780,610 @@ TEST(int_submission_activation_timeline_semaphore) {
 	DestroySemaphore(stp.dev, semaphores[1], nullptr);
 }
 
+// Submissions are retired by the completion thread as soon as they
+// complete. Waiting on a timeline semaphore doesn't retire anything in
+// the layer, so the application doesn't have to call into it again to
+// get hook results. See CompletionTracker.
+TEST(int_completion_thread) {
+	auto& stp = gSetup;
+	auto& vilDev = *stp.vilDev;
+	if(!vilDev.timelineSemaphores || !vilDev.completion.running()) {
+		dlg_info("Completion thread not running, skipping");
+		return;
+	}
+
+	auto tc = TextureCreation();
+	auto tex0 = Texture(stp, tc);
+	auto tex1 = Texture(stp, tc);
+
+	VkCommandPool cmdPool = setupCommandPool();
+	VkCommandBuffer cb = allocCommandBuffer(cmdPool);
+	auto& vilCB = unwrap(cb);
+
+	VkCommandBufferBeginInfo cbi {};
+	cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	VK_CHECK(BeginCommandBuffer(cb, &cbi));
+	recordImageCopy(cb, tex0, tex1, tc);
+	VK_CHECK(EndCommandBuffer(cb));
+
+	// hook the copy
+	auto& rec = *vilCB.lastRecordPtr();
+	auto* dst = rec.commands->children_->next;
+	dlg_assert(dynamic_cast<CopyImageCmd*>(dst));
+
+	CommandHookUpdate update {};
+	update.invalidate = true;
+	auto& ops = update.newOps.emplace();
+	ops.copyTransferSrcBefore = true;
+
+	auto& target = update.newTarget.emplace();
+	target.type = CommandHookTargetType::all;
+	target.record = vilCB.lastRecordPtr();
+	target.command = {rec.commands, dst};
+
+	vilDev.commandHook->updateHook(std::move(update));
+	vilDev.commandHook->forceHook.store(true);
+
+	// submit, signaling an application timeline semaphore
+	VkSemaphoreTypeCreateInfo stci {};
+	stci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	stci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+
+	VkSemaphoreCreateInfo sci {};
+	sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	sci.pNext = &stci;
+
+	VkSemaphore semaphore;
+	VK_CHECK(CreateSemaphore(stp.dev, &sci, nullptr, &semaphore));
+
+	const u64 signalValue = 1u;
+	VkTimelineSemaphoreSubmitInfo tssi {};
+	tssi.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	tssi.signalSemaphoreValueCount = 1u;
+	tssi.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo si {};
+	si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	si.pNext = &tssi;
+	si.commandBufferCount = 1u;
+	si.pCommandBuffers = &cb;
+	si.signalSemaphoreCount = 1u;
+	si.pSignalSemaphores = &semaphore;
+	VK_CHECK(QueueSubmit(stp.queue, 1u, &si, VK_NULL_HANDLE));
+
+	VkSemaphoreWaitInfo swi {};
+	swi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	swi.semaphoreCount = 1u;
+	swi.pSemaphores = &semaphore;
+	swi.pValues = &signalValue;
+	VK_CHECK(WaitSemaphores(stp.dev, &swi, UINT64_MAX));
+
+	// Give the thread a couple of its wait intervals to notice
+	auto drained = false;
+	auto deadline = std::chrono::steady_clock::now() +
+		50 * CompletionTracker::maxWait;
+	while(!drained && std::chrono::steady_clock::now() < deadline) {
+		{
+			std::lock_guard devLock(vilDev.mutex);
+			drained = vilDev.pending.empty();
+		}
+
+		if(!drained) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	EXPECT(drained, true);
+
+	auto completed = vilDev.commandHook->moveCompleted();
+	EXPECT(completed.size(), 1u);
+	if(!completed.empty()) {
+		EXPECT(completed[0].command.back() == dst, true);
+		EXPECT(completed[0].state->transferSrcBefore.img.image != VK_NULL_HANDLE, true);
+	}
+
+	// cleanup
+	DestroySemaphore(stp.dev, semaphore, nullptr);
+	DestroyCommandPool(stp.dev, cmdPool, nullptr);
+}
+
+// Hook records of structurally identical records reuse the resources of
+// the previous one. Captured state must never leak into the next capture.
+TEST(int_hook_reuse_vertex_buffers) {
+	auto& stp = gSetup;
+	auto& vilDev = *stp.vilDev;
+
+	// setup render pass
+	auto tc = TextureCreation();
+	auto tex = Texture(stp, tc);
+
+	auto passes = {0u};
+	auto rpi = renderPassInfo({{tc.ici.format}}, {{passes}});
+	VkRenderPass rp;
+	VK_CHECK(CreateRenderPass(stp.dev, &rpi.info(), nullptr, &rp));
+
+	VkFramebufferCreateInfo fbi = {};
+	fbi.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	fbi.attachmentCount = 1;
+	fbi.pAttachments = &tex.imageView;
+	fbi.renderPass = rp;
+	fbi.width = tc.ici.extent.width;
+	fbi.height = tc.ici.extent.height;
+	fbi.layers = 1;
+	VkFramebuffer fb;
+	VK_CHECK(CreateFramebuffer(stp.dev, &fbi, nullptr, &fb));
+
+	// setup pipe with two vertex bindings, no attributes needed
+	VkPipelineLayoutCreateInfo plci {};
+	plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	VkPipelineLayout pipeLayout;
+	VK_CHECK(CreatePipelineLayout(stp.dev, &plci, nullptr, &pipeLayout));
+
+	VkShaderModuleCreateInfo smci {};
+	smci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	smci.codeSize = sizeof(a_vert_spv_data);
+	smci.pCode = a_vert_spv_data;
+	VkShaderModule mod;
+	VK_CHECK(CreateShaderModule(stp.dev, &smci, nullptr, &mod));
+
+	VkPipelineShaderStageCreateInfo stage {};
+	stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stage.module = mod;
+	stage.pName = "main";
+
+	VkVertexInputBindingDescription vertBindings[2] {};
+	vertBindings[0] = {0u, 16u, VK_VERTEX_INPUT_RATE_VERTEX};
+	vertBindings[1] = {1u, 16u, VK_VERTEX_INPUT_RATE_VERTEX};
+
+	VkPipelineVertexInputStateCreateInfo vertInput {};
+	vertInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertInput.vertexBindingDescriptionCount = 2u;
+	vertInput.pVertexBindingDescriptions = vertBindings;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+
+	VkViewport viewport {0.f, 0.f, float(fbi.width), float(fbi.height), 0.f, 1.f};
+	VkRect2D scissor {{0, 0}, {fbi.width, fbi.height}};
+	VkPipelineViewportStateCreateInfo viewportState {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1u;
+	viewportState.pViewports = &viewport;
+	viewportState.scissorCount = 1u;
+	viewportState.pScissors = &scissor;
+
+	VkPipelineRasterizationStateCreateInfo rasterization {};
+	rasterization.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterization.rasterizerDiscardEnable = VK_TRUE;
+	rasterization.lineWidth = 1.f;
+
+	VkPipelineMultisampleStateCreateInfo multisample {};
+	multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState blendAttachment {};
+	blendAttachment.colorWriteMask = 0xFu;
+	VkPipelineColorBlendStateCreateInfo blend {};
+	blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blend.attachmentCount = 1u;
+	blend.pAttachments = &blendAttachment;
+
+	VkGraphicsPipelineCreateInfo gpi {};
+	gpi.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	gpi.stageCount = 1u;
+	gpi.pStages = &stage;
+	gpi.pVertexInputState = &vertInput;
+	gpi.pInputAssemblyState = &inputAssembly;
+	gpi.pViewportState = &viewportState;
+	gpi.pRasterizationState = &rasterization;
+	gpi.pMultisampleState = &multisample;
+	gpi.pColorBlendState = &blend;
+	gpi.layout = pipeLayout;
+	gpi.renderPass = rp;
+	VkPipeline pipe;
+	VK_CHECK(CreateGraphicsPipelines(stp.dev, {}, 1u, &gpi, nullptr, &pipe));
+	DestroyShaderModule(stp.dev, mod, nullptr);
+
+	auto usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	auto vbuf0 = tut::Buffer(stp, 256u, usage);
+	auto vbuf1 = tut::Buffer(stp, 512u, usage);
+
+	VkCommandPool cmdPool = setupCommandPool();
+	VkCommandBuffer cb = allocCommandBuffer(cmdPool);
+	auto& vilCB = unwrap(cb);
+
+	// Records a draw with the given number of vertex buffers bound and
+	// returns the draw command hierarchy.
+	auto record = [&](u32 vertexBufferCount) {
+		VkCommandBufferBeginInfo cbi {};
+		cbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		VK_CHECK(BeginCommandBuffer(cb, &cbi));
+
+		VkClearValue clearValue {};
+		VkRenderPassBeginInfo rbi {};
+		rbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		rbi.renderPass = rp;
+		rbi.renderArea.extent.width = fbi.width;
+		rbi.renderArea.extent.height = fbi.height;
+		rbi.clearValueCount = 1u;
+		rbi.pClearValues = &clearValue;
+		rbi.framebuffer = fb;
+
+		VkBuffer vbufs[] = {vbuf0.buffer, vbuf1.buffer};
+		VkDeviceSize offsets[] = {0u, 0u};
+
+		CmdBeginRenderPass(cb, &rbi, VK_SUBPASS_CONTENTS_INLINE);
+		CmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe);
+		CmdBindVertexBuffers(cb, 0u, vertexBufferCount, vbufs, offsets);
+		CmdDraw(cb, 1u, 1u, 0u, 0u);
+		CmdEndRenderPass(cb);
+		EndCommandBuffer(cb);
+
+		auto& rec = *vilCB.lastRecordPtr();
+		auto* rpCmd = rec.commands->children();
+		auto* subpassCmd = rpCmd->children();
+		auto* drawCmd = subpassCmd->children()->next->next;
+		dlg_assert(dynamic_cast<DrawCmd*>(drawCmd));
+
+		return std::vector<const Command*>{rec.commands, rpCmd, subpassCmd, drawCmd};
+	};
+
+	auto capture = [&]() {
+		VkSubmitInfo si {};
+		si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		si.commandBufferCount = 1u;
+		si.pCommandBuffers = &cb;
+		QueueSubmit(stp.queue, 1u, &si, VK_NULL_HANDLE);
+		DeviceWaitIdle(stp.dev);
+
+		auto completed = vilDev.commandHook->moveCompleted();
+		dlg_assert(completed.size() == 1u);
+		return std::move(completed[0].state);
+	};
+
+	// first capture, two vertex buffers
+	auto hcommand = record(2u);
+
+	CommandHookUpdate update {};
+	update.invalidate = true;
+	auto& ops = update.newOps.emplace();
+	ops.copyVertexBuffers = true;
+
+	auto& target = update.newTarget.emplace();
+	target.type = CommandHookTargetType::all;
+	target.record = vilCB.lastRecordPtr();
+	target.command = hcommand;
+
+	vilDev.commandHook->updateHook(std::move(update));
+	vilDev.commandHook->forceHook.store(true);
+
+	VkBuffer firstCopy {};
+	{
+		auto state = capture();
+		EXPECT(state->vertexBufCopies.size(), 2u);
+		EXPECT(state->vertexBufCopies[0].size, 256u);
+		EXPECT(state->vertexBufCopies[1].size, 512u);
+		firstCopy = state->vertexBufCopies[0].buf;
+		// only the hook record references the state now
+	}
+
+	// Re-recording destroys the previous hook record. The new record is
+	// structurally identical (bound vertex buffers are not part of the
+	// fingerprint), its hook record reuses the resources.
+	auto reusedBefore = DebugStats::get().reusedHookRecords.load();
+	auto resubmittedBefore = DebugStats::get().resubmittedHookRecords.load();
+	record(1u);
+
+	{
+		auto state = capture();
+		EXPECT(DebugStats::get().reusedHookRecords.load(), reusedBefore + 1);
+		EXPECT(state->vertexBufCopies.size(), 1u);
+		EXPECT(state->vertexBufCopies[0].size, 256u);
+		// the buffer with matching size was taken over
+		EXPECT(state->vertexBufCopies[0].buf == firstCopy, true);
+		EXPECT(state->indexBufCopy.buf == VK_NULL_HANDLE, true);
+		EXPECT(state->neededTime, u64(-1));
+	}
+
+	record(2u);
+
+	{
+		auto state = capture();
+		EXPECT(DebugStats::get().reusedHookRecords.load(), reusedBefore + 2);
+		// different vertex buffers bound, had to be recorded again
+		EXPECT(DebugStats::get().resubmittedHookRecords.load(), resubmittedBefore);
+		EXPECT(state->vertexBufCopies.size(), 2u);
+		EXPECT(state->vertexBufCopies[0].size, 256u);
+		EXPECT(state->vertexBufCopies[1].size, 512u);
+		firstCopy = state->vertexBufCopies[1].buf;
+	}
+
+	// Exactly the same commands and handles as the previous record,
+	// the hooked command buffer is resubmitted without recording it.
+	record(2u);
+
+	{
+		auto state = capture();
+		EXPECT(DebugStats::get().reusedHookRecords.load(), reusedBefore + 3);
+		EXPECT(DebugStats::get().resubmittedHookRecords.load(), resubmittedBefore + 1);
+		EXPECT(state->vertexBufCopies.size(), 2u);
+		EXPECT(state->vertexBufCopies[1].size, 512u);
+		EXPECT(state->vertexBufCopies[1].buf == firstCopy, true);
+	}
+
+	// cleanup
+	DestroyCommandPool(stp.dev, cmdPool, nullptr);
+	DestroyPipeline(stp.dev, pipe, nullptr);
+	DestroyPipelineLayout(stp.dev, pipeLayout, nullptr);
+	DestroyFramebuffer(stp.dev, fb, nullptr);
+	DestroyRenderPass(stp.dev, rp, nullptr);
+}
+
+TEST(int_ds_cow_partial) {
+	auto& stp = gSetup;
+	auto& vilDev = *stp.vilDev;
+
+	// binding 0 spans multiple chunks, see DescriptorSetCow::chunkSize
+	constexpr auto arraySize = 1024u;
+	constexpr auto chunkSize = DescriptorSetCow::chunkSize;
+	constexpr auto arrayChunks = ceilDivide(arraySize * sizeof(BufferDescriptor), chunkSize);
+	static_assert(arrayChunks > 1u);
+
+	VkDescriptorPoolSize poolSize {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, arraySize + 1u};
+	VkDescriptorPoolCreateInfo dci {};
+	dci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	dci.pPoolSizes = &poolSize;
+	dci.poolSizeCount = 1u;
+	dci.maxSets = 1u;
+	VkDescriptorPool dsPool;
+	VK_CHECK(CreateDescriptorPool(stp.dev, &dci, nullptr, &dsPool));
+
+	auto bindings = std::array {
+		VkDescriptorSetLayoutBinding {0u, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			arraySize, VK_SHADER_STAGE_ALL, nullptr},
+		VkDescriptorSetLayoutBinding {1u, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			1u, VK_SHADER_STAGE_ALL, nullptr},
+	};
+
+	VkDescriptorSetLayoutCreateInfo lci {};
+	lci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	lci.bindingCount = bindings.size();
+	lci.pBindings = bindings.data();
+	VkDescriptorSetLayout dsLayout;
+	VK_CHECK(CreateDescriptorSetLayout(stp.dev, &lci, nullptr, &dsLayout));
+
+	VkDescriptorSetAllocateInfo dsai {};
+	dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsai.descriptorPool = dsPool;
+	dsai.pSetLayouts = &dsLayout;
+	dsai.descriptorSetCount = 1u;
+	VkDescriptorSet ds;
+	VK_CHECK(AllocateDescriptorSets(stp.dev, &dsai, &ds));
+	auto& vilDs = get(vilDev, ds);
+
+	auto usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	auto buf0 = tut::Buffer(stp, 1024u, usage);
+	auto buf1 = tut::Buffer(stp, 1024u, usage);
+	auto& vilBuf0 = get(vilDev, buf0.buffer);
+	auto& vilBuf1 = get(vilDev, buf1.buffer);
+
+	auto write = [&](u32 binding, u32 elem, u32 count, VkBuffer buf) {
+		std::vector<VkDescriptorBufferInfo> infos(count);
+		for(auto& info : infos) {
+			info.buffer = buf;
+			info.range = VK_WHOLE_SIZE;
+		}
+
+		VkWriteDescriptorSet w {};
+		w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w.dstSet = ds;
+		w.dstBinding = binding;
+		w.dstArrayElement = elem;
+		w.descriptorCount = count;
+		w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		w.pBufferInfo = infos.data();
+		UpdateDescriptorSets(stp.dev, 1u, &w, 0u, nullptr);
+	};
+
+	write(0u, 0u, arraySize, buf0.buffer);
+	write(1u, 0u, 1u, buf0.buffer);
+
+	IntrusivePtr<DescriptorSetCow> cow;
+	{
+		std::lock_guard devLock(vilDev.mutex);
+		auto lock = vilDs.lock();
+		cow = vilDs.addCowLocked();
+	}
+
+	// single element update of binding 0, only its chunk is copied
+	write(0u, 2u, 1u, buf1.buffer);
+
+	{
+		auto [state, lock] = access(*cow);
+		EXPECT(cow->ds, &vilDs);
+		EXPECT(cow->copiedCount, 1u);
+		EXPECT(state.cow, cow.get());
+
+		// reading the untouched binding doesn't copy anything
+		EXPECT(buffers(state, 1u)[0].buffer, &vilBuf0);
+		EXPECT(cow->copiedCount, 1u);
+
+		// reading the partially copied binding completes it.
+		// The cow still sees the old content
+		for(auto& desc : buffers(state, 0u)) {
+			EXPECT(desc.buffer, &vilBuf0);
+		}
+		EXPECT(cow->copiedCount, u32(arrayChunks));
+		EXPECT(cow->ds, &vilDs);
+	}
+
+	{
+		auto lock = vilDs.lock();
+		EXPECT(buffers(vilDs, 0u)[1].buffer, &vilBuf0);
+		EXPECT(buffers(vilDs, 0u)[2].buffer, &vilBuf1);
+	}
+
+	// updating the binding again doesn't copy anything
+	write(0u, arraySize - 1u, 1u, buf1.buffer);
+
+	{
+		auto [state, lock] = access(*cow);
+		EXPECT(cow->copiedCount, u32(arrayChunks));
+		EXPECT(buffers(state, 0u)[arraySize - 1u].buffer, &vilBuf0);
+	}
+
+	// once the last chunk is copied, the cow is independent
+	write(1u, 0u, 1u, buf1.buffer);
+
+	{
+		auto [state, lock] = access(*cow);
+		EXPECT(cow->ds == nullptr, true);
+		EXPECT(state.cow == nullptr, true);
+		EXPECT(buffers(state, 0u)[2].buffer, &vilBuf0);
+		EXPECT(buffers(state, 1u)[0].buffer, &vilBuf0);
+	}
+
+	cow.reset();
+
+	// cleanup
+	DestroyDescriptorPool(stp.dev, dsPool, nullptr);
+	DestroyDescriptorSetLayout(stp.dev, dsLayout, nullptr);
+}
+
+TEST(int_ds_journal_bounded) {
+	auto& stp = gSetup;
+	auto& vilDev = *stp.vilDev;
+
+	auto lazyBefore = vilDev.lazyDescriptors.exchange(true);
+
+	VkDescriptorPoolSize poolSize {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1u};
+	VkDescriptorPoolCreateInfo dci {};
+	dci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	dci.pPoolSizes = &poolSize;
+	dci.poolSizeCount = 1u;
+	dci.maxSets = 1u;
+	VkDescriptorPool dsPool;
+	VK_CHECK(CreateDescriptorPool(stp.dev, &dci, nullptr, &dsPool));
+
+	VkDescriptorSetLayoutBinding binding {0u, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		1u, VK_SHADER_STAGE_ALL, nullptr};
+	VkDescriptorSetLayoutCreateInfo lci {};
+	lci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	lci.bindingCount = 1u;
+	lci.pBindings = &binding;
+	VkDescriptorSetLayout dsLayout;
+	VK_CHECK(CreateDescriptorSetLayout(stp.dev, &lci, nullptr, &dsLayout));
+
+	// reset it like every frame so it's classified as transient
+	for(auto i = 0u; i < 8u; ++i) {
+		VK_CHECK(ResetDescriptorPool(stp.dev, dsPool, 0u));
+	}
+
+	auto& vilPool = get(vilDev, dsPool);
+	EXPECT(vilPool.transient, true);
+
+	VkDescriptorSetAllocateInfo dsai {};
+	dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	dsai.descriptorPool = dsPool;
+	dsai.pSetLayouts = &dsLayout;
+	dsai.descriptorSetCount = 1u;
+
+	auto usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	auto buf0 = tut::Buffer(stp, 1024u, usage);
+	auto buf1 = tut::Buffer(stp, 1024u, usage);
+
+	auto& vilBuf0 = get(vilDev, buf0.buffer);
+	auto refCountBefore = vilBuf0.refCount.load();
+
+	// The journal of a set that is reset without ever being
+	// materialized must not keep any references
+	{
+		VkDescriptorSet ds;
+		VK_CHECK(AllocateDescriptorSets(stp.dev, &dsai, &ds));
+
+		VkDescriptorBufferInfo info {buf0.buffer, 0u, VK_WHOLE_SIZE};
+		VkWriteDescriptorSet w {};
+		w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w.dstSet = ds;
+		w.descriptorCount = 1u;
+		w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		w.pBufferInfo = &info;
+		UpdateDescriptorSets(stp.dev, 1u, &w, 0u, nullptr);
+		UpdateDescriptorSets(stp.dev, 1u, &w, 0u, nullptr);
+
+		VK_CHECK(ResetDescriptorPool(stp.dev, dsPool, 0u));
+		EXPECT(vilPool.transient, true);
+		EXPECT(vilBuf0.refCount.load(), refCountBefore);
+	}
+
+	VkDescriptorSet ds;
+	VK_CHECK(AllocateDescriptorSets(stp.dev, &dsai, &ds));
+	auto& vilDs = get(vilDev, ds);
+
+	auto write = [&](u32 i) {
+		VkDescriptorBufferInfo info {};
+		info.buffer = (i % 2u) ? buf1.buffer : buf0.buffer;
+		info.range = 4u * (1u + i % 64u);
+
+		VkWriteDescriptorSet w {};
+		w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		w.dstSet = ds;
+		w.descriptorCount = 1u;
+		w.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		w.pBufferInfo = &info;
+		UpdateDescriptorSets(stp.dev, 1u, &w, 0u, nullptr);
+	};
+
+	auto checkState = [&](u32 i) {
+		std::lock_guard devLock(vilDev.mutex);
+		auto lock = vilDs.lock();
+		vilDs.materializeLocked();
+		EXPECT(vilDs.journaledLocked(), false);
+
+		auto& desc = buffers(vilDs, 0u)[0];
+		auto& expected = get(vilDev, (i % 2u) ? buf1.buffer : buf0.buffer);
+		EXPECT(desc.buffer, &expected);
+		EXPECT(desc.range, 4u * (1u + i % 64u));
+	};
+
+	// a few writes are just journaled
+	for(auto i = 0u; i < 3u; ++i) {
+		write(i);
+	}
+
+	{
+		auto lock = vilDs.lock();
+		EXPECT(vilDs.journaledLocked(), true);
+	}
+
+	checkState(2u);
+
+	// The pool is never reset again, the set just rewritten.
+	// The journal must not grow without bound.
+	constexpr auto writeCount = 10000u;
+	for(auto i = 0u; i < writeCount; ++i) {
+		write(i);
+	}
+
+	{
+		auto lock = vilDs.lock();
+		EXPECT(vilPool.transient, false);
+		EXPECT(vilPool.journalAlloc.usedSize() < 64 * 1024u, true);
+	}
+
+	checkState(writeCount - 1);
+
+	// cleanup
+	DestroyDescriptorPool(stp.dev, dsPool, nullptr);
+	DestroyDescriptorSetLayout(stp.dev, dsLayout, nullptr);
+	vilDev.lazyDescriptors.store(lazyBefore);
+
+	// neither journaled nor materialized writes leak references
+	EXPECT(vilBuf0.refCount.load(), refCountBefore);
+}
+
 // TODO: write test where we record a command buffer that executes
 // each command once. Then hook each of those commands, separately.
 
@@ -6,6 +6,7 @@
 #include <fwd.hpp>
 #include <wrap.hpp>
 #include <data.hpp>
+#include <optional>
 #include <shared_mutex>
 
 namespace vil::test {
@@ -28,14 +29,18 @@ extern InternalSetup gSetup;
 // expects to be called with.
 template<typename T, typename O>
 T undispatch(O& dst) {
-	std::shared_lock lock(dataMutex);
-	for(auto& entry : dispatchableTable) {
-		if(entry.second == &dst) {
-			return u64ToHandle<T>(entry.first);
+	std::optional<T> ret;
+	dispatchableTable.forEach([&](u64 key, void* data) {
+		if(data == &dst) {
+			ret = u64ToHandle<T>(key);
 		}
+	});
+
+	if(!ret) {
+		throw std::runtime_error("Invalid handle");
 	}
 
-	throw std::runtime_error("Invalid handle");
+	return *ret;
 }
 
 } // namespace vil::test
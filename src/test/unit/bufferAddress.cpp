@@ -1,113 +1,219 @@
 #include "../bugged.hpp"
-#include <device.hpp>
+#include <util/addressMap.hpp>
 #include <buffer.hpp>
-#include <nytl/span.hpp>
-
-namespace vil {
-
-// buffer.cpp. Internal since we don't want to pull device.hpp in buffer.hpp
-Buffer* bufferAtInternal(const decltype(Device::bufferAddresses)& bufferAddresses,
-		VkDeviceAddress address);
-} // namespace
+#include <atomic>
+#include <thread>
+#include <vector>
 
 using namespace vil;
 
-TEST(unit_cmp) {
-	auto cmp = Device::BufferAddressCmp {};
-
-	Buffer a;
-	a.deviceAddress = VkDeviceAddress(100);
-	a.ci.size = 10;
+namespace {
 
-	auto t1 = VkDeviceAddress(100);
-	EXPECT(cmp(&a, t1), false);
-	EXPECT(cmp(t1, &a), false);
-
-	auto t2 = VkDeviceAddress(99);
-	EXPECT(cmp(&a, t2), false);
-	EXPECT(cmp(t2, &a), true);
-
-	auto t3 = VkDeviceAddress(110);
-	EXPECT(cmp(&a, t3), true);
-	EXPECT(cmp(t3, &a), false);
+void add(AddressMap<Buffer>& map, Buffer& buf) {
+	map.add(buf.deviceAddress, buf.ci.size, buf);
 }
 
+} // anon namespace
+
 TEST(unit_set) {
-	decltype(Device::bufferAddresses) set;
+	AddressMap<Buffer> set;
 
 	Buffer a;
 	a.deviceAddress = VkDeviceAddress(100);
 	a.ci.size = 10;
-	set.insert(&a);
+	add(set, a);
 
 	Buffer b;
 	b.deviceAddress = VkDeviceAddress(200);
 	b.ci.size = 100;
-	set.insert(&b);
+	add(set, b);
 
-	auto buf = bufferAtInternal(set, 105);
+	auto buf = set.find(105);
 	EXPECT(buf != nullptr, true);
 	EXPECT(buf, &a);
 
-	buf = bufferAtInternal(set, 110);
+	buf = set.find(110);
 	EXPECT(buf, nullptr);
 
-	buf = bufferAtInternal(set, 0);
+	buf = set.find(0);
 	EXPECT(buf, nullptr);
 
-	buf = bufferAtInternal(set, 500);
+	buf = set.find(500);
 	EXPECT(buf, nullptr);
 
-	buf = bufferAtInternal(set, 99);
+	buf = set.find(99);
 	EXPECT(buf, nullptr);
 
-	buf = bufferAtInternal(set, 200);
+	buf = set.find(200);
 	EXPECT(buf != nullptr, true);
 	EXPECT(buf, &b);
 
-	buf = bufferAtInternal(set, 299);
+	buf = set.find(299);
 	EXPECT(buf != nullptr, true);
 	EXPECT(buf, &b);
 }
 
 // problematic case that exposed an issue with the old handling
 TEST(unit_alias) {
-	decltype(Device::bufferAddresses) set;
+	AddressMap<Buffer> set;
 
 	Buffer a;
 	a.deviceAddress = VkDeviceAddress(1);
 	a.ci.size = 80;
-	set.insert(&a);
+	add(set, a);
 
 	Buffer b;
 	b.deviceAddress = VkDeviceAddress(200);
 	b.ci.size = 80;
-	set.insert(&b);
+	add(set, b);
 
 	Buffer c;
 	c.deviceAddress = VkDeviceAddress(300);
 	c.ci.size = 80;
-	set.insert(&c);
+	add(set, c);
 
 	Buffer d;
 	d.deviceAddress = VkDeviceAddress(400);
 	d.ci.size = 80;
-	set.insert(&d);
+	add(set, d);
 
 	Buffer e;
 	e.deviceAddress = VkDeviceAddress(500);
 	e.ci.size = 80;
-	set.insert(&e);
+	add(set, e);
 
 	Buffer f;
 	f.deviceAddress = VkDeviceAddress(110);
 	f.ci.size = 1000;
-	set.insert(&f);
+	add(set, f);
 
-	auto buf = bufferAtInternal(set, VkDeviceAddress(490));
+	auto buf = set.find(VkDeviceAddress(490));
 	EXPECT(buf, &f);
 
-	buf = bufferAtInternal(set, VkDeviceAddress(105));
+	buf = set.find(VkDeviceAddress(105));
 	EXPECT(buf, nullptr);
 }
 
+TEST(unit_addressMap_changes) {
+	AddressMap<Buffer> set;
+
+	Buffer a;
+	a.deviceAddress = VkDeviceAddress(100);
+	a.ci.size = 10;
+	add(set, a);
+	EXPECT(set.find(105), &a);
+
+	// changes are only applied on the next lookup, in the order they
+	// were made. A buffer created at the same place in memory as
+	// a destroyed one must not remove the new entry.
+	Buffer b;
+	b.deviceAddress = VkDeviceAddress(200);
+	b.ci.size = 10;
+	add(set, b);
+	set.remove(b);
+	set.remove(a);
+	a.deviceAddress = VkDeviceAddress(300);
+	add(set, a);
+
+	EXPECT(set.find(105), nullptr);
+	EXPECT(set.find(205), nullptr);
+	EXPECT(set.find(305), &a);
+	EXPECT(set.findExact(300), &a);
+	EXPECT(set.findExact(305), nullptr);
+
+	set.remove(a);
+	EXPECT(set.find(305), nullptr);
+}
+
+TEST(unit_addressMap_delta) {
+	using Map = AddressMap<Buffer>;
+	Map set;
+
+	// more buffers than fit into the delta, with lookups in between
+	// so that some of them end up in the base
+	constexpr auto count = 3u * Map::maxDelta;
+	std::vector<Buffer> bufs(count);
+	for(auto i = 0u; i < count; ++i) {
+		bufs[i].deviceAddress = VkDeviceAddress(1000u + 100u * i);
+		bufs[i].ci.size = 50u;
+		add(set, bufs[i]);
+
+		EXPECT(set.find(bufs[i].deviceAddress + 10u), &bufs[i]);
+		EXPECT(set.find(bufs[i / 2u].deviceAddress + 10u), &bufs[i / 2u]);
+	}
+
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(set.findExact(bufs[i].deviceAddress), &bufs[i]);
+		EXPECT(set.find(bufs[i].deviceAddress + 60u), nullptr);
+	}
+
+	// aliasing between the base and the delta, the buffer starting
+	// closest before the address wins
+	Buffer alias;
+	alias.deviceAddress = bufs[5].deviceAddress + 20u;
+	alias.ci.size = 10u;
+	add(set, alias);
+	EXPECT(set.find(bufs[5].deviceAddress + 10u), &bufs[5]);
+	EXPECT(set.find(bufs[5].deviceAddress + 25u), &alias);
+	EXPECT(set.find(bufs[5].deviceAddress + 35u), &bufs[5]);
+
+	// removing base entries without rebuilding the base
+	set.remove(bufs[5]);
+	EXPECT(set.find(bufs[5].deviceAddress + 10u), nullptr);
+	EXPECT(set.find(bufs[5].deviceAddress + 25u), &alias);
+	EXPECT(set.findExact(bufs[5].deviceAddress), nullptr);
+
+	set.remove(alias);
+	for(auto i = 0u; i < count; ++i) {
+		if(i != 5u) {
+			set.remove(bufs[i]);
+		}
+	}
+
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(set.find(bufs[i].deviceAddress + 10u), nullptr);
+	}
+}
+
+// Lookups don't need any external synchronization with add/remove
+TEST(unit_addressMap_concurrent) {
+	AddressMap<Buffer> set;
+
+	Buffer stable;
+	stable.deviceAddress = VkDeviceAddress(100);
+	stable.ci.size = 10u;
+	add(set, stable);
+
+	std::atomic<bool> done {};
+	std::atomic<u32> failed {};
+	std::thread reader([&]{
+		while(!done.load()) {
+			if(set.find(105) != &stable || set.findExact(100) != &stable) {
+				++failed;
+			}
+		}
+	});
+
+	std::vector<Buffer> bufs(256u);
+	for(auto round = 0u; round < 200u; ++round) {
+		for(auto i = 0u; i < bufs.size(); ++i) {
+			bufs[i].deviceAddress = VkDeviceAddress(1000u + 100u * i);
+			bufs[i].ci.size = 50u;
+			add(set, bufs[i]);
+			if(i % 16u == 0u) {
+				set.find(0u);
+			}
+		}
+
+		for(auto& buf : bufs) {
+			set.remove(buf);
+		}
+
+		set.find(0u);
+	}
+
+	done.store(true);
+	reader.join();
+
+	EXPECT(failed.load(), 0u);
+}
@@ -0,0 +1,121 @@
+#include "../bugged.hpp"
+#include <util/util.hpp>
+#include <util/linalloc.hpp>
+
+using namespace vil;
+
+TEST(unit_chain_deepCopy) {
+	VkImageView views[3] = {
+		VkImageView(std::uintptr_t(0x10)),
+		VkImageView(std::uintptr_t(0x20)),
+		VkImageView(std::uintptr_t(0x30)),
+	};
+
+	VkRenderPassAttachmentBeginInfo attInfo {};
+	attInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO;
+	attInfo.attachmentCount = 3u;
+	attInfo.pAttachments = views;
+
+	VkRect2D areas[2] = {{{1, 2}, {3, 4}}, {{5, 6}, {7, 8}}};
+	VkDeviceGroupRenderPassBeginInfo groupInfo {};
+	groupInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO;
+	groupInfo.pNext = &attInfo;
+	groupInfo.deviceMask = 3u;
+	groupInfo.deviceRenderAreaCount = 2u;
+	groupInfo.pDeviceRenderAreas = areas;
+
+	LinAllocator alloc;
+	auto* copy = copyChain(alloc, &groupInfo);
+	EXPECT(copy != nullptr, true);
+	EXPECT(copy != static_cast<const void*>(&groupInfo), true);
+
+	auto* dstGroup = findChainInfo2<VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO>(copy);
+	auto* dstAtt = findChainInfo2<VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO>(copy);
+	EXPECT(dstGroup, copy);
+	EXPECT(dstAtt != nullptr, true);
+
+	auto& group = *static_cast<const VkDeviceGroupRenderPassBeginInfo*>(dstGroup);
+	EXPECT(group.deviceMask, 3u);
+	EXPECT(group.deviceRenderAreaCount, 2u);
+	EXPECT(group.pDeviceRenderAreas != areas, true);
+	EXPECT(group.pDeviceRenderAreas[1].offset.x, 5);
+	EXPECT(group.pDeviceRenderAreas[1].extent.height, 8u);
+
+	auto& att = *static_cast<const VkRenderPassAttachmentBeginInfo*>(dstAtt);
+	EXPECT(att.pNext, nullptr);
+	EXPECT(att.attachmentCount, 3u);
+	EXPECT(att.pAttachments != views, true);
+	EXPECT(att.pAttachments[0], views[0]);
+	EXPECT(att.pAttachments[2], views[2]);
+
+	// the copy must not reference the source anymore
+	views[0] = {};
+	areas[1] = {};
+	EXPECT(att.pAttachments[0] != views[0], true);
+	EXPECT(group.pDeviceRenderAreas[1].offset.x, 5);
+}
+
+TEST(unit_chain_nested) {
+	VkSampleLocationEXT locs0[2] = {{0.25f, 0.25f}, {0.75f, 0.75f}};
+	VkSampleLocationEXT locs1[1] = {{0.5f, 0.5f}};
+
+	VkAttachmentSampleLocationsEXT attLocs[2] {};
+	attLocs[0].attachmentIndex = 1u;
+	attLocs[0].sampleLocationsInfo.sType = VK_STRUCTURE_TYPE_SAMPLE_LOCATIONS_INFO_EXT;
+	attLocs[0].sampleLocationsInfo.sampleLocationsCount = 2u;
+	attLocs[0].sampleLocationsInfo.pSampleLocations = locs0;
+	attLocs[1].attachmentIndex = 4u;
+	attLocs[1].sampleLocationsInfo.sType = VK_STRUCTURE_TYPE_SAMPLE_LOCATIONS_INFO_EXT;
+	attLocs[1].sampleLocationsInfo.sampleLocationsCount = 1u;
+	attLocs[1].sampleLocationsInfo.pSampleLocations = locs1;
+
+	VkRenderPassSampleLocationsBeginInfoEXT info {};
+	info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_SAMPLE_LOCATIONS_BEGIN_INFO_EXT;
+	info.attachmentInitialSampleLocationsCount = 2u;
+	info.pAttachmentInitialSampleLocations = attLocs;
+
+	auto size = chainCopySize(&info);
+	EXPECT(size >= sizeof(info) + sizeof(attLocs) + sizeof(locs0) + sizeof(locs1), true);
+
+	LinAllocator alloc;
+	auto& copy = *static_cast<const VkRenderPassSampleLocationsBeginInfoEXT*>(
+		copyChain(alloc, &info));
+	EXPECT(copy.attachmentInitialSampleLocationsCount, 2u);
+	EXPECT(copy.postSubpassSampleLocationsCount, 0u);
+	EXPECT(copy.pPostSubpassSampleLocations, nullptr);
+
+	auto& dst = copy.pAttachmentInitialSampleLocations;
+	EXPECT(dst != attLocs, true);
+	EXPECT(dst[1].attachmentIndex, 4u);
+	EXPECT(dst[0].sampleLocationsInfo.pSampleLocations != locs0, true);
+	EXPECT(dst[1].sampleLocationsInfo.pSampleLocations != locs1, true);
+	EXPECT(dst[0].sampleLocationsInfo.pSampleLocations[1].x, 0.75f);
+	EXPECT(dst[1].sampleLocationsInfo.pSampleLocations[0].y, 0.5f);
+}
+
+TEST(unit_chain_plain) {
+	EXPECT(chainCopySize(nullptr), 0u);
+
+	LinAllocator alloc;
+	EXPECT(copyChain(alloc, nullptr), nullptr);
+
+	VkMemoryBarrier2 barrier {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT;
+
+	VkImageViewUsageCreateInfo usage {};
+	usage.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+	usage.pNext = &barrier;
+	usage.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+
+	EXPECT(structSize(VK_STRUCTURE_TYPE_MEMORY_BARRIER_2), sizeof(barrier));
+	EXPECT(structSize(VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO), sizeof(usage));
+
+	auto* copy = static_cast<const VkImageViewUsageCreateInfo*>(copyChain(alloc, &usage));
+	EXPECT(copy->usage, u32(VK_IMAGE_USAGE_STORAGE_BIT));
+
+	auto* next = static_cast<const VkMemoryBarrier2*>(copy->pNext);
+	EXPECT(next != &barrier, true);
+	EXPECT(next->srcAccessMask, VK_ACCESS_2_SHADER_WRITE_BIT);
+	EXPECT(next->pNext, nullptr);
+}
@@ -0,0 +1,280 @@
+#include "../bugged.hpp"
+#include <descriptorBuffer.hpp>
+#include <device.hpp>
+#include <buffer.hpp>
+#include <image.hpp>
+#include <memory.hpp>
+#include <pipe.hpp>
+#include <ds.hpp>
+#include <command/record.hpp>
+#include <array>
+#include <cstring>
+
+using namespace vil;
+
+namespace {
+
+// We use 8-byte values as opaque descriptor data
+ReadBuf bytes(const u64& val) {
+	return {reinterpret_cast<const std::byte*>(&val), sizeof(val)};
+}
+
+IntrusivePtr<DescriptorSetLayout> storageBufferLayout(u32 bindingCount) {
+	IntrusivePtr<DescriptorSetLayout> ret(new DescriptorSetLayout());
+	ret->bindings.resize(bindingCount);
+	for(auto b = 0u; b < bindingCount; ++b) {
+		auto& binding = ret->bindings[b];
+		binding.offset = b * sizeof(BufferDescriptor);
+		binding.descriptorCount = 1u;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+
+	return ret;
+}
+
+constexpr auto bindingStride = 16u;
+
+VKAPI_ATTR void VKAPI_CALL stubBindingOffset(VkDevice, VkDescriptorSetLayout,
+		uint32_t binding, VkDeviceSize* pOffset) {
+	*pOffset = binding * bindingStride;
+}
+
+} // anon namespace
+
+TEST(unit_descriptorBuffer_table) {
+	constexpr auto type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+	DescriptorBufferTable table;
+	table.maxEntries = 8u;
+	std::lock_guard lock(table.mutex);
+
+	std::array<u64, 8> data;
+	for(auto i = 0u; i < data.size(); ++i) {
+		data[i] = 100u + i;
+		DescriptorBufferEntry entry;
+		entry.address = i;
+		table.insertLocked(type, bytes(data[i]), entry);
+	}
+
+	EXPECT(table.fullLocked(), true);
+
+	auto* entry = table.findLocked(type, bytes(data[3]));
+	EXPECT(entry != nullptr, true);
+	EXPECT(entry->address, 3u);
+
+	// the type is part of the key
+	EXPECT(table.findLocked(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bytes(data[3])), nullptr);
+
+	// entries with odd addresses refer to destroyed buffers.
+	// Pruning them frees up half of the table, nothing else is dropped.
+	auto removed = table.pruneLocked([](VkDescriptorType, const DescriptorBufferEntry& entry) {
+		return entry.address % 2u == 1u;
+	});
+	EXPECT(removed, 4u);
+	EXPECT(table.findLocked(type, bytes(data[2])) != nullptr, true);
+	EXPECT(table.findLocked(type, bytes(data[3])), nullptr);
+
+	// all entries alive. Pruning must still make room.
+	for(auto i = 1u; i < data.size(); i += 2u) {
+		DescriptorBufferEntry entry;
+		entry.address = 2u * i;
+		table.insertLocked(type, bytes(data[i]), entry);
+	}
+
+	EXPECT(table.fullLocked(), true);
+	removed = table.pruneLocked([](VkDescriptorType, const DescriptorBufferEntry&) {
+		return false;
+	});
+	EXPECT(removed, 4u);
+	EXPECT(table.entries.size(), 4u);
+	EXPECT(table.fullLocked(), false);
+}
+
+TEST(unit_descriptorBuffer_snapshotKey) {
+	auto dsl0 = storageBufferLayout(1u);
+	auto dsl1 = storageBufferLayout(2u);
+
+	PipelineLayout pl;
+	pl.descriptors = {dsl0, dsl0, dsl1};
+
+	std::array<VkDescriptorBufferBindingInfoEXT, 2> buffers {};
+	buffers[0].address = 0x1000;
+	buffers[1].address = 0x2000;
+
+	std::array<BoundDescriptorSet, 3> sets {};
+	DescriptorState state;
+	state.descriptorSets = sets;
+	state.descriptorBuffers = buffers;
+
+	// all sets resolve to the same address
+	std::array<u32, 3> indices {0u, 1u, 0u};
+	std::array<VkDeviceSize, 3> offsets {0x1100, 0x100, 0x1100};
+	state.bindBufferSets(pl, 0u, indices, offsets);
+
+	auto key0 = state.snapshotKey(0u);
+	EXPECT(key0.address, VkDeviceAddress(0x2100));
+	EXPECT(key0.ptr, static_cast<const void*>(dsl0.get()));
+
+	// same data and layout, the decoded state can be shared
+	EXPECT(state.snapshotKey(1u) == key0, true);
+	// same data but decoded with a different layout
+	EXPECT(state.snapshotKey(2u) == key0, false);
+
+	// the buffer index alone doesn't identify the data
+	buffers[0].address = 0x3000;
+	EXPECT(state.snapshotKey(2u).address, VkDeviceAddress(0x4100));
+	EXPECT(state.snapshotKey(0u) == state.snapshotKey(1u), false);
+
+	// regular sets are identified by their entry
+	int entry;
+	sets[1] = {};
+	sets[1].dsEntry = &entry;
+	EXPECT(state.snapshotKey(1u).ptr, static_cast<const void*>(&entry));
+	EXPECT(state.snapshotKey(1u).address, VkDeviceAddress(0u));
+}
+
+TEST(unit_descriptorBuffer_disturb) {
+	auto dslA = storageBufferLayout(1u);
+	auto dslB = storageBufferLayout(2u);
+
+	PipelineLayout a;
+	a.descriptors = {dslA, dslA};
+
+	// not compatible with a for set 0
+	PipelineLayout b;
+	b.descriptors = {dslB, dslA};
+
+	std::array<VkDescriptorBufferBindingInfoEXT, 1> buffers {};
+	buffers[0].address = 0x1000;
+
+	std::array<BoundDescriptorSet, 2> sets {};
+	DescriptorState state;
+	state.descriptorSets = sets;
+	state.descriptorBuffers = buffers;
+
+	std::array<u32, 2> indices {0u, 0u};
+	std::array<VkDeviceSize, 2> offsets {0u, 64u};
+
+	// binding set 1 with b disturbs set 0
+	state.bindBufferSets(a, 0u, indices, offsets);
+	state.bindBufferSets(b, 1u, span<const u32>(indices.data(), 1u),
+		span<const VkDeviceSize>(offsets.data(), 1u));
+	EXPECT(sets[0].fromDescriptorBuffer(), false);
+	EXPECT(sets[0].layout, nullptr);
+	EXPECT(sets[1].layout, &b);
+
+	// compatible layout, set 1 stays
+	state.bindBufferSets(a, 0u, indices, offsets);
+	state.bindBufferSets(a, 0u, span<const u32>(indices.data(), 1u),
+		span<const VkDeviceSize>(offsets.data(), 1u));
+	EXPECT(sets[1].fromDescriptorBuffer(), true);
+	EXPECT(sets[1].descriptorBufferOffset, 64u);
+
+	// set 0 was bound with a layout not compatible for set 0,
+	// all following sets are disturbed
+	state.bindBufferSets(b, 0u, span<const u32>(indices.data(), 1u),
+		span<const VkDeviceSize>(offsets.data(), 1u));
+	EXPECT(sets[0].layout, &b);
+	EXPECT(sets[1].fromDescriptorBuffer(), false);
+	EXPECT(sets[1].layout, nullptr);
+}
+
+TEST(unit_descriptorBuffer_decode) {
+	Device dev;
+	dev.dispatch.GetDescriptorSetLayoutBindingOffsetEXT = stubBindingOffset;
+	dev.descriptorBuffers = std::make_unique<DescriptorBufferTable>();
+	auto& table = *dev.descriptorBuffers;
+	table.props.storageBufferDescriptorSize = sizeof(u64);
+
+	// the buffer the descriptors point to
+	IntrusivePtr<Buffer> target(new Buffer());
+	target->deviceAddress = 0x10000;
+	target->ci.size = 256u;
+	dev.bufferAddresses.add(target->deviceAddress, target->ci.size, *target);
+
+	// the host-mapped descriptor buffer
+	std::array<std::byte, 256> hostData {};
+	DeviceMemory mem;
+	mem.size = hostData.size();
+	mem.map = hostData.data();
+	mem.mapSize = hostData.size();
+
+	IntrusivePtr<Buffer> descriptors(new Buffer());
+	descriptors->deviceAddress = 0x20000;
+	descriptors->ci.size = hostData.size();
+	FullMemoryBind bind;
+	bind.memState = FullMemoryBind::State::bound;
+	bind.memory = &mem;
+	descriptors->memory = bind;
+	dev.bufferAddresses.add(descriptors->deviceAddress, descriptors->ci.size, *descriptors);
+
+	// what vkGetDescriptorEXT would have returned for the target buffer
+	u64 known = 0xABCDu;
+	u64 unknown = 0x1234u;
+	{
+		DescriptorBufferEntry entry;
+		entry.address = target->deviceAddress + 16u;
+		entry.range = 32u;
+
+		std::lock_guard lock(table.mutex);
+		table.insertLocked(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bytes(known), entry);
+	}
+
+	// the set lives at offset 64 in the descriptor buffer
+	constexpr auto setOffset = 64u;
+	std::memcpy(hostData.data() + setOffset, &known, sizeof(known));
+	std::memcpy(hostData.data() + setOffset + bindingStride, &unknown, sizeof(unknown));
+
+	auto dsl = storageBufferLayout(2u);
+	dsl->dev = &dev;
+	PipelineLayout pl;
+	pl.dev = &dev;
+	pl.descriptors = {dsl};
+
+	std::array<VkDescriptorBufferBindingInfoEXT, 1> bufferInfos {};
+	bufferInfos[0].address = descriptors->deviceAddress;
+
+	std::array<BoundDescriptorSet, 1> sets {};
+	DescriptorState state;
+	state.descriptorSets = sets;
+	state.descriptorBuffers = bufferInfos;
+
+	std::array<u32, 1> indices {0u};
+	std::array<VkDeviceSize, 1> offsets {setOffset};
+	state.bindBufferSets(pl, 0u, indices, offsets);
+
+	// destroying the cow must not happen with the device mutex locked
+	IntrusivePtr<DescriptorSetCow> cow;
+	{
+		std::lock_guard devLock(dev.mutex);
+		cow = decodeDescriptorBufferLocked(state, sets[0]);
+	}
+
+	EXPECT(cow.get() != nullptr, true);
+	{
+		auto [ds, lock] = access(*cow);
+		auto b0 = buffers(ds, 0u)[0];
+		EXPECT(b0.buffer, target.get());
+		EXPECT(b0.offset, 16u);
+		EXPECT(b0.range, 32u);
+
+		// descriptors we never saw stay empty
+		EXPECT(buffers(ds, 1u)[0].buffer, nullptr);
+	}
+
+	cow.reset();
+
+	// can't read the descriptors when the buffer isn't mapped
+	mem.map = nullptr;
+	{
+		std::lock_guard devLock(dev.mutex);
+		EXPECT(decodeDescriptorBufferLocked(state, sets[0]).get(), nullptr);
+	}
+
+	dev.bufferAddresses.remove(*descriptors);
+	dev.bufferAddresses.remove(*target);
+
+	// the layouts have no driver handles
+	dsl->dev = nullptr;
+	pl.dev = nullptr;
+}
@@ -0,0 +1,72 @@
+#include "../bugged.hpp"
+#include <data.hpp>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+// Handles look like pointers
+u64 fakeKey(u32 id) {
+	return 0x100000u + 0x40u * u64(id);
+}
+
+void* fakeData(u32 id) {
+	return reinterpret_cast<void*>(std::uintptr_t(0x1000u + 0x10u * id));
+}
+
+} // anon namespace
+
+TEST(unit_dispatchTable_basic) {
+	constexpr auto noPin = DispatchableTable::noPin;
+	constexpr auto count = 1000u;
+
+	// enough entries to grow the table a few times
+	DispatchableTable table;
+	for(auto i = 0u; i < count; ++i) {
+		EXPECT(table.insert(fakeKey(i), fakeData(i), noPin), true);
+	}
+
+	EXPECT(table.insert(fakeKey(0u), fakeData(1u), noPin), false);
+	EXPECT(table.find(fakeKey(count), noPin), nullptr);
+
+	// erase every third entry, the others must still be found after
+	// entries were shifted back
+	for(auto i = 0u; i < count; i += 3) {
+		EXPECT(table.erase(fakeKey(i), noPin), fakeData(i));
+	}
+
+	EXPECT(table.erase(fakeKey(0u), noPin), nullptr);
+	for(auto i = 0u; i < count; ++i) {
+		auto expected = (i % 3 == 0u) ? nullptr : fakeData(i);
+		EXPECT(table.find(fakeKey(i), noPin), expected);
+	}
+
+	auto visited = 0u;
+	table.forEach([&](u64, void*) { ++visited; });
+	EXPECT(visited, count - (count + 2) / 3);
+}
+
+TEST(unit_dispatchTable_pinned) {
+	constexpr auto devPin = DispatchableTable::pinSlot<VkDevice>();
+	static_assert(DispatchableTable::pinSlot<VkQueue>() == DispatchableTable::noPin);
+
+	// The first device goes into the pinned slot, the second one
+	// into the table. Both must be found.
+	DispatchableTable table;
+	EXPECT(table.insert(fakeKey(1u), fakeData(1u), devPin), true);
+	EXPECT(table.insert(fakeKey(2u), fakeData(2u), devPin), true);
+	EXPECT(table.insert(fakeKey(1u), fakeData(1u), devPin), false);
+	EXPECT(table.find(fakeKey(1u), devPin), fakeData(1u));
+	EXPECT(table.find(fakeKey(2u), devPin), fakeData(2u));
+
+	EXPECT(table.erase(fakeKey(1u), devPin), fakeData(1u));
+	EXPECT(table.find(fakeKey(1u), devPin), nullptr);
+	EXPECT(table.find(fakeKey(2u), devPin), fakeData(2u));
+
+	// pinned slot is free again
+	EXPECT(table.insert(fakeKey(3u), fakeData(3u), devPin), true);
+	EXPECT(table.find(fakeKey(3u), devPin), fakeData(3u));
+	EXPECT(table.erase(fakeKey(2u), devPin), fakeData(2u));
+	EXPECT(table.erase(fakeKey(3u), devPin), fakeData(3u));
+}
@@ -0,0 +1,108 @@
+#include "../bugged.hpp"
+#include <util/flatSet.hpp>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+struct Entry {
+	const void* ptr {};
+	unsigned* alive {};
+
+	Entry(const void* p, unsigned& a) : ptr(p), alive(&a) { ++a; }
+	Entry(Entry&& rhs) noexcept : ptr(rhs.ptr), alive(rhs.alive) {
+		rhs.alive = nullptr;
+	}
+	Entry& operator=(Entry&&) = delete;
+	~Entry() {
+		if(alive) {
+			--*alive;
+		}
+	}
+};
+
+struct EntryKey {
+	const void* operator()(const Entry& e) const { return e.ptr; }
+};
+
+} // anon namespace
+
+TEST(unit_flatSet_insert_find) {
+	LinAllocator alloc;
+	unsigned alive = 0u;
+
+	constexpr auto count = 1000u;
+	std::vector<u64> objects(count);
+
+	{
+		FlatPtrSet<Entry, EntryKey> set(alloc);
+		EXPECT(set.empty(), true);
+		EXPECT(set.find(&objects[0]) == set.end(), true);
+
+		for(auto i = 0u; i < count; ++i) {
+			auto [entry, inserted] = set.findOrInsert(&objects[i], [&]{
+				return Entry(&objects[i], alive);
+			});
+			EXPECT(inserted, true);
+			EXPECT(entry.ptr, static_cast<const void*>(&objects[i]));
+		}
+
+		EXPECT(set.size(), count);
+		EXPECT(alive, count);
+
+		// inserting again must return the existing entries
+		for(auto i = 0u; i < count; ++i) {
+			auto [entry, inserted] = set.findOrInsert(&objects[i], [&]{
+				return Entry(&objects[i], alive);
+			});
+			EXPECT(inserted, false);
+			EXPECT(entry.ptr, static_cast<const void*>(&objects[i]));
+		}
+
+		EXPECT(set.size(), count);
+		EXPECT(alive, count);
+
+		for(auto i = 0u; i < count; ++i) {
+			auto it = set.find(&objects[i]);
+			EXPECT(it != set.end(), true);
+			EXPECT(it->ptr, static_cast<const void*>(&objects[i]));
+		}
+
+		u64 other {};
+		EXPECT(set.find(&other) == set.end(), true);
+
+		auto iterated = 0u;
+		for(auto& entry : set) {
+			(void) entry;
+			++iterated;
+		}
+		EXPECT(iterated, count);
+	}
+
+	// destructor must have destroyed all elements
+	EXPECT(alive, 0u);
+}
+
+TEST(unit_flatSet_reserve) {
+	LinAllocator alloc;
+	unsigned alive = 0u;
+
+	constexpr auto count = 100u;
+	std::vector<u64> objects(count);
+
+	FlatPtrSet<Entry, EntryKey> set(alloc);
+	set.reserve(count);
+	auto cap = set.capacity();
+	EXPECT(cap >= count, true);
+
+	for(auto i = 0u; i < count; ++i) {
+		(void) set.findOrInsert(&objects[i], [&]{
+			return Entry(&objects[i], alive);
+		});
+	}
+
+	// no rehash needed
+	EXPECT(set.capacity(), cap);
+	EXPECT(set.size(), count);
+}
@@ -0,0 +1,44 @@
+#include "../bugged.hpp"
+#include <command/alloc.hpp>
+#include <util/linalloc.hpp>
+
+using namespace vil;
+
+TEST(unit_stateChunk_cow) {
+	LinAllocator alloc;
+	auto* state = &construct<GraphicsState>(alloc);
+	state->dynamic = &construct<GraphicsDynamicState>(alloc);
+	auto shared = u32(0u);
+
+	auto& gs = writableChunk(alloc, state, shared, stateChunkState);
+	EXPECT(&gs, state);
+	auto vbs = writableChunk(alloc, gs.vertices, shared, stateChunkVertexBuffers, 2u);
+	EXPECT(vbs.size(), 2u);
+	vbs[0].offset = 1u;
+
+	// not shared, changes happen in place
+	auto vbs2 = writableChunk(alloc, gs.vertices, shared, stateChunkVertexBuffers, 1u);
+	EXPECT(vbs2.data(), vbs.data());
+
+	// captured by a command
+	const GraphicsState* first = state;
+	shared = stateChunkAll;
+
+	auto& gs2 = writableChunk(alloc, state, shared, stateChunkState);
+	EXPECT(&gs2 != first, true);
+	EXPECT(gs2.dynamic, first->dynamic);
+	EXPECT(gs2.vertices.data(), first->vertices.data());
+
+	// only the changed chunk is copied
+	auto vbs3 = writableChunk(alloc, gs2.vertices, shared, stateChunkVertexBuffers, 2u);
+	EXPECT(vbs3.data() != vbs.data(), true);
+	vbs3[0].offset = 2u;
+	EXPECT(first->vertices[0].offset, 1u);
+	EXPECT(gs2.vertices[0].offset, 2u);
+	EXPECT(gs2.dynamic, first->dynamic);
+
+	auto& dyn = writableChunk(alloc, gs2.dynamic, shared, stateChunkDynamic);
+	EXPECT(&dyn != first->dynamic, true);
+	dyn.lineWidth = 2.f;
+	EXPECT(first->dynamic->lineWidth, 0.f);
+}
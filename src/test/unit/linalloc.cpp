@@ -0,0 +1,147 @@
+#include "../bugged.hpp"
+#include <util/linalloc.hpp>
+#include <threadContext.hpp>
+#include <stats.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace vil;
+
+TEST(unit_linalloc_pool_reuse) {
+	LinBlockPool pool;
+
+	std::byte* first {};
+	{
+		LinAllocator alloc({}, {}, &pool);
+		(void) alloc.allocate(128u, 8u);
+		first = reinterpret_cast<std::byte*>(alloc.memRoot.next);
+		EXPECT(first != nullptr, true);
+	}
+
+	// the block was returned to the magazine of this thread
+	// and should be re-used.
+	{
+		LinAllocator alloc({}, {}, &pool);
+		(void) alloc.allocate(128u, 8u);
+		auto second = reinterpret_cast<std::byte*>(alloc.memRoot.next);
+		EXPECT(second, first);
+	}
+
+	pool.trim();
+	EXPECT(pool.cachedSize, 0u);
+}
+
+TEST(unit_linalloc_pool_shared) {
+	constexpr auto numAllocs = 2 * LinBlockPool::Magazine::maxBlocksPerClass;
+	constexpr auto blockSize = LinAllocator::minBlockSize;
+
+	LinBlockPool pool;
+	pool.trim(); // make sure the magazine of this thread is empty
+
+	{
+		std::vector<std::unique_ptr<LinAllocator>> allocs;
+		for(auto i = 0u; i < numAllocs; ++i) {
+			auto& alloc = allocs.emplace_back(
+				std::make_unique<LinAllocator>(LinAllocator::Callback{},
+					LinAllocator::Callback{}, &pool));
+			(void) alloc->allocate(16u, 8u);
+		}
+	}
+
+	// everything that didn't fit into the magazine went to the shared pool
+	auto sharedCount = numAllocs - LinBlockPool::Magazine::maxBlocksPerClass;
+	EXPECT(pool.cachedSize, sharedCount * blockSize);
+
+	// other threads can take blocks from the shared pool
+	std::thread t([&]{
+		LinAllocator alloc({}, {}, &pool);
+		(void) alloc.allocate(16u, 8u);
+		EXPECT(pool.cachedSize, (sharedCount - 1) * blockSize);
+
+		alloc.release();
+		EXPECT(pool.cachedSize, (sharedCount - 1) * blockSize);
+	});
+	t.join();
+
+	pool.trim();
+	EXPECT(pool.cachedSize, 0u);
+}
+
+TEST(unit_linalloc_pool_trim_threads) {
+	LinBlockPool pool;
+	pool.trim();
+
+	// A thread frees a block into its magazine and then stays idle.
+	// trim on another thread must still return it.
+	std::mutex mutex;
+	std::condition_variable cv;
+	LinBlockPool::Magazine* magazine {};
+	auto done = false;
+
+	std::thread t([&]{
+		{
+			LinAllocator alloc({}, {}, &pool);
+			(void) alloc.allocate(16u, 8u);
+		}
+
+		std::unique_lock lock(mutex);
+		magazine = &ThreadContext::instance.blockMagazine_;
+		cv.notify_one();
+		cv.wait(lock, [&]{ return done; });
+	});
+
+	{
+		std::unique_lock lock(mutex);
+		cv.wait(lock, [&]{ return magazine != nullptr; });
+
+		EXPECT(magazine->count(), 1u);
+
+		pool.trim();
+		EXPECT(magazine->count(), 0u);
+		for(auto& slot : magazine->slots) {
+			EXPECT(slot.load(), nullptr);
+		}
+
+		done = true;
+		cv.notify_one();
+	}
+
+	t.join();
+}
+
+TEST(unit_linalloc_pool_oversized) {
+	LinBlockPool pool;
+	pool.trim();
+
+	// allocations larger than maxPooledSize are never cached
+	{
+		LinAllocator alloc({}, {}, &pool);
+		(void) alloc.allocate(2 * LinBlockPool::maxPooledSize, 8u);
+	}
+
+	EXPECT(pool.cachedSize, 0u);
+	EXPECT(ThreadContext::instance.blockMagazine_.count(), 0u);
+}
+
+TEST(unit_linalloc_first_block_size) {
+	LinBlockPool pool;
+
+	LinAllocator alloc({}, {}, &pool, 8 * 1024);
+	EXPECT(alloc.usedSize(), 0u);
+
+	(void) alloc.allocate(1024u, 8u);
+	EXPECT(alloc.usedSize(), 1024u);
+	EXPECT(memSize(*alloc.memRoot.next) + sizeof(LinMemBlock), 8 * 1024u);
+
+	// following blocks grow exponentially
+	(void) alloc.allocate(7 * 1024u, 8u);
+	EXPECT(alloc.usedSize(), 8 * 1024u);
+	EXPECT(memSize(*alloc.memCurrent) + sizeof(LinMemBlock), 16 * 1024u);
+
+	// after a reset, the blocks are kept around
+	alloc.reset();
+	(void) alloc.allocate(16u, 8u);
+	EXPECT(alloc.memCurrent->next != nullptr, true);
+	EXPECT(alloc.usedSize(), 16u);
+}
@@ -0,0 +1,93 @@
+#include "../bugged.hpp"
+#include <util/lockProfile.hpp>
+#include <util/debugMutex.hpp>
+#include <thread>
+
+using namespace vil;
+
+TEST(unit_lockProfile_merge) {
+	resetLockProfile();
+
+	// counters of other threads (even exited ones) are merged on read
+	std::thread thread([]{
+		lockProfileAddWait(LockSite::device, 100u, true);
+		lockProfileAddHold(LockSite::device, 3000u);
+	});
+	thread.join();
+
+	lockProfileAddWait(LockSite::device, 1u, false);
+	lockProfileAddHold(LockSite::device, 1000u);
+	lockProfileAddWait(LockSite::queue, 0u, false);
+
+	auto sites = collectLockProfile();
+	EXPECT(sites.size(), std::size_t(lockSiteCount));
+
+	auto& dev = sites[unsigned(LockSite::device)];
+	EXPECT(std::string(dev.name), std::string("Device::mutex"));
+	EXPECT(dev.count, 2u);
+	EXPECT(dev.contended, 1u);
+	EXPECT(dev.waitNs, 101u);
+	EXPECT(dev.holdNs, 4000u);
+	EXPECT(dev.maxWaitNs, 100u);
+	EXPECT(dev.maxHoldNs, 3000u);
+
+	// 100 is in [64, 128), 1 in [1, 2)
+	EXPECT(dev.waitHist[7], 1u);
+	EXPECT(dev.waitHist[1], 1u);
+	// 1000 and 3000 are in [512, 1024) and [2048, 4096)
+	EXPECT(dev.holdHist[10], 1u);
+	EXPECT(dev.holdHist[12], 1u);
+
+	auto& queue = sites[unsigned(LockSite::queue)];
+	EXPECT(queue.count, 1u);
+	EXPECT(queue.waitHist[0], 1u);
+
+	// per-object mutexes have their own sites
+	EXPECT(std::string(sites[unsigned(LockSite::descriptorPool)].name),
+		std::string("DescriptorPool::mutex"));
+	EXPECT(sites[unsigned(LockSite::descriptorPool)].count, 0u);
+
+	resetLockProfile();
+	sites = collectLockProfile();
+	EXPECT(sites[unsigned(LockSite::device)].count, 0u);
+	EXPECT(sites[unsigned(LockSite::device)].maxHoldNs, 0u);
+
+	lockProfileAddWait(LockSite::device, 5u, false);
+	sites = collectLockProfile();
+	EXPECT(sites[unsigned(LockSite::device)].count, 1u);
+	EXPECT(sites[unsigned(LockSite::device)].waitNs, 5u);
+}
+
+#ifdef VIL_LOCK_PROFILING
+
+TEST(unit_lockProfile_sites) {
+	resetLockProfile();
+	setLockProfileEnabled(true);
+
+	DebugMutex ranked;
+	setLockRank(ranked, LockRank::dsPool);
+	DebugMutex pool;
+	setLockSite(pool, LockSite::descriptorPool);
+	DebugSharedMutex cow;
+	setLockSite(cow, LockSite::descriptorSetCow);
+
+	{
+		std::lock_guard lock(ranked);
+	}
+	{
+		std::lock_guard lock(pool);
+	}
+	{
+		std::shared_lock lock(cow);
+	}
+
+	setLockProfileEnabled(false);
+
+	auto sites = collectLockProfile();
+	EXPECT(sites[unsigned(LockSite::dsPool)].count, 1u);
+	EXPECT(sites[unsigned(LockSite::descriptorPool)].count, 1u);
+	EXPECT(sites[unsigned(LockSite::descriptorSetCow)].count, 1u);
+	EXPECT(sites[unsigned(LockSite::other)].count, 0u);
+}
+
+#endif // VIL_LOCK_PROFILING
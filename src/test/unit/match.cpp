@@ -3,6 +3,7 @@
 #include <command/commands.hpp>
 #include <command/alloc.hpp>
 #include <command/builder.hpp>
+#include <ds.hpp>
 #include <threadContext.hpp>
 #include <vk/vulkan.h>
 #include "../bugged.hpp"
@@ -144,3 +145,77 @@ TEST(unit_match_labels) {
 		dlg_assert(matches2[2].a == &b4);
 	}
 }
+
+TEST(unit_match_fingerprint) {
+	Device dev;
+	dev.captureCmdStack.store(false);
+
+	auto build = [&](RecordBuilder& rb, const char* innerName, u32 numBarriers) {
+		{
+			LabelSection section(rb, "outer");
+			emptyLabelSection(rb, innerName);
+			emptyLabelSection(rb, innerName);
+			for(auto i = 0u; i < numBarriers; ++i) {
+				// parameters of barriers are not part of the fingerprint
+				auto& barrier = rb.add<BarrierCmd>();
+				barrier.srcStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT << i;
+			}
+		}
+
+		rb.add<BarrierCmd>();
+		rb.foldFingerprint();
+	};
+
+	RecordBuilder rb(&dev);
+	build(rb, "inner", 2u);
+	auto recA = rb.record_;
+
+	rb.reset(&dev);
+	build(rb, "inner", 2u);
+	auto recB = rb.record_;
+
+	rb.reset(&dev);
+	build(rb, "other", 2u);
+	auto recOtherName = rb.record_;
+
+	rb.reset(&dev);
+	build(rb, "inner", 3u);
+	auto recOtherCount = rb.record_;
+
+	auto fingerprint = [](const CommandRecord& rec) {
+		return rec.commands->stats_.fingerprint;
+	};
+
+	EXPECT(fingerprint(*recA) != 0u, true);
+	EXPECT(fingerprint(*recA), fingerprint(*recB));
+	EXPECT(fingerprint(*recA) != fingerprint(*recOtherName), true);
+	EXPECT(fingerprint(*recA) != fingerprint(*recOtherCount), true);
+
+	// identical records are matched pairwise
+	ThreadMemScope tms;
+	LinAllocScope lms(localMem);
+	auto [matchRes, _1, _2, matches] = match(tms, lms, matchType,
+		*recA->commands, *recB->commands);
+	EXPECT(eval(matchRes), approx(1.f));
+	EXPECT(matches.size(), 1u);
+
+	auto& outerA = *recA->commands->firstChildParent();
+	auto& outerB = *recB->commands->firstChildParent();
+	EXPECT(matches[0].a, &outerA);
+	EXPECT(matches[0].b, &outerB);
+	EXPECT(matches[0].children.size(), 2u);
+	EXPECT(matches[0].children[0].a, outerA.firstChildParent());
+	EXPECT(matches[0].children[0].b, outerB.firstChildParent());
+	EXPECT(matches[0].children[1].a, outerA.firstChildParent()->nextParent_);
+	EXPECT(matches[0].children[1].b, outerB.firstChildParent()->nextParent_);
+
+	// the second one of two identical labels is found by position
+	auto* secondB = outerB.firstChildParent()->nextParent_;
+	std::vector<const Command*> dstHierarchy {recB->commands, &outerB, secondB};
+	auto findRes = find(matchType, *recA->commands, dstHierarchy, {});
+	EXPECT(findRes.match, approx(1.f));
+	EXPECT(findRes.hierarchy.size(), 3u);
+	EXPECT(findRes.hierarchy[1], static_cast<const Command*>(&outerA));
+	EXPECT(findRes.hierarchy[2], static_cast<const Command*>(
+		outerA.firstChildParent()->nextParent_));
+}
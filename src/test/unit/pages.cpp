@@ -0,0 +1,58 @@
+#include "../bugged.hpp"
+#include <util/pages.hpp>
+#include <cstring>
+
+using namespace vil;
+
+namespace {
+
+bool allZero(const std::byte* data, std::size_t size) {
+	for(auto i = 0u; i < size; ++i) {
+		if(data[i] != std::byte(0)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // anon namespace
+
+TEST(unit_pages_zero) {
+	auto size = 64 * pageSize() + 123u;
+	PageMemory mem(size);
+	EXPECT(allZero(mem.get(), size), true);
+
+	// unaligned range, small enough to be memset
+	std::memset(mem.get(), 0xFF, size);
+	zeroPages(mem.get() + 17u, 2 * pageSize());
+	EXPECT(u8(mem[16u]), u8(0xFF));
+	EXPECT(allZero(mem.get() + 17u, 2 * pageSize()), true);
+	EXPECT(u8(mem[17u + 2 * pageSize()]), u8(0xFF));
+
+	// unaligned range releasing whole pages, the head and tail
+	// must be cleared as well
+	std::memset(mem.get(), 0xFF, size);
+	auto off = pageSize() / 2u;
+	auto len = 40 * pageSize() + 5u;
+	zeroPages(mem.get() + off, len);
+	EXPECT(u8(mem[off - 1]), u8(0xFF));
+	EXPECT(allZero(mem.get() + off, len), true);
+	EXPECT(u8(mem[off + len]), u8(0xFF));
+	EXPECT(u8(mem[size - 1]), u8(0xFF));
+
+	// released pages can be written again
+	mem[off + pageSize()] = std::byte(0x42);
+	EXPECT(u8(mem[off + pageSize()]), u8(0x42));
+}
+
+TEST(unit_pages_move) {
+	PageMemory a(pageSize());
+	a[0] = std::byte(1);
+
+	PageMemory b;
+	b = std::move(a);
+	EXPECT(a.get() == nullptr, true);
+	EXPECT(b.size(), pageSize());
+	EXPECT(u8(b[0]), u8(1));
+}
@@ -0,0 +1,94 @@
+#include "../bugged.hpp"
+#include <util/reclaim.hpp>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+struct Object {
+	ReclaimNode node;
+	std::atomic<u32>* destroyed {};
+	std::thread::id* thread {};
+};
+
+struct ObjectDeleter {
+	void operator()(Object* obj) const {
+		if(obj->thread) {
+			*obj->thread = std::this_thread::get_id();
+		}
+
+		obj->destroyed->fetch_add(1u);
+		delete obj;
+	}
+};
+
+void release(Reclaimer* reclaimer, std::atomic<u32>& destroyed,
+		std::thread::id* thread = nullptr) {
+	auto* obj = new Object();
+	obj->destroyed = &destroyed;
+	obj->thread = thread;
+	reclaim<Object, ObjectDeleter>(reclaimer, obj->node, obj);
+}
+
+} // anon namespace
+
+TEST(unit_reclaim_immediate) {
+	std::atomic<u32> destroyed {};
+
+	// without reclaimer
+	release(nullptr, destroyed);
+	EXPECT(destroyed.load(), 1u);
+
+	// not started yet
+	Reclaimer reclaimer;
+	release(&reclaimer, destroyed);
+	EXPECT(destroyed.load(), 2u);
+
+	reclaimer.start();
+	reclaimer.stop();
+
+	// already stopped
+	release(&reclaimer, destroyed);
+	EXPECT(destroyed.load(), 3u);
+}
+
+TEST(unit_reclaim_thread) {
+	constexpr auto numThreads = 4u;
+	constexpr auto numObjects = 1000u;
+
+	std::atomic<u32> destroyed {};
+	std::thread::id destroyThread {};
+
+	Reclaimer reclaimer;
+	reclaimer.start();
+
+	// Give the thread time to block on the (empty) list. Pushing
+	// must wake it up, the object is destroyed on the reclaim thread.
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	release(&reclaimer, destroyed, &destroyThread);
+	while(destroyed.load() == 0u) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	EXPECT(destroyThread != std::this_thread::get_id(), true);
+
+	std::vector<std::thread> threads;
+	for(auto t = 0u; t < numThreads; ++t) {
+		threads.emplace_back([&]{
+			for(auto i = 0u; i < numObjects; ++i) {
+				release(&reclaimer, destroyed);
+			}
+		});
+	}
+
+	for(auto& thread : threads) {
+		thread.join();
+	}
+
+	// stop must destroy everything still pending
+	reclaimer.stop();
+	EXPECT(destroyed.load(), numThreads * numObjects + 1u);
+}
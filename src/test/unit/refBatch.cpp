@@ -0,0 +1,125 @@
+#include "../bugged.hpp"
+#include <util/refBatch.hpp>
+#include <atomic>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+struct Object {
+	static inline u32 destroyed = 0u;
+
+	std::atomic<u32> refCount {};
+	~Object() { ++destroyed; }
+};
+
+} // anon namespace
+
+TEST(unit_refBatch_coalesce) {
+	Object::destroyed = 0u;
+	auto* a = new Object();
+	auto* b = new Object();
+	a->refCount = 1u;
+	b->refCount = 1u;
+
+	// rewriting the same descriptors with the handles they already hold
+	RefCountBatch refs;
+	for(auto i = 0u; i < 1000u; ++i) {
+		refs.dec(*a);
+		refs.inc(*a);
+		refs.inc(*b);
+	}
+
+	EXPECT(a->refCount.load(), 1u);
+	EXPECT(refs.size() <= 128u, true);
+
+	refs.flush();
+	EXPECT(refs.size(), 0u);
+	EXPECT(a->refCount.load(), 1u);
+	EXPECT(b->refCount.load(), 1001u);
+	EXPECT(Object::destroyed, 0u);
+
+	refs.add(*b, -1001);
+	refs.flush();
+	EXPECT(Object::destroyed, 1u);
+
+	refs.dec(*a);
+	refs.flush();
+	EXPECT(Object::destroyed, 2u);
+}
+
+TEST(unit_refBatch_order) {
+	Object::destroyed = 0u;
+	auto* a = new Object();
+	a->refCount = 1u;
+
+	// the reference is moved from one descriptor to another, the
+	// decrement comes first. Must never destroy the object.
+	RefCountBatch refs;
+	refs.dec(*a);
+	refs.inc(*a);
+	refs.inc(*a);
+	refs.dec(*a);
+	refs.flush();
+	EXPECT(a->refCount.load(), 1u);
+	EXPECT(Object::destroyed, 0u);
+
+	// many distinct objects, forcing intermediate flushes
+	constexpr auto count = 1000u;
+	std::vector<Object*> objects;
+	for(auto i = 0u; i < count; ++i) {
+		objects.push_back(new Object());
+		objects.back()->refCount = 1u;
+		refs.inc(*objects.back());
+	}
+
+	refs.flush();
+	for(auto* obj : objects) {
+		EXPECT(obj->refCount.load(), 2u);
+		refs.add(*obj, -2);
+	}
+
+	refs.dec(*a);
+	refs.flush();
+	EXPECT(Object::destroyed, count + 1u);
+}
+
+TEST(unit_refBatch_overflowOrder) {
+	Object::destroyed = 0u;
+	auto* a = new Object();
+	a->refCount = 1u;
+
+	// The reference of 'a' is moved to another descriptor, with many
+	// distinct objects in between, overflowing the batch. The decrement
+	// must not be applied before the increment.
+	RefCountBatch refs;
+	refs.dec(*a);
+
+	constexpr auto count = 1000u;
+	std::vector<Object*> objects;
+	for(auto i = 0u; i < count; ++i) {
+		objects.push_back(new Object());
+		objects.back()->refCount = 1u;
+		refs.dec(*objects.back());
+		refs.inc(*objects.back());
+		refs.add(*objects.back(), (i % 2u) ? 1 : -1);
+	}
+
+	refs.inc(*a);
+	EXPECT(Object::destroyed, 0u);
+
+	refs.flush();
+	EXPECT(refs.size(), 0u);
+	EXPECT(a->refCount.load(), 1u);
+	EXPECT(Object::destroyed, count / 2u);
+
+	for(auto i = 1u; i < count; i += 2u) {
+		EXPECT(objects[i]->refCount.load(), 2u);
+		refs.add(*objects[i], -2);
+	}
+
+	refs.dec(*a);
+	refs.flush();
+	EXPECT(Object::destroyed, count + 1u);
+}
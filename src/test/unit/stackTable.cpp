@@ -0,0 +1,141 @@
+#include "../bugged.hpp"
+#include <util/stackTable.hpp>
+#include <array>
+#include <thread>
+#include <vector>
+
+using namespace vil;
+
+namespace {
+
+[[gnu::noinline]] StackID captureA(StackTable& table) {
+	return table.capture();
+}
+
+[[gnu::noinline]] StackID captureB(StackTable& table) {
+	return table.capture();
+}
+
+} // anon namespace
+
+TEST(unit_stackTable_intern) {
+	StackTable table;
+
+	int a, b, c;
+	void* frames0[] = {&a, &b, &c};
+	void* frames1[] = {&a, &b};
+	void* frames2[] = {&b, &a, &c};
+
+	EXPECT(table.intern({}), 0u);
+	EXPECT(table.get(0u).empty(), true);
+
+	auto id0 = table.intern(frames0);
+	auto id1 = table.intern(frames1);
+	auto id2 = table.intern(frames2);
+	EXPECT(id0 != 0u, true);
+	EXPECT(id1 != 0u, true);
+	EXPECT(id2 != 0u, true);
+	EXPECT(id0 != id1, true);
+	EXPECT(id0 != id2, true);
+	EXPECT(id1 != id2, true);
+	EXPECT(table.size(), 3u);
+
+	EXPECT(table.intern(frames0), id0);
+	EXPECT(table.intern(frames2), id2);
+	EXPECT(table.size(), 3u);
+
+	auto stack = table.get(id0);
+	EXPECT(stack.size(), 3u);
+	EXPECT(stack[0], frames0[0]);
+	EXPECT(stack[1], frames0[1]);
+	EXPECT(stack[2], frames0[2]);
+
+	// frames beyond the maximum depth are ignored
+	void* deep[StackTable::maxDepth + 4];
+	for(auto& frame : deep) {
+		frame = &a;
+	}
+
+	auto idDeep = table.intern(deep);
+	EXPECT(table.get(idDeep).size(), StackTable::maxDepth);
+	EXPECT(table.intern(span<void* const>(deep).first(StackTable::maxDepth)), idDeep);
+}
+
+TEST(unit_stackTable_grow_threads) {
+	// enough stacks to grow the table multiple times
+	constexpr auto numStacks = 8 * StackTable::minCapacity;
+	constexpr auto numThreads = 4u;
+
+	StackTable table;
+	std::vector<int> anchors(numStacks);
+	auto frames = [&](unsigned i) {
+		// stacks only differing in their last frame
+		return std::array<void*, 3>{&anchors[0], &anchors[1], &anchors[i]};
+	};
+
+	// All threads intern all stacks (in different orders), each stack
+	// must only be added once and get the same id everywhere.
+	std::vector<std::vector<StackID>> ids(numThreads);
+	std::vector<std::thread> threads;
+	for(auto t = 0u; t < numThreads; ++t) {
+		threads.emplace_back([&, t]{
+			ids[t].resize(numStacks);
+			for(auto j = 0u; j < numStacks; ++j) {
+				auto i = (t % 2u == 0u) ? j : numStacks - j - 1;
+				ids[t][i] = table.intern(frames(i));
+			}
+		});
+	}
+
+	for(auto& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT(table.size(), numStacks);
+	for(auto i = 0u; i < numStacks; ++i) {
+		auto id = ids[0][i];
+		for(auto t = 1u; t < numThreads; ++t) {
+			EXPECT(ids[t][i], id);
+		}
+
+		EXPECT(table.intern(frames(i)), id);
+
+		auto stack = table.get(id);
+		EXPECT(stack.size(), 3u);
+		EXPECT(stack[2], static_cast<void*>(&anchors[i]));
+	}
+}
+
+TEST(unit_stackTable_capture) {
+	StackTable table;
+
+	auto idA0 = captureA(table);
+	auto idA1 = captureA(table);
+	auto idB = captureB(table);
+
+	// Only reliable when frame pointers are available, the layer is
+	// built with them when callstacks are enabled.
+#if defined(VIL_COMMAND_CALLSTACKS) && (defined(__GNUC__) || defined(_WIN32))
+	EXPECT(idA0 != 0u, true);
+	EXPECT(idA1 != 0u, true);
+	EXPECT(idB != 0u, true);
+
+	// The innermost frame is inside the capturing function, the
+	// outer frames depend on the call site.
+	auto stackA0 = table.get(idA0);
+	auto stackA1 = table.get(idA1);
+	auto stackB = table.get(idB);
+	EXPECT(stackA0.empty(), false);
+	EXPECT(stackA1.empty(), false);
+	EXPECT(stackB.empty(), false);
+	EXPECT(stackA0[0], stackA1[0]);
+	EXPECT(stackA0[0] != stackB[0], true);
+#endif // VIL_COMMAND_CALLSTACKS
+
+	// must never crash, even if the frame pointer chain is broken
+	for(auto i = 0u; i < 16u; ++i) {
+		void* frames[StackTable::maxDepth];
+		auto count = captureStack(frames, i);
+		EXPECT(count <= StackTable::maxDepth, true);
+	}
+}
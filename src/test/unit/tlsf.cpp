@@ -0,0 +1,175 @@
+#include "../bugged.hpp"
+#include <util/tlsf.hpp>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace vil;
+
+TEST(unit_tlsf_basic) {
+	TlsfAllocator alloc;
+	alloc.init(1024u, 8u);
+	EXPECT(alloc.size(), 1024u);
+	EXPECT(alloc.freeSize(), 1024u);
+
+	auto a = alloc.alloc(100u);
+	auto b = alloc.alloc(8u);
+	auto c = alloc.alloc(200u);
+	EXPECT(a.block != TlsfAllocator::invalid, true);
+	EXPECT(b.block != TlsfAllocator::invalid, true);
+	EXPECT(c.block != TlsfAllocator::invalid, true);
+	EXPECT(a.offset % TlsfAllocator::alignment, 0u);
+	EXPECT(b.offset % TlsfAllocator::alignment, 0u);
+	EXPECT(c.offset % TlsfAllocator::alignment, 0u);
+	EXPECT(alloc.freeSize(), 1024u - 104u - 8u - 200u);
+
+	// freeing in the middle, then allocating the same size again
+	alloc.free(b.block);
+	auto d = alloc.alloc(8u);
+	EXPECT(d.offset, b.offset);
+
+	alloc.free(a.block);
+	alloc.free(c.block);
+	alloc.free(d.block);
+	EXPECT(alloc.freeSize(), 1024u);
+
+	// everything was merged again
+	auto full = alloc.alloc(1024u);
+	EXPECT(full.offset, 0u);
+	EXPECT(alloc.alloc(8u).block, TlsfAllocator::invalid);
+
+	alloc.reset();
+	EXPECT(alloc.freeSize(), 1024u);
+	EXPECT(alloc.alloc(0u).block, TlsfAllocator::invalid);
+	EXPECT(alloc.alloc(1032u).block, TlsfAllocator::invalid);
+}
+
+TEST(unit_tlsf_exactFill) {
+	// Like a descriptor pool that is sized for exactly maxSets sets
+	// of the same layout. All allocations must succeed.
+	constexpr auto count = 64u;
+	constexpr auto size = 1000u;
+
+	TlsfAllocator alloc;
+	alloc.init(count * size, count);
+
+	std::vector<TlsfAllocator::Allocation> allocs;
+	for(auto i = 0u; i < count; ++i) {
+		auto a = alloc.alloc(size);
+		EXPECT(a.block != TlsfAllocator::invalid, true);
+		allocs.push_back(a);
+	}
+
+	EXPECT(alloc.freeSize(), 0u);
+
+	// free every other one and allocate them again
+	for(auto i = 0u; i < count; i += 2) {
+		alloc.free(allocs[i].block);
+	}
+
+	for(auto i = 0u; i < count; i += 2) {
+		allocs[i] = alloc.alloc(size);
+		EXPECT(allocs[i].block != TlsfAllocator::invalid, true);
+	}
+
+	EXPECT(alloc.freeSize(), 0u);
+}
+
+TEST(unit_tlsf_exactFillUnaligned) {
+	// Like a descriptor pool sized exactly for maxSets sets with an
+	// inline uniform block of 4 bytes, i.e. the set sizes aren't aligned.
+	constexpr auto count = 64u;
+	constexpr auto size = 1004u;
+
+	// Without padding, the rounded up allocations don't fit
+	TlsfAllocator unpadded;
+	unpadded.init(count * size, count);
+	auto failed = false;
+	for(auto i = 0u; i < count; ++i) {
+		failed |= (unpadded.alloc(size).block == TlsfAllocator::invalid);
+	}
+
+	EXPECT(failed, true);
+
+	TlsfAllocator alloc;
+	alloc.init(TlsfAllocator::paddedSize(count * size, count), count);
+
+	std::vector<TlsfAllocator::Allocation> allocs;
+	for(auto i = 0u; i < count; ++i) {
+		auto a = alloc.alloc(size);
+		EXPECT(a.block != TlsfAllocator::invalid, true);
+		allocs.push_back(a);
+	}
+
+	// free every other one and allocate them again
+	for(auto i = 0u; i < count; i += 2) {
+		alloc.free(allocs[i].block);
+	}
+
+	for(auto i = 0u; i < count; i += 2) {
+		allocs[i] = alloc.alloc(size);
+		EXPECT(allocs[i].block != TlsfAllocator::invalid, true);
+	}
+}
+
+TEST(unit_tlsf_churn) {
+	constexpr auto rangeSize = 256u * 1024u;
+	constexpr auto maxAllocs = 512u;
+
+	TlsfAllocator alloc;
+	alloc.init(rangeSize, maxAllocs);
+
+	struct Alloc {
+		TlsfAllocator::Allocation alloc;
+		u32 size;
+	};
+
+	std::vector<Alloc> allocs;
+	std::mt19937 rng(42u);
+	std::uniform_int_distribution<u32> sizeDist(1u, 4096u);
+
+	auto checkOverlaps = [&]{
+		auto sorted = allocs;
+		std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+			return a.alloc.offset < b.alloc.offset;
+		});
+
+		for(auto i = 0u; i < sorted.size(); ++i) {
+			auto end = sorted[i].alloc.offset + sorted[i].size;
+			EXPECT(end <= rangeSize, true);
+			if(i + 1 < sorted.size()) {
+				EXPECT(end <= sorted[i + 1].alloc.offset, true);
+			}
+		}
+	};
+
+	for(auto i = 0u; i < 20000u; ++i) {
+		auto doAlloc = allocs.empty() ||
+			(allocs.size() < maxAllocs && rng() % 2u == 0u);
+		if(doAlloc) {
+			auto size = sizeDist(rng);
+			auto a = alloc.alloc(size);
+			if(a.block != TlsfAllocator::invalid) {
+				allocs.push_back({a, size});
+			}
+		} else {
+			auto id = rng() % allocs.size();
+			alloc.free(allocs[id].alloc.block);
+			allocs[id] = allocs.back();
+			allocs.pop_back();
+		}
+
+		if(i % 1000u == 0u) {
+			checkOverlaps();
+		}
+	}
+
+	checkOverlaps();
+
+	for(auto& a : allocs) {
+		alloc.free(a.alloc.block);
+	}
+
+	EXPECT(alloc.freeSize(), rangeSize);
+	EXPECT(alloc.alloc(rangeSize).offset, 0u);
+}
@@ -0,0 +1,408 @@
+#include "../bugged.hpp"
+#include <device.hpp>
+#include <image.hpp>
+#include <ds.hpp>
+#include <util/refBatch.hpp>
+#include <util/dlg.hpp>
+#include <vector>
+#include <cstring>
+
+using namespace vil;
+
+namespace {
+
+struct BindingDesc {
+	VkDescriptorType type;
+	u32 count;
+	VkDescriptorBindingFlags flags {};
+};
+
+u32 elemSize(VkDescriptorType type) {
+	switch(category(type)) {
+		case DescriptorCategory::buffer: return sizeof(BufferDescriptor);
+		case DescriptorCategory::image: return sizeof(ImageDescriptor);
+		case DescriptorCategory::bufferView: return sizeof(BufferViewDescriptor);
+		case DescriptorCategory::accelStruct: return sizeof(AccelStructDescriptor);
+		case DescriptorCategory::inlineUniformBlock: return 1u;
+		case DescriptorCategory::none: break;
+	}
+
+	return 0u;
+}
+
+// Numbers the offsets like CreateDescriptorSetLayout
+IntrusivePtr<DescriptorSetLayout> makeLayout(Device& dev,
+		std::initializer_list<BindingDesc> descs) {
+	IntrusivePtr<DescriptorSetLayout> ret(new DescriptorSetLayout());
+	ret->dev = &dev;
+
+	auto off = 0u;
+	for(auto& desc : descs) {
+		auto& binding = ret->bindings.emplace_back();
+		binding.offset = off;
+		binding.descriptorCount = desc.count;
+		binding.descriptorType = desc.type;
+		binding.flags = desc.flags;
+		off += desc.count * elemSize(desc.type);
+	}
+
+	return ret;
+}
+
+VkDescriptorUpdateTemplateEntry makeEntry(VkDescriptorType type, u32 binding,
+		u32 elem, u32 count, u32 offset, u32 stride) {
+	VkDescriptorUpdateTemplateEntry ret {};
+	ret.descriptorType = type;
+	ret.dstBinding = binding;
+	ret.dstArrayElement = elem;
+	ret.descriptorCount = count;
+	ret.offset = offset;
+	ret.stride = stride;
+	return ret;
+}
+
+u32 stateSize(const DescriptorSetLayout& layout, u32 varCount) {
+	if(layout.bindings.empty()) {
+		return 0u;
+	}
+
+	auto& last = layout.bindings.back();
+	auto count = last.descriptorCount;
+	if(last.flags & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT) {
+		count = varCount;
+	}
+
+	return last.offset + count * elemSize(last.descriptorType);
+}
+
+constexpr auto guardByte = std::byte(0xCDu);
+constexpr auto guardSize = 64u;
+
+// A descriptor set outside of any pool. Like for sets allocated from
+// a pool, the binding data follows it in memory. It's followed by
+// guard bytes to detect out-of-bounds writes.
+struct TestSet {
+	std::vector<u64> mem;
+	DescriptorSet* ds {};
+	u32 dataSize {};
+
+	TestSet(IntrusivePtr<DescriptorSetLayout> layout, u32 varCount = 0u) {
+		dataSize = stateSize(*layout, varCount);
+		auto memSize = sizeof(DescriptorSet) + dataSize + guardSize;
+		mem.resize((memSize + sizeof(u64) - 1) / sizeof(u64));
+		std::memset(mem.data(), int(guardByte), mem.size() * sizeof(u64));
+
+		ds = new(mem.data()) DescriptorSet();
+		ds->layout = std::move(layout);
+		ds->variableDescriptorCount = varCount;
+		std::memset(data(), 0x0, dataSize);
+	}
+
+	~TestSet() {
+		ds->~DescriptorSet();
+	}
+
+	std::byte* data() const {
+		return reinterpret_cast<std::byte*>(ds) + sizeof(DescriptorSet);
+	}
+
+	bool guardIntact() const {
+		auto* guard = data() + dataSize;
+		for(auto i = 0u; i < guardSize; ++i) {
+			if(guard[i] != guardByte) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+};
+
+// Counts the dlg warnings and errors (including failed assertions)
+// while alive instead of forwarding them, for tests that trigger
+// them on purpose.
+struct ExpectErrors {
+	dlg_handler oldHandler {};
+	void* oldData {};
+	u32 count {};
+
+	ExpectErrors() {
+		oldHandler = dlg_get_handler(&oldData);
+		dlg_set_handler(&ExpectErrors::handler, this);
+	}
+
+	~ExpectErrors() {
+		dlg_set_handler(oldHandler, oldData);
+	}
+
+	static void handler(const dlg_origin* origin, const char*, void* data) {
+		if(origin->level >= dlg_level_warn) {
+			++static_cast<ExpectErrors*>(data)->count;
+		}
+	}
+};
+
+// Update data for buffer descriptors with a gap between them,
+// the stride must be respected.
+constexpr auto bufStride = u32(sizeof(VkDescriptorBufferInfo) + 8u);
+
+std::vector<std::byte> bufferData(u32 count, u32 offset = 0u) {
+	std::vector<std::byte> ret(offset + count * bufStride);
+	for(auto i = 0u; i < count; ++i) {
+		VkDescriptorBufferInfo info {};
+		info.offset = 100u + i;
+		info.range = 10u + i;
+		std::memcpy(ret.data() + offset + i * bufStride, &info, sizeof(info));
+	}
+
+	return ret;
+}
+
+void apply(const DescriptorUpdateTemplate& dut, DescriptorSet& ds,
+		std::vector<std::byte> data) {
+	RefCountBatch refs;
+	auto ok = applyUpdatePlan(dut, ds, data.data(), false, refs);
+	refs.flush();
+	EXPECT(ok, true);
+}
+
+} // anon namespace
+
+TEST(unit_updatePlan_overflow) {
+	constexpr auto type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+	Device dev;
+	auto layout = makeLayout(dev, {{type, 2u}, {type, 3u}});
+
+	// writes the last element of binding 0 and the first two of binding 1
+	constexpr auto srcOffset = 8u;
+	DescriptorUpdateTemplate dut;
+	dut.entries = {makeEntry(type, 0u, 1u, 3u, srcOffset, bufStride)};
+	EXPECT(compileUpdatePlan(dut, *layout), true);
+	EXPECT(dut.plan.size(), 2u);
+
+	auto& op0 = dut.plan[0];
+	EXPECT(op0.binding, 0u);
+	EXPECT(op0.elem, 1u);
+	EXPECT(op0.count, 1u);
+	EXPECT(op0.srcOffset, srcOffset);
+	EXPECT(op0.srcStride, bufStride);
+	EXPECT(op0.dstOffset, u32(sizeof(BufferDescriptor)));
+	EXPECT(op0.category, DescriptorCategory::buffer);
+	EXPECT(op0.variableCount, false);
+
+	auto& op1 = dut.plan[1];
+	EXPECT(op1.binding, 1u);
+	EXPECT(op1.elem, 0u);
+	EXPECT(op1.count, 2u);
+	EXPECT(op1.srcOffset, srcOffset + bufStride);
+	EXPECT(op1.srcStride, bufStride);
+	EXPECT(op1.dstOffset, layout->bindings[1].offset);
+
+	TestSet set(layout);
+	apply(dut, *set.ds, bufferData(3u, srcOffset));
+
+	auto b0 = buffers(*set.ds, 0u);
+	auto b1 = buffers(*set.ds, 1u);
+	EXPECT(b0[0].offset, 0u);
+	EXPECT(b0[1].offset, 100u);
+	EXPECT(b0[1].range, 10u);
+	EXPECT(b1[0].offset, 101u);
+	EXPECT(b1[0].range, 11u);
+	EXPECT(b1[1].offset, 102u);
+	EXPECT(b1[2].offset, 0u);
+	EXPECT(b1[2].range, 0u);
+	EXPECT(set.guardIntact(), true);
+
+	layout->dev = nullptr;
+}
+
+TEST(unit_updatePlan_variableCount) {
+	constexpr auto type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	constexpr auto varFlag = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+	Device dev;
+	auto layout = makeLayout(dev, {
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1u},
+		{type, 8u, varFlag},
+	});
+
+	// the set only has 2 of the 8 descriptors, the plan is compiled
+	// for the upper bound of the layout
+	TestSet set(layout, 2u);
+
+	DescriptorUpdateTemplate dut;
+	dut.entries = {makeEntry(type, 1u, 1u, 1u, 0u, bufStride)};
+	EXPECT(compileUpdatePlan(dut, *layout), true);
+	EXPECT(dut.plan.size(), 1u);
+	EXPECT(dut.plan[0].variableCount, true);
+
+	apply(dut, *set.ds, bufferData(1u));
+	EXPECT(buffers(*set.ds, 1u).size(), 2u);
+	EXPECT(buffers(*set.ds, 1u)[0].offset, 0u);
+	EXPECT(buffers(*set.ds, 1u)[1].offset, 100u);
+
+#ifndef VIL_THROW_ON_ASSERT
+	// Out of bounds for the set: we report it but must not write past
+	// the end of its state.
+	dut.entries = {makeEntry(type, 1u, 0u, 4u, 0u, bufStride)};
+	EXPECT(compileUpdatePlan(dut, *layout), true);
+	EXPECT(dut.plan[0].count, 4u);
+
+	{
+		ExpectErrors errors;
+		apply(dut, *set.ds, bufferData(4u));
+#ifndef DLG_DISABLE
+		EXPECT(errors.count, 1u);
+#endif // DLG_DISABLE
+	}
+
+	EXPECT(buffers(*set.ds, 1u)[0].offset, 100u);
+	EXPECT(buffers(*set.ds, 1u)[1].offset, 101u);
+	EXPECT(set.guardIntact(), true);
+#endif // VIL_THROW_ON_ASSERT
+
+	layout->dev = nullptr;
+}
+
+TEST(unit_updatePlan_inlineUniformBlock) {
+	constexpr auto type = VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK_EXT;
+
+	Device dev;
+	auto layout = makeLayout(dev, {
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1u},
+		{type, 16u},
+	});
+
+	// dstArrayElement and descriptorCount are in bytes, the stride
+	// must be ignored
+	DescriptorUpdateTemplate dut;
+	dut.entries = {makeEntry(type, 1u, 4u, 8u, 2u, 64u)};
+	EXPECT(compileUpdatePlan(dut, *layout), true);
+	EXPECT(dut.plan.size(), 1u);
+
+	auto& op = dut.plan[0];
+	EXPECT(op.category, DescriptorCategory::inlineUniformBlock);
+	EXPECT(op.srcOffset, 2u);
+	EXPECT(op.srcStride, 1u);
+	EXPECT(op.elem, 4u);
+	EXPECT(op.count, 8u);
+	EXPECT(op.dstOffset, layout->bindings[1].offset + 4u);
+
+	std::vector<std::byte> data(2u + 8u);
+	for(auto i = 0u; i < 8u; ++i) {
+		data[2u + i] = std::byte(1u + i);
+	}
+
+	TestSet set(layout);
+	apply(dut, *set.ds, data);
+
+	auto block = inlineUniformBlock(*set.ds, 1u);
+	EXPECT(block.size(), 16u);
+	for(auto i = 0u; i < block.size(); ++i) {
+		auto expected = (i >= 4u && i < 12u) ? std::byte(i - 3u) : std::byte(0u);
+		EXPECT(block[i], expected);
+	}
+
+	EXPECT(set.guardIntact(), true);
+
+	layout->dev = nullptr;
+}
+
+TEST(unit_updatePlan_immutableSamplers) {
+	constexpr auto type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	Device dev;
+	auto layout = makeLayout(dev, {{type, 2u}, {type, 1u}});
+
+	IntrusivePtr<Sampler> sampler(new Sampler());
+	auto& immut = layout->bindings[0];
+	immut.immutableSamplers = std::make_unique<IntrusivePtr<Sampler>[]>(2u);
+	immut.immutableSamplers[0] = sampler;
+	immut.immutableSamplers[1] = sampler;
+	layout->immutableSamplers = true;
+
+	DescriptorUpdateTemplate dut;
+	dut.entries = {makeEntry(type, 0u, 0u, 3u, 0u, sizeof(VkDescriptorImageInfo))};
+	EXPECT(compileUpdatePlan(dut, *layout), true);
+	EXPECT(dut.plan.size(), 2u);
+	EXPECT(dut.plan[0].updateView, true);
+	EXPECT(dut.plan[0].updateSampler, false);
+	EXPECT(dut.plan[1].updateView, true);
+	EXPECT(dut.plan[1].updateSampler, true);
+
+	// Filled in on allocation, see initImmutableSamplers. Set without
+	// references here, the test set is never freed via the pool.
+	TestSet set(layout);
+	images(*set.ds, 0u)[0].sampler = sampler.get();
+	images(*set.ds, 0u)[1].sampler = sampler.get();
+
+	std::vector<std::byte> data(3u * sizeof(VkDescriptorImageInfo));
+	for(auto i = 0u; i < 3u; ++i) {
+		VkDescriptorImageInfo info {};
+		info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		std::memcpy(data.data() + i * sizeof(info), &info, sizeof(info));
+	}
+
+	apply(dut, *set.ds, data);
+
+	for(auto& img : images(*set.ds, 0u)) {
+		EXPECT(img.sampler, sampler.get());
+		EXPECT(img.imageView, nullptr);
+		EXPECT(img.layout, VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	EXPECT(images(*set.ds, 1u)[0].sampler, nullptr);
+	EXPECT(images(*set.ds, 1u)[0].layout, VK_IMAGE_LAYOUT_GENERAL);
+
+	layout->dev = nullptr;
+}
+
+TEST(unit_updatePlan_compatibleLayout) {
+	constexpr auto bufType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	constexpr auto inlineType = VK_DESCRIPTOR_TYPE_INLINE_UNIFORM_BLOCK_EXT;
+
+	Device dev;
+	auto layoutA = makeLayout(dev, {{bufType, 2u}, {bufType, 2u}, {inlineType, 8u}});
+	auto layoutB = makeLayout(dev, {{bufType, 2u}, {bufType, 2u}, {inlineType, 8u}});
+	EXPECT(compatible(*layoutA, *layoutB), true);
+
+	constexpr auto inlineOffset = 3u * bufStride;
+	DescriptorUpdateTemplate dut;
+	dut.entries = {
+		makeEntry(bufType, 0u, 1u, 3u, 0u, bufStride),
+		makeEntry(inlineType, 2u, 2u, 4u, inlineOffset, 32u),
+	};
+	EXPECT(compileUpdatePlan(dut, *layoutA), true);
+	dut.planLayout = layoutA;
+
+	auto data = bufferData(3u);
+	data.resize(inlineOffset + 4u);
+	for(auto i = 0u; i < 4u; ++i) {
+		data[inlineOffset + i] = std::byte(1u + i);
+	}
+
+	TestSet setA(layoutA);
+	apply(dut, *setA.ds, data);
+
+	// the plan was not compiled for this layout, so UpdateDescriptorSetWithTemplate
+	// takes the generic path. It must yield the same state.
+	TestSet setB(layoutB);
+	EXPECT(dut.planLayout.get() == setB.ds->layout.get(), false);
+	{
+		RefCountBatch refs;
+		auto copy = data;
+		applyUpdateEntries(dut, *setB.ds, copy.data(), refs);
+		refs.flush();
+	}
+
+	EXPECT(setA.dataSize, setB.dataSize);
+	auto same = std::memcmp(setA.data(), setB.data(), setA.dataSize) == 0;
+	EXPECT(same, true);
+	EXPECT(buffers(*setB.ds, 1u)[1].offset, 102u);
+	EXPECT(inlineUniformBlock(*setB.ds, 2u)[2], std::byte(1u));
+	EXPECT(setB.guardIntact(), true);
+
+	layoutA->dev = nullptr;
+	layoutB->dev = nullptr;
+}
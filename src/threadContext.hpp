@@ -19,8 +19,8 @@
 
 namespace vil {
 
-// All data we need per-thread. Currently only used for stack-like
-// dynamic memory allocation.
+// All data we need per-thread. Used for stack-like dynamic memory
+// allocation and for caching LinAllocator memory blocks.
 struct ThreadContext {
 	// NOTE: C++ does not clearly specify when its constructor will
 	// be called, just that it's before it's used the first time.
@@ -34,6 +34,10 @@ struct ThreadContext {
 	// Only to be used in a scoped manner, via ThreadMemScope.
 	LinAllocator linalloc_;
 
+	// Per-thread block cache for all LinBlockPool objects.
+	// See LinBlockPool in linalloc.hpp
+	LinBlockPool::Magazine blockMagazine_;
+
 	ThreadContext() {
 		linalloc_.onAlloc = [&](auto* buf, auto size) {
 			(void) buf;
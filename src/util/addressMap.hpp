@@ -0,0 +1,309 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace vil {
+
+// Maps device address ranges to objects, e.g. buffers or acceleration
+// structures. Used for every device address resolution so lookups
+// work on an immutable snapshot, loaded via an atomic pointer without
+// taking a lock. Lookups can run concurrently with add/remove, no
+// external synchronization is needed. Whether the returned object is
+// still alive is up to the caller though.
+//
+// A snapshot consists of a sorted interval array (the base), shared
+// between snapshots, and a small delta of entries added and removed
+// since the base was built. Changes are only collected and applied in
+// batches: the first lookup after a change builds a new snapshot. That
+// only copies the delta, the base is rebuilt once the delta gets
+// larger than maxDelta. Creating or destroying many objects in a row
+// thus doesn't rebuild the full array every time.
+//
+// Replaced snapshots are retired with a two-counter epoch scheme:
+// lookups register in the counter of the current epoch. A snapshot
+// replaced in epoch e is freed once no lookup of epoch e (and e - 1)
+// is active anymore, i.e. after the epoch could be advanced twice.
+template<typename T>
+class AddressMap {
+public:
+	struct Entry {
+		u64 begin;
+		u64 end;
+		T* value;
+	};
+
+	// Maximum number of changes kept in the delta of a snapshot.
+	// Lookups check the added entries linearly.
+	static constexpr auto maxDelta = 64u;
+
+	AddressMap() {
+		current_.store(new Snapshot{std::make_shared<Base>(), {}, {}});
+	}
+
+	~AddressMap() {
+		delete current_.load(std::memory_order_relaxed);
+		for(auto& retired : retired_) {
+			delete retired.snapshot;
+		}
+	}
+
+	AddressMap(const AddressMap&) = delete;
+	AddressMap& operator=(const AddressMap&) = delete;
+
+	void add(u64 begin, u64 size, T& value) {
+		dlg_assert(size > 0u);
+		std::lock_guard lock(mutex_);
+		reclaimLocked();
+
+		// NOTE: value might be in removed_ as well, when an object was
+		// destroyed and a new one created at the same place in memory.
+		// The old entry is still removed from the base then.
+		auto [_, success] = added_.emplace(&value, Entry{begin, begin + size, &value});
+		dlg_assert(success);
+		dirty_.store(true, std::memory_order_release);
+	}
+
+	void remove(T& value) {
+		std::lock_guard lock(mutex_);
+		reclaimLocked();
+
+		if(added_.erase(&value) == 0u) {
+			auto [_, success] = removed_.insert(&value);
+			dlg_assert(success);
+		}
+
+		dirty_.store(true, std::memory_order_release);
+	}
+
+	// Returns the object whose range contains the given address, nullptr
+	// if there is none. For overlapping ranges (e.g. aliased memory)
+	// returns the one that starts closest before the address.
+	T* find(u64 address) const {
+		ReadGuard guard(*this);
+		auto& snap = *guard.snapshot;
+		auto& entries = snap.base->entries;
+		auto& maxEnd = snap.base->maxEnd;
+
+		const Entry* best {};
+		auto it = std::upper_bound(entries.begin(), entries.end(), address,
+			[](u64 addr, const Entry& entry) { return addr < entry.begin; });
+		for(auto i = it - entries.begin(); i-- > 0; ) {
+			// no range up to i reaches the address
+			if(maxEnd[i] <= address) {
+				break;
+			}
+
+			if(entries[i].end > address && !snap.removed(entries[i].value)) {
+				best = &entries[i];
+				break;
+			}
+		}
+
+		for(auto& entry : snap.added) {
+			if(entry.begin <= address && entry.end > address &&
+					(!best || entry.begin > best->begin)) {
+				best = &entry;
+			}
+		}
+
+		return best ? best->value : nullptr;
+	}
+
+	// Returns the object whose range starts at the given address, nullptr
+	// if there is none.
+	T* findExact(u64 address) const {
+		ReadGuard guard(*this);
+		auto& snap = *guard.snapshot;
+		auto& entries = snap.base->entries;
+
+		auto it = std::lower_bound(entries.begin(), entries.end(), address,
+			[](const Entry& entry, u64 addr) { return entry.begin < addr; });
+		for(; it != entries.end() && it->begin == address; ++it) {
+			if(!snap.removed(it->value)) {
+				return it->value;
+			}
+		}
+
+		for(auto& entry : snap.added) {
+			if(entry.begin == address) {
+				return entry.value;
+			}
+		}
+
+		return nullptr;
+	}
+
+private:
+	struct Base {
+		std::vector<Entry> entries; // sorted by begin
+		std::vector<u64> maxEnd; // maximum end of entries[0..i]
+	};
+
+	struct Snapshot {
+		std::shared_ptr<const Base> base;
+		std::vector<Entry> added; // not in base
+		std::vector<const T*> removedValues; // sorted, still in base
+
+		bool removed(const T* value) const {
+			return !removedValues.empty() && std::binary_search(
+				removedValues.begin(), removedValues.end(), value);
+		}
+	};
+
+	struct Retired {
+		const Snapshot* snapshot;
+		u64 epoch; // in which it was replaced
+	};
+
+	// Registers a lookup in the current epoch and loads the snapshot.
+	struct ReadGuard {
+		const AddressMap& map;
+		std::atomic<u32>* readers {};
+		const Snapshot* snapshot {};
+
+		explicit ReadGuard(const AddressMap& xmap) : map(xmap) {
+			if(map.dirty_.load(std::memory_order_acquire)) {
+				map.rebuild();
+			}
+
+			// If the epoch changed before we registered, the writer might
+			// already have checked our counter.
+			while(true) {
+				auto epoch = map.epoch_.load();
+				readers = &map.readers_[epoch % 2u];
+				readers->fetch_add(1u);
+				if(map.epoch_.load() == epoch) {
+					break;
+				}
+
+				readers->fetch_sub(1u);
+			}
+
+			snapshot = map.current_.load();
+		}
+
+		~ReadGuard() {
+			readers->fetch_sub(1u, std::memory_order_release);
+		}
+	};
+
+	void rebuild() const {
+		std::lock_guard lock(mutex_);
+		if(!dirty_.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		auto* old = current_.load(std::memory_order_relaxed);
+		auto* next = new Snapshot();
+		if(added_.size() + removed_.size() <= maxDelta) {
+			next->base = old->base;
+			next->added.reserve(added_.size());
+			for(auto& [_, entry] : added_) {
+				next->added.push_back(entry);
+			}
+
+			next->removedValues.assign(removed_.begin(), removed_.end());
+			std::sort(next->removedValues.begin(), next->removedValues.end());
+		} else {
+			next->base = mergeLocked(*old->base);
+			added_.clear();
+			removed_.clear();
+		}
+
+		current_.store(next);
+		dirty_.store(false, std::memory_order_release);
+
+		// Lookups might still use the old snapshot
+		retired_.push_back({old, epoch_.load()});
+		reclaimLocked();
+	}
+
+	// Returns a new base with the pending changes applied.
+	std::shared_ptr<const Base> mergeLocked(const Base& old) const {
+		auto cmp = [](const Entry& a, const Entry& b) { return a.begin < b.begin; };
+
+		std::vector<Entry> added;
+		added.reserve(added_.size());
+		for(auto& [_, entry] : added_) {
+			added.push_back(entry);
+		}
+
+		std::sort(added.begin(), added.end(), cmp);
+
+		std::vector<Entry> kept;
+		kept.reserve(old.entries.size());
+		for(auto& entry : old.entries) {
+			if(!removed_.count(entry.value)) {
+				kept.push_back(entry);
+			}
+		}
+
+		auto ret = std::make_shared<Base>();
+		ret->entries.resize(kept.size() + added.size());
+		std::merge(kept.begin(), kept.end(), added.begin(), added.end(),
+			ret->entries.begin(), cmp);
+
+		ret->maxEnd.resize(ret->entries.size());
+		auto maxEnd = u64(0u);
+		for(auto i = 0u; i < ret->entries.size(); ++i) {
+			maxEnd = std::max(maxEnd, ret->entries[i].end);
+			ret->maxEnd[i] = maxEnd;
+		}
+
+		return ret;
+	}
+
+	// Frees the retired snapshots no lookup can use anymore and advances
+	// the epoch if possible. Never blocks.
+	void reclaimLocked() const {
+		if(retired_.empty()) {
+			return;
+		}
+
+		// Lookups registered in the previous epoch might still use
+		// anything replaced up to now.
+		auto epoch = epoch_.load();
+		if(readers_[(epoch + 1u) % 2u].load() != 0u) {
+			return;
+		}
+
+		// All snapshots replaced before the current epoch can only
+		// be used by lookups of the previous one.
+		auto it = std::remove_if(retired_.begin(), retired_.end(),
+			[&](const Retired& retired) {
+				if(retired.epoch < epoch) {
+					delete retired.snapshot;
+					return true;
+				}
+
+				return false;
+			});
+		retired_.erase(it, retired_.end());
+
+		// Lookups of the new epoch will see the current snapshot
+		epoch_.store(epoch + 1u);
+	}
+
+	mutable std::atomic<const Snapshot*> current_ {};
+	mutable std::atomic<bool> dirty_ {};
+	mutable std::atomic<u64> epoch_ {};
+	mutable std::atomic<u32> readers_[2] {};
+
+	// Protects everything below. Only accessed when adding or removing
+	// entries and when rebuilding the snapshot.
+	mutable std::mutex mutex_;
+	// Changes relative to the base of the current snapshot
+	mutable std::unordered_map<T*, Entry> added_;
+	mutable std::unordered_set<T*> removed_;
+	mutable std::vector<Retired> retired_;
+};
+
+} // namespace vil
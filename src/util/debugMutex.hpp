@@ -1,22 +1,267 @@
 #pragma once
 
-#include <unordered_set>
+#include <unordered_map>
 #include <shared_mutex>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <vector>
 #include <util/dlg.hpp>
 #include <util/profiling.hpp>
+#include <util/lockProfile.hpp>
+
+// Debug checks always come with the lock profile
+#if defined(VIL_DEBUG_MUTEX) && !defined(VIL_LOCK_PROFILING)
+	#define VIL_LOCK_PROFILING
+#endif
 
 namespace vil {
 
-#ifndef VIL_DEBUG_MUTEX
+// Fixed ranks of the long-lived locks, forming the lock hierarchy.
+// A thread may only lock a ranked mutex while it holds no mutex with the
+// same or a higher rank, i.e. locks are acquired in the order listed here.
+// With VIL_DEBUG_MUTEX, this is checked on every lock, see setLockRank.
+// Per-object mutexes (e.g. DescriptorPool::mutex) stay unranked, they
+// are not checked. They only get their own lock profile site, see setLockSite.
+enum class LockRank : unsigned {
+	none,
+	// Device::submissionMutex, held during application submissions,
+	// including the driver call. Guarantees that Device::pending contains
+	// all submitted work.
+	submission,
+	// Device::mutex, the resource graph: handle tables, connections
+	// between handles, command records and their hook records.
+	device,
+	// CommandHook::mutex, the capture state: hook target and ops,
+	// completed hooks and local captures.
+	hook,
+	// DescriptorBufferTable::mutex
+	descriptorBuffer,
+	// Device::queueMutex, only held around queue operations.
+	queue,
+	// Device::dsPoolMutex, only held around allocating and freeing
+	// descriptor sets from Device::dsPool.
+	dsPool,
+	// Device::snapshotMutex, the handle tables and the links between
+	// handles the gui shows. Only held for short sections that never
+	// lock another ranked mutex.
+	snapshot,
+};
+
+constexpr auto lockRankCount = unsigned(LockRank::snapshot) + 1u;
+
+// The lock profile site of a ranked mutex.
+constexpr LockSite lockSite(LockRank rank) {
+	switch(rank) {
+		case LockRank::none: return LockSite::other;
+		case LockRank::submission: return LockSite::submission;
+		case LockRank::device: return LockSite::device;
+		case LockRank::hook: return LockSite::hook;
+		case LockRank::descriptorBuffer: return LockSite::descriptorBuffer;
+		case LockRank::queue: return LockSite::queue;
+		case LockRank::dsPool: return LockSite::dsPool;
+		case LockRank::snapshot: return LockSite::snapshot;
+	}
+
+	return LockSite::other;
+}
+
+#ifdef VIL_LOCK_PROFILING
+
+// Locks via the given functions, recording the wait time into the lock
+// profile when enabled. Returns the time the lock was acquired, 0 when
+// the lock profile is disabled.
+template<typename TryLock, typename Lock>
+u64 profiledLock(LockSite site, TryLock&& tryLock, Lock&& lock) {
+	if(!lockProfileEnabled()) {
+		lock();
+		return 0u;
+	}
+
+	auto start = lockProfileNow();
+	auto contended = !tryLock();
+	if(contended) {
+		lock();
+	}
+
+	auto end = lockProfileNow();
+	lockProfileAddWait(site, end - start, contended);
+	return end;
+}
+
+inline u64 profiledTryLock() {
+	return lockProfileEnabled() ? lockProfileNow() : 0u;
+}
+
+inline void profiledUnlock(LockSite site, u64 lockedAt) {
+	if(lockedAt) {
+		lockProfileAddHold(site, lockProfileNow() - lockedAt);
+	}
+}
+
+#endif // VIL_LOCK_PROFILING
+
+#if !defined(VIL_LOCK_PROFILING)
 
 using DebugSharedMutex = std::shared_mutex;
 using DebugMutex = std::mutex;
 
+template<typename M> void setLockRank(M&, LockRank) {}
+template<typename M> void setLockSite(M&, LockSite) {}
+
+#elif !defined(VIL_DEBUG_MUTEX) // VIL_LOCK_PROFILING
+
+// Release builds with the lock-profile option: the mutexes only record
+// into the lock profile, none of the checks of VIL_DEBUG_MUTEX.
+
+// The shared locks the current thread holds, with the time they were
+// locked. Usually just a handful.
+struct SharedLockTime {
+	const void* mutex;
+	u64 lockedAt;
+};
+
+inline std::vector<SharedLockTime>& sharedLockTimes() {
+	thread_local std::vector<SharedLockTime> times;
+	return times;
+}
+
+// Returns 0 if the lock wasn't profiled, e.g. when profiling
+// was enabled while it was held.
+inline u64 popSharedLockTime(const void* mutex) {
+	auto& times = sharedLockTimes();
+	for(auto i = times.size(); i-- > 0u; ) {
+		if(times[i].mutex == mutex) {
+			auto ret = times[i].lockedAt;
+			times[i] = times.back();
+			times.pop_back();
+			return ret;
+		}
+	}
+
+	return 0u;
+}
+
+struct ProfiledSharedMutex {
+	std::shared_mutex mtx_;
+	LockSite site_ {LockSite::other};
+	u64 lockedAt_ {}; // only accessed by the owner
+
+	void lock() {
+		lockedAt_ = profiledLock(site_,
+			[&]{ return mtx_.try_lock(); }, [&]{ mtx_.lock(); });
+	}
+
+	void unlock() {
+		profiledUnlock(site_, lockedAt_);
+		mtx_.unlock();
+	}
+
+	bool try_lock() {
+		auto ret = mtx_.try_lock();
+		if(ret) {
+			lockedAt_ = profiledTryLock();
+		}
+		return ret;
+	}
+
+	void lock_shared() {
+		auto lockedAt = profiledLock(site_,
+			[&]{ return mtx_.try_lock_shared(); }, [&]{ mtx_.lock_shared(); });
+		if(lockedAt) {
+			sharedLockTimes().push_back({this, lockedAt});
+		}
+	}
+
+	void unlock_shared() {
+		profiledUnlock(site_, popSharedLockTime(this));
+		mtx_.unlock_shared();
+	}
+
+	bool try_lock_shared() {
+		auto ret = mtx_.try_lock_shared();
+		if(ret) {
+			if(auto lockedAt = profiledTryLock(); lockedAt) {
+				sharedLockTimes().push_back({this, lockedAt});
+			}
+		}
+		return ret;
+	}
+};
+
+struct ProfiledMutex {
+	std::mutex mtx_;
+	LockSite site_ {LockSite::other};
+	u64 lockedAt_ {}; // only accessed by the owner
+
+	void lock() {
+		lockedAt_ = profiledLock(site_,
+			[&]{ return mtx_.try_lock(); }, [&]{ mtx_.lock(); });
+	}
+
+	void unlock() {
+		profiledUnlock(site_, lockedAt_);
+		mtx_.unlock();
+	}
+
+	bool try_lock() {
+		auto ret = mtx_.try_lock();
+		if(ret) {
+			lockedAt_ = profiledTryLock();
+		}
+		return ret;
+	}
+};
+
+using DebugSharedMutex = ProfiledSharedMutex;
+using DebugMutex = ProfiledMutex;
+
+// Ranks are only checked with VIL_DEBUG_MUTEX, they just determine the site.
+inline void setLockRank(DebugMutex& m, LockRank rank) { m.site_ = lockSite(rank); }
+inline void setLockRank(DebugSharedMutex& m, LockRank rank) { m.site_ = lockSite(rank); }
+
+// Assigns the site an unranked mutex is attributed to in the lock profile.
+inline void setLockSite(DebugMutex& m, LockSite site) { m.site_ = site; }
+inline void setLockSite(DebugSharedMutex& m, LockSite site) { m.site_ = site; }
+
+#ifdef TRACY_ENABLE
+inline void setLockRank(tracy::Lockable<DebugMutex>& m, LockRank rank) { setLockRank(m.inner(), rank); }
+inline void setLockRank(tracy::SharedLockable<DebugSharedMutex>& m, LockRank rank) { setLockRank(m.inner(), rank); }
+inline void setLockSite(tracy::Lockable<DebugMutex>& m, LockSite site) { setLockSite(m.inner(), site); }
+inline void setLockSite(tracy::SharedLockable<DebugSharedMutex>& m, LockSite site) { setLockSite(m.inner(), site); }
+#endif // TRACY_ENABLE
+
 #else // VIL_DEBUG_MUTEX
 
+// Bitmask of the ranks of all mutexes the current thread holds.
+inline unsigned& heldLockRanks() {
+	thread_local unsigned ranks {};
+	return ranks;
+}
+
+inline void checkLockRank(LockRank rank) {
+	if(rank == LockRank::none) {
+		return;
+	}
+
+	auto bit = 1u << unsigned(rank);
+	dlg_assertm((heldLockRanks() & ~(bit - 1u)) == 0u,
+		"Lock order violation: locking rank {} while holding ranks {}",
+		unsigned(rank), heldLockRanks());
+}
+
+inline void addLockRank(LockRank rank) {
+	if(rank != LockRank::none) {
+		heldLockRanks() |= (1u << unsigned(rank));
+	}
+}
+
+inline void removeLockRank(LockRank rank) {
+	if(rank != LockRank::none) {
+		heldLockRanks() &= ~(1u << unsigned(rank));
+	}
+}
+
 // std::shared_mutex that knows whether it's locked.
 // Using this information in actual code logic is a terrible idea but
 // it's useful to find issues (e.g. a mutex isn't locked when we expected
@@ -25,15 +270,24 @@ using DebugMutex = std::mutex;
 struct DebugSharedMutex {
 	std::shared_mutex mtx_;
 	std::atomic<std::thread::id> owner_ {};
-	std::unordered_set<std::thread::id> shared_ {};
+	// Threads holding a shared lock, with the time they locked it
+	// for the lock profile.
+	std::unordered_map<std::thread::id, u64> shared_ {};
 	mutable std::mutex sharedMutex_ {};
+	LockRank rank_ {LockRank::none};
+	LockSite site_ {LockSite::other};
+	u64 lockedAt_ {}; // only accessed by the owner
 
 	void lock() {
 		dlg_assert(!owned());
 		dlg_assert(!ownedShared());
-		mtx_.lock();
+		checkLockRank(rank_);
+		auto lockedAt = profiledLock(site_,
+			[&]{ return mtx_.try_lock(); }, [&]{ mtx_.lock(); });
 		dlg_assert(owner_ == std::thread::id{});
 		owner_.store(std::this_thread::get_id());
+		lockedAt_ = lockedAt;
+		addLockRank(rank_);
 	}
 
 	void unlock() {
@@ -44,6 +298,8 @@ struct DebugSharedMutex {
 			dlg_assert(shared_.empty());
 		}
 
+		profiledUnlock(site_, lockedAt_);
+		removeLockRank(rank_);
 		owner_.store({});
 		mtx_.unlock();
 	}
@@ -56,6 +312,8 @@ struct DebugSharedMutex {
 			dlg_assert(shared_.empty());
 			dlg_assert(owner_ == std::thread::id{});
 			owner_ = std::this_thread::get_id();
+			lockedAt_ = profiledTryLock();
+			addLockRank(rank_);
 		}
 		return ret;
 	}
@@ -63,22 +321,30 @@ struct DebugSharedMutex {
 	void lock_shared() {
 		dlg_assert(!owned());
 		dlg_assert(!ownedShared());
-		mtx_.lock_shared();
+		checkLockRank(rank_);
+		auto lockedAt = profiledLock(site_,
+			[&]{ return mtx_.try_lock_shared(); }, [&]{ mtx_.lock_shared(); });
 		dlg_assert(owner_.load() == std::thread::id{});
 
 		std::lock_guard lock(sharedMutex_);
-		shared_.insert(std::this_thread::get_id());
+		shared_.emplace(std::this_thread::get_id(), lockedAt);
+		addLockRank(rank_);
 	}
 
 	void unlock_shared() {
 		dlg_assert(ownedShared());
 		dlg_assert(owner_ == std::thread::id{});
 
+		u64 lockedAt {};
 		{
 			std::lock_guard lock(sharedMutex_);
-			shared_.erase(std::this_thread::get_id());
+			auto it = shared_.find(std::this_thread::get_id());
+			lockedAt = it->second;
+			shared_.erase(it);
 		}
 
+		profiledUnlock(site_, lockedAt);
+		removeLockRank(rank_);
 		mtx_.unlock_shared();
 	}
 
@@ -89,7 +355,8 @@ struct DebugSharedMutex {
 		if(ret) {
 			std::lock_guard lock(sharedMutex_);
 			dlg_assert(owner_.load() == std::thread::id{});
-			shared_.insert(std::this_thread::get_id());
+			shared_.emplace(std::this_thread::get_id(), profiledTryLock());
+			addLockRank(rank_);
 		}
 		return ret;
 	}
@@ -107,16 +374,25 @@ struct DebugSharedMutex {
 struct DebugMutex {
 	std::mutex mtx_;
 	std::atomic<std::thread::id> owner_ {};
+	LockRank rank_ {LockRank::none};
+	LockSite site_ {LockSite::other};
+	u64 lockedAt_ {}; // only accessed by the owner
 
 	void lock() {
 		dlg_assert(!owned());
-		mtx_.lock();
+		checkLockRank(rank_);
+		auto lockedAt = profiledLock(site_,
+			[&]{ return mtx_.try_lock(); }, [&]{ mtx_.lock(); });
 		dlg_assert(owner_ == std::thread::id{});
 		owner_.store(std::this_thread::get_id());
+		lockedAt_ = lockedAt;
+		addLockRank(rank_);
 	}
 
 	void unlock() {
 		dlg_assert(owned());
+		profiledUnlock(site_, lockedAt_);
+		removeLockRank(rank_);
 		owner_.store({});
 		mtx_.unlock();
 	}
@@ -127,6 +403,8 @@ struct DebugMutex {
 		if(ret) {
 			dlg_assert(owner_ == std::thread::id{});
 			owner_ = std::this_thread::get_id();
+			lockedAt_ = profiledTryLock();
+			addLockRank(rank_);
 		}
 		return ret;
 	}
@@ -140,10 +418,30 @@ inline bool owned(const DebugMutex& m) { return m.owned(); }
 inline bool owned(const DebugSharedMutex& m) { return m.owned(); }
 inline bool ownedShared(const DebugSharedMutex& m) { return m.ownedShared(); }
 
+// Assigns the given mutex its place in the lock hierarchy, see LockRank.
+// Must be called before the mutex is used for the first time.
+inline void setLockRank(DebugMutex& m, LockRank rank) {
+	m.rank_ = rank;
+	m.site_ = lockSite(rank);
+}
+
+inline void setLockRank(DebugSharedMutex& m, LockRank rank) {
+	m.rank_ = rank;
+	m.site_ = lockSite(rank);
+}
+
+// Assigns the site an unranked mutex is attributed to in the lock profile.
+inline void setLockSite(DebugMutex& m, LockSite site) { m.site_ = site; }
+inline void setLockSite(DebugSharedMutex& m, LockSite site) { m.site_ = site; }
+
 #ifdef TRACY_ENABLE
 inline bool owned(const tracy::Lockable<DebugMutex>& m) { return m.inner().owned(); }
 inline bool owned(const tracy::SharedLockable<DebugSharedMutex>& m) { return m.inner().owned(); }
 inline bool ownedShared(const tracy::SharedLockable<DebugSharedMutex>& m) { return m.inner().ownedShared(); }
+inline void setLockRank(tracy::Lockable<DebugMutex>& m, LockRank rank) { setLockRank(m.inner(), rank); }
+inline void setLockRank(tracy::SharedLockable<DebugSharedMutex>& m, LockRank rank) { setLockRank(m.inner(), rank); }
+inline void setLockSite(tracy::Lockable<DebugMutex>& m, LockSite site) { setLockSite(m.inner(), site); }
+inline void setLockSite(tracy::SharedLockable<DebugSharedMutex>& m, LockSite site) { setLockSite(m.inner(), site); }
 #endif // TRACY_ENABLE
 
 #endif // VIL_DEBUG_MUTEX
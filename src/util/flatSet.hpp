@@ -0,0 +1,191 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/linalloc.hpp>
+#include <util/dlg.hpp>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace vil {
+
+// Open-addressing hash set (linear probing) for elements that are
+// identified by a pointer, e.g. the handle they reference.
+// KeyOf must be a functor returning that key (as 'const void*', never null)
+// for a given element. Lookup works directly with the key, no temporary
+// element has to be created.
+// Memory is allocated from a LinAllocator and never freed individually,
+// so this is only meant for sets that just grow and are destroyed at once,
+// like the used handles of a CommandRecord. Growing abandons the
+// previous arrays in the allocator, the total memory is bounded by
+// twice the final size though.
+// Erasing elements is not supported.
+// Pointers and references to elements are only stable until the next insertion.
+template<typename T, typename KeyOf>
+class FlatPtrSet {
+public:
+	static constexpr auto minCapacity = std::size_t(8u);
+
+	template<typename S, typename V>
+	struct Iterator {
+		S* set {};
+		std::size_t id {};
+
+		V& operator*() const { return set->slots_[id]; }
+		V* operator->() const { return &set->slots_[id]; }
+
+		Iterator& operator++() {
+			id = set->nextOccupied(id + 1);
+			return *this;
+		}
+
+		bool operator==(const Iterator& rhs) const { return id == rhs.id; }
+		bool operator!=(const Iterator& rhs) const { return id != rhs.id; }
+	};
+
+	using iterator = Iterator<FlatPtrSet, T>;
+	using const_iterator = Iterator<const FlatPtrSet, const T>;
+
+public:
+	explicit FlatPtrSet(LinAllocator& alloc) noexcept : alloc_(&alloc) {}
+
+	~FlatPtrSet() {
+		for(auto i = 0u; i < capacity_; ++i) {
+			if(keys_[i]) {
+				slots_[i].~T();
+			}
+		}
+	}
+
+	FlatPtrSet(FlatPtrSet&&) noexcept = delete;
+	FlatPtrSet& operator=(FlatPtrSet&&) noexcept = delete;
+
+	iterator begin() { return {this, nextOccupied(0u)}; }
+	iterator end() { return {this, capacity_}; }
+	const_iterator begin() const { return {this, nextOccupied(0u)}; }
+	const_iterator end() const { return {this, capacity_}; }
+
+	std::size_t size() const { return size_; }
+	std::size_t capacity() const { return capacity_; }
+	bool empty() const { return size_ == 0u; }
+
+	iterator find(const void* key) {
+		return {this, findID(key)};
+	}
+
+	const_iterator find(const void* key) const {
+		return {this, findID(key)};
+	}
+
+	// Returns the element with the given key. If there is none yet, inserts
+	// the element returned by create(). The returned bool is true
+	// if the element was inserted.
+	template<typename F>
+	std::pair<T&, bool> findOrInsert(const void* key, F&& create) {
+		dlg_assert(key);
+
+		std::size_t id;
+		if(capacity_) VIL_LIKELY {
+			id = probe(key);
+			if(keys_[id]) {
+				return {slots_[id], false};
+			}
+		}
+
+		if(4 * (size_ + 1) > 3 * capacity_) VIL_UNLIKELY {
+			rehash(capacity_ ? 2 * capacity_ : minCapacity);
+			id = probe(key);
+		}
+
+		new(&slots_[id]) T(create());
+		dlg_assert(KeyOf{}(slots_[id]) == key);
+		keys_[id] = key;
+		++size_;
+
+		return {slots_[id], true};
+	}
+
+	// Makes sure that the given number of elements can be held without
+	// growing again. Useful before inserting many elements at once.
+	void reserve(std::size_t count) {
+		auto cap = capacity_ ? capacity_ : minCapacity;
+		while(4 * count > 3 * cap) {
+			cap *= 2;
+		}
+
+		if(cap != capacity_) {
+			rehash(cap);
+		}
+	}
+
+private:
+	template<typename S, typename V> friend struct Iterator;
+
+	static std::size_t hash(const void* key) {
+		// fibonacci hashing, the low bits of pointers are mostly zero
+		auto val = u64(reinterpret_cast<std::uintptr_t>(key));
+		return std::size_t((val * 11400714819323198485ull) >> 32u);
+	}
+
+	// Returns the slot holding the given key or the empty slot where
+	// it would be inserted. Expects capacity_ > 0.
+	std::size_t probe(const void* key) const {
+		auto mask = capacity_ - 1;
+		auto id = hash(key) & mask;
+		while(keys_[id] && keys_[id] != key) {
+			id = (id + 1) & mask;
+		}
+
+		return id;
+	}
+
+	std::size_t findID(const void* key) const {
+		if(!key || size_ == 0u) {
+			return capacity_;
+		}
+
+		auto id = probe(key);
+		return keys_[id] ? id : capacity_;
+	}
+
+	std::size_t nextOccupied(std::size_t id) const {
+		while(id < capacity_ && !keys_[id]) {
+			++id;
+		}
+
+		return id;
+	}
+
+	void rehash(std::size_t newCapacity) {
+		dlg_assert((newCapacity & (newCapacity - 1)) == 0u);
+		dlg_assert(4 * size_ <= 3 * newCapacity);
+
+		auto oldKeys = keys_;
+		auto oldSlots = slots_;
+		auto oldCapacity = capacity_;
+
+		keys_ = alloc_->alloc<const void*>(newCapacity).data();
+		slots_ = reinterpret_cast<T*>(alloc_->allocate(
+			newCapacity * sizeof(T), alignof(T)));
+		capacity_ = newCapacity;
+
+		for(auto i = 0u; i < oldCapacity; ++i) {
+			if(!oldKeys[i]) {
+				continue;
+			}
+
+			auto id = probe(oldKeys[i]);
+			new(&slots_[id]) T(std::move(oldSlots[i]));
+			oldSlots[i].~T();
+			keys_[id] = oldKeys[i];
+		}
+	}
+
+	LinAllocator* alloc_;
+	const void** keys_ {};
+	T* slots_ {};
+	std::size_t capacity_ {};
+	std::size_t size_ {};
+};
+
+} // namespace vil
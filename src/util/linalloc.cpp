@@ -1,5 +1,7 @@
 #include <util/linalloc.hpp>
 #include <util/util.hpp> // nextPOT
+#include <threadContext.hpp>
+#include <stats.hpp>
 #include <device.hpp>
 
 #ifdef VIL_DEBUG
@@ -10,13 +12,203 @@
 
 namespace vil {
 
+// LinBlockPool
+namespace {
+
+u32 sizeClass(std::size_t size) {
+	dlg_assert(size >= LinBlockPool::minPooledSize);
+	dlg_assert(size <= LinBlockPool::maxPooledSize);
+	dlg_assert((size & (size - 1)) == 0u);
+
+	auto ret = 0u;
+	while((LinBlockPool::minPooledSize << ret) < size) {
+		++ret;
+	}
+
+	return ret;
+}
+
+bool pooledSize(std::size_t size) {
+	return size >= LinBlockPool::minPooledSize &&
+		size <= LinBlockPool::maxPooledSize;
+}
+
+// Returns a block cached in a magazine or pool to the system.
+void freeCached(LinBlockPool::FreeBlock* block, std::size_t size) {
+	debugStatSub(DebugStats::get().pooledBlockMem, size);
+	delete[] reinterpret_cast<std::byte*>(block);
+}
+
+} // anon namespace
+
+std::byte* LinBlockPool::allocSystem(std::size_t size) {
+	debugStatAdd(DebugStats::get().liveBlockMem, size);
+	return new std::byte[size]; // no need to value-initialize
+}
+
+void LinBlockPool::freeSystem(std::byte* buf, std::size_t size) {
+	debugStatSub(DebugStats::get().liveBlockMem, size);
+	delete[] buf;
+}
+
+LinBlockPool::Magazine& LinBlockPool::threadMagazine() {
+	return ThreadContext::instance.blockMagazine_;
+}
+
+LinBlockPool::Magazine::~Magazine() {
+	clear();
+}
+
+void LinBlockPool::Magazine::clear() {
+	for(auto c = 0u; c < slots.size(); ++c) {
+		auto size = minPooledSize << c;
+		auto* head = slots[c].exchange(nullptr, std::memory_order_acquire);
+		while(head) {
+			auto next = head->next;
+			freeCached(head, size);
+			head = next;
+		}
+	}
+}
+
+u32 LinBlockPool::Magazine::count() const {
+	auto ret = 0u;
+	for(auto& slot : slots) {
+		auto* head = slot.load(std::memory_order_acquire);
+		ret += head ? head->count : 0u;
+	}
+
+	return ret;
+}
+
+LinBlockPool::~LinBlockPool() {
+	trim();
+}
+
+std::byte* LinBlockPool::alloc(std::size_t size) {
+	if(!pooledSize(size)) {
+		return allocSystem(size);
+	}
+
+	auto c = sizeClass(size);
+
+	// fast path: take it from the thread-local magazine
+	{
+		auto& slot = threadMagazine().slots[c];
+		if(auto* block = slot.exchange(nullptr, std::memory_order_acquire); block) {
+			slot.store(block->next, std::memory_order_release);
+
+			debugStatSub(DebugStats::get().pooledBlockMem, size);
+			debugStatAdd(DebugStats::get().liveBlockMem, size);
+			return reinterpret_cast<std::byte*>(block);
+		}
+	}
+
+	// take it from the shared pool
+	{
+		std::lock_guard lock(mutex);
+		if(auto* block = freeLists[c]; block) {
+			freeLists[c] = block->next;
+			dlg_assert(cachedSize >= size);
+			cachedSize -= size;
+
+			debugStatSub(DebugStats::get().pooledBlockMem, size);
+			debugStatAdd(DebugStats::get().liveBlockMem, size);
+			return reinterpret_cast<std::byte*>(block);
+		}
+	}
+
+	return allocSystem(size);
+}
+
+void LinBlockPool::free(std::byte* buf, std::size_t size) {
+	dlg_assert(buf);
+
+	if(!pooledSize(size)) {
+		freeSystem(buf, size);
+		return;
+	}
+
+	auto c = sizeClass(size);
+	auto* block = new(buf) FreeBlock;
+
+	// fast path: put it into the thread-local magazine
+	{
+		auto& slot = threadMagazine().slots[c];
+		auto* head = slot.exchange(nullptr, std::memory_order_acquire);
+		auto count = head ? head->count : 0u;
+		if(count < Magazine::maxBlocksPerClass) {
+			block->next = head;
+			block->count = count + 1;
+			slot.store(block, std::memory_order_release);
+
+			debugStatSub(DebugStats::get().liveBlockMem, size);
+			debugStatAdd(DebugStats::get().pooledBlockMem, size);
+			return;
+		}
+
+		slot.store(head, std::memory_order_release);
+	}
+
+	// put it into the shared pool, if there is still space
+	{
+		std::lock_guard lock(mutex);
+		if(cachedSize + size <= maxCachedSize) {
+			block->next = freeLists[c];
+			freeLists[c] = block;
+			cachedSize += size;
+
+			debugStatSub(DebugStats::get().liveBlockMem, size);
+			debugStatAdd(DebugStats::get().pooledBlockMem, size);
+			return;
+		}
+	}
+
+	freeSystem(buf, size);
+}
+
+void LinBlockPool::trim() {
+	ZoneScoped;
+
+	// Records are usually freed on the reclaim thread (or whichever
+	// thread drops the last reference), the blocks end up in their
+	// magazines, not the one of the calling thread.
+	{
+		std::lock_guard lock(ThreadContext::mutex_);
+		for(auto* tc : ThreadContext::contexts_) {
+			tc->blockMagazine_.clear();
+		}
+	}
+
+	// Move the lists out so we don't free while holding the lock
+	decltype(freeLists) lists;
+
+	{
+		std::lock_guard lock(mutex);
+		lists = freeLists;
+		freeLists = {};
+		cachedSize = 0u;
+	}
+
+	for(auto c = 0u; c < lists.size(); ++c) {
+		auto size = minPooledSize << c;
+		auto* head = lists[c];
+		while(head) {
+			auto next = head->next;
+			freeCached(head, size);
+			head = next;
+		}
+	}
+}
+
+// LinAllocator
 std::byte* LinAllocator::addBlock(std::size_t size, std::size_t alignment) {
-	auto newBlockSize = (memCurrent == &memRoot) ? minBlockSize :
+	auto newBlockSize = (memCurrent == &memRoot) ? firstBlockSize :
 		std::min<size_t>(blockGrowFac * memSize(*memCurrent), maxBlockSize);
 	auto neededSize = alignPOT(size, alignment) + sizeof(LinMemBlock);
 	newBlockSize = nextPOT(std::max<size_t>(newBlockSize, neededSize));
 
-	auto buf = new std::byte[newBlockSize]; // no need to value-initialize
+	auto buf = pool ? pool->alloc(newBlockSize) : new std::byte[newBlockSize];
 	auto* newBlock = new(buf) LinMemBlock;
 	newBlock->data = buf + sizeof(LinMemBlock);
 	newBlock->end = buf + newBlockSize;
@@ -42,9 +234,12 @@ LinAllocator::LinAllocator() {
 	memCurrent = &memRoot;
 }
 
-LinAllocator::LinAllocator(Callback alloc, Callback free) : LinAllocator() {
+LinAllocator::LinAllocator(Callback alloc, Callback free, LinBlockPool* xpool,
+		std::size_t xfirstBlockSize) : LinAllocator() {
 	onAlloc = alloc;
 	onFree = free;
+	pool = xpool;
+	firstBlockSize = xfirstBlockSize;
 }
 
 LinAllocator::~LinAllocator() {
@@ -64,28 +259,60 @@ void LinAllocator::reset() {
 	memCurrent = &memRoot;
 }
 
-void LinAllocator::release() {
-	// Free all memory blocks
-	auto head = memRoot.next;
+namespace {
+
+void freeBlocks(LinAllocator& alloc, LinMemBlock* head) {
 	while(head) {
 		assertCanary(*head);
 		auto next = head->next;
 
 		auto ptr = reinterpret_cast<std::byte*>(head);
-		if(onFree) {
-			onFree(ptr, sizeof(LinMemBlock) + memSize(*head));
+		auto size = sizeof(LinMemBlock) + memSize(*head);
+		if(alloc.onFree) {
+			alloc.onFree(ptr, size);
 		}
 
 		// no need to call MemBlocks destructor, it's trivial
 		static_assert(std::is_trivially_destructible_v<LinMemBlock>);
-		delete[] ptr;
+		if(alloc.pool) {
+			alloc.pool->free(ptr, size);
+		} else {
+			delete[] ptr;
+		}
 		head = next;
 	}
+}
+
+} // anon namespace
 
+void LinAllocator::release() {
+	// Free all memory blocks
+	freeBlocks(*this, memRoot.next);
 	memRoot.next = nullptr;
 	memCurrent = &memRoot;
 }
 
+std::size_t LinAllocator::usedSize() const {
+	if(memCurrent == &memRoot) {
+		return 0u;
+	}
+
+	auto ret = std::size_t(0u);
+	auto head = memRoot.next;
+	while(true) {
+		dlg_assert(head);
+		assertCanary(*head);
+		ret += memOffset(*head);
+		if(head == memCurrent) {
+			break;
+		}
+
+		head = head->next;
+	}
+
+	return ret;
+}
+
 bool LinAllocator::empty() const {
 	// dlg_assertm(memOffset(*memCurrent) == 0u, "{}", memOffset(*memCurrent));
 	return (memCurrent == &memRoot);
@@ -6,6 +6,9 @@
 #include <cstring>
 #include <memory_resource>
 #include <functional>
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <util/allocation.hpp>
 #include <util/profiling.hpp>
 #include <util/dlg.hpp>
@@ -16,8 +19,8 @@
 // the allocation fast path only needs ~6 instructions (1 load, 1 store).
 // Creating a LinAllocScope has ~7 instructions with ~2 independent loads.
 // See node 2107.
-// TODO: add support for retrieving the memory blocks from a parent
-// allocator instead of calling new[], delete[] directly every time.
+// Memory blocks can optionally be retrieved from (and returned to) a shared
+// LinBlockPool instead of calling new[], delete[] directly every time.
 // PERF: maybe don't support any alignment? Instead define a
 // maxAlignment and always align allocation size to multiple? We could
 // hope that constant folding will detect that object size is a multiple
@@ -60,6 +63,85 @@ inline std::size_t memOffset(const LinMemBlock& block) {
 	return block.data - dataBegin(block);
 }
 
+// Thread-safe, shared cache of raw memory blocks for LinAllocator objects.
+// Blocks are bucketed in power-of-two size classes. Freed blocks are first
+// put into the per-thread magazine of the freeing thread (see ThreadContext),
+// allowing allocation and freeing without taking a lock in the common case
+// where the same thread re-records command buffers over and over again.
+// Only when the magazine is full/empty, the shared, mutex-protected pool is
+// accessed. Blocks larger than maxPooledSize are never cached.
+// Note that the blocks themselves are just raw system memory, they are
+// not associated with a specific pool. Magazines are therefore shared
+// between all pools.
+struct LinBlockPool {
+	static constexpr auto minPooledSizeLog = 12u; // 4KB
+	static constexpr auto maxPooledSizeLog = 20u; // 1MB
+	static constexpr auto minPooledSize = std::size_t(1u) << minPooledSizeLog;
+	static constexpr auto maxPooledSize = std::size_t(1u) << maxPooledSizeLog;
+	static constexpr auto numSizeClasses = maxPooledSizeLog - minPooledSizeLog + 1;
+
+	// The maximum number of bytes cached in the shared pool.
+	// When this is exceeded, blocks are returned to the system.
+	static constexpr auto defaultMaxCachedSize = std::size_t(64u * 1024 * 1024);
+
+	// Intrusive free list, placed in the memory of the cached blocks.
+	struct FreeBlock {
+		FreeBlock* next {};
+		u32 count {}; // length of the list starting at this block
+	};
+
+	// Per-thread cache of blocks. Only the owning thread allocates from
+	// and frees into its magazine, trim() may clear the magazines of all
+	// threads though. Instead of a lock, every access swaps the list of
+	// a size class out of its slot via an atomic exchange and puts the
+	// remaining list back afterwards. Whoever swapped out a list owns it,
+	// trim() simply doesn't see blocks the owner is working on.
+	struct Magazine {
+		// Maximum number of blocks per size class in a magazine.
+		static constexpr auto maxBlocksPerClass = 4u;
+
+		std::array<std::atomic<FreeBlock*>, numSizeClasses> slots {};
+
+		Magazine() = default;
+		~Magazine();
+
+		Magazine(Magazine&&) noexcept = delete;
+		Magazine& operator=(Magazine&&) noexcept = delete;
+
+		// Returns all cached blocks to the system.
+		void clear();
+		// Returns the number of cached blocks. Reads the cached blocks
+		// themselves, so only valid while the owning thread doesn't
+		// use the magazine. Mainly for testing.
+		u32 count() const;
+	};
+
+	std::mutex mutex;
+	std::array<FreeBlock*, numSizeClasses> freeLists {};
+	std::size_t cachedSize {}; // synchronized via mutex
+	std::size_t maxCachedSize {defaultMaxCachedSize};
+
+	LinBlockPool() = default;
+	~LinBlockPool();
+
+	LinBlockPool(LinBlockPool&&) noexcept = delete;
+	LinBlockPool& operator=(LinBlockPool&&) noexcept = delete;
+
+	// Returns a block of exactly the given size, which must be a power of two.
+	std::byte* alloc(std::size_t size);
+	// Returns a block previously allocated via alloc (from any pool)
+	// with the same size.
+	void free(std::byte* buf, std::size_t size);
+
+	// Returns all blocks cached in the shared pool and the magazines
+	// of all threads to the system.
+	void trim();
+
+	static Magazine& threadMagazine();
+	static std::byte* allocSystem(std::size_t size);
+	static void freeSystem(std::byte* buf, std::size_t size);
+};
+
 template<typename T>
 class UniqueSpan : public span<T> {
 public:
@@ -86,6 +168,14 @@ struct LinAllocator {
 	LinMemBlock memRoot {}; // empty block
 	LinMemBlock* memCurrent;
 
+	// Size of the first block allocated. Following blocks grow
+	// exponentially from there (up to maxBlockSize). Can be set by users
+	// that have an estimate of how much memory will be needed.
+	std::size_t firstBlockSize {minBlockSize};
+
+	// Optional pool to retrieve blocks from. Must outlive the allocator.
+	LinBlockPool* pool {};
+
 	// NOTE: should be removed later in final release mode.
 	// For keeping track of allocation size.
 	using Callback = std::function<void(const std::byte*, u32)>;
@@ -93,7 +183,8 @@ struct LinAllocator {
 	Callback onFree;
 
 	LinAllocator();
-	LinAllocator(Callback alloc, Callback free);
+	LinAllocator(Callback alloc, Callback free, LinBlockPool* pool = nullptr,
+		std::size_t firstBlockSize = minBlockSize);
 	~LinAllocator();
 
 	// NOTE: could be implemented but need special handling of memRoot
@@ -110,6 +201,11 @@ struct LinAllocator {
 	// Returns whether there are no allocations in the allocator.
 	bool empty() const;
 
+	// Returns the number of bytes allocated from the blocks up to
+	// (and including) the current block. Does not include the
+	// unused tail space of blocks.
+	std::size_t usedSize() const;
+
 	// We really want this function to be inlined (in release mode at least)
 	// so we keep it as small as possible.
 	inline bool attemptAlloc(LinMemBlock& block, std::size_t size,
@@ -0,0 +1,205 @@
+#include <util/lockProfile.hpp>
+#include <util/debugMutex.hpp>
+#include <util/util.hpp>
+#include <algorithm>
+#include <mutex>
+
+namespace vil {
+
+namespace {
+
+// Counters of one thread for one lock site. Only written by the owning
+// thread, atomic so they can be read from other threads.
+struct SiteCounters {
+	std::atomic<u64> count;
+	std::atomic<u64> contended;
+	std::atomic<u64> waitNs;
+	std::atomic<u64> holdNs;
+	std::atomic<u64> maxWaitNs;
+	std::atomic<u64> maxHoldNs;
+	std::atomic<u64> waitHist[lockProfileBucketCount];
+	std::atomic<u64> holdHist[lockProfileBucketCount];
+};
+
+struct ThreadLockProfile {
+	// The reset epoch the counters belong to. When it is outdated, the
+	// counters are considered zero.
+	std::atomic<u32> epoch {};
+	SiteCounters sites[lockSiteCount] {};
+
+	ThreadLockProfile();
+	~ThreadLockProfile();
+	SiteCounters& site(LockSite site);
+};
+
+struct LockProfileRegistry {
+	// Plain std::mutex, the profiler must not profile itself.
+	std::mutex mutex;
+	std::vector<ThreadLockProfile*> threads;
+	// merged counters of the threads that already exited
+	std::array<LockSiteProfile, lockSiteCount> exited {};
+	std::atomic<u32> epoch {};
+};
+
+LockProfileRegistry& registry() {
+	// Never destroyed, threads might exit after static destruction
+	static auto* reg = new LockProfileRegistry();
+	return *reg;
+}
+
+void add(std::atomic<u64>& dst, u64 val) {
+	dst.store(dst.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+}
+
+void addMax(std::atomic<u64>& dst, u64 val) {
+	if(val > dst.load(std::memory_order_relaxed)) {
+		dst.store(val, std::memory_order_relaxed);
+	}
+}
+
+unsigned bucket(u64 ns) {
+	auto i = 0u;
+	while(ns && i + 1 < lockProfileBucketCount) {
+		ns >>= 1u;
+		++i;
+	}
+
+	return i;
+}
+
+void merge(LockSiteProfile& dst, const SiteCounters& src) {
+	constexpr auto mo = std::memory_order_relaxed;
+	dst.count += src.count.load(mo);
+	dst.contended += src.contended.load(mo);
+	dst.waitNs += src.waitNs.load(mo);
+	dst.holdNs += src.holdNs.load(mo);
+	dst.maxWaitNs = std::max(dst.maxWaitNs, src.maxWaitNs.load(mo));
+	dst.maxHoldNs = std::max(dst.maxHoldNs, src.maxHoldNs.load(mo));
+	for(auto i = 0u; i < lockProfileBucketCount; ++i) {
+		dst.waitHist[i] += src.waitHist[i].load(mo);
+		dst.holdHist[i] += src.holdHist[i].load(mo);
+	}
+}
+
+const char* name(LockSite site) {
+	switch(site) {
+		case LockSite::other: return "other";
+		case LockSite::submission: return "Device::submissionMutex";
+		case LockSite::device: return "Device::mutex";
+		case LockSite::hook: return "CommandHook::mutex";
+		case LockSite::descriptorBuffer: return "DescriptorBufferTable::mutex";
+		case LockSite::queue: return "Device::queueMutex";
+		case LockSite::dsPool: return "Device::dsPoolMutex";
+		case LockSite::snapshot: return "Device::snapshotMutex";
+		case LockSite::descriptorPool: return "DescriptorPool::mutex";
+		case LockSite::descriptorSetCow: return "DescriptorSetCow::mutex";
+	}
+
+	return "<unknown>";
+}
+
+ThreadLockProfile::ThreadLockProfile() {
+	auto& reg = registry();
+	std::lock_guard lock(reg.mutex);
+	epoch.store(reg.epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	reg.threads.push_back(this);
+}
+
+ThreadLockProfile::~ThreadLockProfile() {
+	auto& reg = registry();
+	std::lock_guard lock(reg.mutex);
+	auto it = std::find(reg.threads.begin(), reg.threads.end(), this);
+	dlg_assert(it != reg.threads.end());
+	reg.threads.erase(it);
+
+	if(epoch.load(std::memory_order_relaxed) == reg.epoch.load(std::memory_order_relaxed)) {
+		for(auto i = 0u; i < lockSiteCount; ++i) {
+			merge(reg.exited[i], sites[i]);
+		}
+	}
+}
+
+SiteCounters& ThreadLockProfile::site(LockSite id) {
+	// Counters were reset since the last lock on this thread
+	auto current = registry().epoch.load(std::memory_order_relaxed);
+	if(epoch.load(std::memory_order_relaxed) != current) {
+		for(auto& site : sites) {
+			site.count.store(0u, std::memory_order_relaxed);
+			site.contended.store(0u, std::memory_order_relaxed);
+			site.waitNs.store(0u, std::memory_order_relaxed);
+			site.holdNs.store(0u, std::memory_order_relaxed);
+			site.maxWaitNs.store(0u, std::memory_order_relaxed);
+			site.maxHoldNs.store(0u, std::memory_order_relaxed);
+			for(auto i = 0u; i < lockProfileBucketCount; ++i) {
+				site.waitHist[i].store(0u, std::memory_order_relaxed);
+				site.holdHist[i].store(0u, std::memory_order_relaxed);
+			}
+		}
+
+		epoch.store(current, std::memory_order_release);
+	}
+
+	dlg_assert(unsigned(id) < lockSiteCount);
+	return sites[unsigned(id)];
+}
+
+ThreadLockProfile& threadLockProfile() {
+	thread_local ThreadLockProfile profile;
+	return profile;
+}
+
+} // anon namespace
+
+std::atomic<bool> lockProfileActive {checkEnvBinary("VIL_LOCK_PROFILE", false)};
+
+void setLockProfileEnabled(bool enabled) {
+	lockProfileActive.store(enabled, std::memory_order_relaxed);
+}
+
+void lockProfileAddWait(LockSite id, u64 waitNs, bool contended) {
+	auto& site = threadLockProfile().site(id);
+	add(site.count, 1u);
+	add(site.contended, contended ? 1u : 0u);
+	add(site.waitNs, waitNs);
+	add(site.waitHist[bucket(waitNs)], 1u);
+	addMax(site.maxWaitNs, waitNs);
+}
+
+void lockProfileAddHold(LockSite id, u64 holdNs) {
+	auto& site = threadLockProfile().site(id);
+	add(site.holdNs, holdNs);
+	add(site.holdHist[bucket(holdNs)], 1u);
+	addMax(site.maxHoldNs, holdNs);
+}
+
+std::vector<LockSiteProfile> collectLockProfile() {
+	auto& reg = registry();
+	std::lock_guard lock(reg.mutex);
+	auto current = reg.epoch.load(std::memory_order_relaxed);
+
+	std::vector<LockSiteProfile> ret(reg.exited.begin(), reg.exited.end());
+	for(auto* thread : reg.threads) {
+		if(thread->epoch.load(std::memory_order_acquire) != current) {
+			continue;
+		}
+
+		for(auto i = 0u; i < lockSiteCount; ++i) {
+			merge(ret[i], thread->sites[i]);
+		}
+	}
+
+	for(auto i = 0u; i < lockSiteCount; ++i) {
+		ret[i].name = name(LockSite(i));
+	}
+
+	return ret;
+}
+
+void resetLockProfile() {
+	auto& reg = registry();
+	std::lock_guard lock(reg.mutex);
+	reg.exited = {};
+	reg.epoch.fetch_add(1u, std::memory_order_relaxed);
+}
+
+} // namespace vil
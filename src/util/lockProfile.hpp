@@ -0,0 +1,83 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace vil {
+
+// Lock contention profiling.
+// With VIL_LOCK_PROFILING, DebugMutex and DebugSharedMutex (and therefore
+// the tracy lockables wrapping them) record how long threads waited for a
+// lock and how long they held it, while profiling is enabled.
+// VIL_LOCK_PROFILING is defined for builds with debug checks and for
+// release builds with the lock-profile meson option.
+// Every thread records into its own counters, without any synchronization,
+// they are only merged when reading them via collectLockProfile.
+// Can be enabled via the VIL_LOCK_PROFILE environment variable, the gui
+// or the public api.
+
+// The sites locks are attributed to. Every ranked mutex has its own site
+// (see LockRank), per-object mutexes share one site per kind of object.
+enum class LockSite : unsigned {
+	other, // mutexes without a site
+	submission, // Device::submissionMutex
+	device, // Device::mutex
+	hook, // CommandHook::mutex
+	descriptorBuffer, // DescriptorBufferTable::mutex
+	queue, // Device::queueMutex
+	dsPool, // Device::dsPoolMutex
+	snapshot, // Device::snapshotMutex
+	descriptorPool, // DescriptorPool::mutex
+	descriptorSetCow, // DescriptorSetCow::mutex
+};
+
+constexpr auto lockSiteCount = unsigned(LockSite::descriptorSetCow) + 1u;
+
+// Durations are recorded into log2 histograms: bucket i counts the
+// durations in [2^(i-1), 2^i) nanoseconds, the last bucket everything above.
+constexpr auto lockProfileBucketCount = 32u;
+
+struct LockSiteProfile {
+	const char* name {};
+	u64 count {}; // number of locks
+	u64 contended {}; // number of locks that had to wait
+	u64 waitNs {};
+	u64 holdNs {};
+	u64 maxWaitNs {};
+	u64 maxHoldNs {};
+	std::array<u64, lockProfileBucketCount> waitHist {};
+	std::array<u64, lockProfileBucketCount> holdHist {};
+};
+
+extern std::atomic<bool> lockProfileActive;
+
+inline bool lockProfileEnabled() {
+	return lockProfileActive.load(std::memory_order_relaxed);
+}
+
+void setLockProfileEnabled(bool enabled);
+
+// Timestamp in nanoseconds, never 0.
+inline u64 lockProfileNow() {
+	using Clock = std::chrono::steady_clock;
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		Clock::now().time_since_epoch());
+	return u64(ns.count()) | 1u;
+}
+
+// Called by the mutexes after locking/before unlocking.
+void lockProfileAddWait(LockSite site, u64 waitNs, bool contended);
+void lockProfileAddHold(LockSite site, u64 holdNs);
+
+// Returns the merged counters of all threads since the last reset, one
+// entry per lock site.
+std::vector<LockSiteProfile> collectLockProfile();
+
+// Resets the counters. Only the merged view is reset, the per-thread
+// counters are never written by other threads.
+void resetLockProfile();
+
+} // namespace vil
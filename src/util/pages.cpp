@@ -0,0 +1,176 @@
+#include <util/pages.hpp>
+#include <util/dlg.hpp>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+	#include <windows.h>
+	#include <map>
+	#include <shared_mutex>
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+namespace vil {
+
+// Ranges with less pages than this are just memset in zeroPages.
+// Returning pages to the OS and faulting them in again on the next
+// write is way more expensive per page than clearing them.
+constexpr auto minReleasePages = 16u;
+
+std::size_t pageSize() {
+	static const auto size = [] {
+#if defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return std::size_t(info.dwPageSize);
+#else
+		return std::size_t(sysconf(_SC_PAGESIZE));
+#endif
+	}();
+
+	return size;
+}
+
+#if defined(_WIN32)
+
+namespace {
+
+// Windows has no overcommit: committed memory counts against the commit
+// limit even if it's never touched. So we only reserve the address space
+// and commit each page on its first access, from a vectored exception
+// handler that is installed while there are reservations. Debuggers
+// will see these accesses as first chance exceptions.
+struct Reservations {
+	std::shared_mutex mutex;
+	std::map<std::uintptr_t, std::size_t> ranges; // begin -> size
+	void* handler {};
+};
+
+Reservations& reservations() {
+	static Reservations ret;
+	return ret;
+}
+
+LONG CALLBACK commitOnAccess(EXCEPTION_POINTERS* info) {
+	auto& record = *info->ExceptionRecord;
+	if(record.ExceptionCode != EXCEPTION_ACCESS_VIOLATION ||
+			record.NumberParameters < 2u) {
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	auto addr = std::uintptr_t(record.ExceptionInformation[1]);
+
+	auto& res = reservations();
+	std::shared_lock lock(res.mutex);
+	auto it = res.ranges.upper_bound(addr);
+	if(it == res.ranges.begin()) {
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	--it;
+	if(addr >= it->first + it->second) {
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	// Newly committed pages are zero
+	auto ps = pageSize();
+	auto* page = reinterpret_cast<void*>(addr & ~(ps - 1));
+	if(!VirtualAlloc(page, ps, MEM_COMMIT, PAGE_READWRITE)) {
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	return EXCEPTION_CONTINUE_EXECUTION;
+}
+
+} // anon namespace
+
+#endif // _WIN32
+
+std::byte* allocPages(std::size_t size) {
+	dlg_assert(size > 0u);
+
+#if defined(_WIN32)
+	// Pages are committed on first access, see commitOnAccess
+	auto* ptr = VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+	if(!ptr) {
+		throw std::bad_alloc();
+	}
+
+	auto& res = reservations();
+	std::lock_guard lock(res.mutex);
+	if(!res.handler) {
+		res.handler = AddVectoredExceptionHandler(1u, commitOnAccess);
+		if(!res.handler) {
+			VirtualFree(ptr, 0u, MEM_RELEASE);
+			throw std::bad_alloc();
+		}
+	}
+
+	res.ranges.emplace(reinterpret_cast<std::uintptr_t>(ptr), size);
+#else
+	auto* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(ptr == MAP_FAILED) {
+		throw std::bad_alloc();
+	}
+#endif
+
+	return static_cast<std::byte*>(ptr);
+}
+
+void freePages(std::byte* data, std::size_t size) {
+#if defined(_WIN32)
+	(void) size;
+
+	auto& res = reservations();
+	std::lock_guard lock(res.mutex);
+	VirtualFree(data, 0u, MEM_RELEASE);
+	res.ranges.erase(reinterpret_cast<std::uintptr_t>(data));
+
+	// Don't keep the handler installed, the layer might get unloaded
+	if(res.ranges.empty()) {
+		RemoveVectoredExceptionHandler(res.handler);
+		res.handler = nullptr;
+	}
+#else
+	munmap(data, size);
+#endif
+}
+
+void zeroPages(std::byte* data, std::size_t size) {
+	auto ps = pageSize();
+	auto begin = reinterpret_cast<std::uintptr_t>(data);
+	auto end = begin + size;
+	auto pagesBegin = (begin + ps - 1) & ~(ps - 1);
+	auto pagesEnd = end & ~(ps - 1);
+
+	if(pagesEnd <= pagesBegin || (pagesEnd - pagesBegin) / ps < minReleasePages) {
+		std::memset(data, 0x0, size);
+		return;
+	}
+
+	std::memset(data, 0x0, pagesBegin - begin);
+	std::memset(reinterpret_cast<std::byte*>(pagesEnd), 0x0, end - pagesEnd);
+
+	auto* pages = reinterpret_cast<void*>(pagesBegin);
+	auto pagesSize = pagesEnd - pagesBegin;
+
+#if defined(_WIN32)
+	// Decommitted pages are zero when committed again on their next
+	// access, see commitOnAccess
+	auto ok = VirtualFree(pages, pagesSize, MEM_DECOMMIT);
+#else
+	// For private anonymous mappings, the pages read as zero afterwards
+	auto ok = (madvise(pages, pagesSize, MADV_DONTNEED) == 0);
+#endif
+
+	if(!ok) {
+		dlg_warn("Releasing pages failed, falling back to memset");
+		std::memset(pages, 0x0, pagesSize);
+	}
+}
+
+} // namespace vil
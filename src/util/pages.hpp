@@ -0,0 +1,58 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <cstddef>
+#include <utility>
+
+namespace vil {
+
+// Allocates zero-initialized memory directly from the operating system.
+// The pages are only committed when they are first written, so huge
+// allocations that are only sparsely written (e.g. bindless descriptor
+// arrays) don't cost more physical memory than the written pages.
+// On Linux, reading pages that were never written does not commit them
+// either. On Windows, pages are only reserved and committed on their
+// first access, including reads.
+// Throws std::bad_alloc on failure. Must be freed via freePages.
+std::byte* allocPages(std::size_t size);
+void freePages(std::byte* data, std::size_t size);
+
+// Zeroes the given range of memory allocated via allocPages.
+// Whole pages are returned to the operating system instead of being
+// written, leaving them uncommitted until they are written again.
+// Only worth it for large ranges, small ranges are just memset.
+void zeroPages(std::byte* data, std::size_t size);
+
+std::size_t pageSize();
+
+// Owning wrapper around allocPages.
+class PageMemory {
+public:
+	PageMemory() = default;
+	explicit PageMemory(std::size_t size) :
+		data_(size ? allocPages(size) : nullptr), size_(size) {}
+	~PageMemory() {
+		if(data_) {
+			freePages(data_, size_);
+		}
+	}
+
+	PageMemory(PageMemory&& rhs) noexcept :
+		data_(std::exchange(rhs.data_, nullptr)),
+		size_(std::exchange(rhs.size_, 0u)) {}
+	PageMemory& operator=(PageMemory rhs) noexcept {
+		std::swap(data_, rhs.data_);
+		std::swap(size_, rhs.size_);
+		return *this;
+	}
+
+	std::byte* get() const { return data_; }
+	std::size_t size() const { return size_; }
+	std::byte& operator[](std::size_t i) const { return data_[i]; }
+
+private:
+	std::byte* data_ {};
+	std::size_t size_ {};
+};
+
+} // namespace vil
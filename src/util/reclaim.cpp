@@ -0,0 +1,110 @@
+#include <util/reclaim.hpp>
+#include <util/profiling.hpp>
+#include <util/dlg.hpp>
+
+namespace vil {
+
+Reclaimer::~Reclaimer() {
+	stop();
+}
+
+void Reclaimer::start() {
+	dlg_assert(!thread_.joinable());
+	dlg_assert(!running_.load());
+
+	exit_ = false;
+	running_.store(true);
+	thread_ = std::thread([this]{ threadMain(); });
+}
+
+void Reclaimer::stop() {
+	// From now on, push will destroy the objects itself.
+	// See the comment there for the ordering.
+	running_.store(false);
+
+	if(thread_.joinable()) {
+		{
+			std::lock_guard lock(mutex_);
+			exit_ = true;
+		}
+
+		cv_.notify_one();
+		thread_.join();
+	}
+
+	drain();
+}
+
+void Reclaimer::push(ReclaimNode& node) {
+	dlg_assert(node.object);
+	dlg_assert(node.destroy);
+
+	if(!running_.load()) {
+		node.destroy(node.object);
+		return;
+	}
+
+	auto head = pending_.load(std::memory_order_relaxed);
+	do {
+		node.next = head;
+	} while(!pending_.compare_exchange_weak(head, &node));
+
+	// stop() might have been called concurrently, after its final drain.
+	// Since both the push above and the load here are sequentially
+	// consistent (just as the store and the drain in stop), either we see
+	// the change here or the drain in stop will see our node.
+	if(!running_.load()) VIL_UNLIKELY {
+		drain();
+		return;
+	}
+
+	// If the list wasn't empty, the thread was already woken up.
+	// Otherwise, lock the mutex so the notification can't be missed
+	// between the predicate check of the thread and its wait.
+	if(!head) {
+		{
+			std::lock_guard lock(mutex_);
+		}
+
+		cv_.notify_one();
+	}
+}
+
+std::size_t Reclaimer::drain() {
+	auto node = pending_.exchange(nullptr);
+	if(!node) {
+		return 0u;
+	}
+
+	ZoneScoped;
+
+	auto count = std::size_t(0u);
+	while(node) {
+		// the node is part of the object, read next before destroying it
+		auto next = node->next;
+		node->destroy(node->object);
+		node = next;
+		++count;
+	}
+
+	return count;
+}
+
+void Reclaimer::threadMain() {
+	while(true) {
+		{
+			std::unique_lock lock(mutex_);
+			cv_.wait(lock, [&]{
+				return exit_ || pending_.load(std::memory_order_relaxed);
+			});
+
+			if(exit_) {
+				break;
+			}
+		}
+
+		drain();
+	}
+}
+
+} // namespace vil
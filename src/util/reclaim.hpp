@@ -0,0 +1,82 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace vil {
+
+// Intrusive list node for objects whose destruction can be deferred
+// via a Reclaimer. Must be a member of the object, see reclaim().
+struct ReclaimNode {
+	ReclaimNode* next {};
+	void* object {};
+	void (*destroy)(void*) {};
+};
+
+// Defers the destruction of objects with an expensive teardown
+// (CommandRecord, CommandHookState, DescriptorStateCopy) to a separate
+// thread. That way it doesn't happen inside application calls, possibly
+// while holding the device mutex.
+// Pushing is lock-free (multi-producer single-consumer list), except for
+// waking up the idle thread when the list was empty. The thread destroys
+// all pending objects in one batch when woken up.
+// Before start() and after stop(), objects are destroyed immediately.
+class Reclaimer {
+public:
+	Reclaimer() = default;
+	~Reclaimer();
+
+	Reclaimer(Reclaimer&&) noexcept = delete;
+	Reclaimer& operator=(Reclaimer&&) noexcept = delete;
+
+	void start();
+
+	// Joins the thread and destroys all pending objects.
+	// Must be called before anything the pending objects might
+	// reference is destroyed.
+	void stop();
+
+	// Schedules the object of the given node for destruction.
+	// Can be called from any thread.
+	void push(ReclaimNode& node);
+
+	// Destroys all currently pending objects on the calling thread.
+	// Returns the number of destroyed objects.
+	std::size_t drain();
+
+	bool running() const { return running_.load(); }
+
+private:
+	void threadMain();
+
+	std::atomic<ReclaimNode*> pending_ {};
+	std::atomic<bool> running_ {};
+
+	std::mutex mutex_;
+	std::condition_variable cv_;
+	bool exit_ {}; // synced via mutex_
+	std::thread thread_;
+};
+
+// Destroys the given object via the given reclaimer or immediately
+// if it is null. The node must be part of the object.
+template<typename T, typename Deleter = std::default_delete<T>>
+void reclaim(Reclaimer* reclaimer, ReclaimNode& node, T* obj) {
+	if(!reclaimer) {
+		Deleter()(obj);
+		return;
+	}
+
+	node.object = obj;
+	node.destroy = [](void* ptr) {
+		Deleter()(static_cast<T*>(ptr));
+	};
+
+	reclaimer->push(node);
+}
+
+} // namespace vil
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <util/intrusive.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace vil {
+
+// Coalesces reference count changes of intrusively reference counted
+// objects. Walking (or updating) descriptor sets often references the
+// same handles over and over again (e.g. the same sampler in all image
+// descriptors, or rewriting a descriptor with the handle it already
+// contains). Instead of one atomic operation per change, only the net
+// change per object is applied on flush.
+// Increments are applied before decrements (even when the batch
+// overflows), so an object can't be destroyed because of the order of
+// changes inside a batch.
+// Objects passed to 'inc' must stay alive until the batch is flushed,
+// this has to be guaranteed by the caller. Objects passed to 'dec' are
+// kept alive by the pending decrement.
+// Only used locally in a single thread, not synchronized in any way.
+class RefCountBatch {
+public:
+	RefCountBatch() = default;
+	~RefCountBatch() {
+		dlg_assertm(count_ == 0u && spilled_.empty(),
+			"RefCountBatch destroyed without flush");
+	}
+
+	RefCountBatch(const RefCountBatch&) = delete;
+	RefCountBatch& operator=(const RefCountBatch&) = delete;
+
+	template<typename T> void inc(T& obj) { add(obj, 1); }
+	template<typename T> void dec(T& obj) { add(obj, -1); }
+
+	template<typename T>
+	void add(T& obj, i32 delta) {
+		if(count_ == entries_.size()) VIL_UNLIKELY {
+			coalesce();
+			// Still mostly full. We can't apply decrements before the
+			// increments that might still follow, so only the increments
+			// are applied early and the decrements are moved aside.
+			if(count_ > entries_.size() / 2) {
+				spill();
+			}
+		}
+
+		// Cheap check for the common case of the same object
+		// being referenced repeatedly.
+		if(count_ > 0u && entries_[count_ - 1].obj == &obj) {
+			entries_[count_ - 1].delta += delta;
+			return;
+		}
+
+		entries_[count_++] = {&obj, &apply<T>, delta};
+	}
+
+	// Applies all pending changes. Might destroy objects.
+	void flush() {
+		coalesce();
+
+		for(auto i = 0u; i < count_; ++i) {
+			auto& entry = entries_[i];
+			if(entry.delta > 0) {
+				entry.apply(entry.obj, entry.delta);
+			}
+		}
+
+		for(auto i = 0u; i < count_; ++i) {
+			auto& entry = entries_[i];
+			if(entry.delta < 0) {
+				entry.apply(entry.obj, entry.delta);
+			}
+		}
+
+		for(auto& entry : spilled_) {
+			entry.apply(entry.obj, entry.delta);
+		}
+
+		count_ = 0u;
+		spilled_.clear();
+	}
+
+	// Number of pending entries. Not necessarily coalesced.
+	u32 size() const { return count_ + u32(spilled_.size()); }
+
+private:
+	using ApplyFn = void(*)(void* obj, i32 delta);
+
+	struct Entry {
+		void* obj;
+		ApplyFn apply;
+		i32 delta;
+	};
+
+	template<typename T>
+	static void apply(void* ptr, i32 delta) {
+		auto& obj = *static_cast<T*>(ptr);
+		if(delta > 0) {
+			obj.refCount.fetch_add(u32(delta), std::memory_order_relaxed);
+		} else {
+			auto sub = u32(-delta);
+			dlg_assert(obj.refCount.load() >= sub);
+			if(obj.refCount.fetch_sub(sub, std::memory_order_acq_rel) == sub) {
+				std::default_delete<T>()(&obj);
+			}
+		}
+	}
+
+	// Merges all entries of the same object, drops entries without
+	// a net change.
+	void coalesce() {
+		auto begin = entries_.begin();
+		auto end = begin + count_;
+		std::sort(begin, end, [](const Entry& a, const Entry& b) {
+			return a.obj < b.obj;
+		});
+
+		auto dst = 0u;
+		for(auto i = 0u; i < count_;) {
+			auto entry = entries_[i];
+			for(++i; i < count_ && entries_[i].obj == entry.obj; ++i) {
+				entry.delta += entries_[i].delta;
+			}
+
+			if(entry.delta != 0) {
+				entries_[dst++] = entry;
+			}
+		}
+
+		count_ = dst;
+	}
+
+	// Applies the pending increments and moves the pending decrements
+	// to spilled_.
+	void spill() {
+		for(auto i = 0u; i < count_; ++i) {
+			auto& entry = entries_[i];
+			if(entry.delta > 0) {
+				entry.apply(entry.obj, entry.delta);
+			} else {
+				spilled_.push_back(entry);
+			}
+		}
+
+		count_ = 0u;
+	}
+
+private:
+	static constexpr auto maxEntries = 128u;
+	std::array<Entry, maxEntries> entries_;
+	u32 count_ {};
+
+	// Decrements that didn't fit into entries_, applied on flush.
+	// Only used for calls touching many distinct objects.
+	std::vector<Entry> spilled_;
+};
+
+} // namespace vil
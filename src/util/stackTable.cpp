@@ -0,0 +1,268 @@
+#include <util/stackTable.hpp>
+#include <util/util.hpp>
+#include <util/dlg.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#if defined(_WIN32)
+	#define VIL_STACK_WIN32
+	#include <windows.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+	#define VIL_STACK_FRAME_POINTER
+	#include <pthread.h>
+#elif defined(__GNUC__)
+	#define VIL_STACK_UNWIND
+	#include <unwind.h>
+#endif
+
+#ifdef _MSC_VER
+	#define VIL_NOINLINE __declspec(noinline)
+#else
+	#define VIL_NOINLINE [[gnu::noinline]]
+#endif
+
+namespace vil {
+
+#ifdef VIL_STACK_FRAME_POINTER
+
+struct StackBounds {
+	std::uintptr_t low {};
+	std::uintptr_t high {};
+	bool init {};
+};
+
+const StackBounds& threadStackBounds() {
+	thread_local StackBounds bounds;
+	if(!bounds.init) {
+		bounds.init = true;
+
+		pthread_attr_t attr;
+		if(pthread_getattr_np(pthread_self(), &attr) == 0) {
+			void* addr {};
+			std::size_t size {};
+			if(pthread_attr_getstack(&attr, &addr, &size) == 0) {
+				bounds.low = reinterpret_cast<std::uintptr_t>(addr);
+				bounds.high = bounds.low + size;
+			}
+
+			pthread_attr_destroy(&attr);
+		}
+	}
+
+	return bounds;
+}
+
+VIL_NOINLINE unsigned captureStack(span<void*> out, unsigned skip) {
+	auto& bounds = threadStackBounds();
+
+	// Frame records on x86_64 and aarch64: [previous frame pointer, return address].
+	// We make sure to only ever read inside our own stack. The chain must
+	// strictly grow towards the stack base, otherwise it's broken.
+	auto* fp = static_cast<void**>(__builtin_frame_address(0));
+	auto count = 0u;
+	while(count < out.size()) {
+		auto addr = reinterpret_cast<std::uintptr_t>(fp);
+		if(addr < bounds.low || addr + 2 * sizeof(void*) > bounds.high ||
+				addr % alignof(void*) != 0u) {
+			break;
+		}
+
+		auto* ret = fp[1];
+		auto* next = static_cast<void**>(fp[0]);
+		if(!ret) {
+			break;
+		}
+
+		if(skip > 0u) {
+			--skip;
+		} else {
+			out[count] = ret;
+			++count;
+		}
+
+		if(reinterpret_cast<std::uintptr_t>(next) <= addr) {
+			break;
+		}
+
+		fp = next;
+	}
+
+	return count;
+}
+
+#elif defined(VIL_STACK_UNWIND)
+
+struct UnwindState {
+	span<void*> out;
+	unsigned skip;
+	unsigned count;
+};
+
+_Unwind_Reason_Code unwindCallback(_Unwind_Context* ctx, void* data) {
+	auto& state = *static_cast<UnwindState*>(data);
+	if(state.count >= state.out.size()) {
+		return _URC_END_OF_STACK;
+	}
+
+	auto ip = _Unwind_GetIP(ctx);
+	if(!ip) {
+		return _URC_END_OF_STACK;
+	}
+
+	if(state.skip > 0u) {
+		--state.skip;
+	} else {
+		state.out[state.count] = reinterpret_cast<void*>(ip);
+		++state.count;
+	}
+
+	return _URC_NO_REASON;
+}
+
+VIL_NOINLINE unsigned captureStack(span<void*> out, unsigned skip) {
+	// +1: the first frame is this function
+	UnwindState state {out, skip + 1u, 0u};
+	_Unwind_Backtrace(unwindCallback, &state);
+	return state.count;
+}
+
+#elif defined(VIL_STACK_WIN32)
+
+VIL_NOINLINE unsigned captureStack(span<void*> out, unsigned skip) {
+	// +1: skip this function
+	auto count = RtlCaptureStackBackTrace(DWORD(skip + 1u),
+		DWORD(out.size()), out.data(), nullptr);
+	return count;
+}
+
+#else
+
+unsigned captureStack(span<void*> out, unsigned skip) {
+	(void) out;
+	(void) skip;
+	return 0u;
+}
+
+#endif
+
+// StackTable
+StackTable::StackTable() {
+	auto& table = *tables_.emplace_back(std::make_unique<Table>());
+	table.mask = minCapacity - 1;
+	table.slots = std::make_unique<std::atomic<Stack*>[]>(minCapacity);
+	table_.store(&table);
+}
+
+StackTable::~StackTable() = default;
+
+StackTable::Stack* StackTable::find(const Table& table, u64 hash,
+		span<void* const> frames) {
+	// Table sizes are powers of two, the lower bits of the hash are
+	// mixed well enough by combineHash64.
+	auto id = std::size_t(hash) & table.mask;
+	while(true) {
+		auto* stack = table.slots[id].load(std::memory_order_acquire);
+		if(!stack) {
+			return nullptr;
+		}
+
+		// Compare the frames, different stacks might have the same hash
+		if(stack->hash == hash && stack->count == frames.size() &&
+				std::equal(frames.begin(), frames.end(), stack->frames)) {
+			return stack;
+		}
+
+		id = (id + 1) & table.mask;
+	}
+}
+
+StackID StackTable::intern(span<void* const> frames) {
+	frames = frames.first(std::min<std::size_t>(frames.size(), maxDepth));
+	if(frames.empty()) {
+		return 0u;
+	}
+
+	auto hash = u64(frames.size());
+	for(auto* frame : frames) {
+		hash = combineHash64(hash, reinterpret_cast<std::uintptr_t>(frame));
+	}
+
+	// fast path: known stack, the common case.
+	// Tables and stacks are never destroyed before the StackTable itself.
+	if(auto* stack = find(*table_.load(std::memory_order_acquire), hash, frames); stack) {
+		return stack->id;
+	}
+
+	std::lock_guard lock(mutex_);
+
+	// might have been inserted in the meantime
+	auto* table = tables_.back().get();
+	if(auto* stack = find(*table, hash, frames); stack) {
+		return stack->id;
+	}
+
+	// Keep the load factor below 1/2, grow the table if needed.
+	// Readers might still probe the old table and miss new stacks,
+	// they will find them here, under the lock, then.
+	auto capacity = table->mask + 1;
+	if(2 * (stacks_.size() + 1) > capacity) {
+		auto& newTable = *tables_.emplace_back(std::make_unique<Table>());
+		newTable.mask = 2 * capacity - 1;
+		newTable.slots = std::make_unique<std::atomic<Stack*>[]>(2 * capacity);
+
+		for(auto& old : stacks_) {
+			auto id = std::size_t(old->hash) & newTable.mask;
+			while(newTable.slots[id].load(std::memory_order_relaxed)) {
+				id = (id + 1) & newTable.mask;
+			}
+
+			newTable.slots[id].store(old.get(), std::memory_order_relaxed);
+		}
+
+		table = &newTable;
+		table_.store(table, std::memory_order_release);
+	}
+
+	auto& stack = *stacks_.emplace_back(std::make_unique<Stack>());
+	stack.hash = hash;
+	stack.id = StackID(stacks_.size());
+	stack.count = u32(frames.size());
+	std::copy(frames.begin(), frames.end(), stack.frames);
+
+	auto id = std::size_t(hash) & table->mask;
+	while(table->slots[id].load(std::memory_order_relaxed)) {
+		id = (id + 1) & table->mask;
+	}
+
+	table->slots[id].store(&stack, std::memory_order_release);
+	return stack.id;
+}
+
+VIL_NOINLINE StackID StackTable::capture(unsigned skip) {
+	void* frames[maxDepth];
+	// +1: skip this function
+	auto count = captureStack(frames, skip + 1u);
+	return intern({frames, count});
+}
+
+span<void* const> StackTable::get(StackID id) const {
+	if(id == 0u) {
+		return {};
+	}
+
+	std::lock_guard lock(mutex_);
+	dlg_assert_or(id <= stacks_.size(), return {});
+
+	// Stacks are never moved or destroyed, safe to return
+	auto& stack = *stacks_[id - 1];
+	return {stack.frames, stack.count};
+}
+
+std::size_t StackTable::size() const {
+	std::lock_guard lock(mutex_);
+	return stacks_.size();
+}
+
+} // namespace vil
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <nytl/span.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vil {
+
+// Captures the return addresses of the current call stack into 'out',
+// starting with the caller of this function. Skips the first 'skip' frames.
+// Returns the number of captured frames.
+// Where possible, this walks the frame pointer chain, validated against the
+// bounds of the current thread's stack, so it's cheap enough to be called
+// for every recorded command. Stacks through code compiled without frame
+// pointers are cut short or may contain bogus addresses, though.
+// Symbolization is not done here, see backward::resolve.
+unsigned captureStack(span<void*> out, unsigned skip = 0u);
+
+// Interns call stacks, so that each unique stack is only stored once
+// and can be referenced via a 32-bit id.
+// Interned stacks are never freed, the number of unique stacks in an
+// application is usually small.
+// Can be used from multiple threads. Looking up a known stack in intern,
+// the common case when recording commands, doesn't take a lock.
+class StackTable {
+public:
+	// Maximum number of frames stored per stack
+	static constexpr auto maxDepth = 32u;
+	static constexpr auto minCapacity = std::size_t(256u);
+
+public:
+	StackTable();
+	~StackTable();
+
+	StackTable(StackTable&&) noexcept = delete;
+	StackTable& operator=(StackTable&&) noexcept = delete;
+
+	// Returns the id of the given stack, adding it if it is new.
+	// Frames beyond maxDepth are ignored. Returns 0 for an empty stack.
+	StackID intern(span<void* const> frames);
+
+	// Captures the current call stack and interns it.
+	StackID capture(unsigned skip = 0u);
+
+	// Returns the frames of the stack with the given id. The returned
+	// span stays valid for the lifetime of the table.
+	// Returns an empty span for id 0.
+	span<void* const> get(StackID id) const;
+
+	std::size_t size() const;
+
+private:
+	struct Stack {
+		u64 hash {};
+		StackID id {};
+		u32 count {};
+		void* frames[maxDepth];
+	};
+
+	// Open-addressing hash table (linear probing) of the stacks.
+	// Slots are only ever set once, from null to a stack. When growing,
+	// a new table is published and the old one is kept alive until
+	// destruction since readers might still use it.
+	struct Table {
+		std::size_t mask {};
+		std::unique_ptr<std::atomic<Stack*>[]> slots;
+	};
+
+	static Stack* find(const Table&, u64 hash, span<void* const> frames);
+
+	std::atomic<Table*> table_ {};
+
+	mutable std::mutex mutex_; // for insertion and the members below
+	std::vector<std::unique_ptr<Table>> tables_; // current table is last
+	std::vector<std::unique_ptr<Stack>> stacks_; // index id - 1
+};
+
+} // namespace vil
@@ -4,6 +4,8 @@
 #include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <cassert>
 #include <util/intrusive.hpp>
@@ -95,6 +97,27 @@ struct UniqueWrappedPtr : std::unique_ptr<WrappedHandle<T>> {
 	}
 };
 
+// Number of shards of SyncedUnorderedMap and SyncedUnorderedSet.
+// Must be a power of two.
+constexpr auto syncedMapShardBits = 4u;
+constexpr auto syncedMapShardCount = 1u << syncedMapShardBits;
+
+// Returns the shard for the given hash. Handles are mostly pointers with
+// meaningless low bits (and std::hash of a pointer is the identity), so
+// we use the high bits of a fibonacci hash.
+inline unsigned syncedMapShard(std::size_t hash) {
+	auto mixed = std::uint64_t(hash) * 0x9E3779B97F4A7C15ull;
+	return unsigned(mixed >> (64u - syncedMapShardBits));
+}
+
+// Aligned to make sure the locks of different shards don't share
+// a cache line.
+template<typename C>
+struct alignas(64) SyncedMapShard {
+	mutable std::shared_mutex mutex;
+	C inner;
+};
+
 // Synchronized unordered map.
 // Elements are stored in P<T>'s (where P should be a smart pointer type such
 // as unique_ptr or shared_ptr) making sure that as long as two
@@ -106,21 +129,32 @@ struct UniqueWrappedPtr : std::unique_ptr<WrappedHandle<T>> {
 // at *any* moment, when the unordered map needs a rehash. But the underlying
 // elements are guaranteed to survive.
 // The mutex will always be unlocked when the destructor of an object is run.
+//
+// The map is split into syncedMapShardCount shards by key hash, each with
+// its own lock. Lookups (find, get, getPtr) only lock their shard, so
+// threads looking up different handles (e.g. in CmdBind* or descriptor
+// updates) don't contend. Inserting or removing an element additionally
+// locks 'mutex' (Device::snapshotMutex) exclusively. Therefore, while
+// holding it (shared or exclusive), the map can't change and the *Locked
+// functions don't need the shard locks. The device mutex isn't needed.
 template<typename K, typename T, template<typename...> typename P>
 class SyncedUnorderedMap {
 public:
 	using UnorderedMap = std::unordered_map<K, P<T>>;
+	using Shard = SyncedMapShard<UnorderedMap>;
 
 	P<T> moveLocked(const K& key) {
 		assertOwned(*mutex);
 
-		auto it = inner.find(key);
-		if(it == inner.end()) {
+		auto& shard = shardFor(key);
+		std::lock_guard lock(shard.mutex);
+		auto it = shard.inner.find(key);
+		if(it == shard.inner.end()) {
 			return nullptr;
 		}
 
 		auto ret = std::move(it->second);
-		inner.erase(it);
+		shard.inner.erase(it);
 		return ret;
 	}
 
@@ -141,81 +175,53 @@ public:
 		return ret;
 	}
 
-	// Makes sure to run destructor outside of lock
-	// std::size_t erase(const K& key) {
-	// 	// std::lock_guard lock(*mutex);
-	// 	// return map.erase(key);
-	// 	auto ptr = move(key);
-	// 	return ptr ? 1u : 0u;
-	// }
-
 	void mustErase(const K& key) {
-		// std::lock_guard lock(*mutex);
-		// auto count = map.erase(key);
-		// assert(count);
-		// return count;
 		auto ptr = mustMove(key);
 		(void) ptr;
 	}
 
 	T* find(const K& key) {
-		std::shared_lock lock(*mutex);
-		auto it = inner.find(key);
-		return it == inner.end() ? nullptr : &*it->second;
+		auto& shard = shardFor(key);
+		std::shared_lock lock(shard.mutex);
+		auto it = shard.inner.find(key);
+		return it == shard.inner.end() ? nullptr : &*it->second;
 	}
 
 	// Expects an element in the map, finds and returns it.
 	// Unlike operator[], will never create the element.
 	// Error to call this with a key that isn't present.
 	T& get(const K& key) {
-		std::shared_lock lock(*mutex);
-		return getLocked(key);
+		auto& shard = shardFor(key);
+		std::shared_lock lock(shard.mutex);
+		auto it = shard.inner.find(key);
+		assert(it != shard.inner.end());
+		return *it->second;
 	}
 
 	T& getLocked(const K& key) {
 		assertOwnedOrShared(*mutex);
 
-		auto it = inner.find(key);
-		assert(it != inner.end());
+		auto& shard = shardFor(key);
+		auto it = shard.inner.find(key);
+		assert(it != shard.inner.end());
 		return *it->second;
 	}
 
-	// template<class O>
-	// bool contains(const O& x) const {
-	// 	// TODO C++20, use map.contains
-	// 	std::shared_lock lock(*mutex);
-	// 	return map.find(x) != map.end();
-	// }
-
-	// T& operator[](const K& key) {
-	// 	std::lock_guard lock(*mutex);
-	// 	return map[key];
-	// }
-
-	// emplace methods may be counter-intuitive.
-	// You must actually pass a P<T> as value.
-	// Might wanna use add() instead.
-	template<class... Args>
-	std::pair<P<T>*, bool> emplace(Args&&... args) {
+	std::pair<P<T>*, bool> emplace(const K& key, P<T> value) {
 		std::lock_guard lock(*mutex);
-		auto [it, success] = inner.emplace(std::forward<Args>(args)...);
+
+		auto& shard = shardFor(key);
+		std::lock_guard shardLock(shard.mutex);
+		auto [it, success] = shard.inner.emplace(key, std::move(value));
 		return {&it->second, success};
 	}
 
-	template<class... Args>
-	P<T>& mustEmplace(Args&&... args) {
-		auto [ptr, success] = this->emplace(std::forward<Args>(args)...);
+	P<T>& mustEmplace(const K& key, P<T> value) {
+		auto [ptr, success] = this->emplace(key, std::move(value));
 		assert(success);
 		return *ptr;
 	}
 
-	// Asserts that element is really new
-	// template<typename V = T, class... Args>
-	// P<T>& addPtr(const K& key, Args&&... args) {
-	// 	auto elem = HandlePtrFactory<P<V>>::create(std::forward<Args>(args)...);
-	// 	return this->mustEmplace(key, std::move(elem));
-	// }
-
 	template<typename V = T, class... Args>
 	T& add(const K& key, Args&&... args) {
 		auto elem = HandlePtrFactory<P<V>>::create(std::forward<Args>(args)...);
@@ -224,43 +230,62 @@ public:
 
 	// Keep in mind they can immediately be out-of-date.
 	bool empty() const {
-		std::shared_lock lock(*mutex);
-		return inner.empty();
+		for(auto& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			if(!shard.inner.empty()) {
+				return false;
+			}
+		}
+
+		return true;
 	}
 
 	std::size_t size() const {
-		std::shared_lock lock(*mutex);
-		return inner.size();
+		std::size_t ret = 0u;
+		for(auto& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			ret += shard.inner.size();
+		}
+
+		return ret;
 	}
 
 	// Only allowed to call this function when P<T> is copyable.
 	// Useful for shared/intrusive pointers.
-	// template<typename = void>
 	P<T> getPtr(const K& key) {
 		static_assert(std::is_copy_constructible_v<P<T>>);
-		std::shared_lock lock(*mutex);
-		auto it = inner.find(key);
-		assert(it != inner.end());
+		auto& shard = shardFor(key);
+		std::shared_lock lock(shard.mutex);
+		auto it = shard.inner.find(key);
+		assert(it != shard.inner.end());
 		return it->second;
 	}
 
-	// template<typename = void>
-	// P<T> findPtr(const K& key) {
-	// 	static_assert(std::is_copy_constructible_v<P<T>>);
-	// 	std::shared_lock lock(*mutex);
-	// 	auto it = map.find(key);
-	// 	if(it == map.end()) {
-	// 		return {};
-	// 	}
-//
-	// 	return it->second;
-	// }
+	// Calls the given function with every (key, P<T>) entry.
+	// The entries are visited in no particular order.
+	template<typename F>
+	void forEachLocked(F&& func) {
+		assertOwnedOrShared(*mutex);
+		for(auto& shard : shards_) {
+			for(auto& entry : shard.inner) {
+				func(entry);
+			}
+		}
+	}
 
-	// Can also be used directly, but take care!
 	SharedLockableBase(DebugSharedMutex)* mutex;
-	UnorderedMap inner;
+
+private:
+	Shard& shardFor(const K& key) {
+		return shards_[syncedMapShard(std::hash<K>{}(key))];
+	}
+
+	std::array<Shard, syncedMapShardCount> shards_;
 };
 
+// Synchronized unordered set, the elements are their own keys.
+// Works exactly like SyncedUnorderedMap, see there for details on the
+// sharding and locking.
 template<typename T, template<typename...> typename P>
 class SyncedUnorderedSet {
 public:
@@ -269,25 +294,22 @@ public:
 	// using UnorderedSet = std::unordered_set<P<T>, std::hash<P<T>>, std::equal_to<>>;
 
 	using UnorderedSet = std::unordered_set<P<T>>;
+	using Shard = SyncedMapShard<UnorderedSet>;
 	using pointer = T*;
-	// using reference = T&;
 	using const_reference = const T&;
 
 	P<T> moveLocked(const_reference key) {
 		assertOwned(*mutex);
 
-		// TODO: not exception safe
-		// Remove with c++20s better container lookup
-		P<T> dummy(acquireOwnership, const_cast<pointer>(&key));
-		auto it = inner.find(dummy);
-		(void) dummy.release();
-
-		if(it == inner.end()) {
+		auto& shard = shardFor(&key);
+		std::lock_guard lock(shard.mutex);
+		auto it = findIn(shard, &key);
+		if(it == shard.inner.end()) {
 			return nullptr;
 		}
 
 		auto ret = std::move(*it);
-		inner.erase(it);
+		shard.inner.erase(it);
 		return ret;
 	}
 
@@ -317,36 +339,41 @@ public:
 	// Unlike operator[], will never create the element.
 	// Error to call this with a key that isn't present.
 	T& get(const_reference key) {
-		std::shared_lock lock(*mutex);
-		return getLocked(key);
+		auto& shard = shardFor(&key);
+		std::shared_lock lock(shard.mutex);
+		auto it = findIn(shard, &key);
+		assert(it != shard.inner.end());
+		return **it;
 	}
 
 	T& getLocked(const_reference key) {
 		assertOwnedOrShared(*mutex);
 
-		// TODO: not exception safe
-		// Remove with c++20s better container lookup
-		P<T> dummy(acquireOwnership, const_cast<pointer>(&key));
-		auto it = inner.find(dummy);
-		(void) dummy.release();
+		auto& shard = shardFor(&key);
+		auto it = findIn(shard, &key);
+		assert(it != shard.inner.end());
+		return **it;
+	}
 
-		assert(it != inner.end());
-		return *it;
+	// Returns whether the given element is in the set, i.e. whether
+	// the handle is still alive.
+	bool contains(const T* ptr) {
+		auto& shard = shardFor(ptr);
+		std::shared_lock lock(shard.mutex);
+		return findIn(shard, ptr) != shard.inner.end();
 	}
 
-	// emplace methods may be counter-intuitive.
-	// You must actually pass a P<T> as value.
-	// Might wanna use add() instead.
-	template<class... Args>
-	std::pair<T*, bool> emplace(Args&&... args) {
+	std::pair<T*, bool> emplace(P<T> value) {
 		std::lock_guard lock(*mutex);
-		auto [it, success] = inner.emplace(std::forward<Args>(args)...);
+
+		auto& shard = shardFor(&*value);
+		std::lock_guard shardLock(shard.mutex);
+		auto [it, success] = shard.inner.emplace(std::move(value));
 		return {&**it, success};
 	}
 
-	template<class... Args>
-	T& mustEmplace(Args&&... args) {
-		auto [ptr, success] = this->emplace(std::forward<Args>(args)...);
+	T& mustEmplace(P<T> value) {
+		auto [ptr, success] = this->emplace(std::move(value));
 		assert(success);
 		return *ptr;
 	}
@@ -359,29 +386,66 @@ public:
 
 	// Keep in mind they can immediately be out-of-date.
 	bool empty() const {
-		std::shared_lock lock(*mutex);
-		return inner.empty();
+		for(auto& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			if(!shard.inner.empty()) {
+				return false;
+			}
+		}
+
+		return true;
 	}
 
 	std::size_t size() const {
-		std::shared_lock lock(*mutex);
-		return inner.size();
+		std::size_t ret = 0u;
+		for(auto& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			ret += shard.inner.size();
+		}
+
+		return ret;
 	}
 
 	// Only allowed to call this function when P<T> is copyable.
 	// Useful for shared/intrusive pointers.
-	// template<typename = void>
 	P<T> getPtr(const_reference key) {
 		static_assert(std::is_copy_constructible_v<P<T>>);
-		std::shared_lock lock(*mutex);
-		auto it = inner.find(key);
-		assert(it != inner.end());
+		auto& shard = shardFor(&key);
+		std::shared_lock lock(shard.mutex);
+		auto it = findIn(shard, &key);
+		assert(it != shard.inner.end());
 		return *it;
 	}
 
-	// Can also be used directly, but take care!
+	// Calls the given function with every P<T> element.
+	// The elements are visited in no particular order.
+	template<typename F>
+	void forEachLocked(F&& func) {
+		assertOwnedOrShared(*mutex);
+		for(auto& shard : shards_) {
+			for(auto& elem : shard.inner) {
+				func(elem);
+			}
+		}
+	}
+
 	SharedLockableBase(DebugSharedMutex)* mutex;
-	UnorderedSet inner;
+
+private:
+	Shard& shardFor(const T* ptr) {
+		return shards_[syncedMapShard(std::hash<const T*>{}(ptr))];
+	}
+
+	static auto findIn(Shard& shard, const T* ptr) {
+		// TODO: not exception safe
+		// Remove with c++20s better container lookup
+		P<T> dummy(acquireOwnership, const_cast<pointer>(ptr));
+		auto it = shard.inner.find(dummy);
+		(void) dummy.release();
+		return it;
+	}
+
+	std::array<Shard, syncedMapShardCount> shards_;
 };
 
 template<typename T>
@@ -437,4 +501,12 @@ using SyncedIntrusiveWrappedUnorderedMap = SyncedUnorderedMap<K, T, IntrusiveWra
 template<typename T>
 using SyncedIntrusiveUnorderedSet = SyncedUnorderedSet<T, IntrusivePtr>;
 
+// Returns whether the given handle is still alive, i.e. in the given
+// device map. The api destroy functions only erase handles with the device
+// mutex locked (see mustMoveUnset), so the result stays valid while it is.
+template<typename Set, typename Handle>
+bool containsHandle(Set& set, Handle* handle) {
+	return set.contains(handle);
+}
+
 } // namespace vil
@@ -0,0 +1,280 @@
+#include <util/tlsf.hpp>
+#include <util/dlg.hpp>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+namespace vil {
+
+namespace {
+
+// Index of the highest set bit. v must not be zero.
+u32 highestBit(u32 v) {
+	dlg_assert(v != 0u);
+#ifdef _MSC_VER
+	unsigned long ret;
+	_BitScanReverse(&ret, v);
+	return u32(ret);
+#else
+	return 31u - u32(__builtin_clz(v));
+#endif
+}
+
+// Index of the lowest set bit. v must not be zero.
+u32 lowestBit(u32 v) {
+	dlg_assert(v != 0u);
+#ifdef _MSC_VER
+	unsigned long ret;
+	_BitScanForward(&ret, v);
+	return u32(ret);
+#else
+	return u32(__builtin_ctz(v));
+#endif
+}
+
+} // anon namespace
+
+void TlsfAllocator::init(u32 size, u32 maxAllocations) {
+	size_ = size - size % alignment;
+
+	// Every allocation can split off at most one free block and
+	// free blocks are always merged, so there are at most
+	// maxAllocations + 1 free blocks.
+	blocks_.resize(2 * std::size_t(maxAllocations) + 1u);
+	reset();
+}
+
+void TlsfAllocator::reset() {
+	flBitmap_ = 0u;
+	for(auto fl = 0u; fl < flCount; ++fl) {
+		slBitmaps_[fl] = 0u;
+		for(auto sl = 0u; sl < slCount; ++sl) {
+			freeLists_[fl][sl] = invalid;
+		}
+	}
+
+	unusedBlocks_ = invalid;
+	for(auto i = u32(blocks_.size()); i-- > 0u;) {
+		blocks_[i] = {};
+		blocks_[i].nextFree = unusedBlocks_;
+		unusedBlocks_ = i;
+	}
+
+	freeSize_ = 0u;
+	if(size_ == 0u || blocks_.empty()) {
+		return;
+	}
+
+	auto id = newBlock();
+	auto& block = blocks_[id];
+	block.offset = 0u;
+	block.size = size_;
+	insertFree(id);
+}
+
+TlsfAllocator::Mapping TlsfAllocator::mapping(u32 size) {
+	if(size < smallSize) {
+		return {0u, size / (smallSize / slCount)};
+	}
+
+	auto msb = highestBit(size);
+	auto sl = (size >> (msb - slLog2)) ^ slCount;
+	return {msb - flShift + 1u, sl};
+}
+
+u32 TlsfAllocator::newBlock() {
+	dlg_assert(unusedBlocks_ != invalid);
+	auto id = unusedBlocks_;
+	unusedBlocks_ = blocks_[id].nextFree;
+	blocks_[id] = {};
+	return id;
+}
+
+void TlsfAllocator::insertFree(u32 id) {
+	auto& block = blocks_[id];
+	auto [fl, sl] = mapping(block.size);
+
+	block.free = true;
+	block.prevFree = invalid;
+	block.nextFree = freeLists_[fl][sl];
+	if(block.nextFree != invalid) {
+		blocks_[block.nextFree].prevFree = id;
+	}
+
+	freeLists_[fl][sl] = id;
+	slBitmaps_[fl] |= 1u << sl;
+	flBitmap_ |= 1u << fl;
+	freeSize_ += block.size;
+}
+
+void TlsfAllocator::removeFree(u32 id) {
+	auto& block = blocks_[id];
+	dlg_assert(block.free);
+
+	if(block.prevFree != invalid) {
+		blocks_[block.prevFree].nextFree = block.nextFree;
+	} else {
+		auto [fl, sl] = mapping(block.size);
+		dlg_assert(freeLists_[fl][sl] == id);
+		freeLists_[fl][sl] = block.nextFree;
+		if(block.nextFree == invalid) {
+			slBitmaps_[fl] &= ~(1u << sl);
+			if(!slBitmaps_[fl]) {
+				flBitmap_ &= ~(1u << fl);
+			}
+		}
+	}
+
+	if(block.nextFree != invalid) {
+		blocks_[block.nextFree].prevFree = block.prevFree;
+	}
+
+	block.free = false;
+	block.prevFree = invalid;
+	block.nextFree = invalid;
+	freeSize_ -= block.size;
+}
+
+u32 TlsfAllocator::findFree(u32 size) {
+	// (1) The list of the size class itself. Its blocks might be smaller
+	// than the requested size but in the common case of many allocations
+	// of the same size, the first block fits.
+	auto [fl, sl] = mapping(size);
+	auto head = freeLists_[fl][sl];
+	if(head != invalid && blocks_[head].size >= size) {
+		return head;
+	}
+
+	// (2) All blocks in the next larger size class are large enough.
+	// Find the first non-empty list there via the bitmaps.
+	auto next = size;
+	if(size >= smallSize) {
+		next += (1u << (highestBit(size) - slLog2)) - 1u;
+	}
+
+	if(next >= size) { // otherwise overflow
+		auto [nfl, nsl] = mapping(next);
+		if(nfl == fl && nsl == sl) {
+			++nsl;
+			if(nsl == slCount) {
+				nsl = 0u;
+				++nfl;
+			}
+		}
+
+		auto slMap = nfl < flCount ? slBitmaps_[nfl] & (~0u << nsl) : 0u;
+		if(!slMap && nfl + 1 < flCount) {
+			auto flMap = flBitmap_ & (~0u << (nfl + 1));
+			if(flMap) {
+				nfl = lowestBit(flMap);
+				slMap = slBitmaps_[nfl];
+			}
+		}
+
+		if(slMap) {
+			auto ret = freeLists_[nfl][lowestBit(slMap)];
+			dlg_assert(ret != invalid && blocks_[ret].size >= size);
+			return ret;
+		}
+	}
+
+	// (3) No larger block. There might still be a block in the list
+	// of the size class itself that fits. Only happens when the range
+	// is (nearly) exhausted.
+	if(head != invalid) {
+		for(auto it = blocks_[head].nextFree; it != invalid; it = blocks_[it].nextFree) {
+			if(blocks_[it].size >= size) {
+				return it;
+			}
+		}
+	}
+
+	return invalid;
+}
+
+TlsfAllocator::Allocation TlsfAllocator::alloc(u32 size) {
+	if(size == 0u || size > freeSize_) {
+		return {};
+	}
+
+	// can't overflow since size_ is aligned
+	size = (size + alignment - 1) & ~(alignment - 1);
+	if(size > freeSize_) {
+		return {};
+	}
+
+	auto id = findFree(size);
+	if(id == invalid) {
+		return {};
+	}
+
+	removeFree(id);
+
+	// split off the rest
+	auto& block = blocks_[id];
+	if(block.size > size) {
+		// blocks_ is never resized here, references stay valid
+		auto restID = newBlock();
+		auto& rest = blocks_[restID];
+		rest.offset = block.offset + size;
+		rest.size = block.size - size;
+		rest.prevPhys = id;
+		rest.nextPhys = block.nextPhys;
+		if(rest.nextPhys != invalid) {
+			blocks_[rest.nextPhys].prevPhys = restID;
+		}
+
+		block.nextPhys = restID;
+		block.size = size;
+		insertFree(restID);
+	}
+
+	return {blocks_[id].offset, id};
+}
+
+void TlsfAllocator::free(u32 id) {
+	dlg_assert(id < blocks_.size());
+	dlg_assert(!blocks_[id].free);
+
+	auto release = [&](u32 unused) {
+		blocks_[unused] = {};
+		blocks_[unused].nextFree = unusedBlocks_;
+		unusedBlocks_ = unused;
+	};
+
+	// merge with next block
+	auto nextID = blocks_[id].nextPhys;
+	if(nextID != invalid && blocks_[nextID].free) {
+		removeFree(nextID);
+		auto& block = blocks_[id];
+		auto& next = blocks_[nextID];
+		block.size += next.size;
+		block.nextPhys = next.nextPhys;
+		if(block.nextPhys != invalid) {
+			blocks_[block.nextPhys].prevPhys = id;
+		}
+
+		release(nextID);
+	}
+
+	// merge with previous block
+	auto prevID = blocks_[id].prevPhys;
+	if(prevID != invalid && blocks_[prevID].free) {
+		removeFree(prevID);
+		auto& block = blocks_[id];
+		auto& prev = blocks_[prevID];
+		prev.size += block.size;
+		prev.nextPhys = block.nextPhys;
+		if(prev.nextPhys != invalid) {
+			blocks_[prev.nextPhys].prevPhys = prevID;
+		}
+
+		release(id);
+		id = prevID;
+	}
+
+	insertFree(id);
+}
+
+} // namespace vil
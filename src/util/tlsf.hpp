@@ -0,0 +1,103 @@
+#pragma once
+
+#include <fwd.hpp>
+#include <vector>
+
+namespace vil {
+
+// Suballocates a range of memory (only dealing with offsets) using
+// segregated size-class free lists, in the style of TLSF.
+// Free blocks are kept in one list per size class. The classes are
+// split logarithmically into first levels, each first level is split
+// linearly into second levels. Two bitmasks track the non-empty lists.
+// Allocation and freeing are O(1) and don't depend on the number of
+// allocations or the amount of fragmentation. Neighboring free blocks
+// are merged on free.
+// Not synchronized in any way.
+class TlsfAllocator {
+public:
+	static constexpr auto invalid = u32(-1);
+
+	// All offsets and sizes are aligned to this.
+	static constexpr auto alignment = u32(8u);
+
+	struct Allocation {
+		u32 offset {invalid};
+		u32 block {invalid}; // must be passed to free
+	};
+
+public:
+	TlsfAllocator() = default;
+
+	// Returns the range size needed so that count allocations whose
+	// sizes sum up to at most dataSize always fit, even though each of
+	// them is rounded up to the alignment.
+	static u32 paddedSize(u32 dataSize, u32 count) {
+		return dataSize + count * (alignment - 1u);
+	}
+
+	// Initializes the allocator for a range of the given size.
+	// maxAllocations is the maximum number of allocations that can
+	// be alive at the same time, used to preallocate all internal data.
+	void init(u32 size, u32 maxAllocations);
+
+	// Frees all allocations.
+	void reset();
+
+	// Returns an invalid allocation if there isn't any free block
+	// large enough for the given size.
+	Allocation alloc(u32 size);
+	void free(u32 block);
+
+	u32 size() const { return size_; }
+	u32 freeSize() const { return freeSize_; }
+
+private:
+	static constexpr auto slLog2 = 4u;
+	static constexpr auto slCount = 1u << slLog2;
+	static constexpr auto alignLog2 = 3u;
+	static_assert((1u << alignLog2) == alignment);
+
+	// Sizes below this are all in the first level 0, linearly split
+	// into the second level classes.
+	static constexpr auto flShift = slLog2 + alignLog2;
+	static constexpr auto smallSize = 1u << flShift;
+	static constexpr auto flCount = 32u - flShift + 1u;
+
+	struct Block {
+		u32 offset {};
+		u32 size {};
+		u32 prevPhys {invalid};
+		u32 nextPhys {invalid};
+		// Links in the free list of its size class when free.
+		// nextFree also links unused Block objects.
+		u32 prevFree {invalid};
+		u32 nextFree {invalid};
+		bool free {};
+	};
+
+	struct Mapping {
+		u32 fl;
+		u32 sl;
+	};
+
+	static Mapping mapping(u32 size);
+
+	u32 newBlock();
+	void insertFree(u32 block);
+	void removeFree(u32 block);
+	u32 findFree(u32 size);
+
+private:
+	u32 size_ {};
+	u32 freeSize_ {};
+
+	std::vector<Block> blocks_;
+	u32 unusedBlocks_ {invalid}; // linked via Block::nextFree
+
+	u32 flBitmap_ {};
+	u32 slBitmaps_[flCount] {};
+	u32 freeLists_[flCount][slCount] {};
+};
+
+} // namespace vil
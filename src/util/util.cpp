@@ -9,7 +9,10 @@
 #include <vk/vk_layer.h>
 #include <vk/format_utils.h>
 #include <vkutil/enumString.hpp>
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstddef>
 #include <cstdio>
 
 namespace vil {
@@ -87,9 +90,204 @@ VkImageViewType minImageViewType(VkExtent3D size, unsigned layers,
 	}
 }
 
-std::size_t structSize(VkStructureType type) {
-	static const std::unordered_map<VkStructureType, std::size_t> structSizes = {
-#define ENTRY(stype) {stype, sizeof(LvlSTypeMap<stype>::Type)}
+// pNext chain copying
+namespace {
+
+// Describes a pointer member of a chain struct (or of an element of
+// such a pointer) that has to be deep-copied.
+struct ChainPointer {
+	// countOffset value for pointers that always point to one element
+	static constexpr auto single = u32(-1);
+
+	u32 offset; // offset of the pointer member
+	u32 countOffset; // offset of the u32 element count member, or 'single'
+	u32 elemSize;
+	// pointer members inside each element, deep-copied as well
+	const ChainPointer* nested {};
+	u32 nestedCount {};
+};
+
+struct ChainStructInfo {
+	VkStructureType sType;
+	u32 size;
+	const ChainPointer* pointers {};
+	u32 pointerCount {};
+};
+
+struct ChainPointerLayout {
+	VkStructureType sType;
+	const ChainPointer* pointers;
+	u32 pointerCount;
+};
+
+#define CHAIN_ARRAY(T, ptr, count, E) ChainPointer{ \
+	u32(offsetof(T, ptr)), u32(offsetof(T, count)), u32(sizeof(E))}
+#define CHAIN_SINGLE(T, ptr, E) ChainPointer{ \
+	u32(offsetof(T, ptr)), ChainPointer::single, u32(sizeof(E))}
+
+// Sample locations are embedded into the elements of
+// VkRenderPassSampleLocationsBeginInfoEXT
+constexpr ChainPointer attachmentSampleLocationsPointers[] = {{
+	u32(offsetof(VkAttachmentSampleLocationsEXT, sampleLocationsInfo) +
+		offsetof(VkSampleLocationsInfoEXT, pSampleLocations)),
+	u32(offsetof(VkAttachmentSampleLocationsEXT, sampleLocationsInfo) +
+		offsetof(VkSampleLocationsInfoEXT, sampleLocationsCount)),
+	u32(sizeof(VkSampleLocationEXT)),
+}};
+
+constexpr ChainPointer subpassSampleLocationsPointers[] = {{
+	u32(offsetof(VkSubpassSampleLocationsEXT, sampleLocationsInfo) +
+		offsetof(VkSampleLocationsInfoEXT, pSampleLocations)),
+	u32(offsetof(VkSubpassSampleLocationsEXT, sampleLocationsInfo) +
+		offsetof(VkSampleLocationsInfoEXT, sampleLocationsCount)),
+	u32(sizeof(VkSampleLocationEXT)),
+}};
+
+constexpr ChainPointer rpAttachmentBeginPointers[] = {
+	CHAIN_ARRAY(VkRenderPassAttachmentBeginInfo, pAttachments, attachmentCount, VkImageView),
+};
+
+constexpr ChainPointer deviceGroupRpBeginPointers[] = {
+	CHAIN_ARRAY(VkDeviceGroupRenderPassBeginInfo, pDeviceRenderAreas, deviceRenderAreaCount, VkRect2D),
+};
+
+constexpr ChainPointer deviceGroupSubmitPointers[] = {
+	CHAIN_ARRAY(VkDeviceGroupSubmitInfo, pWaitSemaphoreDeviceIndices, waitSemaphoreCount, u32),
+	CHAIN_ARRAY(VkDeviceGroupSubmitInfo, pCommandBufferDeviceMasks, commandBufferCount, u32),
+	CHAIN_ARRAY(VkDeviceGroupSubmitInfo, pSignalSemaphoreDeviceIndices, signalSemaphoreCount, u32),
+};
+
+constexpr ChainPointer rpSampleLocationsBeginPointers[] = {
+	{
+		u32(offsetof(VkRenderPassSampleLocationsBeginInfoEXT, pAttachmentInitialSampleLocations)),
+		u32(offsetof(VkRenderPassSampleLocationsBeginInfoEXT, attachmentInitialSampleLocationsCount)),
+		u32(sizeof(VkAttachmentSampleLocationsEXT)),
+		attachmentSampleLocationsPointers, 1u,
+	}, {
+		u32(offsetof(VkRenderPassSampleLocationsBeginInfoEXT, pPostSubpassSampleLocations)),
+		u32(offsetof(VkRenderPassSampleLocationsBeginInfoEXT, postSubpassSampleLocationsCount)),
+		u32(sizeof(VkSubpassSampleLocationsEXT)),
+		subpassSampleLocationsPointers, 1u,
+	}
+};
+
+constexpr ChainPointer sampleLocationsPointers[] = {
+	CHAIN_ARRAY(VkSampleLocationsInfoEXT, pSampleLocations, sampleLocationsCount, VkSampleLocationEXT),
+};
+
+constexpr ChainPointer writeAccelStructPointers[] = {
+	CHAIN_ARRAY(VkWriteDescriptorSetAccelerationStructureKHR, pAccelerationStructures,
+		accelerationStructureCount, VkAccelerationStructureKHR),
+};
+
+constexpr ChainPointer writeAccelStructNVPointers[] = {
+	CHAIN_ARRAY(VkWriteDescriptorSetAccelerationStructureNV, pAccelerationStructures,
+		accelerationStructureCount, VkAccelerationStructureNV),
+};
+
+constexpr ChainPointer writeInlineUniformBlockPointers[] = {
+	CHAIN_ARRAY(VkWriteDescriptorSetInlineUniformBlock, pData, dataSize, std::byte),
+};
+
+constexpr ChainPointer fragDensityOffsetEndPointers[] = {
+	CHAIN_ARRAY(VkSubpassFragmentDensityMapOffsetEndInfoQCOM, pFragmentDensityOffsets,
+		fragmentDensityOffsetCount, VkOffset2D),
+};
+
+constexpr ChainPointer depthStencilResolvePointers[] = {
+	CHAIN_SINGLE(VkSubpassDescriptionDepthStencilResolve, pDepthStencilResolveAttachment,
+		VkAttachmentReference2),
+};
+
+constexpr ChainPointer fragShadingRateAttachmentPointers[] = {
+	CHAIN_SINGLE(VkFragmentShadingRateAttachmentInfoKHR, pFragmentShadingRateAttachment,
+		VkAttachmentReference2),
+};
+
+constexpr ChainPointer attachmentSampleCountPointers[] = {
+	CHAIN_ARRAY(VkAttachmentSampleCountInfoAMD, pColorAttachmentSamples,
+		colorAttachmentCount, VkSampleCountFlagBits),
+};
+
+#undef CHAIN_ARRAY
+#undef CHAIN_SINGLE
+
+// Chain structs with pointer members we deep-copy. Pointers inside
+// the copied elements are not followed, except for the explicitly
+// nested ones. Element pNext chains are not copied.
+// TODO: unknown structs with pointers are only copied shallowly, which
+// will keep pointers to application memory.
+constexpr ChainPointerLayout chainPointerLayouts[] = {
+#define LAYOUT(stype, ptrs) {stype, ptrs, u32(std::size(ptrs))}
+	LAYOUT(VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO, rpAttachmentBeginPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO, deviceGroupRpBeginPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO, deviceGroupSubmitPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_RENDER_PASS_SAMPLE_LOCATIONS_BEGIN_INFO_EXT, rpSampleLocationsBeginPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_SAMPLE_LOCATIONS_INFO_EXT, sampleLocationsPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR, writeAccelStructPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_NV, writeAccelStructNVPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_INLINE_UNIFORM_BLOCK, writeInlineUniformBlockPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_SUBPASS_FRAGMENT_DENSITY_MAP_OFFSET_END_INFO_QCOM, fragDensityOffsetEndPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE, depthStencilResolvePointers),
+	LAYOUT(VK_STRUCTURE_TYPE_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR, fragShadingRateAttachmentPointers),
+	LAYOUT(VK_STRUCTURE_TYPE_ATTACHMENT_SAMPLE_COUNT_INFO_AMD, attachmentSampleCountPointers),
+#undef LAYOUT
+};
+
+// Sorts the table by sType (heap sort, to keep the number of
+// constexpr evaluation steps low) and adds the pointer layouts.
+template<std::size_t N>
+constexpr std::array<ChainStructInfo, N> buildChainStructInfos(
+		std::array<ChainStructInfo, N> infos) {
+	auto less = [&](std::size_t a, std::size_t b) {
+		return infos[a].sType < infos[b].sType;
+	};
+	auto swap = [&](std::size_t a, std::size_t b) {
+		auto tmp = infos[a];
+		infos[a] = infos[b];
+		infos[b] = tmp;
+	};
+	auto siftDown = [&](std::size_t root, std::size_t end) {
+		while(2 * root + 1 < end) {
+			auto child = 2 * root + 1;
+			if(child + 1 < end && less(child, child + 1)) {
+				++child;
+			}
+
+			if(!less(root, child)) {
+				break;
+			}
+
+			swap(root, child);
+			root = child;
+		}
+	};
+
+	for(auto i = N / 2; i-- > 0u;) {
+		siftDown(i, N);
+	}
+
+	for(auto end = N; end-- > 1u;) {
+		swap(0u, end);
+		siftDown(0u, end);
+	}
+
+	for(auto& info : infos) {
+		for(auto& layout : chainPointerLayouts) {
+			if(layout.sType == info.sType) {
+				info.pointers = layout.pointers;
+				info.pointerCount = layout.pointerCount;
+			}
+		}
+	}
+
+	return infos;
+}
+
+// Table of all known chain structs, sorted by sType.
+// Generated from the LvlSTypeMap mappings in typemap_helper.h.
+constexpr auto chainStructInfos = buildChainStructInfos(std::array{
+#define ENTRY(stype) ChainStructInfo{stype, u32(sizeof(LvlSTypeMap<stype>::Type))}
     	ENTRY(VK_STRUCTURE_TYPE_APPLICATION_INFO),
     	ENTRY(VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO),
     	ENTRY(VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO),
@@ -137,8 +335,8 @@ std::size_t structSize(VkStructureType type) {
     	ENTRY(VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER),
     	ENTRY(VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER),
     	ENTRY(VK_STRUCTURE_TYPE_MEMORY_BARRIER),
-		{VK_STRUCTURE_TYPE_LOADER_INSTANCE_CREATE_INFO, sizeof(VkLayerInstanceCreateInfo)},
-		{VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO, sizeof(VkLayerDeviceCreateInfo)},
+		ChainStructInfo{VK_STRUCTURE_TYPE_LOADER_INSTANCE_CREATE_INFO, u32(sizeof(VkLayerInstanceCreateInfo))},
+		ChainStructInfo{VK_STRUCTURE_TYPE_LOADER_DEVICE_CREATE_INFO, u32(sizeof(VkLayerDeviceCreateInfo))},
     	ENTRY(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES),
     	ENTRY(VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO),
     	ENTRY(VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO),
@@ -723,63 +921,184 @@ std::size_t structSize(VkStructureType type) {
     	ENTRY(VK_STRUCTURE_TYPE_SUBPASS_FRAGMENT_DENSITY_MAP_OFFSET_END_INFO_QCOM),
     	ENTRY(VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_LINEAR_COLOR_ATTACHMENT_FEATURES_NV),
 #undef ENTRY
-	};
+});
+
+const ChainStructInfo* findChainStructInfo(VkStructureType type) {
+	auto it = std::lower_bound(chainStructInfos.begin(), chainStructInfos.end(), type,
+		[](const ChainStructInfo& info, VkStructureType type) {
+			return info.sType < type;
+		});
+	if(it == chainStructInfos.end() || it->sType != type) {
+		return nullptr;
+	}
 
-	auto it = structSizes.find(type);
-    if (it == structSizes.end()) {
-        dlg_error("Unknown pNext chain sType '{}'", u64(type));
-        return sizeof(VkBaseInStructure);
-    }
+	return &*it;
+}
 
-	return it->second;
+std::size_t chainStructSize(VkStructureType type) {
+	auto* info = findChainStructInfo(type);
+	return info ? info->size : 0u;
 }
 
-std::unique_ptr<std::byte[]> copyChain(const void*& pNext) {
-	if(!pNext) {
-		return {};
+// All structs and copied arrays are aligned to this
+constexpr auto chainAlign = std::max(alignof(void*), alignof(u64));
+
+constexpr std::size_t alignChain(std::size_t size) {
+	return (size + chainAlign - 1) & ~(chainAlign - 1);
+}
+
+u32 chainCount(const std::byte* data, const ChainPointer& ptr) {
+	if(ptr.countOffset == ChainPointer::single) {
+		return 1u;
 	}
 
-	// first march-through: find needed size
-	std::size_t size = 0u;
-	auto it = pNext;
-	while(it) {
-		auto src = static_cast<const VkBaseInStructure*>(it);
+	u32 count;
+	std::memcpy(&count, data + ptr.countOffset, sizeof(count));
+	return count;
+}
+
+const std::byte* chainPointer(const std::byte* data, const ChainPointer& ptr) {
+	const std::byte* ret;
+	std::memcpy(&ret, data + ptr.offset, sizeof(ret));
+	return ret;
+}
 
-		auto ssize = structSize(src->sType);
-		dlg_assertm(ssize > 0, "Unknown structure type: {}", src->sType);
-		size += ssize;
+std::size_t pointeeCopySize(const std::byte* data,
+		const ChainPointer* pointers, u32 pointerCount) {
+	auto size = std::size_t(0u);
+	for(auto& ptr : span(pointers, pointerCount)) {
+		auto* src = chainPointer(data, ptr);
+		auto count = chainCount(data, ptr);
+		if(!src || !count) {
+			continue;
+		}
 
-		it = src->pNext;
+		size += alignChain(count * ptr.elemSize);
+		if(ptr.nested) {
+			for(auto e = 0u; e < count; ++e) {
+				size += pointeeCopySize(src + e * ptr.elemSize, ptr.nested, ptr.nestedCount);
+			}
+		}
 	}
 
-	auto buf = std::make_unique<std::byte[]>(size);
-	auto offset = std::size_t(0u);
+	return size;
+}
+
+// 'data' is already a copy of the source struct, i.e. its pointers
+// still point to the source data. Redirects them to copies in 'buf'.
+void copyPointees(std::byte* data, const ChainPointer* pointers,
+		u32 pointerCount, std::byte*& buf) {
+	for(auto& ptr : span(pointers, pointerCount)) {
+		auto* src = chainPointer(data, ptr);
+		auto count = chainCount(data, ptr);
+		if(!src || !count) {
+			continue;
+		}
+
+		auto* dst = buf;
+		std::memcpy(dst, src, count * ptr.elemSize);
+		std::memcpy(data + ptr.offset, &dst, sizeof(dst));
+		buf += alignChain(count * ptr.elemSize);
+
+		if(ptr.nested) {
+			for(auto e = 0u; e < count; ++e) {
+				copyPointees(dst + e * ptr.elemSize, ptr.nested, ptr.nestedCount, buf);
+			}
+		}
+	}
+}
+
+} // anon namespace
+
+std::size_t structSize(VkStructureType type) {
+	auto* info = findChainStructInfo(type);
+	if(!info) {
+		dlg_error("Unknown pNext chain sType '{}'", u64(type));
+		return sizeof(VkBaseInStructure);
+	}
 
-	// second-march-through: copy structure
-	VkBaseInStructure* last = nullptr;
-	it = pNext;
+	return info->size;
+}
+
+std::size_t chainCopySize(const void* pNext) {
+	auto size = std::size_t(0u);
+	auto* it = static_cast<const VkBaseInStructure*>(pNext);
+	while(it) {
+		auto* info = findChainStructInfo(it->sType);
+		if(info) {
+			size += alignChain(info->size);
+			size += pointeeCopySize(reinterpret_cast<const std::byte*>(it),
+				info->pointers, info->pointerCount);
+		}
+
+		it = it->pNext;
+	}
+
+	return size;
+}
+
+void* copyChain(const void* pNext, span<std::byte> buf) {
+	VkBaseOutStructure* first = nullptr;
+	VkBaseOutStructure* last = nullptr;
+	auto* dst = buf.data();
+
+	auto* it = static_cast<const VkBaseInStructure*>(pNext);
 	while(it) {
-		auto src = static_cast<const VkBaseInStructure*>(it);
-		auto size = structSize(src->sType);
-		dlg_assertm(size > 0, "Unknown structure type: {}", src->sType);
+		auto* info = findChainStructInfo(it->sType);
+		if(!info) {
+			dlg_error("Unknown pNext chain sType '{}', dropping it", u64(it->sType));
+			it = it->pNext;
+			continue;
+		}
 
-		auto dst = reinterpret_cast<VkBaseInStructure*>(buf.get() + offset);
+		auto* copy = reinterpret_cast<VkBaseOutStructure*>(dst);
 		// TODO: technicallly UB to not construct object via placement new.
 		// In practice, this works everywhere since its only C PODs
-		std::memcpy(dst, src, size);
-		offset += size;
+		std::memcpy(copy, it, info->size);
+		copy->pNext = nullptr;
+		dst += alignChain(info->size);
+
+		copyPointees(reinterpret_cast<std::byte*>(copy),
+			info->pointers, info->pointerCount, dst);
 
 		if(last) {
-			last->pNext = dst;
+			last->pNext = copy;
 		} else {
-			pNext = dst;
+			first = copy;
 		}
 
-		last = dst;
-		it = src->pNext;
+		last = copy;
+		it = it->pNext;
+	}
+
+	dlg_assert(dst <= buf.data() + buf.size());
+	return first;
+}
+
+const void* copyChain(LinAllocator& alloc, const void* pNext) {
+	if(!pNext) {
+		return nullptr;
+	}
+
+	auto size = chainCopySize(pNext);
+	if(!size) {
+		return nullptr;
+	}
+
+	auto* buf = alloc.allocate(size, chainAlign);
+	return copyChain(pNext, {buf, size});
+}
+
+std::unique_ptr<std::byte[]> copyChain(const void*& pNext) {
+	if(!pNext) {
+		return {};
 	}
 
-	dlg_assert(offset == size);
+	// NOTE: new[] returns memory aligned for any fundamental type,
+	// i.e. to at least chainAlign.
+	auto size = chainCopySize(pNext);
+	auto buf = std::make_unique<std::byte[]>(size);
+	pNext = copyChain(pNext, {buf.get(), size});
 	return buf;
 }
 
@@ -793,35 +1112,17 @@ void* copyChain(const void*& pNext, std::unique_ptr<std::byte[]>& buf) {
 }
 
 void* copyChainLocal(ThreadMemScope& memScope, const void* pNext) {
-	VkBaseInStructure* last = nullptr;
-	void* ret = nullptr;
-	auto it = static_cast<const VkBaseInStructure*>(pNext);
-
-	while(it) {
-		auto size = structSize(it->sType);
-		dlg_assertm_or(size > 0, it = it->pNext; continue,
-			"Unknown structure type: {}", it->sType);
-
-		auto dstBuf = memScope.alloc<std::byte>(size);
-		auto* dst = reinterpret_cast<VkBaseInStructure*>(dstBuf.data());
-
-		// TODO: technicallly UB to not construct object via placement new.
-		// In practice, this works everywhere since its only C PODs
-		std::memcpy(dst, it, size);
-		dst->pNext = nullptr;
-
-		if(!last) {
-			dlg_assert(!ret);
-			ret = static_cast<void*>(dst);
-		} else {
-			last->pNext = dst;
-		}
+	if(!pNext) {
+		return nullptr;
+	}
 
-		last = dst;
-		it = it->pNext;
+	auto size = chainCopySize(pNext);
+	if(!size) {
+		return nullptr;
 	}
 
-	return ret;
+	auto* buf = memScope.allocBytes(size, chainAlign);
+	return copyChain(pNext, {buf, size});
 }
 
 void writeFile(const char* path, span<const std::byte> buffer, bool binary) {
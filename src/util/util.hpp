@@ -25,6 +25,15 @@ inline void hash_combine(std::size_t& s, const T & v) {
 	s ^= std::hash<T>{}(v) + 0x9e3779b9 + (s<< 6) + (s>> 2);
 }
 
+// Order-dependent combination of 64-bit hashes. The value is mixed first
+// so that inputs with mostly zero bits (e.g. pointers) are fine as well.
+inline u64 combineHash64(u64 seed, u64 value) {
+	value ^= value >> 33u;
+	value *= 0xff51afd7ed558ccdull;
+	value ^= value >> 33u;
+	return (seed ^ value) * 0x9e3779b97f4a7c15ull + (seed >> 29u);
+}
+
 template<typename T>
 struct ReversionAdatper {
 	T& iterable;
@@ -167,11 +176,28 @@ void* findChainInfo2(void* pNext) {
 	return nullptr;
 }
 
+// pNext chains are deep-copied: all known structs in the chain are
+// copied, including the arrays their pointer members reference (see the
+// chain struct table in util.cpp). Unknown structs are dropped.
+// The whole chain is copied into one allocation.
+
+// Returns the number of bytes needed to copy the given chain.
+std::size_t chainCopySize(const void* pNext);
+// Copies the given chain into the given buffer, which must be at least
+// chainCopySize(pNext) bytes large and aligned for pointers and u64.
+// Returns the copied chain.
+void* copyChain(const void* pNext, span<std::byte> buf);
+const void* copyChain(LinAllocator&, const void* pNext);
+
 std::unique_ptr<std::byte[]> copyChain(const void*& pNext);
 void* copyChain(const void*& pNext, std::unique_ptr<std::byte[]>& buf);
 
 void* copyChainLocal(ThreadMemScope&, const void* pNext);
 
+// Returns the size of the given struct type, or 0 if it isn't known
+// to the chain struct table.
+std::size_t chainStructSize(VkStructureType);
+
 template<typename T>
 auto aliasCmd(T&& list) {
 	std::remove_reference_t<decltype(**list.begin())> found = nullptr;
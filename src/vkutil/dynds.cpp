@@ -59,6 +59,8 @@ void DynDs::destroy() {
 	if(handle_) {
 		dlg_assert(layout_ && layout_->vkHandle());
 		dlg_assert(pool_);
+		// pool might be shared with the hook, see Device::dsPoolMutex
+		std::lock_guard lock(dev_->dsPoolMutex);
 		dev_->dispatch.FreeDescriptorSets(dev_->handle, pool_, 1, &handle_);
 		handle_ = {};
 		dev_ = {};
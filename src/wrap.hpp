@@ -209,6 +209,7 @@ template<typename H> auto mustMoveUnset(Device& dev, H& handle) {
 
 	{
 		auto lock = std::lock_guard(dev.mutex);
+		auto snapshotLock = std::lock_guard(dev.snapshotMutex);
 		ptr = HandleDesc<H>::map(dev).mustMoveLocked(handle);
 		handle = ptr->handle;
 		ptr->handle = {};
@@ -239,6 +240,7 @@ Device& mustMoveUnsetKeepAlive(VkDevice vkDev, H& vkHandle) {
 
 	{
 		auto lock = std::lock_guard(dev.mutex);
+		auto snapshotLock = std::lock_guard(dev.snapshotMutex);
 		ptr = HandleDesc<H>::map(dev).mustMoveLocked(handle);
 		oldPtr = (dev.*KeepAlive).pushLocked(ptr);
 		vkHandle = ptr->handle;